@@ -10,6 +10,10 @@
 
 #include	"any_int.h"
 #include	"Malloc.h"
+
+#ifdef	_REENTRANT		/* compiled with -pthread */
+#include	<pthread.h>
+#endif
 /* make malloc.h available */
 #undef	malloc
 #undef	calloc
@@ -43,6 +47,18 @@
 static size_t restricted_balance = 0;	/* to simulate out-of-memory */
 
 							/* ADMINISTRATION */
+/* When compiled with -pthread, the administration is protected by a lock,
+   so the allocation routines can be called from several threads at once.
+*/
+#ifdef	_REENTRANT
+static pthread_mutex_t admin_lock = PTHREAD_MUTEX_INITIALIZER;
+#define	lock_admin()	pthread_mutex_lock(&admin_lock)
+#define	unlock_admin()	pthread_mutex_unlock(&admin_lock)
+#else
+#define	lock_admin()	/* nothing */
+#define	unlock_admin()	/* nothing */
+#endif
+
 static vlong_uint total = 0;
 static vlong_uint balance = 0;
 static vlong_uint max = 0;
@@ -224,6 +240,7 @@ register_alloc(char *addr, size_t size, const char *fname, int l_nmb) {
 
 	if (addr == 0) return;
 
+	lock_admin();
 	new = my_new(struct alloc);
 	new->addr = addr;
 	new->size = size;
@@ -237,6 +254,7 @@ register_alloc(char *addr, size_t size, const char *fname, int l_nmb) {
 	if (balance > max) {
 		max = balance;
 	}
+	unlock_admin();
 }
 
 void
@@ -324,16 +342,21 @@ pointer_to_alloc_for(const char *addr) {
 static size_t
 register_free(char *addr) {
 	/* registers the freeing of a block */
+	lock_admin();
 	struct alloc **old_p = pointer_to_alloc_for(addr);
 	struct alloc *old = *old_p;
 
-	if (old == 0) return (size_t) -1;
+	if (old == 0) {
+		unlock_admin();
+		return (size_t) -1;
+	}
 	size_t old_size = old->size;
 
 	*old_p = old->next;
 	free((void *)old);
 
 	balance -= old_size;
+	unlock_admin();
 	return old_size;
 }
 
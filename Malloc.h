@@ -79,6 +79,9 @@ Notes:
 
 *    The system consumes hardly any time and is fast enough to be kept active
      at all times.
+
+*    Compiled with -pthread, the administration is protected by a lock, and
+     the routines may be called from several threads simultaneously.
 *****/
 
 #include	<stdio.h>		/* for FILE */
@@ -8,14 +8,27 @@
 #include	"runs.h"
 #include	"percentages.h"
 #include	"options.h"
+#include	"shard.h"
+#include	"incremental.h"
+#include	"progress.h"
 #include	"add_run.h"
 
-/* Sends the run info to add_to_percentages or to add_to_runs. */
+/* Sends the run info to add_to_percentages or to add_to_runs,
+   or to the partial results file under -W; under -U it is also kept
+   for the next run. */
 void
 add_run(struct text *txt0, size_t i0,
 	struct text *txt1, size_t i1,
 	size_t size
 ) {
+	Progress_Run();
+	if (Incremental_Name) {
+		Record_Incremental_Run(txt0, i0, txt1, i1, size);
+	}
+	if (Partial_Results_Name) {
+		Write_Partial_Run(txt0, i0, txt1, i1, size);
+	}
+	else
 	if (is_set_option('p')) {
 		add_to_percentages(txt0, txt1, size);
 	}
@@ -6,6 +6,7 @@
 #include	"sim.h"
 #include	"options.h"
 #include	"token.h"
+#include	"balance.h"
 #include	"algollike.h"
 
 /*	Arrays for fast identification tests for tokens.  Each token is
@@ -73,6 +74,10 @@ largest_routine(const Token *tk_array, size_t size) {
 	/* Overkill: only a fraction of the tokens are balancers; oh well. */
 	int n_imbalances;
 
+	/* look it up, if possible */
+	size_t balanced_size = Balanced_Size(tk_array, size);
+	if (balanced_size != BALANCE_UNKNOWN) return balanced_size;
+
 	/* clear administration */
 	n_imbalances = 0;
 	for (i = 0; i < N_REGULAR_TOKENS; i++) {
@@ -114,6 +119,13 @@ largest_routine(const Token *tk_array, size_t size) {
 	return mrb_size;
 }
 
+void
+Prepare_Algol_Best_Run_Size(void) {
+	if (is_set_option('f')) {
+		Update_Balance_Index(openers, closers);
+	}
+}
+
 size_t
 Best_Algol_Run_Size(const Token *tk_array, size_t size) {
 	/*	Checks the run starting at tk_array[0] with length size for
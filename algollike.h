@@ -6,12 +6,13 @@
 /*	The class Algollike is a subclass of Language.  It implements
 	the routines
 	    void Init_Algol_Language()
-	    int May_Be_Start_Of_Algol_Run() and
-	    size_t Best_Algol_Run_Size()
+	    int May_Be_Start_Of_Algol_Run(),
+	    size_t Best_Algol_Run_Size() and
+	    void Prepare_Algol_Best_Run_Size()
 	for ALGOL-like languages, languages in which it is meaningful and
 	useful to isolate function bodies. These routines can be used in
-	Init_Language(), May_Be_Start_Of_Run(), and Best_Run_Size(), required
-	by language.h .
+	Init_Language(), May_Be_Start_Of_Run(), Best_Run_Size() and
+	Prepare_Best_Run_Size(), required by language.h .
 
 	It requires the user to define four token sets, represented as
 	Token set[] and terminated by No_Token:
@@ -30,3 +31,4 @@ extern void Init_Algol_Language(
 ); /* note the order of the arguments: Non_Finals ~ Openers, etc. */
 extern int May_Be_Start_Of_Algol_Run(Token ch);
 extern size_t Best_Algol_Run_Size(const Token *str, size_t size);
+extern void Prepare_Algol_Best_Run_Size(void);
@@ -0,0 +1,855 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	A tar archive is a sequence of 512-byte blocks: for each member a
+	header block, followed by the contents, padded to a whole block;
+	the end is marked by a block of zeroes. Names longer than the 100
+	bytes in the header come in a prefix field (ustar), in a preceding
+	pseudo-member of type 'L' (GNU) or in a 'path' record of a preceding
+	pseudo-member of type 'x' (POSIX pax). Large sizes are in base 256.
+
+	The archive is read sequentially, so a compressed archive can be
+	read from a pipe from the decompressing program.
+*/
+
+#include	<stdio.h>
+#include	<string.h>
+#include	<stdint.h>
+
+#include	"sim.h"
+#include	"stream.h"
+#include	"fname.h"
+#include	"Malloc.h"
+#include	"archive.h"
+
+#define	TAR_BLOCK	512
+
+							/* MEMBERS */
+struct member {
+	struct member *mb_next;		/* in the hash chain */
+	char *mb_name;			/* archive!member, or rev:path */
+	struct input mb_input;
+	int mb_owner;			/* Boolean, the buffer is its own */
+};
+
+static struct member **member_table;	/* to be filled by Calloc() */
+static size_t member_table_size;	/* a power of 2 */
+static size_t n_members;
+
+static size_t
+name_hash(const char *s) {
+	uint64_t h = UINT64_C(0xcbf29ce484222325);
+
+	while (*s) {
+		h = (h ^ (unsigned char)*s++) * UINT64_C(0x100000001b3);
+	}
+	return (size_t)(h ^ (h >> 32));
+}
+
+static void
+grow_member_table(void) {
+	size_t old_size = member_table_size;
+	struct member **old_table = member_table;
+	size_t i;
+
+	member_table_size = (old_size ? 2 * old_size : 1024);
+	member_table = (struct member **)
+		Calloc(member_table_size, sizeof (struct member *));
+	for (i = 0; i < old_size; i++) {
+		while (old_table[i]) {
+			struct member *mb = old_table[i];
+			size_t h = name_hash(mb->mb_name) & (member_table_size-1);
+
+			old_table[i] = mb->mb_next;
+			mb->mb_next = member_table[h];
+			member_table[h] = mb;
+		}
+	}
+	if (old_table) {
+		Free(old_table);
+	}
+}
+
+static struct member *
+add_member(char *name, char *buf, size_t size) {
+	/* name and buf are taken over */
+	if (n_members >= member_table_size) {
+		grow_member_table();
+	}
+	struct member *mb = new(struct member);
+	size_t h = name_hash(name) & (member_table_size-1);
+
+	mb->mb_name = name;
+	mb->mb_input.in_buf = buf;
+	mb->mb_input.in_size = size + 2;
+	mb->mb_input.in_mapped = 0;
+	mb->mb_input.in_shared = 1;
+	mb->mb_owner = 1;
+	mb->mb_next = member_table[h];
+	member_table[h] = mb;
+	n_members++;
+	return mb;
+}
+
+void
+Add_Memory_Member(const char *name, char *buf, size_t size) {
+	char *copy = (char *)Malloc(strlen(name) + 1);
+
+	add_member(strcpy(copy, name), buf, size)->mb_owner = 0;
+}
+
+struct input *
+Archive_Member(const char *fname) {
+	if (!n_members) return 0;
+
+	struct member *mb =
+		member_table[name_hash(fname) & (member_table_size-1)];
+	while (mb) {
+		if (strcmp(mb->mb_name, fname) == 0) return &mb->mb_input;
+		mb = mb->mb_next;
+	}
+	return 0;
+}
+
+void
+Free_Archives(void) {
+	size_t i;
+
+	for (i = 0; i < member_table_size; i++) {
+		while (member_table[i]) {
+			struct member *mb = member_table[i];
+
+			member_table[i] = mb->mb_next;
+			if (mb->mb_owner) {
+				Free(mb->mb_input.in_buf);
+			}
+			Free(mb->mb_name);
+			Free(mb);
+		}
+	}
+	if (member_table) {
+		Free(member_table); member_table = 0;
+	}
+	member_table_size = 0;
+	n_members = 0;
+}
+
+							/* NEW ARGUMENTS */
+static const char **new_args;		/* to be filled by Malloc() */
+static int new_args_free;
+static int new_args_size;
+
+static void
+add_arg(const char *arg) {
+	if (new_args_free == new_args_size) {
+		/* allocated array is full; increase its size */
+		new_args_size = (new_args_size ? 2 * new_args_size : 256);
+		new_args = (const char **)Realloc(
+			new_args, (size_t)new_args_size * sizeof (const char *)
+		);
+	}
+	new_args[new_args_free++] = arg;
+}
+
+							/* OPENING ARCHIVES */
+static const struct archive_kind {
+	const char *ak_suffix;
+	const char *ak_program;		/* to decompress, or 0 */
+} archive_kinds[] = {
+	{".tar", 0},
+	{".tar.gz", "gzip"},
+	{".tgz", "gzip"},
+	{".tar.bz2", "bzip2"},
+	{".tbz2", "bzip2"},
+	{".tar.xz", "xz"},
+	{".txz", "xz"},
+	{0, 0}
+};
+
+static const struct archive_kind *
+archive_kind_of(const char *fname) {
+	size_t len = strlen(fname);
+	const struct archive_kind *ak;
+
+	for (ak = archive_kinds; ak->ak_suffix; ak++) {
+		size_t s_len = strlen(ak->ak_suffix);
+
+		if (len > s_len && strcmp(fname + len - s_len, ak->ak_suffix) == 0)
+			return ak;
+	}
+	return 0;
+}
+
+#ifndef	MSDOS
+static char *
+shell_quoted(const char *str) {
+	/* str quoted for the shell, with ' written as '\'' */
+	char *q = (char *)Malloc(4 * strlen(str) + 3);
+	char *p = q;
+	const char *s;
+
+	*p++ = '\'';
+	for (s = str; *s; s++) {
+		if (*s == '\'') {
+			strcpy(p, "'\\''"); p += 4;
+		} else {
+			*p++ = *s;
+		}
+	}
+	strcpy(p, "'");
+	return q;
+}
+#endif	/* MSDOS */
+
+static FILE *
+open_archive(const char *fname, const struct archive_kind *ak) {
+	FILE *f = Fopen(str2Fname(fname), "rb");
+
+	if (!f || !ak->ak_program) return f;
+	fclose(f);
+
+#ifndef	MSDOS
+	/* read it through the decompressing program */
+	char *q_fname = shell_quoted(fname);
+	char *cmd = (char *)
+		Malloc(strlen(ak->ak_program) + strlen(q_fname) + 10);
+
+	sprintf(cmd, "%s -dc < %s", ak->ak_program, q_fname);
+	f = popen(cmd, "r");
+	Free(cmd);
+	Free(q_fname);
+	return f;
+#else	/* MSDOS */
+	return 0;
+#endif	/* MSDOS */
+}
+
+static int
+close_archive(FILE *f, const struct archive_kind *ak) {
+	/* returns 0 if the decompressing program failed */
+#ifndef	MSDOS
+	if (ak->ak_program) {
+		/* read the rest, so the program can finish normally */
+		char block[TAR_BLOCK];
+
+		while (fread(block, 1, sizeof block, f) > 0) {
+			/* skip */
+		}
+		return pclose(f) == 0;
+	}
+#endif	/* MSDOS */
+	fclose(f);
+	return 1;
+}
+
+							/* READING ARCHIVES */
+
+static int
+read_block(FILE *f, char *block) {
+	return fread(block, 1, TAR_BLOCK, f) == TAR_BLOCK;
+}
+
+static int
+is_zero_block(const char *block) {
+	int i;
+
+	for (i = 0; i < TAR_BLOCK; i++) {
+		if (block[i]) return 0;
+	}
+	return 1;
+}
+
+static uint64_t
+tar_number(const char *p, int len) {
+	/* octal, or base 256 if the top bit of the first byte is set */
+	uint64_t v = 0;
+	int i;
+
+	if ((unsigned char)p[0] & 0x80) {
+		v = (unsigned char)p[0] & 0x7F;
+		for (i = 1; i < len; i++) {
+			v = (v << 8) | (unsigned char)p[i];
+		}
+		return v;
+	}
+	for (i = 0; i < len && (p[i] == ' ' || p[i] == '\0'); i++) {
+		/* skip leading layout */
+	}
+	for (; i < len && '0' <= p[i] && p[i] <= '7'; i++) {
+		v = v * 8 + (uint64_t)(p[i] - '0');
+	}
+	return v;
+}
+
+static int
+is_valid_header(const char *block) {
+	/* the checksum is taken with its own field as spaces */
+	uint64_t sum = 0;
+	int i;
+
+	for (i = 0; i < TAR_BLOCK; i++) {
+		sum += (148 <= i && i < 156 ? ' ' : (unsigned char)block[i]);
+	}
+	return tar_number(&block[148], 8) == sum;
+}
+
+static char *
+read_data(FILE *f, uint64_t size) {
+	/* the next size bytes, and the padding; followed by two null bytes */
+	char padding[TAR_BLOCK];
+	size_t n_padding = (size_t)((TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK);
+
+	if ((size_t)size != size || (size_t)size + 2 < 2) {
+		fatal("out of memory: archive member too large");
+	}
+	char *buf = (char *)TryMalloc((size_t)size + 2);
+	if (!buf) {
+		fatal("out of memory: archive member too large");
+	}
+	if (	fread(buf, 1, (size_t)size, f) != (size_t)size
+	||	fread(padding, 1, n_padding, f) != n_padding
+	) {
+		Free(buf);
+		return 0;
+	}
+	buf[size] = buf[size+1] = '\0';
+	return buf;
+}
+
+static char *
+copy_field(const char *p, int len) {
+	/* a field that is null-terminated unless it is full */
+	int n = 0;
+
+	while (n < len && p[n]) {
+		n++;
+	}
+	char *s = (char *)Malloc((size_t)n + 1);
+	memcpy(s, p, (size_t)n);
+	s[n] = '\0';
+	return s;
+}
+
+static char *
+pax_path(const char *data, uint64_t size) {
+	/* the value of the path record in pax data, or 0 */
+	const char *p = data;
+	const char *end = data + size;
+
+	while (p < end) {
+		/* a record is "length key=value\n" */
+		uint64_t rec_len = 0;
+		const char *q = p;
+
+		while (q < end && '0' <= *q && *q <= '9') {
+			rec_len = rec_len * 10 + (uint64_t)(*q++ - '0');
+		}
+		if (rec_len == 0 || rec_len > (uint64_t)(end - p)) return 0;
+		q++;			/* the space */
+		if (strncmp(q, "path=", 5) == 0) {
+			const char *value = q + 5;
+			const char *value_end = p + rec_len - 1;
+
+			if (value > value_end) return 0;
+			return copy_field(value, (int)(value_end - value));
+		}
+		p += rec_len;
+	}
+	return 0;
+}
+
+static char *
+member_name(const char *aname, const char *mname) {
+	char *name = (char *)Malloc(strlen(aname) + 1 + strlen(mname) + 1);
+
+	sprintf(name, "%s%c%s", aname, ARCHIVE_SEPARATOR, mname);
+	return name;
+}
+
+static const char *
+read_archive(FILE *f, const char *aname) {
+	/*	Registers the members of the tar archive on f and adds their
+		names to the arguments; returns an error message, or 0.
+	*/
+	char block[TAR_BLOCK];
+	char *long_name = 0;		/* from an 'L' or 'x' pseudo-member */
+	const char *msg = 0;
+
+	for (;;) {
+		if (!read_block(f, block)) {
+			msg = "archive truncated";
+			break;
+		}
+		if (is_zero_block(block)) break;
+		if (!is_valid_header(block)) {
+			msg = "damaged archive header";
+			break;
+		}
+
+		uint64_t size = tar_number(&block[124], 12);
+		char type = block[156];
+		char *data = read_data(f, size);
+		if (!data) {
+			msg = "archive truncated";
+			break;
+		}
+
+		if (type == 'L' || type == 'x') {
+			/* the name of the next member */
+			if (long_name) {
+				Free(long_name);
+			}
+			long_name = (type == 'L' ?
+				copy_field(data, (int)size) : pax_path(data, size));
+			Free(data);
+			continue;
+		}
+		if (	/* not a non-empty regular file */
+			!(type == '0' || type == '\0' || type == '7')
+		||	size == 0
+		) {
+			if (long_name) {
+				Free(long_name); long_name = 0;
+			}
+			Free(data);
+			continue;
+		}
+
+		/* get the name of the member */
+		char *mname = long_name;
+		if (!mname) {
+			char *name = copy_field(&block[0], 100);
+
+			if (strncmp(&block[257], "ustar", 5) == 0 && block[345]) {
+				/* there is a prefix */
+				char *prefix = copy_field(&block[345], 155);
+
+				mname = (char *)
+					Malloc(strlen(prefix) + 1 + strlen(name) + 1);
+				sprintf(mname, "%s/%s", prefix, name);
+				Free(prefix);
+				Free(name);
+			} else {
+				mname = name;
+			}
+		}
+		long_name = 0;
+
+		struct member *mb =
+			add_member(member_name(aname, mname), data, (size_t)size);
+		add_arg(mb->mb_name);
+		Free(mname);
+	}
+	if (long_name) {
+		Free(long_name);
+	}
+	return msg;
+}
+
+void
+Get_Archive_Args(int *argcp, const char **argvp[]) {
+	int argc = *argcp;
+	const char **argv = *argvp;
+	int i;
+
+	new_args = 0;
+	new_args_free = 0;
+	new_args_size = 0;
+	for (i = 0; i < argc; i++) {
+		const char *arg = argv[i];
+		const struct archive_kind *ak = archive_kind_of(arg);
+		int j;
+
+		if (is_new_old_separator(arg) || !ak) {
+			add_arg(arg);
+			continue;
+		}
+
+		/* the members of an archive are read only once */
+		for (j = 0; j < i; j++) {
+			if (strcmp(argv[j], arg) == 0) break;
+		}
+		if (j < i) {
+			fprintf(stderr, "could not handle archive %s: %s\n",
+				arg, "given more than once");
+			continue;
+		}
+
+		FILE *f = open_archive(arg, ak);
+		if (!f) {
+			/* Pass 1 will report it */
+			add_arg(arg);
+			continue;
+		}
+		const char *msg = read_archive(f, arg);
+		if (!close_archive(f, ak) && !msg) {
+			msg = "decompression failed";
+		}
+		if (msg) {
+			fprintf(stderr, "could not handle archive %s: %s\n",
+				arg, msg);
+		}
+	}
+	add_arg(0);
+
+	*argcp = new_args_free - 1, *argvp = new_args;
+}
+
+							/* GIT REPOSITORIES */
+/*	Under -b, an argument rev:path stands for the blobs in the tree of
+	revision rev below path, as listed by git ls-tree; the contents of
+	each distinct blob (object id) are read only once, through git
+	cat-file --batch, in batches of GIT_BATCH_SIZE blobs, and are shared
+	by all members that have that blob.
+*/
+#define	GIT_BATCH_SIZE	256
+
+const char *Git_Repository_Name;
+size_t Git_Files_Read;
+size_t Git_Blobs_Read;
+
+struct blob {
+	struct blob *bl_next;		/* in the hash chain */
+	char *bl_id;			/* the object id, in hex */
+	char *bl_buf;			/* the contents, or 0 if not read */
+	size_t bl_size;
+	int bl_taken;			/* Boolean, bl_buf belongs to a member */
+};
+
+struct git_entry {
+	const char *ge_arg;		/* a plain argument, or 0 */
+	char *ge_name;			/* rev:path */
+	struct blob *ge_blob;
+};
+
+static struct blob **blob_table;	/* to be filled by Calloc() */
+static size_t blob_table_size;		/* a power of 2 */
+static struct blob **blobs;		/* in order of appearance */
+static size_t n_blobs;
+static size_t blobs_size;
+
+static struct git_entry *git_entries;	/* to be filled by Malloc() */
+static size_t n_git_entries;
+static size_t git_entries_size;
+
+static struct blob *
+blob_of(const char *id) {
+	/* the blob with object id id, new if not seen before */
+	if (n_blobs >= blob_table_size) {
+		/* grow the table, rehashing the blobs */
+		size_t i;
+
+		if (blob_table) {
+			Free(blob_table);
+		}
+		blob_table_size = (blob_table_size ? 2 * blob_table_size : 1024);
+		blob_table = (struct blob **)
+			Calloc(blob_table_size, sizeof (struct blob *));
+		for (i = 0; i < n_blobs; i++) {
+			size_t h = name_hash(blobs[i]->bl_id) & (blob_table_size-1);
+
+			blobs[i]->bl_next = blob_table[h];
+			blob_table[h] = blobs[i];
+		}
+	}
+
+	size_t h = name_hash(id) & (blob_table_size-1);
+	struct blob *bl = blob_table[h];
+	while (bl) {
+		if (strcmp(bl->bl_id, id) == 0) return bl;
+		bl = bl->bl_next;
+	}
+
+	bl = new(struct blob);
+	bl->bl_id = (char *)Malloc(strlen(id) + 1);
+	strcpy(bl->bl_id, id);
+	bl->bl_buf = 0;
+	bl->bl_size = 0;
+	bl->bl_taken = 0;
+	bl->bl_next = blob_table[h];
+	blob_table[h] = bl;
+	if (n_blobs == blobs_size) {
+		/* allocated array is full; increase its size */
+		blobs_size = (blobs_size ? 2 * blobs_size : 1024);
+		blobs = (struct blob **)Realloc(
+			blobs, blobs_size * sizeof (struct blob *)
+		);
+	}
+	blobs[n_blobs++] = bl;
+	return bl;
+}
+
+static void
+add_git_entry(const char *arg, char *name, struct blob *bl) {
+	if (n_git_entries == git_entries_size) {
+		/* allocated array is full; increase its size */
+		git_entries_size = (git_entries_size ? 2 * git_entries_size : 256);
+		git_entries = (struct git_entry *)Realloc(
+			git_entries, git_entries_size * sizeof (struct git_entry)
+		);
+	}
+	git_entries[n_git_entries].ge_arg = arg;
+	git_entries[n_git_entries].ge_name = name;
+	git_entries[n_git_entries].ge_blob = bl;
+	n_git_entries++;
+}
+
+#ifndef	MSDOS
+static FILE *
+open_git(const char *args) {
+	/* a pipe from the command git args, run in the repository */
+	char *q_repo = shell_quoted(Git_Repository_Name);
+	char *cmd = (char *)Malloc(strlen(q_repo) + strlen(args) + 10);
+
+	sprintf(cmd, "git -C %s %s", q_repo, args);
+	FILE *f = popen(cmd, "r");
+	Free(cmd);
+	Free(q_repo);
+	return f;
+}
+
+static char *
+read_record(FILE *f, char **bufp, size_t *sizep, int end) {
+	/* the next record on f, terminated by end, or 0 at the end of f */
+	size_t n = 0;
+	int ch;
+
+	while ((ch = getc(f)) != EOF && ch != end) {
+		if (n + 1 >= *sizep) {
+			/* allocated buffer is full; increase its size */
+			*sizep = (*sizep ? 2 * *sizep : 256);
+			*bufp = (char *)Realloc(*bufp, *sizep);
+		}
+		(*bufp)[n++] = (char)ch;
+	}
+	if (ch == EOF && n == 0) return 0;
+	if (!*bufp) {
+		*sizep = 256;
+		*bufp = (char *)Malloc(*sizep);
+	}
+	(*bufp)[n] = '\0';
+	return *bufp;
+}
+
+static int
+list_git_blobs(const char *arg, const char *colon) {
+	/*	Adds the blobs in the tree named by arg = rev:path to the
+		entries; returns the number of blobs found, or -1 if git
+		failed.
+	*/
+	char *rev = (char *)Malloc((size_t)(colon - arg) + 1);
+	memcpy(rev, arg, (size_t)(colon - arg));
+	rev[colon - arg] = '\0';
+	char *q_rev = shell_quoted(rev);
+	char *q_path = shell_quoted(colon + 1);
+	char *args = (char *)Malloc(strlen(q_rev) + strlen(q_path) + 40);
+
+	sprintf(args, "ls-tree -r -z --full-tree %s%s%s", q_rev,
+		(colon[1] ? " -- " : ""), (colon[1] ? q_path : ""));
+	FILE *f = open_git(args);
+	Free(args);
+	Free(q_path);
+	Free(q_rev);
+	if (!f) {
+		Free(rev);
+		return -1;
+	}
+
+	/* the records are "mode type id<TAB>path" */
+	char *rec = 0;
+	size_t rec_size = 0;
+	int n_found = 0;
+	while (read_record(f, &rec, &rec_size, '\0')) {
+		char mode[20], type[20], id[100];
+		char *tab = strchr(rec, '\t');
+
+		if (	!tab
+		||	sscanf(rec, "%19s %19s %99s", mode, type, id) != 3
+		||	strcmp(type, "blob") != 0
+		||	strcmp(mode, "120000") == 0	/* a symbolic link */
+		) continue;
+
+		char *name = (char *)Malloc(strlen(rev) + 1 + strlen(tab+1) + 1);
+		sprintf(name, "%s:%s", rev, tab+1);
+		add_git_entry(0, name, blob_of(id));
+		n_found++;
+	}
+	if (rec) {
+		Free(rec);
+	}
+	Free(rev);
+	return (pclose(f) == 0 ? n_found : -1);
+}
+
+static const char *
+read_git_batch(size_t first, size_t limit) {
+	/*	Reads the contents of blobs[first .. limit-1]; returns an error
+		message, or 0.
+	*/
+	size_t i;
+	size_t len = 0;
+
+	for (i = first; i < limit; i++) {
+		len += strlen(blobs[i]->bl_id) + 1;
+	}
+	char *args = (char *)Malloc(len + 100);
+	char *p = args;
+
+	/* the ids are hexadecimal, so they need no quoting */
+	p += sprintf(p, "cat-file --batch <<'EOF'\n");
+	for (i = first; i < limit; i++) {
+		p += sprintf(p, "%s\n", blobs[i]->bl_id);
+	}
+	strcpy(p, "EOF");
+	FILE *f = open_git(args);
+	Free(args);
+	if (!f) return "cannot run git";
+
+	/* the answers are "id type size\ncontents\n" or "id missing\n" */
+	const char *msg = 0;
+	char *line = 0;
+	size_t line_size = 0;
+	for (i = first; i < limit && !msg; i++) {
+		struct blob *bl = blobs[i];
+		char id[100], type[20];
+		unsigned long long size;
+
+		if (!read_record(f, &line, &line_size, '\n')) {
+			msg = "git cat-file failed";
+			break;
+		}
+		if (	sscanf(line, "%99s %19s %llu", id, type, &size) != 3
+		||	strcmp(id, bl->bl_id) != 0
+		) {
+			msg = "blob missing";
+			break;
+		}
+		if ((size_t)size != size || (size_t)size + 2 < 2) {
+			fatal("out of memory: git blob too large");
+		}
+		bl->bl_buf = (char *)TryMalloc((size_t)size + 2);
+		if (!bl->bl_buf) {
+			fatal("out of memory: git blob too large");
+		}
+		if (	fread(bl->bl_buf, 1, (size_t)size, f) != (size_t)size
+		||	getc(f) != '\n'
+		) {
+			Free(bl->bl_buf); bl->bl_buf = 0;
+			msg = "git cat-file output truncated";
+			break;
+		}
+		bl->bl_buf[size] = bl->bl_buf[size+1] = '\0';
+		bl->bl_size = (size_t)size;
+		Git_Blobs_Read++;
+	}
+	if (line) {
+		Free(line);
+	}
+
+	/* read the rest, so git can finish normally */
+	while (getc(f) != EOF) {
+		/* skip */
+	}
+	if (pclose(f) != 0 && !msg) {
+		msg = "git cat-file failed";
+	}
+	return msg;
+}
+#endif	/* MSDOS */
+
+static void
+free_git_tables(void) {
+	size_t i;
+
+	for (i = 0; i < n_blobs; i++) {
+		struct blob *bl = blobs[i];
+
+		if (bl->bl_buf && !bl->bl_taken) {
+			Free(bl->bl_buf);
+		}
+		Free(bl->bl_id);
+		Free(bl);
+	}
+	if (blobs) {
+		Free(blobs); blobs = 0;
+	}
+	n_blobs = blobs_size = 0;
+	if (blob_table) {
+		Free(blob_table); blob_table = 0;
+	}
+	blob_table_size = 0;
+	if (git_entries) {
+		Free(git_entries); git_entries = 0;
+	}
+	n_git_entries = git_entries_size = 0;
+}
+
+void
+Get_Git_Args(int *argcp, const char **argvp[]) {
+#ifndef	MSDOS
+	int argc = *argcp;
+	const char **argv = *argvp;
+	int i;
+	size_t e;
+
+	/* list the blobs */
+	for (i = 0; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *colon = strchr(arg, ':');
+
+		if (is_new_old_separator(arg) || !colon || colon == arg) {
+			add_git_entry(arg, 0, 0);
+			continue;
+		}
+		if (list_git_blobs(arg, colon) <= 0) {
+			fprintf(stderr, "could not read %s from git repository %s\n",
+				arg, Git_Repository_Name);
+			/* Pass 1 will report it */
+			add_git_entry(arg, 0, 0);
+		}
+	}
+
+	/* read the distinct blobs */
+	for (e = 0; e < n_blobs; e += GIT_BATCH_SIZE) {
+		size_t limit =
+			(e + GIT_BATCH_SIZE < n_blobs ? e + GIT_BATCH_SIZE : n_blobs);
+		const char *msg = read_git_batch(e, limit);
+
+		if (msg) {
+			fprintf(stderr, "could not handle git repository %s: %s\n",
+				Git_Repository_Name, msg);
+		}
+	}
+
+	/* the members share the contents of their blobs */
+	new_args = 0;
+	new_args_free = 0;
+	new_args_size = 0;
+	for (e = 0; e < n_git_entries; e++) {
+		struct git_entry *ge = &git_entries[e];
+
+		if (ge->ge_arg) {
+			add_arg(ge->ge_arg);
+			continue;
+		}
+
+		struct blob *bl = ge->ge_blob;
+		if (!bl->bl_buf) {
+			/* Pass 1 will report it */
+			add_arg(ge->ge_name);
+			continue;
+		}
+		struct member *mb = add_member(ge->ge_name, bl->bl_buf, bl->bl_size);
+		mb->mb_owner = !bl->bl_taken;
+		bl->bl_taken = 1;
+		add_arg(mb->mb_name);
+		Git_Files_Read++;
+	}
+	add_arg(0);
+	free_git_tables();
+
+	*argcp = new_args_free - 1, *argvp = new_args;
+#else	/* MSDOS */
+	fatal("git repositories are not supported on this system");
+#endif	/* MSDOS */
+}
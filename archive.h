@@ -0,0 +1,42 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Reading the members of tar archives as input files (-A option).
+
+	Get_Archive_Args(&argc, &argv) replaces each argument that names a
+	tar archive (.tar, or compressed: .tar.gz, .tgz, .tar.bz2, .tbz2,
+	.tar.xz, .txz) by the names of its non-empty regular members, in
+	archive order, as archive!member. The members are read into memory
+	right away, compressed archives through the programs gzip, bzip2 or
+	xz, and stay there until Free_Archives().
+
+	Archive_Member(fname) yields the contents of the member fname, as a
+	struct input, or 0 if fname is not such a name; the stream module
+	and Pass 3 use it instead of opening the file. An archive that
+	cannot be opened is left in the arguments as it is.
+
+	Likewise, under -b, Get_Git_Args(&argc, &argv) replaces each
+	argument rev:path by the files in revision rev of the git repository
+	Git_Repository_Name below path, as rev:path for each file. The
+	contents of a blob that occurs more than once are read only once and
+	shared by its members, so Pass 1 can recognize them; see
+	Archive_Member().
+*/
+
+#define	ARCHIVE_SEPARATOR	'!'
+
+extern void Get_Archive_Args(int *argcp, const char **argvp[]);
+
+extern const char *Git_Repository_Name;
+extern size_t Git_Files_Read;		/* for -M */
+extern size_t Git_Blobs_Read;
+extern void Get_Git_Args(int *argcp, const char **argvp[]);
+
+/*	Add_Memory_Member(name, buf, size) makes the size bytes in buf,
+	followed by two null bytes, a member named name, as if it had come
+	from an archive; buf stays the caller's. It is used by libsim.c.
+*/
+extern void Add_Memory_Member(const char *name, char *buf, size_t size);
+
+extern struct input *Archive_Member(const char *fname);
+extern void Free_Archives(void);
@@ -0,0 +1,120 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+#include	<stdio.h>
+#include	<stddef.h>
+
+#include	"Malloc.h"
+#include	"memstat.h"
+#include	"arena.h"
+
+/*	The blocks are chained through their first field; the records follow,
+	each aligned like the most demanding of the basic types, and at least
+	large enough to hold the link of the free list.
+*/
+#define	ARENA_BLOCK_SIZE	(64*1024)	/* in bytes */
+
+union arena_align {
+	void *aa_pointer;
+	long aa_long;
+	double aa_double;
+};
+
+struct arena_block {
+	struct arena_block *ab_next;
+	union arena_align ab_records[1];
+};
+
+#define	ALIGNED(s) \
+	(((s) + sizeof (union arena_align) - 1) \
+	 / sizeof (union arena_align) * sizeof (union arena_align))
+
+static size_t
+record_size(const struct arena *ar) {
+	size_t size = ar->ar_record_size;
+
+	if (size < sizeof (void *)) {
+		size = sizeof (void *);
+	}
+	return ALIGNED(size);
+}
+
+static int
+add_block(struct arena *ar, size_t n_records) {
+	/* returns 0 when out of memory */
+	size_t rec_size = record_size(ar);
+	size_t n_bytes =
+		offsetof(struct arena_block, ab_records) + n_records * rec_size;
+	struct arena_block *ab = (struct arena_block *)TryMalloc(n_bytes);
+
+	if (!ab) return 0;
+	ar->ar_n_bytes += n_bytes;
+	Count_Memory(ar->ar_category, n_bytes);
+	ab->ab_next = ar->ar_blocks;
+	ar->ar_blocks = ab;
+	ar->ar_free = (char *)ab->ab_records;
+	ar->ar_limit = ar->ar_free + n_records * rec_size;
+	return 1;
+}
+
+void *
+Try_Arena_New(struct arena *ar) {
+	size_t rec_size = record_size(ar);
+
+	if (ar->ar_free_list) {
+		/* reuse a record given back */
+		void *p = ar->ar_free_list;
+
+		ar->ar_free_list = *(void **)p;
+		return p;
+	}
+
+	if (ar->ar_free + rec_size > ar->ar_limit || !ar->ar_free) {
+		size_t n_records = ARENA_BLOCK_SIZE / rec_size;
+
+		if (n_records == 0) {
+			n_records = 1;
+		}
+		if (	!add_block(ar, n_records)
+		&&	/* a last try, for a single record */
+			!add_block(ar, 1)
+		) {
+			return 0;
+		}
+	}
+
+	void *p = ar->ar_free;
+	ar->ar_free += rec_size;
+	return p;
+}
+
+void *
+Arena_New(struct arena *ar) {
+	void *p = Try_Arena_New(ar);
+
+	if (!p) {
+		OutOfMemoryExit("arena");
+		/*NOTREACHED*/
+	}
+	return p;
+}
+
+void
+Arena_Free(struct arena *ar, void *p) {
+	*(void **)p = ar->ar_free_list;
+	ar->ar_free_list = p;
+}
+
+void
+Free_Arena(struct arena *ar) {
+	while (ar->ar_blocks) {
+		struct arena_block *ab = ar->ar_blocks;
+
+		ar->ar_blocks = ab->ab_next;
+		Free(ab);
+	}
+	Uncount_Memory(ar->ar_category, ar->ar_n_bytes);
+	ar->ar_n_bytes = 0;
+	ar->ar_free = ar->ar_limit = 0;
+	ar->ar_free_list = 0;
+}
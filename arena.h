@@ -0,0 +1,32 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Arenas for short-lived records of one size, like the runs and the
+	percentage matches, of which there can be millions: the records are
+	carved out of large blocks, obtained through Malloc(), and are all
+	given back in one step, when the phase that uses them ends.
+
+	A struct arena is initialized statically with ARENA_OF(T, cat), for
+	records of type T, whose memory is counted in the category cat of
+	memstat.h. Arena_New(ar) yields a new record, never NULL;
+	Try_Arena_New(ar) does the same but returns NULL when out of memory.
+	Arena_Free(ar, p) makes the record p available again for the next
+	Arena_New(ar), and Free_Arena(ar) frees all records of ar at once.
+*/
+
+struct arena {
+	size_t ar_record_size;
+	int ar_category;		/* for memstat.h */
+	size_t ar_n_bytes;		/* in the blocks */
+	struct arena_block *ar_blocks;	/* to be filled by Malloc() */
+	char *ar_free;			/* in the first block */
+	char *ar_limit;
+	void *ar_free_list;		/* of records given back */
+};
+
+#define	ARENA_OF(T,cat)	{sizeof (T), (cat), 0, 0, 0, 0, 0}
+
+extern void *Arena_New(struct arena *ar);
+extern void *Try_Arena_New(struct arena *ar);
+extern void Arena_Free(struct arena *ar, void *p);
+extern void Free_Arena(struct arena *ar);
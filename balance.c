@@ -0,0 +1,284 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	With depth[i] the number of openers minus the number of closers
+	before position i, of all kinds taken together, and the counts of
+	the separate kinds, a prefix of the run starting at i0 is balanced
+	if no kind has been closed more often than opened since i0 and the
+	depth is back at depth[i0]; as long as no kind has been closed too
+	often, the depth cannot go below depth[i0], and it is back there
+	exactly when each kind is. So the answer is found in two lookups:
+	fail_dist[i0], the distance to the first token that closes a kind
+	more often than it has been opened since i0, made by one sweep for
+	each kind, and the last position before that where the depth equals
+	depth[i0], that is, where it has its minimum. The latter is a range
+	minimum query, answered by scanning the ends of the range and
+	looking up the minima of the blocks of BALANCE_BLOCK positions in
+	between in a sparse table.
+
+	Texts are added to the end of Token_Array[]; the index is extended
+	for them, the positions of the earlier texts keeping their values,
+	since no run crosses the end of a text. If tokens may have been
+	replaced, as noted by Token_Array_Resets, it is made anew.
+*/
+
+#include	<stdint.h>
+
+#include	"sim.h"
+#include	"token.h"
+#include	"tokenarray.h"
+#include	"Malloc.h"
+#include	"memstat.h"
+#include	"balance.h"
+
+#define	BALANCE_BLOCK	32		/* positions per block */
+#define	NO_FAILURE	UINT32_MAX
+
+static int32_t *depth;			/* to be filled by Malloc() */
+static uint32_t *fail_dist;		/* same */
+static size_t n_indexed;		/* depth[0 .. n_indexed] are set */
+static size_t n_allocated;		/* positions in the arrays */
+static int resets_seen;
+
+static int32_t *block_min;		/* to be filled by Malloc() */
+static size_t n_blocks;
+static int n_levels;			/* block_min[l*n_blocks + b] is the
+					   minimum of blocks b .. b+2^l-1 */
+static size_t block_min_size;
+
+static int
+kind_in(const char set[], Token tk) {
+	if (!is_regular_token(tk)) return 0;
+	return set[Token2int(tk)];
+}
+
+static void
+count_index_memory(int sign) {
+	size_t size =
+		n_allocated * (sizeof (int32_t) + sizeof (uint32_t))
+	+	block_min_size * sizeof (int32_t);
+
+	if (sign > 0) {
+		Count_Memory(MEM_BALANCE_INDEX, size);
+	} else {
+		Uncount_Memory(MEM_BALANCE_INDEX, size);
+	}
+}
+
+static void
+find_failures(const char openers[], const char closers[],
+	int kind, size_t start, size_t limit
+) {
+	/*	For each position i in start .. limit-1 whose fail_dist[] has
+		not been found to be smaller, finds the first token j >= i
+		that makes the count of kind, counted from i, negative.
+		The positions that have not yet met their token are kept on
+		a stack, with their counts counted from start; the counts
+		increase towards the top.
+	*/
+	size_t *pending = (size_t *)Malloc((limit - start + 1) * sizeof (size_t));
+	int32_t *count_at = (int32_t *)
+		Malloc((limit - start + 1) * sizeof (int32_t));
+	size_t n_pending = 0;
+	int32_t count = 0;
+	size_t i;
+
+	for (i = start; i < limit; i++) {
+		Token tk = Token_Array[i];
+
+		pending[n_pending] = i;
+		count_at[n_pending] = count;
+		n_pending++;
+
+		if (kind_in(openers, tk) == kind) count++;
+		if (kind_in(closers, tk) == kind) count--;
+
+		while (n_pending > 0 && count_at[n_pending-1] > count) {
+			size_t p = pending[--n_pending];
+			size_t dist = i - p;
+
+			if (dist < fail_dist[p]) {
+				fail_dist[p] = (uint32_t)dist;
+			}
+		}
+	}
+	Free(count_at);
+	Free(pending);
+}
+
+static void
+make_block_minima(void) {
+	size_t b;
+	int l;
+
+	count_index_memory(-1);
+	n_blocks = n_indexed / BALANCE_BLOCK + 1;
+	n_levels = 1;
+	while (((size_t)1 << n_levels) <= n_blocks) {
+		n_levels++;
+	}
+	block_min_size = (size_t)n_levels * n_blocks;
+	block_min = (int32_t *)Realloc(block_min,
+		block_min_size * sizeof (int32_t));
+	count_index_memory(1);
+
+	for (b = 0; b < n_blocks; b++) {
+		size_t i = b * BALANCE_BLOCK;
+		size_t end = i + BALANCE_BLOCK;
+		int32_t min = depth[i];
+
+		if (end > n_indexed + 1) end = n_indexed + 1;
+		for (i++; i < end; i++) {
+			if (depth[i] < min) min = depth[i];
+		}
+		block_min[b] = min;
+	}
+	for (l = 1; l < n_levels; l++) {
+		const int32_t *prev = &block_min[(size_t)(l-1) * n_blocks];
+		int32_t *cur = &block_min[(size_t)l * n_blocks];
+		size_t half = (size_t)1 << (l-1);
+
+		for (b = 0; b < n_blocks; b++) {
+			cur[b] = (	b + half < n_blocks
+				&&	prev[b + half] < prev[b]
+				?	prev[b + half] : prev[b]);
+		}
+	}
+}
+
+void
+Update_Balance_Index(const char openers[], const char closers[]) {
+	size_t limit = Token_Array_Length();
+	size_t start;
+	int n_kinds = 0;
+	int kind;
+	size_t i;
+
+	if (resets_seen != Token_Array_Resets) {
+		/* tokens may have been replaced */
+		n_indexed = 0;
+		resets_seen = Token_Array_Resets;
+	}
+	if (depth && n_indexed >= limit) return;
+
+	if (limit + 1 > n_allocated) {
+		count_index_memory(-1);
+		n_allocated = limit + limit/2 + 1;
+		depth = (int32_t *)Realloc(depth,
+			n_allocated * sizeof (int32_t));
+		fail_dist = (uint32_t *)Realloc(fail_dist,
+			n_allocated * sizeof (uint32_t));
+		count_index_memory(1);
+	}
+
+	start = n_indexed;
+	if (start == 0) {
+		depth[0] = 0;
+	}
+	for (i = start; i < limit; i++) {
+		Token tk = Token_Array[i];
+
+		depth[i+1] = depth[i]
+			+ (kind_in(openers, tk) ? 1 : 0)
+			- (kind_in(closers, tk) ? 1 : 0);
+		fail_dist[i] = NO_FAILURE;
+	}
+	fail_dist[limit] = NO_FAILURE;
+	n_indexed = limit;
+
+	for (i = 0; i < N_REGULAR_TOKENS; i++) {
+		if (openers[i] > n_kinds) n_kinds = openers[i];
+	}
+	for (kind = 1; kind <= n_kinds; kind++) {
+		find_failures(openers, closers, kind, start, limit);
+	}
+
+	make_block_minima();
+}
+
+static int32_t
+min_of_blocks(size_t b0, size_t b1) {
+	/* the minimum of the blocks b0 .. b1, b0 <= b1 */
+	int l = 0;
+
+	while (((size_t)2 << l) <= b1 - b0 + 1) {
+		l++;
+	}
+	const int32_t *level = &block_min[(size_t)l * n_blocks];
+	int32_t m0 = level[b0];
+	int32_t m1 = level[b1 + 1 - ((size_t)1 << l)];
+
+	return (m0 < m1 ? m0 : m1);
+}
+
+static size_t
+last_at_depth(int32_t d, size_t p0, size_t p1) {
+	/*	Returns the last position p in p0 .. p1 with depth[p] == d,
+		or 0 if there is none; depth[] is at least d in p0 .. p1.
+	*/
+	size_t b0 = p0 / BALANCE_BLOCK;
+	size_t b1 = p1 / BALANCE_BLOCK;
+	size_t p;
+
+	/* the block of p1 */
+	for (p = p1; p >= p0 && p / BALANCE_BLOCK == b1; p--) {
+		if (depth[p] == d) return p;
+	}
+	if (b0 == b1) return 0;
+
+	/* the blocks between those of p0 and p1 */
+	if (b0 + 1 < b1 && min_of_blocks(b0 + 1, b1 - 1) == d) {
+		/* find the last of them that reaches d */
+		size_t lo = b0 + 1;
+		size_t hi = b1 - 1;
+
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo + 1) / 2;
+
+			if (min_of_blocks(mid, hi) == d) {
+				lo = mid;
+			} else {
+				hi = mid - 1;
+			}
+		}
+		for (p = (lo + 1) * BALANCE_BLOCK - 1; ; p--) {
+			if (depth[p] == d) return p;
+		}
+	}
+
+	/* the block of p0 */
+	for (p = (b0 + 1) * BALANCE_BLOCK - 1; p >= p0; p--) {
+		if (depth[p] == d) return p;
+	}
+	return 0;
+}
+
+size_t
+Balanced_Size(const Token *tk_array, size_t size) {
+	if (!depth || !tk_array || tk_array < Token_Array)
+		return BALANCE_UNKNOWN;
+
+	size_t i0 = (size_t)(tk_array - Token_Array);
+	if (i0 + size > n_indexed) return BALANCE_UNKNOWN;
+
+	/* the tokens up to the first failure are candidates */
+	size_t room = (fail_dist[i0] < size ? fail_dist[i0] : size);
+	if (room == 0) return 0;
+
+	size_t p = last_at_depth(depth[i0], i0 + 1, i0 + room);
+	return (p ? p - i0 : 0);
+}
+
+void
+Free_Balance_Index(void) {
+	count_index_memory(-1);
+	if (depth) {
+		Free(depth); depth = 0;
+		Free(fail_dist); fail_dist = 0;
+	}
+	if (block_min) {
+		Free(block_min); block_min = 0;
+	}
+	n_indexed = n_allocated = 0;
+	n_blocks = block_min_size = 0;
+}
@@ -0,0 +1,25 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	An index on the nesting of the parentheses in Token_Array[], so the
+	-f option can find the longest balanced prefix of a run by lookup
+	rather than by scanning the run, as the Best_Run_Size() routines of
+	properties.c and algollike.c do otherwise.
+
+	Update_Balance_Index(openers, closers) brings the index up to date
+	with the tokens in Token_Array[]; openers[] and closers[] map the
+	regular tokens to their position in the set of openers or closers,
+	+ 1, or 0 if they are not in it, as in properties.c. It must be
+	called by the main thread, before the search for runs.
+
+	Balanced_Size(tk_array, size) returns the size of the longest prefix
+	of the size tokens starting at tk_array that contains no unbalanced
+	parentheses, or BALANCE_UNKNOWN if these tokens are not indexed.
+	It can be called from several threads at once.
+*/
+
+#define	BALANCE_UNKNOWN	((size_t)-1)
+
+extern void Update_Balance_Index(const char openers[], const char closers[]);
+extern size_t Balanced_Size(const Token *tk_array, size_t size);
+extern void Free_Balance_Index(void);
@@ -0,0 +1,128 @@
+#!/bin/sh
+#	This file is part of the software similarity tester SIM.
+#
+#	The benchmarks of make bench:
+#	    bench.sh run RESULTS BINARY ...
+#		makes the synthetic corpora in bench_corpus (see benchgen.c),
+#		runs each binary on them with each of the options in OPTIONS
+#		and writes the time and the peak memory of each phase to
+#		RESULTS, one line per phase, with the tab-separated fields
+#		    binary corpus options phase wall_s cpu_s peak_kB
+#	    bench.sh compare BASELINE RESULTS [TOLERANCE]
+#		reports each phase that takes more than TOLERANCE percent
+#		(default 10) more wall-clock time or peak memory in RESULTS
+#		than in BASELINE, and fails if there is one; phases of less
+#		than MIN_TIME seconds are too noisy to compare for time.
+
+CORPUS_DIR=bench_corpus
+MIN_TIME=0.05
+
+# name and benchgen options of each corpus
+CORPORA="
+plain	-n 100 -l 400 -d 10 -b 10
+dup	-n 100 -l 400 -d 50 -b 10
+boiler	-n 100 -l 400 -d 5 -b 50
+many	-n 300 -l 100 -d 10 -b 10
+"
+
+OPTIONS="-r24
+-r24 -a
+-r24 -e
+-r24 -p
+-r24 -f"
+
+make_corpora() {
+	echo "$CORPORA" | while read name flags; do
+		[ -n "$name" ] || continue
+		for kind in c text; do
+			dir=$CORPUS_DIR/$name.$kind
+			[ -d $dir ] && continue
+			mkdir -p $dir
+			if [ $kind = text ]; then
+				./benchgen -t $flags $dir
+			else
+				./benchgen $flags $dir
+			fi
+		done
+	done
+}
+
+run_one() {	# binary corpus options
+	"./$1" -D -M -n $3 $CORPUS_DIR/$2/* 2>&1 >/dev/null |
+	awk -v bin="$1" -v corpus="$2" -v opts="$3" '
+	/^Time for / {
+		phase = substr($0, 10, index($0, ":") - 10)
+		wall[phase] = $(NF-5); cpu[phase] = $(NF-2)
+		order[++n] = phase
+	}
+	/^Memory after / {
+		phase = substr($0, 14, index($0, ":") - 14)
+		if (match($0, /peak resident = [0-9]+/))
+			peak[phase] = substr($0, RSTART + 16, RLENGTH - 16)
+	}
+	END {
+		for (i = 1; i <= n; i++) {
+			p = order[i]
+			printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\n", bin, corpus,
+				opts, p, wall[p], cpu[p], (p in peak ? peak[p] : "-")
+		}
+	}'
+}
+
+run() {		# results binary ...
+	results=$1; shift
+	make_corpora
+	: > $results
+	for bin in "$@"; do
+		case $bin in
+		sim_text*)	kind=text;;
+		*)		kind=c;;
+		esac
+		echo "$CORPORA" | while read name flags; do
+			[ -n "$name" ] || continue
+			echo "$OPTIONS" | while read opts; do
+				case "$kind $opts" in
+				"text -r24 -f")	continue;;	# no -f in text
+				esac
+				echo "$bin $name.$kind $opts" >&2
+				run_one $bin $name.$kind "$opts" >> $results
+			done
+		done
+	done
+}
+
+compare() {	# baseline results [tolerance]
+	awk -F'\t' -v tol="${3:-10}" -v min_time=$MIN_TIME '
+	FNR == NR {
+		key = $1 FS $2 FS $3 FS $4
+		wall[key] = $5; peak[key] = $7
+		next
+	}
+	{	key = $1 FS $2 FS $3 FS $4
+		if (!(key in wall)) next
+		what = ""
+		if ($5 >= min_time && $5 > wall[key] * (1 + tol/100))
+			what = sprintf("time %s s -> %s s", wall[key], $5)
+		if ($7 != "-" && peak[key] != "-" &&
+		    $7 > peak[key] * (1 + tol/100))
+			what = what (what ? ", " : "") \
+				sprintf("memory %s kB -> %s kB", peak[key], $7)
+		if (what) {
+			printf "REGRESSION %s %s %s, %s: %s\n",
+				$1, $2, $3, $4, what
+			n_regressions++
+		}
+	}
+	END {
+		if (n_regressions) exit 1
+		print "no regressions"
+	}' $1 $2
+}
+
+case "$1" in
+run)		shift; run "$@";;
+compare)	shift; compare "$@";;
+*)		echo "usage: bench.sh run RESULTS BINARY ..." >&2
+		echo "       bench.sh compare BASELINE RESULTS [TOLERANCE]" >&2
+		exit 1;;
+esac
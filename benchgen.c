@@ -0,0 +1,228 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Generator of synthetic corpora for the benchmarks (make bench).
+
+	    benchgen [-t] [-n files] [-l lines] [-d dup] [-b boiler] [-s seed] dir
+
+	writes files dir/f0001.c, ... (dir/f0001.txt, ... under -t, text
+	instead of C) of the given number of lines each. The lines come in
+	blocks of BLOCK_LINES; a block is a copy of a block of an earlier
+	file with a probability of dup percent, the common boilerplate block
+	with a probability of boiler percent, and new otherwise. The output
+	depends on the seed only, so the corpora can be made again on any
+	machine.
+*/
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	"Malloc.h"
+
+#define	BLOCK_LINES	16
+#define	LINE_LEN	100
+#define	N_WORDS		4096
+
+static int text_mode;
+static int n_files = 100;
+static int n_lines = 400;
+static int dup_percentage = 10;
+static int boiler_percentage = 10;
+static unsigned long seed = 1;
+
+static char word[N_WORDS][16];		/* the vocabulary */
+static char *block_pool;		/* all blocks written, in order */
+static size_t n_blocks;
+
+							/* RANDOM NUMBERS */
+static unsigned long long rng_state;
+
+static unsigned long
+next_random(void) {
+	/* xorshift64*, the same on any machine */
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (unsigned long)((rng_state * 2685821657736338717ULL) >> 33);
+}
+
+static int
+random_below(int n) {
+	return (int)(next_random() % (unsigned long)n);
+}
+
+static const char *
+random_word(void) {
+	/* skewed towards the first words, as in real vocabularies */
+	int w = random_below(N_WORDS);
+
+	return word[random_below(w + 1)];
+}
+
+							/* BLOCKS */
+static char *
+block_at(size_t b) {
+	return &block_pool[b * BLOCK_LINES * LINE_LEN];
+}
+
+static void
+new_line(char *line) {
+	const char *x = random_word(), *y = random_word(), *z = random_word();
+
+	if (text_mode) {
+		int n = 4 + random_below(6);	/* fits in LINE_LEN */
+
+		line[0] = '\0';
+		while (n-- > 0) {
+			strcat(line, random_word());
+			strcat(line, (n ? " " : "."));
+		}
+		return;
+	}
+	switch (random_below(6)) {
+	case 0:	sprintf(line, "\t%s = %s + %s;", x, y, z); break;
+	case 1:	sprintf(line, "\tif (%s < %s) %s++;", x, y, z); break;
+	case 2:	sprintf(line, "\t%s(%s, %s);", x, y, z); break;
+	case 3:	sprintf(line, "\tfor (%s = 0; %s < %s; %s++) {}", x, x, y, x);
+		break;
+	case 4:	sprintf(line, "\treturn %s[%s] * %s;", x, y, z); break;
+	default: sprintf(line, "\t%s = %s(%s - 1);", x, y, z); break;
+	}
+}
+
+static void
+make_boilerplate(char *block) {
+	/* a table of numbers, such as initializers and licence texts give */
+	int i;
+
+	for (i = 0; i < BLOCK_LINES; i++) {
+		char *line = &block[i * LINE_LEN];
+
+		if (text_mode) {
+			sprintf(line, "Clause %d: the software is provided as is.",
+				i);
+		}
+		else {
+			sprintf(line, "\t{%d, %d, %d, %d},", i, i * 3, i * 7, i);
+		}
+	}
+}
+
+static void
+make_block(char *block, const char *boilerplate) {
+	int i;
+
+	if (n_blocks > 0 && random_below(100) < dup_percentage) {
+		memcpy(block, block_at((size_t)random_below((int)n_blocks)),
+			BLOCK_LINES * LINE_LEN);
+		return;
+	}
+	if (random_below(100) < boiler_percentage) {
+		memcpy(block, boilerplate, BLOCK_LINES * LINE_LEN);
+		return;
+	}
+	for (i = 0; i < BLOCK_LINES; i++) {
+		new_line(&block[i * LINE_LEN]);
+	}
+}
+
+							/* FILES */
+static void
+make_vocabulary(void) {
+	static const char letters[] = "abcdefghijklmnopqrstuvwxyz_";
+	int w;
+
+	for (w = 0; w < N_WORDS; w++) {
+		int len = 2 + random_below(8);
+		int i;
+
+		for (i = 0; i < len; i++) {
+			word[w][i] = letters[random_below(i ? 27 : 26)];
+		}
+		word[w][len] = '\0';
+	}
+}
+
+static void
+write_file(const char *dir, int f, const char *boilerplate) {
+	char *fname = (char *)Malloc(strlen(dir) + 20);
+	int blocks_per_file = (n_lines + BLOCK_LINES - 1) / BLOCK_LINES;
+	int b;
+
+	sprintf(fname, "%s/f%04d.%s", dir, f + 1, (text_mode ? "txt" : "c"));
+	FILE *out = fopen(fname, "w");
+	if (!out) {
+		fprintf(stderr, "benchgen: cannot create %s\n", fname);
+		exit(1);
+	}
+
+	if (!text_mode) fprintf(out, "int f%04d(void) {\n", f + 1);
+	for (b = 0; b < blocks_per_file; b++) {
+		char *block = block_at(n_blocks);
+		int i;
+
+		make_block(block, boilerplate);
+		for (i = 0; i < BLOCK_LINES; i++) {
+			fprintf(out, "%s\n", &block[i * LINE_LEN]);
+		}
+		n_blocks++;
+	}
+	if (!text_mode) fprintf(out, "}\n");
+
+	if (fclose(out) != 0) {
+		fprintf(stderr, "benchgen: cannot write %s\n", fname);
+		exit(1);
+	}
+	Free(fname);
+}
+
+static void
+usage(void) {
+	fprintf(stderr, "usage: benchgen [-t] [-n files] [-l lines]");
+	fprintf(stderr, " [-d dup%%] [-b boiler%%] [-s seed] dir\n");
+	exit(1);
+}
+
+int
+main(int argc, const char *argv[]) {
+	int f;
+
+	while (argc > 2 && argv[1][0] == '-') {
+		const char *op = argv[1];
+
+		if (strcmp(op, "-t") == 0) {
+			text_mode = 1;
+			argc--, argv++;
+			continue;
+		}
+		if (argc < 4 || op[1] == '\0' || op[2] != '\0') usage();
+		int value = atoi(argv[2]);
+		switch (op[1]) {
+		case 'n':	n_files = value; break;
+		case 'l':	n_lines = value; break;
+		case 'd':	dup_percentage = value; break;
+		case 'b':	boiler_percentage = value; break;
+		case 's':	seed = (unsigned long)value; break;
+		default:	usage();
+		}
+		argc -= 2, argv += 2;
+	}
+	if (argc != 2 || n_files <= 0 || n_lines <= 0) usage();
+
+	rng_state = 0x9E3779B97F4A7C15ULL ^ seed;
+	make_vocabulary();
+
+	char *boilerplate = (char *)Malloc(BLOCK_LINES * LINE_LEN);
+	make_boilerplate(boilerplate);
+	block_pool = (char *)Malloc((size_t)n_files
+		* ((n_lines + BLOCK_LINES - 1) / BLOCK_LINES)
+		* BLOCK_LINES * LINE_LEN);
+	n_blocks = 0;
+	for (f = 0; f < n_files; f++) {
+		write_file(argv[1], f, boilerplate);
+	}
+	Free(block_pool);
+	Free(boilerplate);
+	return 0;
+}
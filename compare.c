@@ -3,14 +3,26 @@
 	$Id: compare.c,v 2.44 2017-12-11 14:12:33 dick Exp $
 */
 
+#include	<stdlib.h>
+
 #include	"sim.h"
 #include	"text.h"
 #include	"token.h"
 #include	"tokenarray.h"
+#include	"tokencmp.h"
 #include	"hash.h"
+#include	"suffix.h"
+#include	"sketch.h"
 #include	"properties.h"
 #include	"options.h"
 #include	"add_run.h"
+#include	"parallel.h"
+#include	"stats.h"
+#include	"shard.h"
+#include	"incremental.h"
+#include	"progress.h"
+#include	"identical.h"
+#include	"Malloc.h"
 #include	"compare.h"
 #include	"debug.par"
 
@@ -33,8 +45,8 @@ in_range(size_t i, const struct range *rg) {
 		return (rg->rg_start <= i && i < rg->rg_limit);
 	} else {
 		/* looped-around range */
-		return (rg->rg_start <= i && i < end_of_text
-			|| beginning_of_text <= i && i < rg->rg_limit);
+		return ((rg->rg_start <= i && i < end_of_text)
+			|| (beginning_of_text <= i && i < rg->rg_limit));
 	}
 }
 
@@ -43,10 +55,76 @@ is_empty_range(const struct range *rg) {
 	return rg->rg_start == rg->rg_limit;
 }
 
+							/* RUN COLLECTION */
+/*	When the new texts are compared on several threads (-j option), the
+	runs found for a text are collected in a private buffer by the thread
+	that does the text, and are passed to add_run() by the main thread in
+	the order of the texts, so the back-end sees exactly the same sequence
+	of calls as in the serial case.
+*/
+struct found_run {
+	struct text *fr_txt0;
+	size_t fr_i0;
+	struct text *fr_txt1;
+	size_t fr_i1;
+	size_t fr_size;
+};
+
+struct run_buffer {
+	struct found_run *rb_runs;	/* to be filled by Malloc() */
+	size_t rb_free;
+	size_t rb_size;
+	int rb_done;			/* Boolean, protected by Lock() */
+};
+
+static void
+enter_run(struct run_buffer *rb,
+	struct text *txt0, size_t i0, struct text *txt1, size_t i1, size_t size
+) {
+	if (!rb) {
+		/* serial case */
+		Add_Run_And_Copies(txt0, i0, txt1, i1, size);
+		return;
+	}
+
+	if (rb->rb_free == rb->rb_size) {
+		/* allocated array is full; increase its size */
+		rb->rb_size = (rb->rb_size ? 2 * rb->rb_size : 64);
+		rb->rb_runs = (struct found_run *)Realloc(
+			rb->rb_runs, rb->rb_size * sizeof (struct found_run)
+		);
+	}
+	struct found_run *fr = &rb->rb_runs[rb->rb_free++];
+	fr->fr_txt0 = txt0, fr->fr_i0 = i0;
+	fr->fr_txt1 = txt1, fr->fr_i1 = i1;
+	fr->fr_size = size;
+}
+
+static void
+deliver_runs(struct run_buffer *rb) {
+	size_t i;
+
+	for (i = 0; i < rb->rb_free; i++) {
+		const struct found_run *fr = &rb->rb_runs[i];
+		Add_Run_And_Copies(fr->fr_txt0, fr->fr_i0,
+			fr->fr_txt1, fr->fr_i1, fr->fr_size);
+	}
+	if (rb->rb_runs) {
+		Free(rb->rb_runs); rb->rb_runs = 0;
+	}
+}
+
 							/* COMPARE FILES */
-static void compare_one_text(int n, struct range *rg);
-static void compare_one_on_one(int n, int m, struct range *rg);
+static void compare_new_text(int n, struct run_buffer *rb);
+static void compare_one_text(int n, struct range *rg, struct run_buffer *rb);
+static void compare_one_on_one(
+	int n, int m, struct range *rg, struct run_buffer *rb
+);
 static size_t lcs(
+	struct text *txt0, size_t i0, struct range *rg,
+	struct text **tx_bp, size_t *i_bp, struct search_counts *sc
+);
+static size_t lcs_by_suffix_array(
 	struct text *txt0, size_t i0, struct range *rg,
 	struct text **tx_bp, size_t *i_bp
 );
@@ -59,78 +137,180 @@ static size_t lcs(
 				for all positions in the text
 					for ever increasing sizes
 						try to match and keep the best
+
+	The comparison of one new file does not depend on that of any other
+	new file; in particular the range, which may be modified while a file
+	is being compared ("sticky" ranges under -a), is private to it. So the
+	outer loop can be spread over several threads, provided each new file
+	is done completely by one thread.
 */
 
+static struct run_buffer *run_buffers;	/* one for each new text */
+static int next_text_to_do;		/* protected by Lock() */
+
+static void
+compare_texts_worker(int w, void *arg) {
+	(void)w;
+	(void)arg;
+	for (;;) {
+		Lock();
+		int n = next_text_to_do++;
+		Unlock();
+		if (n >= Number_of_New_Texts) break;
+
+		compare_new_text(n, &run_buffers[n]);
+		Progress_Done(1, Text[n].tx_limit - Text[n].tx_start);
+
+		Lock();
+		run_buffers[n].rb_done = 1;
+		Signal_Change();
+		Unlock();
+	}
+}
+
 static void
 compare_texts(void) {
 	int n;
 
-	for (	/* all new texts */
-		n = 0; n < Number_of_New_Texts; n++
-	) {
-		struct range range;
+	beginning_of_text = Text[0].tx_start;
+	beginning_of_old_text = Text[Number_of_New_Texts-1].tx_limit;
+	end_of_text = Text[Number_of_Texts-1].tx_limit;
+	Progress_Phase("comparing", Number_of_New_Texts,
+		beginning_of_old_text - beginning_of_text);
+
+	if (Number_of_Threads <= 1 || Number_of_New_Texts <= 1) {
+		for (	/* all new texts */
+			n = 0; n < Number_of_New_Texts; n++
+		) {
+			compare_new_text(n, 0);
+			if (Is_Duplicate_Text(n)) {
+				Add_Runs_Of_Duplicate(n);
+			}
+			Progress_Done(1, Text[n].tx_limit - Text[n].tx_start);
+		}
+		return;
+	}
+
+	run_buffers = (struct run_buffer *)
+		Calloc(Number_of_New_Texts, sizeof (struct run_buffer));
+	next_text_to_do = 0;
+	Start_Workers(Number_of_Threads, compare_texts_worker, 0);
+
+	/* pass the runs on in text order, as they become available */
+	for (n = 0; n < Number_of_New_Texts; n++) {
+		Lock();
+		while (!run_buffers[n].rb_done) {
+			Wait_For_Change();
+		}
+		Unlock();
+		deliver_runs(&run_buffers[n]);
+		if (Is_Duplicate_Text(n)) {
+			Add_Runs_Of_Duplicate(n);
+		}
+	}
 
-		/* construct default range */
-		beginning_of_text = Text[0].tx_start;
-		beginning_of_old_text = Text[Number_of_New_Texts-1].tx_limit;
-		end_of_text = Text[Number_of_Texts-1].tx_limit;
+	Join_Workers();
+	Free(run_buffers); run_buffers = 0;
+}
+
+static void
+compare_new_text(int n, struct run_buffer *rb) {
+	struct range range;
+
+	if (!Is_In_Shard(n)) {
+		/* another shard compares it (-L) */
+		return;
+	}
+	if (is_set_option('x') && !May_Reach_Threshold(n)) {
+		/* its percentages would all be below the threshold */
+		return;
+	}
+	if (Is_Duplicate_Text(n)) {
+		/* it gets the runs of its representative (-Z) */
+		return;
+	}
+
+	/* construct default range */
+	range.rg_start = Text[n].tx_start + 1;
+	range.rg_limit = end_of_text;
+	range.rg_sticky = 0;
+
+	/* update range for options */
+	if (is_set_option('a')) {
+		/* all text */
 		range.rg_start = Text[n].tx_start + 1;
+		range.rg_limit = Text[n].tx_start;
+		range.rg_sticky = 1;
+	}
+
+	if (is_set_option('S')) {
+		/* old text only */
+		range.rg_start = beginning_of_old_text;
 		range.rg_limit = end_of_text;
 		range.rg_sticky = 0;
+	}
 
-		/* update range for options */
-		if (is_set_option('a')) {
-			/* all text */
-			range.rg_start = Text[n].tx_start + 1;
-			range.rg_limit = Text[n].tx_start;
-			range.rg_sticky = 1;
-		}
-
-		if (is_set_option('S')) {
-			/* old text only */
-			range.rg_start = beginning_of_old_text;
-			range.rg_limit = end_of_text;
+	if (is_set_option('s')) {
+		if (	/* n in range */
+			range.rg_start == Text[n].tx_start + 1
+		) {	/* take it out */
+			range.rg_start = Text[n].tx_limit;
 			range.rg_sticky = 0;
 		}
+	}
 
-		if (is_set_option('s')) {
-			if (	/* n in range */
-				range.rg_start == Text[n].tx_start + 1
-			) {	/* take it out */
-				range.rg_start = Text[n].tx_limit;
-				range.rg_sticky = 0;
-			}
-		}
-
-		if (is_empty_range(&range)) continue;
+	if (is_empty_range(&range)) return;
 
-		/* compare the files */
-		if (is_set_option('e')) {
-			/* over the range in steps of one */
-			int m;
+	/* compare the files */
+	if (is_set_option('e')) {
+		/* over the range in steps of one */
+		int m;
 
-			for (m = n; m < Number_of_Texts; m++) {
-				compare_one_on_one(n, m, &range);
-			}
-			for (m = 0; m < n; m++) {
-				compare_one_on_one(n, m, &range);
-			}
+		for (m = n; m < Number_of_Texts; m++) {
+			compare_one_on_one(n, m, &range, rb);
 		}
-		else {
-			/* the whole range in one action */
-			compare_one_text(n, &range);
+		for (m = 0; m < n; m++) {
+			compare_one_on_one(n, m, &range, rb);
 		}
 	}
+	else {
+		/* the whole range in one action */
+		compare_one_text(n, &range, rb);
+	}
 }
 
 static void
 compare_one_on_one(
 	int n,				/* index of text to be compared */
 	int m,				/* index of text to be compared to */
-	struct range *rg		/* pointer to search range */
+	struct range *rg,		/* pointer to search range */
+	struct run_buffer *rb		/* where to put the runs, if not 0 */
 ) {
 	const struct text *txt1 = &Text[m];
 	if (!in_range(txt1->tx_start+1, rg)) return;
+	if (Is_Duplicate_Text(m)) {
+		/* its runs are copies of those of its representative (-Z) */
+		return;
+	}
+
+	const struct carried_run *cr;
+	size_t n_runs;
+	if (Incremental_Name && Is_Carried_Over(n, m, &cr, &n_runs)) {
+		/* the runs of the previous run still hold (-U) */
+		struct text *txt0 = &Text[n];
+		size_t i;
+
+		for (i = 0; i < n_runs; i++) {
+			enter_run(rb, txt0, txt0->tx_start + cr[i].cr_i0,
+				&Text[m], Text[m].tx_start + cr[i].cr_i1,
+				cr[i].cr_size);
+		}
+		return;
+	}
+	if (n != m && !Have_Common_Chain(n, m)) {
+		/* they have no window in common */
+		return;
+	}
 
 	/* construct private range consisting of Text[m] */
 	struct range range_m;
@@ -139,16 +319,37 @@ compare_one_on_one(
 	range_m.rg_sticky = 0;
 
 	/* compare Text[n] and Text[m] */
-	compare_one_text(n, &range_m);
+	compare_one_text(n, &range_m, rb);
+}
+
+static int
+may_reach_threshold(const struct text *txt0, size_t i0, size_t found) {
+	/*	Under -p, the runs found so far cover found tokens of txt0, and
+		the tokens from i0 on have not been scanned yet; each token is
+		in at most one run, so no text can get a higher share of txt0
+		than found + the rest. The test keeps a margin of a percent, to
+		be safe from the rounding in the printing of the percentages.
+	*/
+	size_t size0 = txt0->tx_limit - txt0->tx_start;
+	size_t bound = found + (txt0->tx_limit - i0);
+
+	return (bound + 1) * 100 >= (size_t)(Threshold_Percentage - 1) * size0;
 }
 
 static void
 compare_one_text(
 	int n,				/* index of text to be compared */
-	struct range *rg		/* pointer to search range */
+	struct range *rg,		/* pointer to search range */
+	struct run_buffer *rb		/* where to put the runs, if not 0 */
 ) {
 	struct text *txt0 = &Text[n];
 	size_t i0 = txt0->tx_start;
+	struct search_counts sc = {0, 0, 0, 0, 0, 0};	/* for -D */
+	/* under -p with a threshold, the scan stops as soon as no text can
+	   reach it any more
+	*/
+	int pruning = is_set_option('p') && Threshold_Percentage > 1;
+	size_t found = 0;		/* tokens of txt0 in runs with others */
 
 #ifdef	DB_COMP
 	fprintf(Debug_File, "compare_one_text(%s", txt0->tx_fname);
@@ -168,7 +369,7 @@ compare_one_text(
 			struct text *txt_run;
 			size_t i_run;
 			size_t run_size =
-				lcs(txt0, i0, rg, &txt_run, &i_run);
+				lcs(txt0, i0, rg, &txt_run, &i_run, &sc);
 
 			if (run_size) {
 				/* run found; enter it */
@@ -178,7 +379,11 @@ compare_one_text(
 					txt0->tx_fname, i0,
 					txt_run->tx_fname, i_run, run_size);
 #endif
-				add_run(txt0, i0, txt_run, i_run, run_size);
+				enter_run(rb,
+					txt0, i0, txt_run, i_run, run_size);
+				if (txt_run != txt0) {
+					found += run_size;
+				}
 				/* and skip it */
 				i0 += run_size;
 			}
@@ -187,11 +392,20 @@ compare_one_text(
 				i0++;
 			}
 		}
+		if (pruning && !may_reach_threshold(txt0, i0, found)) {
+			/* what is left cannot make up for what has been
+			   missed
+			*/
+			break;
+		}
 		if (rg->rg_sticky) {
 			/* drag rg->rg_start along */
 			rg->rg_start = i0 - 1;
 		}
 	}
+	if (is_set_option('D')) {
+		Add_Search_Counts(&sc);
+	}
 }
 
 #ifdef	DB_COMP_2
@@ -208,20 +422,52 @@ fprint_tokens(FILE *o, size_t p0, size_t p1) {
 
 static size_t
 first_forward_ref_for(size_t i0, const struct range *rg) {
+	/*	Under -e the range is a single text and under -S the old
+		texts, so the part of the chain of i0 in front of it is passed
+		a text or a region at a time (see Forward_Skip()).
+	*/
+	int skipping = is_set_option('e') || is_set_option('S');
 	size_t res = Forward_Reference(i0, i0);
 	while (res && !in_range(res, rg)) {
-		res = Forward_Reference(res, i0);
+		if (	/* the chain has passed the range for good */
+			!is_set_option('a') && rg->rg_start <= rg->rg_limit
+		&&	res >= rg->rg_limit
+		) {
+			return 0;
+		}
+		res = (skipping ? Forward_Skip(res, i0)
+			: Forward_Reference(res, i0));
 	}
 	return res;
 }
 
+static size_t
+room_to_extend(size_t room0, size_t room1,
+	size_t i0, size_t i1, size_t j0, size_t j1
+) {
+	/*	Returns the number of steps j0 and j1 can be moved forward
+		while j0 is still inside txt0 (at most room0 steps), j1 is still
+		inside txt1 (at most room1 steps), and j0 and j1 don't overlap,
+		that is, (j0 < i1 || j1 < i0).
+	*/
+	size_t room = (room0 < room1 ? room0 : room1);
+	size_t no_overlap =
+		(	i0 < i1 ? (j0 < i1 ? i1 - j0 : 0)
+		:	i1 < i0 ? (j1 < i0 ? i0 - j1 : 0)
+		:	0
+		);
+
+	return (no_overlap < room ? no_overlap : room);
+}
+
 static size_t
 lcs(	struct text *txt0,		/* text to be compared */
 	size_t i0,			/* starting pos. in txt0 */
 	struct range *rg,		/* search range */
 	/* two output parameters, set if return value > 0: */
 	struct text **tx_bp,		/* output, text of best run */
-	size_t *i_bp			/* starting pos. in text of best run */
+	size_t *i_bp,			/* starting pos. in text of best run */
+	struct search_counts *sc	/* the work done is counted here */
 ) {
 	/*	Finds the longest common substring (not subsequence) in:
 			txt0, starting precisely at i0 and
@@ -231,10 +477,15 @@ lcs(	struct text *txt0,		/* text to be compared */
 	*/
 	size_t i1;
 	size_t size_best = 0;
+	size_t n_hops = 0;
 
 	if (!(txt0->tx_start <= i0 && i0 < txt0->tx_limit))
 		fatal("i0 not inside txt0");
 
+	if (is_set_option('X')) {
+		return lcs_by_suffix_array(txt0, i0, rg, tx_bp, i_bp);
+	}
+
 #ifdef	DB_COMP
 	fprintf(Debug_File,
 		"lcs(i0 = %d, rg_start = %d, rg_limit = %d), FWR[i0] = %d, ffr[i0] = %d\n",
@@ -249,33 +500,10 @@ lcs(	struct text *txt0,		/* text to be compared */
 		i1 = Forward_Reference(i1, i0)
 	) {
 		/* i1 is always on the forward reference chain of i0 */
+		n_hops++;
 
 		/* Find the text txt1 into which i1 points. */
-#if	0
-		/* by sequential search */
-		struct text *txt1 = txt0;
-		while (i1 < txt1->tx_start) {
-			txt1--;
-		}
-		while (i1 >= txt1->tx_limit) {
-			txt1++;
-		}
-#else
-		/* by binary search */
-		struct text *txt1;
-		{	struct text *txt_b = &Text[0];
-			struct text *txt_e = &Text[Number_of_Texts-1];
-			while (txt_b != txt_e) {
-				struct text *txt_m = txt_b + (txt_e-txt_b) / 2;
-				if (i1 < txt_m->tx_limit) {
-					txt_e = txt_m;
-				} else {
-					txt_b = txt_m + 1;
-				}
-			}
-			txt1 = txt_b;
-		}
-#endif
+		struct text *txt1 = Text_Containing(i1);
 		if (!(txt1->tx_start <= i1 && i1 < txt1->tx_limit))
 			fatal("i1 not inside txt1");
 
@@ -284,7 +512,7 @@ lcs(	struct text *txt0,		/* text to be compared */
 			txt0->tx_fname, i0, txt1->tx_fname, i1);
 #endif
 
-		size_t better_size = (size_best ? size_best+1 : Min_Run_Size);
+		size_t better_size = (size_best ? size_best+1 : (size_t)Min_Run_Size);
 
 		/* Are we looking at something better than we have got? */
 		{	/* we compare backwards from the end of
@@ -310,9 +538,9 @@ lcs(	struct text *txt0,		/* text to be compared */
 				*/
 				/* since we have perfect forward references and
 				   check backwards, we do not have to check the
-				   last Min_Run_Size tokens:
+				   last Window_Size tokens:
 				*/
-				size_t cnt = better_size - Min_Run_Size;
+				size_t cnt = better_size - Window_Size;
 
 #ifdef	DB_COMP
 				fprintf(Debug_File,
@@ -326,12 +554,12 @@ lcs(	struct text *txt0,		/* text to be compared */
 #endif
 				fprintf(Debug_File, "\n");
 #endif
-				while (	cnt
-				&&	Token_EQ(Token_Array[j0],
-						 Token_Array[j1])
-				) {
-					cnt--, j0--, j1--;
-				}
+				/* tokens j0-cnt+1 .. j0 and j1-cnt+1 .. j1 */
+				cnt -= Common_Suffix_Size(
+					&Token_Array[j0 + 1 - cnt],
+					&Token_Array[j1 + 1 - cnt],
+					cnt
+				);
 #ifdef	DB_COMP
 				fprintf(Debug_File,
 					"end verification: cnt = %d\n", cnt);
@@ -339,14 +567,17 @@ lcs(	struct text *txt0,		/* text to be compared */
 				if (cnt) {
 					/* not all tokens matched,
 					   so forget it */
+					sc->sc_n_rejected++;
 					continue;
 				}
 			} else {
 				/* no, there is not enough room for a better
 				   match, so forget it */
+				   sc->sc_n_no_room++;
 				   continue;
 			}
 		}
+		sc->sc_n_extended++;
 
 		/* Yes, we are looking at a better match;
 		   how long can we make it?
@@ -356,17 +587,14 @@ lcs(	struct text *txt0,		/* text to be compared */
 			size_t j0 = i0 + better_size;
 			size_t j1 = i1 + better_size;
 
-			while (	/* j0 still inside txt0 */
-				j0 < txt0->tx_limit
-			&&	/* j1 still inside txt1 */
-				j1 < txt1->tx_limit
-			&&	/* j0 and j1 don't overlap */
-				(j0 < i1 || j1 < i0)
-			&&	/* tokens are the same */
-				Token_EQ(Token_Array[j0], Token_Array[j1])
-			) {
-				j0++, j1++, new_size++;
-			}
+			/* find how far j0 and j1 may go */
+			size_t room = room_to_extend(txt0->tx_limit - j0,
+				txt1->tx_limit - j1, i0, i1, j0, j1);
+
+			/* and see how far the tokens are the same */
+			new_size += Common_Prefix_Size(
+				&Token_Array[j0], &Token_Array[j1], room
+			);
 		}
 #ifdef	DB_COMP
 		fprintf(Debug_File,
@@ -379,7 +607,7 @@ lcs(	struct text *txt0,		/* text to be compared */
 		new_size = Best_Run_Size(&Token_Array[i0], new_size);
 
 		if (	/* we still have an acceptable run */
-			new_size >= Min_Run_Size
+			new_size >= (size_t)Min_Run_Size
 		&&	/* it is still better than what we had */
 			new_size > size_best
 		) {
@@ -396,6 +624,11 @@ lcs(	struct text *txt0,		/* text to be compared */
 		}
 		/* and see if it can be improved with a different i1 */
 	}
+	sc->sc_n_searches++;
+	sc->sc_n_hops += n_hops;
+	if (n_hops > sc->sc_longest_chain) {
+		sc->sc_longest_chain = n_hops;
+	}
 #ifdef	DB_COMP
 	fprintf(Debug_File, "lcs out, size_best = %d\n",
 		size_best);
@@ -404,9 +637,307 @@ lcs(	struct text *txt0,		/* text to be compared */
 	return size_best;
 }
 
+							/* SUFFIX ARRAY */
+/*	Under the -X option the candidates for i1 are not found by following
+	the forward reference chain of i0 but from the suffix array: they are
+	the positions whose suffixes lie close to that of i0 in the array.
+	Going away from i0 in the array in either direction, the common prefix
+	with i0 can only shrink, so the search stops as soon as it has become
+	too short to yield anything better than what has been found.
+
+	The result is the same as that of the forward references: the size
+	is found from the longest raw match, since Best_Run_Size() can only
+	shorten a run and all raw matches at least as long as the accepted
+	size are accepted with that size; of those, the one that comes first
+	on the forward reference chain is taken.
+*/
+
+struct sa_search {
+	size_t ss_i0;
+	const struct range *ss_rg;
+	int ss_circular;		/* Boolean, the chains would be circular */
+	int ss_ahead_only;		/* Boolean, only i1 > i0 qualifies */
+};
+
+static size_t
+chain_distance(const struct sa_search *ss, size_t i1) {
+	/* how far i1 would be from i0 on the forward reference chain */
+	size_t i0 = ss->ss_i0;
+
+	return (i1 > i0 ? i1 - i0 : i1 + Token_Array_Length() - i0);
+}
+
+static size_t
+candidate_size(const struct sa_search *ss, size_t i1, size_t common) {
+	/*	Returns the size of the match between i0 and i1, given that
+		their suffixes have common tokens in common, or 0 if i1 is
+		not a candidate.
+	*/
+	size_t i0 = ss->ss_i0;
+
+	if (!in_range(i1, ss->ss_rg)) return 0;
+	if (i1 < i0 && (!ss->ss_circular || ss->ss_ahead_only)) return 0;
+
+	/* the match may not overlap */
+	size_t distance = (i0 < i1 ? i1 - i0 : i0 - i1);
+	return (common < distance ? common : distance);
+}
+
+static int
+is_chain_broken_off(const struct sa_search *ss) {
+	/*	Finds out if the forward reference chain of i0 has a position
+		after i0 in the range, followed by one outside it; if so, the
+		chain is not followed to the positions before i0.
+	*/
+	size_t r0 = Suffix_Rank(ss->ss_i0);
+	int ahead = 0;
+	int outside = 0;
+	size_t r;
+
+	for (	r = r0;
+		r > 1 && Suffix_LCP(r) >= (size_t)Min_Run_Size;
+		r--
+	) {
+		size_t i1 = Suffix_At(r-1);
+		if (!in_range(i1, ss->ss_rg)) outside = 1;
+		else if (i1 > ss->ss_i0) ahead = 1;
+		if (ahead && outside) return 1;
+	}
+	for (	r = r0 + 1;
+		r < Suffix_Array_Limit() && Suffix_LCP(r) >= (size_t)Min_Run_Size;
+		r++
+	) {
+		size_t i1 = Suffix_At(r);
+		if (!in_range(i1, ss->ss_rg)) outside = 1;
+		else if (i1 > ss->ss_i0) ahead = 1;
+		if (ahead && outside) return 1;
+	}
+	return 0;
+}
+
+static size_t
+longest_candidate(const struct sa_search *ss) {
+	/* the size of the longest candidate match; 0 if none */
+	size_t r0 = Suffix_Rank(ss->ss_i0);
+	size_t size_best = 0;
+	size_t need = Min_Run_Size;	/* what a candidate needs to count */
+	size_t common;
+	size_t r;
+
+	common = (size_t)-1;
+	for (r = r0; r > 1; r--) {
+		size_t lcp = Suffix_LCP(r);
+		if (lcp < common) common = lcp;
+		if (common < need) break;
+
+		size_t i1 = Suffix_At(r-1);
+		size_t size = candidate_size(ss, i1, common);
+		if (size >= need) {
+			size_best = size;
+			need = size + 1;
+		}
+	}
+
+	common = (size_t)-1;
+	for (r = r0 + 1; r < Suffix_Array_Limit(); r++) {
+		size_t lcp = Suffix_LCP(r);
+		if (lcp < common) common = lcp;
+		if (common < need) break;
+
+		size_t i1 = Suffix_At(r);
+		size_t size = candidate_size(ss, i1, common);
+		if (size >= need) {
+			size_best = size;
+			need = size + 1;
+		}
+	}
+
+	return size_best;
+}
+
+static size_t
+first_candidate_of_size(const struct sa_search *ss, size_t size) {
+	/*	Of the candidates with a match of at least size tokens,
+		returns the one closest to i0 on the forward reference chain.
+	*/
+	size_t r0 = Suffix_Rank(ss->ss_i0);
+	size_t i_best = 0;
+	size_t common;
+	size_t r;
+
+	common = (size_t)-1;
+	for (r = r0; r > 1; r--) {
+		size_t lcp = Suffix_LCP(r);
+		if (lcp < common) common = lcp;
+		if (common < size) break;
+
+		size_t i1 = Suffix_At(r-1);
+		if (	candidate_size(ss, i1, common) >= size
+		&&	(	!i_best
+			||	chain_distance(ss, i1) < chain_distance(ss, i_best)
+			)
+		) {
+			i_best = i1;
+		}
+	}
+
+	common = (size_t)-1;
+	for (r = r0 + 1; r < Suffix_Array_Limit(); r++) {
+		size_t lcp = Suffix_LCP(r);
+		if (lcp < common) common = lcp;
+		if (common < size) break;
+
+		size_t i1 = Suffix_At(r);
+		if (	candidate_size(ss, i1, common) >= size
+		&&	(	!i_best
+			||	chain_distance(ss, i1) < chain_distance(ss, i_best)
+			)
+		) {
+			i_best = i1;
+		}
+	}
+
+	return i_best;
+}
+
+static size_t
+lcs_by_suffix_array(
+	struct text *txt0,		/* text to be compared */
+	size_t i0,			/* starting pos. in txt0 */
+	struct range *rg,		/* search range */
+	/* two output parameters, set if return value > 0: */
+	struct text **tx_bp,		/* output, text of best run */
+	size_t *i_bp			/* starting pos. in text of best run */
+) {
+	/* As lcs(), but using the suffix array */
+	struct sa_search ss;
+	size_t i1;
+
+	(void)txt0;		/* the suffix array knows the texts */
+
+	ss.ss_i0 = i0;
+	ss.ss_rg = rg;
+	ss.ss_circular = is_set_option('a');
+	ss.ss_ahead_only = 0;
+	if (ss.ss_circular && !rg->rg_sticky && in_range(i0, rg)) {
+		/*	The chain from i0 passes through the range after i0,
+			may leave it, and enters it again before i0. The chain
+			is followed only as long as it stays in the range.
+		*/
+		ss.ss_ahead_only = is_chain_broken_off(&ss);
+	}
+
+	size_t raw_size = longest_candidate(&ss);
+	if (raw_size == 0) return 0;
+
+	size_t size = Best_Run_Size(&Token_Array[i0], raw_size);
+	if (size < (size_t)Min_Run_Size) return 0;
+
+	/* a raw match shorter than raw_size may come earlier on the chain */
+	i1 = first_candidate_of_size(&ss, size);
+
+#ifdef	DB_COMP
+	fprintf(Debug_File, "lcs_by_suffix_array(i0 = %d) = %d at %d\n",
+		i0, size, i1);
+#endif
+	*tx_bp = Text_Containing(i1);
+	*i_bp = i1;
+	return size;
+}
+
+static int sweeping;			/* Boolean, keep the index */
+static int have_index;			/* Boolean */
+
+void
+Start_Sweep(void) {
+	sweeping = 1;
+}
+
+static void
+free_index(void) {
+	if (is_set_option('X')) {
+		Free_Suffix_Array();
+	}
+	else {
+		Free_Forward_References();
+	}
+	have_index = 0;
+}
+
+void
+End_Sweep(void) {
+	if (have_index) {
+		free_index();
+	}
+	sweeping = 0;
+}
+
 void
 Compare_Files(void) {
-	Make_Forward_References();
+	Make_Text_Map();
+	Prepare_Best_Run_Size();
+	if (is_set_option('x')) {
+		Make_Sketches();
+	}
+	if (!have_index) {
+		/* under -Z, for the representatives only */
+		Hide_Duplicate_Texts();
+		if (is_set_option('X')) {
+			Make_Suffix_Array();
+		}
+		else {
+			Make_Forward_References();
+		}
+		Show_Duplicate_Texts();
+		have_index = 1;
+	}
 	compare_texts();
+	if (!sweeping) {
+		free_index();
+	}
+	if (is_set_option('x')) {
+		Free_Sketches();
+	}
+	Free_Text_Map();
+}
+
+void
+Prepare_Old_Files(void) {
+	Make_Text_Map();
+	Make_Forward_References();
+	Make_Old_Windows();
+}
+
+void
+Compare_To_Old_Files(int n) {
+	struct range range;
+
+	/* the old texts are all texts before Text[n] */
+	beginning_of_text = Text[0].tx_start;
+	beginning_of_old_text = beginning_of_text;
+	end_of_text = Text[n].tx_limit;
+	range.rg_start = beginning_of_old_text;
+	range.rg_limit = Text[n].tx_start;
+	range.rg_sticky = 0;
+	if (is_empty_range(&range)) return;
+
+	Add_Forward_References(&Text[n]);
+	Prepare_Best_Run_Size();
+	if (is_set_option('e')) {
+		int m;
+
+		for (m = 0; m < n; m++) {
+			compare_one_on_one(n, m, &range, 0);
+		}
+	}
+	else {
+		compare_one_text(n, &range, 0);
+	}
+	Remove_Forward_References();
+}
+
+void
+Release_Old_Files(void) {
 	Free_Forward_References();
+	Free_Text_Map();
 }
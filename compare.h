@@ -9,3 +9,21 @@
 */
 
 extern void Compare_Files(void);
+
+/*	Under -r N,N,... the texts are compared once for each run size, in
+	increasing order. Between Start_Sweep() and End_Sweep(),
+	Compare_Files() keeps the forward references or the suffix array it
+	makes the first time, for the smallest run size, and uses them for
+	the next ones; End_Sweep() frees them.
+*/
+extern void Start_Sweep(void);
+extern void End_Sweep(void);
+
+/*	Under -q (see query.h), the old texts are prepared once by
+	Prepare_Old_Files(); then Compare_To_Old_Files(n) compares Text[n],
+	the last text, which follows them, with the old texts only, as -S
+	would. Release_Old_Files() frees what Prepare_Old_Files() made.
+*/
+extern void Prepare_Old_Files(void);
+extern void Compare_To_Old_Files(int n);
+extern void Release_Old_Files(void);
@@ -28,38 +28,179 @@
 	reduced the total forward chain length from 103555 to 345, as
 	determined by db_forward_reference_check().
 
+	For larger values of Min_Run_Size the full comparisons dominate the
+	second sweep. Then a 64-bit fingerprint of each window is computed
+	first, by a polynomial rolling hash, and kept in fingerprint[]; two
+	windows can only be equal if their fingerprints are, so most of the
+	full comparisons are replaced by a single integer comparison. The
+	forward references remain perfect, since a full comparison is still
+	done when the fingerprints are equal.
+
+	The rolling hash of the windows can be chosen with -H, from the
+	families in window_hash_family[]: the original 32-bit rotate-and-XOR
+	("xor"), a 64-bit polynomial hash ("poly") and a 64-bit buzhash
+	("buz"), which scrambles each token first. The rotate-and-XOR
+	hash loses the oldest token entirely when Min_Run_Size * SHIFT is a
+	multiple of 32, and repetitive token patterns collide under it;
+	the 64-bit families are folded to 32 bits for the hash table. For a
+	64-bit family the fingerprints are the same hash values; for "xor"
+	they are polynomial. Under -D the total forward chain length is
+	reported after the hashing and after the second sweep, so the
+	families can be compared (see the Makefile target hash_bench).
+
 	The forward references can be checked with db_forward_reference_check(),
 	which also collects statistics.
 */
 
 #include	<stdio.h>
 #include	<stdint.h>
+#include	<string.h>
 
 #include	"system.par"
+#include	"settings.par"
 #include	"debug.par"
 #include	"sim.h"
 #include	"text.h"
 #include	"Malloc.h"
+#include	"mapped.h"
+#include	"memstat.h"
 #include	"any_int.h"
 #include	"token.h"
 #include	"properties.h"
 #include	"token.h"
 #include	"tokenarray.h"
 #include	"options.h"
+#include	"parallel.h"
+#include	"stats.h"
+#include	"progress.h"
 #include	"hash.h"
 
 							/* MAIN ENTRIES */
-static size_t *forward_reference;		/* to be filled by Malloc() */
+static Index *forward_reference;		/* to be filled by Malloc() */
 static size_t n_forward_references;
 
 static void make_forward_references_using_hash(void);
-static void make_forward_references_perfect(void);
-static void make_chains_circular(void);
+static void make_chain_skips(void);
+static void free_chain_skips(void);
+static void make_chain_lists(void);
+static void free_chain_lists(void);
+static int link_chains_in_buckets(void);
 
 							/* HASHING */
-static size_t *latest_index;
+static Index *latest_index;
 static size_t latest_index_table_size;
 
+/* hash values of windows known from an index, see textindex.h */
+static const uint32_t *known_hash;
+static size_t known_start, known_limit;
+
+							/* FINGERPRINTS */
+static uint64_t *fingerprint;			/* to be filled by Malloc() */
+#define	FINGERPRINT_BASE	UINT64_C(0x100000001B3)	/* odd, so invertible */
+static uint64_t fingerprint_base_power;		/* BASE^Min_Run_Size */
+
+							/* HASH FAMILIES */
+#define	HASH_XOR	0
+#define	HASH_POLY	1
+#define	HASH_BUZ	2
+
+static const char *window_hash_family[] = {"xor", "poly", "buz", 0};
+
+const char *Window_Hash_Name = "xor";
+int Window_Size;
+static int window_family = HASH_XOR;	/* for the hash table */
+static int fingerprint_family = HASH_POLY;
+
+#define	SHIFT	(5)			/* of the rotate-and-XOR hash */
+static int xor_oldest_shift;		/* of the oldest token in the window */
+static int buz_oldest_shift;
+
+/* the shift counts are taken modulo the width, so a shift by 0 is safe */
+#define	Left_Circular_32(i, s)	(((i) << (s)) | ((i) >> ((32-(s)) & 31)))
+#define	Left_Circular_64(i, s)	(((i) << (s)) | ((i) >> ((64-(s)) & 63)))
+
+/* the window hash totals, for -D */
+static size_t n_chain_links;		/* before the second sweep */
+static size_t n_perfect_links;		/* after it */
+
+void
+Select_Window_Hash(void) {
+	int f;
+
+	for (f = 0; window_hash_family[f]; f++) {
+		if (strcmp(Window_Hash_Name, window_hash_family[f]) == 0) {
+			window_family = f;
+			fingerprint_family = (f == HASH_XOR ? HASH_POLY : f);
+			return;
+		}
+	}
+	fatal("unknown window hash; use xor, poly or buz");
+}
+
+static void
+set_window_hash_parameters(void) {
+	int k;
+
+	fingerprint_base_power = 1;
+	for (k = 0; k < Min_Run_Size; k++) {
+		fingerprint_base_power *= FINGERPRINT_BASE;
+	}
+	xor_oldest_shift = ((Min_Run_Size-1) * SHIFT) % 32;
+	buz_oldest_shift = (Min_Run_Size-1) % 64;
+}
+
+static uint64_t
+scrambled(Token tk) {
+	/* the finalizer of SplitMix64, for the buzhash */
+	uint64_t z = (uint64_t)Token2int(tk) + UINT64_C(0x9E3779B97F4A7C15);
+
+	z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+	return z ^ (z >> 31);
+}
+
+static uint64_t
+rolled(int family, uint64_t v, Token new_tk, const Token *oldest) {
+	/*	The hash value v of a window, with the token new_tk added
+		and, if oldest is not 0, the token *oldest removed.
+	*/
+	switch (family) {
+	case HASH_XOR: {
+		uint32_t h = (uint32_t)v;
+
+		if (oldest) {
+			uint32_t oldest_value = (uint32_t)Token2int(*oldest);
+			h ^= Left_Circular_32(oldest_value, xor_oldest_shift);
+		}
+		h = Left_Circular_32(h, SHIFT);
+		return h ^ (uint32_t)Token2int(new_tk);
+	}
+	case HASH_POLY:
+		v = v * FINGERPRINT_BASE + (uint64_t)Token2int(new_tk);
+		if (oldest) {
+			v -= fingerprint_base_power *
+			     (uint64_t)Token2int(*oldest);
+		}
+		return v;
+	case HASH_BUZ:
+	default:
+		if (oldest) {
+			uint64_t oldest_value = scrambled(*oldest);
+			v ^= Left_Circular_64(oldest_value, buz_oldest_shift);
+		}
+		v = Left_Circular_64(v, 1);
+		return v ^ scrambled(new_tk);
+	}
+}
+
+static uint32_t
+hash_value(uint64_t v) {
+	/* the 32-bit hash value of the window hash value v */
+	if (window_family == HASH_XOR) return (uint32_t)v;
+	/* the top bits of a multiplicative hash are the best ones */
+	return (uint32_t)((v * UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+}
+
 #ifdef	DB_FORW_REF
 #include	"hash_db.i"
 #endif	/* DB_FORW_REF */
@@ -112,12 +253,12 @@ static const uint64_t prime[] = {
 };
 
 static void
-init_hash_table(void) {
+init_hash_table(size_t n_tokens) {
 	int n;
 
 	/* find the ideal hash table size */
 	n = 0;
-	while (prime[n] < Token_Array_Length()) {
+	while (prime[n] < n_tokens) {
 		n++;
 		/* this will always terminate, if prime[] is large enough */
 	}
@@ -130,109 +271,254 @@ init_hash_table(void) {
 	        n >= 0
 	) {
 		latest_index_table_size = prime[n];
-		latest_index = (size_t *)
-			TryCalloc(latest_index_table_size, sizeof (size_t));
+		latest_index = (Index *)
+			TryMap_Calloc(latest_index_table_size, sizeof (Index));
 		n--;
 	}
 	if (!latest_index) {
 		fatal("out of memory: no room for hash table");
 	}
+	Count_Memory(MEM_LATEST_INDEX,
+		latest_index_table_size * sizeof (Index));
+	Map_Advise(latest_index, Map_Random);
 }
 
 static void
-make_forward_references_using_hash(void) {
-	int n;
+free_hash_table(void) {
+	Map_Free(latest_index);
+	Uncount_Memory(MEM_LATEST_INDEX,
+		latest_index_table_size * sizeof (Index));
+}
 
-	init_hash_table();
+static size_t counted_forward_references;	/* for memstat.h */
 
-	/* Set up the forward references using the latest_index[] hash table. */
-	for (n = 0; n < Number_of_Texts; n++) {
-		const struct text *txt = &Text[n];
-		size_t j;
-		uint32_t hash = 0;
-
-#define	Left_Circular_32(i, s)	(((i) << (s)) | ((i) >> (32-(s))))
-#define	SHIFT	(5)
-
-		for (j = txt->tx_start;	j < txt->tx_limit; j++) {
-			if (	/* we have a complete hash value */
-				j - txt->tx_start >= Min_Run_Size
-			) {	/* remove the oldest token */
-				/* this should be a routine,
-				   but it is too active code for that */
-				int oldest_value =
-				    Token2int(Token_Array[j - Min_Run_Size]);
-				int oldest_shift =
-				    ((Min_Run_Size-1) * SHIFT) % 32;
-				hash ^=
-				    Left_Circular_32(
-				        oldest_value, oldest_shift
-				    );
-			}
-			/* Circular left shift */
-			hash = Left_Circular_32(hash, SHIFT);
-			/* Add new token */
-			hash ^= Token2int(Token_Array[j]);
-
-			/* If have we assembled a complete hash value now,
-			   the corresponding run would start at
-			   j - (Min_Run_Size - 1). For it to be valid it
-			   should start at or after txt->tx_start, so we would
-			   like to write the test
-			   j - (Min_Run_Size - 1) >= txt->tx_start. However,
-			   the type of this computation is size_t, which is
-			   unsigned, and j - (Min_Run_Size - 1) may be negative,
-			   so we code instead:
-			*/
-			if (j - txt->tx_start < (Min_Run_Size - 1)) {
-				/* no */
-				continue;
-			}
+static void
+count_forward_references(size_t n) {
+	/* forward_reference[] has been allocated for n positions now */
+	Uncount_Memory(MEM_FORWARD_REFERENCES,
+		counted_forward_references * sizeof (Index));
+	counted_forward_references = n;
+	Count_Memory(MEM_FORWARD_REFERENCES, n * sizeof (Index));
+}
 
-			/* We now have the complete hash value for a run ending
-			   at j and can safely compute j - (Min_Run_Size - 1).
+static int
+has_known_hashes(const struct text *txt) {
+	return	known_hash
+	&&	known_start <= txt->tx_start && txt->tx_limit <= known_limit;
+}
+
+static void
+hash_text(const struct text *txt, uint32_t *window_hash, uint32_t *raw_hash) {
+	/*	Computes the hash values of the Min_Run_Size windows in txt.
+		If raw_hash is not 0, the hash values are stored in raw_hash[]
+		as they are, for all windows. Otherwise, if window_hash is 0,
+		the windows are entered in the chains directly through
+		latest_index[]; if it is not, the hash values are stored in
+		window_hash[] and the chains are built later.
+		If the hash values of txt are known from an index (see
+		Set_Known_Window_Hashes()), they are not computed again.
+	*/
+	size_t j;
+	uint64_t v = 0;
+	uint32_t hash = 0;
+	int known = has_known_hashes(txt);
+
+	for (j = txt->tx_start;	j < txt->tx_limit; j++) {
+		if (known) {
+			/* no need to compute the hash value */
+		}
+		else {
+			/* add the new token, and remove the oldest token
+			   if we have a complete hash value
 			*/
-			size_t run_start = j - (Min_Run_Size - 1);
+			v = rolled(window_family, v, Token_Array[j],
+				(j - txt->tx_start >= (size_t)Min_Run_Size ?
+					&Token_Array[j - Min_Run_Size] : 0));
+			hash = hash_value(v);
+		}
 
-			/* Can the run be useful? */
-			if (!May_Be_Start_Of_Run(Token_Array[run_start]))
-				continue;			/* no*/
+		/* If have we assembled a complete hash value now,
+		   the corresponding run would start at
+		   j - (Min_Run_Size - 1). For it to be valid it
+		   should start at or after txt->tx_start, so we would
+		   like to write the test
+		   j - (Min_Run_Size - 1) >= txt->tx_start. However,
+		   the type of this computation is size_t, which is
+		   unsigned, and j - (Min_Run_Size - 1) may be negative,
+		   so we code instead:
+		*/
+		if (j - txt->tx_start < (size_t)(Min_Run_Size - 1)) {
+			/* no */
+			continue;
+		}
 
-			/* the hash value is used here for an index */
-			size_t h = hash % latest_index_table_size;
+		/* We now have the complete hash value for a run ending
+		   at j and can safely compute j - (Min_Run_Size - 1).
+		*/
+		size_t run_start = j - (Min_Run_Size - 1);
+		if (known) {
+			hash = known_hash[run_start - known_start];
+		}
 
-			if (latest_index[h]) {
-				forward_reference[latest_index[h]] = run_start;
-			}
-			/*latest_index[h] = j;*/
-			latest_index[h] = run_start;
+		if (raw_hash) {
+			raw_hash[run_start - txt->tx_start] = hash;
+			continue;
+		}
+
+		/* Can the run be useful? */
+		if (!May_Be_Start_Of_Run(Token_Array[run_start]))
+			continue;			/* no*/
+
+		/* the hash value is used here for an index */
+		size_t h = hash % latest_index_table_size;
+
+		if (window_hash) {
+			/* h < 2^32, since hash < 2^32 */
+			window_hash[run_start] = (uint32_t)h;
+			continue;
+		}
+
+		if (latest_index[h]) {
+			forward_reference[latest_index[h]] = run_start;
+			n_chain_links++;
+		}
+		/*latest_index[h] = j;*/
+		latest_index[h] = run_start;
+	}
+}
+
+void
+Get_Window_Hashes(const struct text *txt, uint32_t *raw_hash) {
+	set_window_hash_parameters();
+	hash_text(txt, 0, raw_hash);
+}
+
+void
+Set_Known_Window_Hashes(size_t start, size_t limit, const uint32_t *raw_hash) {
+	known_start = start;
+	known_limit = limit;
+	known_hash = raw_hash;
+}
+
+static void
+make_forward_references_using_hash(void) {
+	int n;
+
+	init_hash_table(Token_Array_Length());
+
+	if (!link_chains_in_buckets()) {
+		/* Set up the forward references using the latest_index[]
+		   hash table.
+		*/
+		for (n = 0; n < Number_of_Texts; n++) {
+			hash_text(&Text[n], 0, 0);
+			Progress_Done(1, Text[n].tx_limit - Text[n].tx_start);
 		}
 	}
 
-	Free(latest_index);
+	free_hash_table();
 
 #ifdef	DB_FORW_REF
 	db_forward_reference_check("first hashing");
 #endif	/* DB_FORW_REF */
 }
 
+/*	The chains contain each position at most once and never merge, so
+	a position that is pointed to by another position is not the head of
+	its chain. Such positions are first marked, by setting the top bit of
+	their (own) forward reference, which is free since positions are much
+	smaller than that. Then each unmarked position that has a forward
+	reference is the head of a chain; its chain is followed once to the
+	tail, which is tied back to it, and the marks are removed. The total
+	cost is linear in the number of positions.
+*/
+#define	HAS_PREDECESSOR		(MAX_INDEX + 1)		/* top bit */
+
+static void
+mark_successor(size_t i) {
+	size_t j = forward_reference[i] & ~HAS_PREDECESSOR;
+
+	if (j) {
+		forward_reference[j] |= HAS_PREDECESSOR;
+	}
+}
+
+static void
+make_chain_circular(size_t i) {
+	if (forward_reference[i] & HAS_PREDECESSOR) {
+		/* not a head; just remove the mark */
+		forward_reference[i] &= ~HAS_PREDECESSOR;
+		return;
+	}
+	if (!forward_reference[i]) return;
+
+	/* i is the head of a chain; find its tail */
+	size_t j = i;
+	size_t j1;
+	while ((j1 = forward_reference[j] & ~HAS_PREDECESSOR)) {
+		j = j1;
+	}
+	/* tie it back to the beginning of the chain; the tail keeps its
+	   mark, which is removed when its turn comes
+	*/
+	forward_reference[j] = i | HAS_PREDECESSOR;
+}
+
 static void
 make_chains_circular(void) {
 	size_t i;
 
-	/* Make the chains circular, by a slightly quadratic algorithm. */
-	for (i = 0; i+Min_Run_Size < Token_Array_Length(); i++) {
-		if (!forward_reference[i]) continue;
-		size_t j = i;
-		while (forward_reference[j]) {
-			size_t j1 = forward_reference[j];
-			if (j1 < j) break;	/* has already been treated */
-			j = j1;
-		}
-		if (forward_reference[j] == 0 && j != i) {
-			/* tie it back to the beginning of the chain */
-			forward_reference[j] = i;
-		}
+	/* Make the chains circular, in linear time. */
+	for (i = 0; i < Token_Array_Length(); i++) {
+		mark_successor(i);
+	}
+	for (i = 0; i < Token_Array_Length(); i++) {
+		make_chain_circular(i);
+	}
+}
+
+static void
+init_fingerprints(void) {
+	fingerprint = 0;
+	if (Min_Run_Size < MIN_RUN_SIZE_FOR_FINGERPRINTS) return;
+
+	/* they are an optimization only, so we can do without */
+	fingerprint = (uint64_t *)
+		TryMalloc(n_forward_references * sizeof (uint64_t));
+	if (!fingerprint) return;
+}
+
+static void
+fingerprint_text(const struct text *txt) {
+	/*	Sets fingerprint[i] to the 64-bit hash of the window
+		Token_Array[i .. i+Min_Run_Size-1], for all windows in txt.
+	*/
+	size_t j;
+	uint64_t fp = 0;
+
+	for (j = txt->tx_start; j < txt->tx_limit; j++) {
+		fp = rolled(fingerprint_family, fp, Token_Array[j],
+			(j - txt->tx_start >= (size_t)Min_Run_Size ?
+				&Token_Array[j - Min_Run_Size] : 0));
+		if (j - txt->tx_start < (size_t)(Min_Run_Size - 1)) continue;
+
+		fingerprint[j - (Min_Run_Size - 1)] = fp;
+	}
+}
+
+static void
+fingerprint_texts(void) {
+	int n;
+
+	for (n = 0; n < Number_of_Texts; n++) {
+		fingerprint_text(&Text[n]);
+	}
+}
+
+static void
+free_fingerprints(void) {
+	if (fingerprint) {
+		Free(fingerprint); fingerprint = 0;
 	}
 }
 
@@ -241,12 +527,31 @@ is_eq_min_run(const Token *p, const Token *q) {
 	/* a full comparison for the tertiary sweep */
 	size_t n;
 
-	for (n = 0; n < Min_Run_Size; n++) {
+	for (n = 0; n < (size_t)Min_Run_Size; n++) {
 		if (!Token_EQ(p[n], q[n])) return 0;
 	}
 	return 1;
 }
 
+static int
+make_forward_reference_perfect(size_t i) {
+	/* returns 1 if a forward reference remains */
+	size_t j = i;
+
+	while (	/* there is still a forward reference */
+		(j = forward_reference[j])
+	&&	/* it does not match over Min_Run_Size */
+		!(	(!fingerprint || fingerprint[i] == fingerprint[j])
+		&&	is_eq_min_run(&Token_Array[i], &Token_Array[j])
+		)
+	) {
+		/* continue searching */
+	}
+	/* short-circuit forward reference to it, or to zero */
+	forward_reference[i] = j;
+	return (j != 0);
+}
+
 static void
 make_forward_references_perfect(void) {
 	size_t i;
@@ -256,17 +561,7 @@ make_forward_references_perfect(void) {
 	*/
 
 	for (i = 0; i+Min_Run_Size < Token_Array_Length(); i++) {
-		size_t j = i;
-
-		while (	/* there is still a forward reference */
-			(j = forward_reference[j])
-		&&	/* it does not match over Min_Run_Size */
-			!is_eq_min_run(&Token_Array[i], &Token_Array[j])
-		) {
-			/* continue searching */
-		}
-		/* short-circuit forward reference to it, or to zero */
-		forward_reference[i] = j;
+		n_perfect_links += make_forward_reference_perfect(i);
 	}
 	/* now we have perfect forward references */
 
@@ -275,18 +570,867 @@ make_forward_references_perfect(void) {
 #endif	/* DB_FORW_REF */
 }
 
+							/* IN PARALLEL */
+/*	With more than one thread, the construction is done in two phases.
+	In the first phase the hash values of all windows are computed, text
+	by text, and stored in window_hash[]. In the second phase the windows
+	are distributed over buckets by their hash values, as in the blocked
+	construction below, and the threads take the buckets in turns; each
+	builds, makes perfect and possibly makes circular the chains of the
+	hash values in its bucket. All positions on a chain have the same
+	hash value, so the threads never touch each other's entries in
+	forward_reference[] or latest_index[], and since the positions in a
+	bucket are in increasing order, the result is identical to that of
+	the serial construction. Each thread only visits the positions in
+	its own buckets, so the work does not grow with the number of
+	threads. If there is no room for the buckets, the main thread does
+	the second phase.
+
+	The two phases do about twice the work of the serial construction,
+	so they are used only when there is more than one processor and the
+	input is not small, or when the first phase has been done while
+	reading.
+*/
+static uint32_t *window_hash;		/* to be filled by Malloc() */
+static int next_text_to_hash;		/* protected by Lock() */
+
+/* the first phase may have been done while reading, see below */
+static int hashing_while_reading;	/* Boolean */
+static int n_texts_hashed;
+static size_t window_hash_room;
+
+static int
+construction_in_parallel(void) {
+	if (Number_of_Threads <= 1) return 0;
+	/* the windows hashed while reading are in window_hash[] already */
+	if (hashing_while_reading) return 1;
+	return	Number_of_Processors() != 1	/* 0 is unknown */
+	&&	Token_Array_Length() >= MIN_TOKENS_FOR_PARALLEL_HASHING;
+}
+
+static void
+reduce_window_hashes(const struct text *txt) {
+	/* turn the hash values computed while reading into indexes */
+	size_t i;
+
+	for (i = txt->tx_start; i + Min_Run_Size <= txt->tx_limit; i++) {
+		if (May_Be_Start_Of_Run(Token_Array[i])) {
+			window_hash[i] %= latest_index_table_size;
+		}
+	}
+}
+
+static void
+hash_texts_worker(int w, void *arg) {
+	(void)w;
+	(void)arg;
+	for (;;) {
+		Lock();
+		int n = next_text_to_hash++;
+		Unlock();
+		if (n >= Number_of_Texts) break;
+
+		if (!hashing_while_reading) {
+			hash_text(&Text[n], window_hash, 0);
+		}
+		else {
+			reduce_window_hashes(&Text[n]);
+		}
+		if (fingerprint) {
+			fingerprint_text(&Text[n]);
+		}
+		Progress_Done(1, Text[n].tx_limit - Text[n].tx_start);
+	}
+}
+
+static int make_forward_reference_perfect(size_t i);
+static void mark_successor(size_t i);
+static void make_chain_circular(size_t i);
+static int make_window_pairs(int n_workers);
+static void build_bucket_chains_worker(int w, void *arg);
+static void free_window_pairs(void);
+static int next_bucket;			/* protected by Lock() */
+
+static void
+link_chains_serially(void) {
+	/* the second phase in the main thread, if there is no room for
+	   the pairs
+	*/
+	int n;
+	size_t i;
+
+	for (n = 0; n < Number_of_Texts; n++) {
+		const struct text *txt = &Text[n];
+
+		for (i = txt->tx_start; i + Min_Run_Size <= txt->tx_limit; i++) {
+			if (!May_Be_Start_Of_Run(Token_Array[i])) continue;
+
+			size_t h = window_hash[i];
+
+			if (latest_index[h]) {
+				forward_reference[latest_index[h]] = i;
+				n_chain_links++;
+			}
+			latest_index[h] = i;
+		}
+	}
+}
+
+static void
+make_forward_references_in_parallel(void) {
+	if (hashing_while_reading) {
+		/* hash the texts not yet hashed, for example from an index */
+		Hash_Windows_Up_To(Number_of_Texts);
+	}
+	else {
+		window_hash = (uint32_t *)
+			Malloc(n_forward_references * sizeof (uint32_t));
+	}
+	init_hash_table(Token_Array_Length());
+	init_fingerprints();
+
+	next_text_to_hash = 0;
+	Run_Workers(Number_of_Threads, hash_texts_worker, 0);
+
+	if (make_window_pairs(Number_of_Threads)) {
+		/* the pairs hold the hash indexes now */
+		Free(window_hash); window_hash = 0;
+		next_bucket = 0;
+		Run_Workers(Number_of_Threads, build_bucket_chains_worker, 0);
+		free_window_pairs();
+		free_hash_table();
+	}
+	else {
+		link_chains_serially();
+		Free(window_hash); window_hash = 0;
+		free_hash_table();
+		make_forward_references_perfect();
+		if (is_set_option('a')) {
+			make_chains_circular();
+		}
+	}
+	hashing_while_reading = 0;
+
+#ifdef	DB_FORW_REF
+	db_forward_reference_check("parallel construction");
+#endif	/* DB_FORW_REF */
+}
+
+							/* WHILE READING */
+/*	Under -j, Pass 1 can do most of the first phase of the parallel
+	construction for each text as soon as it has been read, while the
+	worker threads lex the texts after it (see Hash_While_Reading in
+	pass1.h). The size of the hash table depends on the total number of
+	tokens, which is not yet known then, so the hash values themselves
+	are stored in window_hash[], which grows with the texts, and the
+	workers of the first phase only reduce them to indexes in the hash
+	table. The forward references are the same as without it.
+*/
+void
+Start_Window_Hashing(size_t estimated_length) {
+	set_window_hash_parameters();
+	window_hash_room = estimated_length + 1;
+	window_hash = (uint32_t *)
+		Malloc(window_hash_room * sizeof (uint32_t));
+	n_texts_hashed = 0;
+	hashing_while_reading = 1;
+}
+
+void
+Hash_Windows_Up_To(int n) {
+	if (!hashing_while_reading) return;
+
+	for (; n_texts_hashed < n; n_texts_hashed++) {
+		const struct text *txt = &Text[n_texts_hashed];
+
+		if (txt->tx_limit > window_hash_room) {
+			while (window_hash_room < txt->tx_limit) {
+				window_hash_room *= 2;
+			}
+			window_hash = (uint32_t *)Realloc(window_hash,
+				window_hash_room * sizeof (uint32_t));
+		}
+		hash_text(txt, 0, &window_hash[txt->tx_start]);
+	}
+}
+
+							/* BLOCKED */
+/*	When latest_index[] is much larger than the caches, linking the
+	windows into the chains costs a cache miss in latest_index[] for
+	nearly every window. The blocked construction avoids these: with the
+	hash indexes of all windows in window_hash[], as in the first phase
+	of the parallel construction, it distributes the windows, as pairs
+	of position and index, over buckets by the high part of the index,
+	each covering a stretch of latest_index[] of about BUCKET_BYTES,
+	and then links the chains bucket by bucket, in the cache. The
+	distribution reads window_hash[] and writes each bucket sequentially.
+	The writes in forward_reference[] are still scattered, but they do
+	not have to wait for a read.
+
+	All positions on a chain have the same index and so are in the same
+	bucket, where they are in increasing order, so the chains are the
+	same as those of the other constructions. The distribution is done
+	by one or more workers, each for a consecutive series of texts, and
+	the buckets are independent of each other, so under -j the workers
+	take them in turns, and make the chains perfect and circular too;
+	there they are used whatever the size of latest_index[], with at
+	least a few buckets per worker. If there is no room for the pairs,
+	the construction is not blocked.
+*/
+struct window_pair {
+	Index wp_position;
+	uint32_t wp_index;		/* in latest_index[] */
+};
+
+static struct window_pair *window_pairs;	/* to be filled by TryMalloc() */
+static size_t *bucket_start;			/* n_buckets + 1 entries */
+static int n_buckets;
+static size_t bucket_span;			/* indexes per bucket */
+
+/* the distribution of the pairs */
+static int *first_text_of;			/* of each worker, and one more */
+static size_t *bucket_count;			/* [w * n_buckets + b] */
+
+static int
+blocking_pays(void) {
+	return latest_index_table_size * sizeof (Index) > BLOCKING_THRESHOLD;
+}
+
+/* loop over the positions of the windows of the texts of worker w */
+#define	for_windows_of_worker(i, w)					\
+    for (n = first_text_of[w]; n < first_text_of[w+1]; n++)		\
+	for (i = Text[n].tx_start; i + Min_Run_Size <= Text[n].tx_limit; i++) \
+	    if (May_Be_Start_Of_Run(Token_Array[i]))
+
+static void
+count_windows_worker(int w, void *arg) {
+	size_t *count = &bucket_count[(size_t)w * n_buckets];
+	int n;
+	size_t i;
+
+	(void)arg;
+
+	for_windows_of_worker(i, w) {
+		count[window_hash[i] / bucket_span]++;
+	}
+}
+
+static void
+distribute_windows_worker(int w, void *arg) {
+	/* the counts have been turned into the places of the pairs */
+	size_t *place = &bucket_count[(size_t)w * n_buckets];
+	int n;
+	size_t i;
+
+	(void)arg;
+
+	for_windows_of_worker(i, w) {
+		uint32_t h = window_hash[i];
+		struct window_pair *wp = &window_pairs[place[h / bucket_span]++];
+
+		wp->wp_position = i;
+		wp->wp_index = h;
+	}
+}
+
+static void
+divide_texts(int n_workers) {
+	/* into n_workers series of about the same number of tokens */
+	size_t length = Token_Array_Length();
+	int w;
+	int n = 0;
+
+	first_text_of = (int *)Malloc((n_workers + 1) * sizeof (int));
+	for (w = 0; w < n_workers; w++) {
+		size_t start = length / n_workers * w;
+
+		while (n < Number_of_Texts && Text[n].tx_limit <= start) {
+			n++;
+		}
+		first_text_of[w] = n;
+	}
+	first_text_of[n_workers] = Number_of_Texts;
+}
+
+static int
+make_window_pairs(int n_workers) {
+	/* distributes the windows over the buckets; yields 0 if no room */
+	size_t n_pairs = 0;
+	int b, w;
+
+	n_buckets = (int)(latest_index_table_size * sizeof (Index)
+		/ BUCKET_BYTES + 1);
+	if (n_buckets < 4 * n_workers) {
+		/* enough for the workers to take turns */
+		n_buckets = 4 * n_workers;
+	}
+	if (n_buckets > MAX_BUCKETS) {
+		n_buckets = MAX_BUCKETS;
+	}
+	if ((size_t)n_buckets > latest_index_table_size) {
+		n_buckets = (int)latest_index_table_size;
+	}
+	bucket_span = (latest_index_table_size + n_buckets - 1) / n_buckets;
+
+	bucket_count = (size_t *)
+		Calloc((size_t)n_workers * n_buckets, sizeof (size_t));
+	bucket_start = (size_t *)Malloc((n_buckets + 1) * sizeof (size_t));
+	divide_texts(n_workers);
+	Run_Workers(n_workers, count_windows_worker, 0);
+
+	/* the pairs of worker w in bucket b go after those of worker w-1 */
+	for (b = 0; b < n_buckets; b++) {
+		bucket_start[b] = n_pairs;
+		for (w = 0; w < n_workers; w++) {
+			size_t *count = &bucket_count[(size_t)w * n_buckets + b];
+			size_t c = *count;
+
+			*count = n_pairs;
+			n_pairs += c;
+		}
+	}
+	bucket_start[n_buckets] = n_pairs;
+
+	window_pairs = (struct window_pair *)
+		TryMalloc(n_pairs * sizeof (struct window_pair) + 1);
+	if (window_pairs) {
+		Run_Workers(n_workers, distribute_windows_worker, 0);
+	}
+
+	Free(bucket_count); bucket_count = 0;
+	Free(first_text_of); first_text_of = 0;
+	if (!window_pairs) {
+		Free(bucket_start); bucket_start = 0;
+		return 0;
+	}
+	return 1;
+}
+
+static void
+free_window_pairs(void) {
+	Free(window_pairs); window_pairs = 0;
+	Free(bucket_start); bucket_start = 0;
+}
+
+static size_t
+link_bucket(int b) {
+	/* yields the number of links made */
+	const struct window_pair *wp = &window_pairs[bucket_start[b]];
+	const struct window_pair *limit = &window_pairs[bucket_start[b+1]];
+	size_t n_links = 0;
+
+	for (; wp < limit; wp++) {
+		size_t h = wp->wp_index;
+
+		if (latest_index[h]) {
+			forward_reference[latest_index[h]] = wp->wp_position;
+			n_links++;
+		}
+		latest_index[h] = wp->wp_position;
+	}
+	return n_links;
+}
+
+static int
+link_chains_in_buckets(void) {
+	/*	The serial construction, blocked; yields 0 if it was not done.
+		The chains are made perfect and circular afterwards, in one
+		sweep over all positions.
+	*/
+	int n;
+	int b;
+
+	if (!blocking_pays()) return 0;
+
+	window_hash = (uint32_t *)
+		TryMalloc(n_forward_references * sizeof (uint32_t));
+	if (!window_hash) return 0;
+	for (n = 0; n < Number_of_Texts; n++) {
+		hash_text(&Text[n], window_hash, 0);
+		Progress_Done(1, Text[n].tx_limit - Text[n].tx_start);
+	}
+	int ok = make_window_pairs(1);
+	Free(window_hash); window_hash = 0;
+	if (!ok) return 0;
+
+	for (b = 0; b < n_buckets; b++) {
+		n_chain_links += link_bucket(b);
+	}
+	free_window_pairs();
+	return 1;
+}
+
+static void
+build_bucket_chains_worker(int w, void *arg) {
+	/* the second phase of the parallel construction, blocked */
+	size_t n_links = 0;
+	size_t n_perfect = 0;
+
+	(void)w;
+	(void)arg;
+
+	for (;;) {
+		Lock();
+		int b = next_bucket++;
+		Unlock();
+		if (b >= n_buckets) break;
+
+		const struct window_pair *first = &window_pairs[bucket_start[b]];
+		const struct window_pair *limit =
+			&window_pairs[bucket_start[b+1]];
+		const struct window_pair *wp;
+
+		n_links += link_bucket(b);
+		for (wp = first; wp < limit; wp++) {
+			n_perfect +=
+				make_forward_reference_perfect(wp->wp_position);
+		}
+		if (is_set_option('a')) {
+			for (wp = first; wp < limit; wp++) {
+				mark_successor(wp->wp_position);
+			}
+			for (wp = first; wp < limit; wp++) {
+				make_chain_circular(wp->wp_position);
+			}
+		}
+	}
+	Lock();
+	n_chain_links += n_links;
+	n_perfect_links += n_perfect;
+	Unlock();
+}
+
+							/* SKIPS */
+/*	Under -e each comparison searches the range of a single text, and
+	under -S the range of the old texts, but the chain of i0 leads
+	through all texts after it, so first_forward_ref_for() in compare.c
+	follows it over all the entries before the range, for each pair of
+	texts. To avoid this, the positions are divided into regions, the
+	texts under -e and the new and the old texts under -S, and
+	chain_skip[i] is the first position on the chain of i that lies
+	outside the region of i, or 0 if there is none. The entries in
+	between are in the region of i, so if that region is not in the
+	range, none of them is, and they can be passed in one step. A
+	circular chain (-a) that turns back to its head inside the region
+	has that head as its skip, so a skip never passes the place where
+	the chain turns.
+*/
+static Index *chain_skip;			/* to be filled by Malloc() */
+static size_t n_chain_skips;
+
+static size_t
+region_limit(size_t i) {
+	if (is_set_option('e')) {
+		return Text_Containing(i)->tx_limit;
+	}
+	/* -S */
+	size_t old_start = Text[Number_of_New_Texts-1].tx_limit;
+	return (i < old_start ? old_start : Text[Number_of_Texts-1].tx_limit);
+}
+
+static void
+make_chain_skips(void) {
+	int n;
+
+	if (!is_set_option('e') && !is_set_option('S')) return;
+
+	/* they are an optimization only, so we can do without */
+	chain_skip = (Index *)
+		TryCalloc(n_forward_references, sizeof (Index));
+	if (!chain_skip) return;
+	n_chain_skips = n_forward_references;
+	Count_Memory(MEM_FORWARD_REFERENCES, n_chain_skips * sizeof (Index));
+
+	/* from right to left, so the skip of j > i is known when i needs it */
+	for (n = Number_of_Texts - 1; n >= 0; n--) {
+		const struct text *txt = &Text[n];
+		size_t limit = region_limit(txt->tx_start);
+		size_t i;
+
+		for (i = txt->tx_limit; i > txt->tx_start; ) {
+			i--;
+			size_t j = forward_reference[i];
+
+			chain_skip[i] =
+				(j == 0 || j < i || j >= limit ? j : chain_skip[j]);
+		}
+	}
+}
+
+static void
+free_chain_skips(void) {
+	if (chain_skip) {
+		Uncount_Memory(MEM_FORWARD_REFERENCES,
+			n_chain_skips * sizeof (Index));
+		Free(chain_skip); chain_skip = 0;
+	}
+	n_chain_skips = 0;
+}
+
+size_t
+Forward_Skip(size_t i, size_t i0) {
+	if (	/* there is no skip */
+		i >= n_chain_skips
+	||	/* the skip could pass i0, after the chain has turned */
+		(i < i0 && i0 < region_limit(i))
+	) {
+		return Forward_Reference(i, i0);
+	}
+	size_t new_i = chain_skip[i];
+	return (new_i == i0 /*circular*/ ? 0 : new_i);
+}
+
+							/* COMMON CHAINS */
+/*	Under -e, Text[n] and Text[m] can have a run only if some window of
+	the one is on the chain of a window of the other, since that is
+	where lcs() in compare.c looks. Each chain that passes through more
+	than one text gets a number, and the numbers of the chains through
+	Text[n] are kept in increasing order in chains_through[n], so
+	Have_Common_Chain(n, m) is a merge of two short sorted lists. The
+	lists are made by walking each chain from its head, the one window
+	on it no forward reference leads to; a circular chain (-a) leads back
+	to its head, but from its tail, which lies after it. The heads are
+	taken in increasing order, so the numbers come in increasing order,
+	and each window is visited once. Like the skips they are an
+	optimization only.
+*/
+struct chain_list {
+	uint32_t *cl_chain;		/* in chain_numbers[] */
+	size_t cl_length;
+};
+
+static struct chain_list *chains_through;	/* to be filled by Malloc() */
+static uint32_t *chain_numbers;			/* to be filled by Malloc() */
+static int n_chain_lists;
+
+static int
+texts_on_chain(size_t head, int *text) {
+	/* fills text[] with the texts on the chain of head */
+	int n_texts = 0;
+	size_t j = head;
+
+	while (j) {
+		int n = (int)(Text_Containing(j) - &Text[0]);
+
+		if (n_texts == 0 || text[n_texts-1] != n) {
+			text[n_texts++] = n;
+		}
+		size_t next = forward_reference[j];
+		j = (next > j ? next : 0);
+	}
+	return n_texts;
+}
+
+static int
+number_chains(const unsigned char *is_led_to, int *text, int filling) {
+	/*	Walks the chains through more than one text; counts their
+		numbers for each text, or enters them if filling. Returns 0
+		if there are too many to number.
+	*/
+	uint32_t number = 0;
+	size_t i;
+
+	for (i = 1; i < n_forward_references; i++) {
+		if (!forward_reference[i]) continue;	/* no chain at all */
+		if (is_led_to[i / 8] & (1 << (i % 8))) continue;
+
+		int n_texts = texts_on_chain(i, text);
+		if (n_texts < 2) continue;
+		if (number == UINT32_MAX) return 0;
+
+		int k;
+		for (k = 0; k < n_texts; k++) {
+			struct chain_list *cl = &chains_through[text[k]];
+
+			if (filling) {
+				cl->cl_chain[cl->cl_length] = number;
+			}
+			cl->cl_length++;
+		}
+		number++;
+	}
+	return 1;
+}
+
+static void
+make_chain_lists(void) {
+	size_t i;
+	int n;
+
+	if (!is_set_option('e') || is_set_option('q')) return;
+
+	unsigned char *is_led_to = (unsigned char *)
+		TryCalloc(n_forward_references / 8 + 1, 1);
+	int *text = (int *)TryMalloc(Number_of_Texts * sizeof (int));
+	chains_through = (struct chain_list *)
+		TryCalloc(Number_of_Texts, sizeof (struct chain_list));
+	if (!is_led_to || !text || !chains_through) goto give_up;
+
+	for (i = 1; i < n_forward_references; i++) {
+		size_t j = forward_reference[i];
+
+		if (j > i) {
+			is_led_to[j / 8] |= (1 << (j % 8));
+		}
+	}
+
+	/* count the numbers of each text, then enter them */
+	if (!number_chains(is_led_to, text, 0)) goto give_up;
+	size_t n_numbers = 0;
+	for (n = 0; n < Number_of_Texts; n++) {
+		n_numbers += chains_through[n].cl_length;
+	}
+	chain_numbers = (uint32_t *)
+		TryMalloc((n_numbers + 1) * sizeof (uint32_t));
+	if (!chain_numbers) goto give_up;
+	n_numbers = 0;
+	for (n = 0; n < Number_of_Texts; n++) {
+		struct chain_list *cl = &chains_through[n];
+
+		cl->cl_chain = &chain_numbers[n_numbers];
+		n_numbers += cl->cl_length;
+		cl->cl_length = 0;
+	}
+	(void)number_chains(is_led_to, text, 1);
+	n_chain_lists = Number_of_Texts;
+
+	Free(is_led_to);
+	Free(text);
+	return;
+
+give_up:
+	if (is_led_to) Free(is_led_to);
+	if (text) Free(text);
+	if (chains_through) {
+		Free(chains_through); chains_through = 0;
+	}
+}
+
+static void
+free_chain_lists(void) {
+	if (chains_through) {
+		Free(chains_through); chains_through = 0;
+	}
+	if (chain_numbers) {
+		Free(chain_numbers); chain_numbers = 0;
+	}
+	n_chain_lists = 0;
+}
+
+int
+Have_Common_Chain(int n, int m) {
+	if (n >= n_chain_lists || m >= n_chain_lists) return 1;
+
+	const struct chain_list *cl0 = &chains_through[n];
+	const struct chain_list *cl1 = &chains_through[m];
+	size_t k0 = 0;
+	size_t k1 = 0;
+
+	while (k0 < cl0->cl_length && k1 < cl1->cl_length) {
+		uint32_t c0 = cl0->cl_chain[k0];
+		uint32_t c1 = cl1->cl_chain[k1];
+
+		if (c0 == c1) return 1;
+		if (c0 < c1) {
+			k0++;
+		} else {
+			k1++;
+		}
+	}
+	return 0;
+}
+
+							/* QUERIES */
+/*	Under -q (see query.h) the forward references of the old texts are
+	kept, and the texts to be compared to them are appended to
+	Token_Array[] one at a time. Such a text lies beyond the old texts,
+	so its windows cannot be entered in their chains; instead each
+	window gets a reference back to the first old window equal to it,
+	from where the chain of that window leads on through the old texts.
+	This yields the same candidates, in the same order, as the normal
+	chains would for a new text in front of the old texts. The first old
+	windows are kept in old_window[], an open hash table on the
+	fingerprints of the windows.
+*/
+struct old_window {
+	uint64_t ow_fingerprint;
+	size_t ow_pos;			/* 0 if the entry is free */
+};
+
+static struct old_window *old_window;	/* to be filled by Map_Calloc() */
+static size_t old_window_mask;		/* table size - 1, a power of 2 */
+static size_t n_old_references;		/* up to the end of the old texts */
+
+static void
+for_windows_of(const struct text *txt, void (*proc)(size_t, uint64_t)) {
+	/* calls proc(i, fp) for each window i in txt that may start a run,
+	   with fp its fingerprint, as computed by fingerprint_text()
+	*/
+	size_t j;
+	uint64_t fp = 0;
+
+	for (j = txt->tx_start; j < txt->tx_limit; j++) {
+		fp = rolled(fingerprint_family, fp, Token_Array[j],
+			(j - txt->tx_start >= (size_t)Min_Run_Size ?
+				&Token_Array[j - Min_Run_Size] : 0));
+		if (j - txt->tx_start < (size_t)(Min_Run_Size - 1)) continue;
+
+		size_t i = j - (Min_Run_Size - 1);
+		if (May_Be_Start_Of_Run(Token_Array[i])) {
+			proc(i, fp);
+		}
+	}
+}
+
+static size_t
+old_window_slot(size_t i, uint64_t fp) {
+	/* the slot holding the old window equal to window i, or else the
+	   free slot where it would go
+	*/
+	uint64_t h = fp * UINT64_C(0x9E3779B97F4A7C15);
+	size_t s = (size_t)(h ^ (h >> 32)) & old_window_mask;
+
+	while (old_window[s].ow_pos) {
+		const struct old_window *ow = &old_window[s];
+
+		if (	ow->ow_fingerprint == fp
+		&&	is_eq_min_run(&Token_Array[ow->ow_pos], &Token_Array[i])
+		) break;
+		s = (s + 1) & old_window_mask;
+	}
+	return s;
+}
+
+static size_t n_old_windows;
+
+static void
+count_old_window(size_t i, uint64_t fp) {
+	(void)i;
+	(void)fp;
+	n_old_windows++;
+}
+
+static void
+enter_old_window(size_t i, uint64_t fp) {
+	struct old_window *ow = &old_window[old_window_slot(i, fp)];
+
+	/* the old texts are done from left to right, so the first one of
+	   equal windows stays
+	*/
+	if (!ow->ow_pos) {
+		ow->ow_fingerprint = fp;
+		ow->ow_pos = i;
+	}
+}
+
+static void
+add_forward_reference(size_t i, uint64_t fp) {
+	/* 0 if there is no equal old window */
+	forward_reference[i] = old_window[old_window_slot(i, fp)].ow_pos;
+}
+
+void
+Make_Old_Windows(void) {
+	int n;
+
+	set_window_hash_parameters();
+
+	/* make the table at most half full */
+	n_old_windows = 0;
+	for (n = 0; n < Number_of_Texts; n++) {
+		for_windows_of(&Text[n], count_old_window);
+	}
+	size_t size = 1024;
+	while (size < 2 * n_old_windows) {
+		size *= 2;
+	}
+	old_window = (struct old_window *)
+		TryMap_Calloc(size, sizeof (struct old_window));
+	if (!old_window) {
+		fatal("out of memory: no room for window table");
+	}
+	old_window_mask = size - 1;
+
+	for (n = 0; n < Number_of_Texts; n++) {
+		for_windows_of(&Text[n], enter_old_window);
+	}
+	n_old_references = n_forward_references;
+}
+
+void
+Add_Forward_References(const struct text *txt) {
+	size_t i;
+
+	n_forward_references = txt->tx_limit;
+	Index *new_refs = (Index *)TryMap_Realloc(
+		forward_reference, n_forward_references * sizeof (Index)
+	);
+	if (!new_refs) {
+		fatal("out of memory: no room for forward references");
+	}
+	forward_reference = new_refs;
+	count_forward_references(n_forward_references);
+
+	for (i = n_old_references; i < txt->tx_limit; i++) {
+		forward_reference[i] = 0;
+	}
+	for_windows_of(txt, add_forward_reference);
+}
+
+void
+Remove_Forward_References(void) {
+	n_forward_references = n_old_references;
+}
+
 void
 Make_Forward_References(void) {
 	/*	Constructs the forward references table.
 	*/
+	int in_parallel;
+
 	n_forward_references = Token_Array_Length();
+	Window_Size = Min_Run_Size;
 	forward_reference =
-		(size_t *)Calloc(n_forward_references, sizeof (size_t));
-	make_forward_references_using_hash();
-	make_forward_references_perfect();
-	if (is_set_option('a')) {
-		make_chains_circular();
+		(Index *)Map_Calloc(n_forward_references, sizeof (Index));
+	count_forward_references(n_forward_references);
+	/* the sweeps go through the arrays from left to right */
+	Map_Advise(Token_Array, Map_Sequential);
+	Map_Advise(forward_reference, Map_Sequential);
+	set_window_hash_parameters();
+	n_chain_links = n_perfect_links = 0;
+	Progress_Phase("hashing", Number_of_Texts, n_forward_references);
+	in_parallel = construction_in_parallel();
+	if (in_parallel) {
+		make_forward_references_in_parallel();
+	} else {
+		make_forward_references_using_hash();
+		if (is_set_option('D')) {
+			Time_Phase(stderr, "hashing");
+		}
+		/* latest_index[] has been freed, which leaves room for: */
+		init_fingerprints();
+		if (fingerprint) {
+			fingerprint_texts();
+		}
+		make_forward_references_perfect();
+		if (is_set_option('a')) {
+			make_chains_circular();
+		}
+	}
+	make_chain_skips();
+	make_chain_lists();
+	if (is_set_option('D')) {
+		Time_Phase(stderr, (in_parallel ?
+			"hashing and perfect references" : "perfect references"));
+		fprintf(stderr, "Forward chains (-H %s): total length %s",
+			Window_Hash_Name, any_uint2string(n_chain_links, 0));
+		fprintf(stderr, " after hashing, %s after full comparison\n",
+			any_uint2string(n_perfect_links, 0));
 	}
+	free_fingerprints();
+	/* lcs() jumps around in them */
+	Map_Advise(Token_Array, Map_Random);
+	Map_Advise(forward_reference, Map_Random);
 #ifdef	DB_FORW_REF_PRINT
 	db_print_forward_references();
 #endif	/* DB_FORW_REF_PRINT */
@@ -304,5 +1448,11 @@ Forward_Reference(size_t i, size_t i0) {
 
 void
 Free_Forward_References(void) {
-	Free(forward_reference);
+	Map_Free(forward_reference);
+	count_forward_references(0);
+	free_chain_skips();
+	free_chain_lists();
+	if (old_window) {
+		Map_Free(old_window); old_window = 0;
+	}
 }
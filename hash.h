@@ -7,7 +7,64 @@
 	the Longest Substring Algorithm.
 */
 
+/*	The hash function of the windows is named by Window_Hash_Name (-H):
+	"xor" (the default), "poly" or "buz"; Select_Window_Hash() sets it
+	up, and calls fatal() for an unknown name.
+*/
+extern const char *Window_Hash_Name;
+extern void Select_Window_Hash(void);
+
+/*	Make_Forward_References() makes the chains for the windows of
+	Min_Run_Size tokens, and records that size in Window_Size; the
+	chains serve any larger Min_Run_Size as well (see -r N,N,...).
+*/
+extern int Window_Size;
 extern void Make_Forward_References(void);
 extern void Free_Forward_References(void);
+
+/*	Under -j, the hash values of the windows can be computed while the
+	texts are being read: Start_Window_Hashing(estimated_length) prepares
+	for it, and Hash_Windows_Up_To(n) hashes the windows of the texts
+	before Text[n] that have not been hashed yet; it does nothing if the
+	hashing has not been started. Make_Forward_References() does the
+	rest.
+*/
+extern void Start_Window_Hashing(size_t estimated_length);
+extern void Hash_Windows_Up_To(int n);
 /* with circularity check: */
 extern size_t Forward_Reference(size_t i, size_t i0);
+/*	Under -e and -S, Forward_Skip(i, i0) passes the entries on the chain
+	of i that lie in the region of i, its text under -e, the new or the
+	old texts under -S, in one step, and yields the first one after them.
+*/
+extern size_t Forward_Skip(size_t i, size_t i0);
+/*	Under -e, Have_Common_Chain(n, m) tells if some window of Text[n]
+	and some window of Text[m] are on the same chain; if not, the two
+	texts have no runs in common.
+*/
+extern int Have_Common_Chain(int n, int m);
+
+/*	The hash values of the windows can be saved and restored, to avoid
+	recomputing them for texts that are read from an index file:
+	Get_Window_Hashes(txt, raw_hash) stores the hash value of the window
+	starting at position j in raw_hash[j - txt->tx_start], for all
+	windows in txt; Set_Known_Window_Hashes(start, limit, raw_hash)
+	declares that raw_hash[j - start] holds this value for all windows in
+	the texts that lie within [start, limit). The values depend on
+	Min_Run_Size and Window_Hash_Name only.
+*/
+extern void Get_Window_Hashes(const struct text *txt, uint32_t *raw_hash);
+extern void Set_Known_Window_Hashes(
+	size_t start, size_t limit, const uint32_t *raw_hash
+);
+
+/*	Under -q (see query.h), Make_Old_Windows() is called after
+	Make_Forward_References() and records the windows of the texts read
+	so far, the old texts. Add_Forward_References(txt) then gives the
+	windows of txt, which follows the old texts in Token_Array[], forward
+	references into the chains of the old texts, so its runs with them
+	can be found; Remove_Forward_References() takes them away again.
+*/
+extern void Make_Old_Windows(void);
+extern void Add_Forward_References(const struct text *txt);
+extern void Remove_Forward_References(void);
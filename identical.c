@@ -0,0 +1,287 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	The texts are grouped by a hash of their token streams, and the
+	texts with equal hashes and sizes are compared token by token, so a
+	collision of the hashes costs time but does no harm. Texts too
+	short to contain a run are left alone: they yield no runs anyway.
+	A group is kept as a list through next_member[], in text order, so
+	the representative is the text with the lowest number; since the
+	new texts come first, a duplicate that is a new text always has a
+	new text as its representative.
+*/
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<stdint.h>
+#include	<string.h>
+
+#include	"sim.h"
+#include	"text.h"
+#include	"token.h"
+#include	"tokenarray.h"
+#include	"add_run.h"
+#include	"Malloc.h"
+#include	"identical.h"
+
+static int *representative;		/* 0 if there are no duplicates */
+static int *next_member;		/* -1 at the end of a group */
+static size_t *hidden_limit;		/* tx_limit of a hidden duplicate */
+
+struct kept_run {
+	int kr_text1;
+	size_t kr_offset0;		/* from the start of the first text */
+	size_t kr_i1;
+	size_t kr_size;
+};
+
+struct kept_runs {
+	struct kept_run *kr_list;	/* to be filled by Malloc() */
+	size_t kr_free;
+	size_t kr_n_size;
+};
+
+static struct kept_runs *kept_runs;	/* one for each text */
+
+							/* GROUPING */
+static uint64_t *token_hash;		/* for the sorting */
+
+static size_t
+text_size(int n) {
+	return Text[n].tx_limit - Text[n].tx_start;
+}
+
+static uint64_t
+hash_tokens(const struct text *txt) {
+	/* FNV-1a, over the tokens */
+	uint64_t h = UINT64_C(0xCBF29CE484222325);
+	size_t i;
+
+	for (i = txt->tx_start; i < txt->tx_limit; i++) {
+		h = (h ^ (uint64_t)Token_Array[i]) * UINT64_C(0x100000001B3);
+	}
+	return h;
+}
+
+static int
+text_cmp(const void *p, const void *q) {
+	/* by size, by hash, and then by number */
+	int n0 = *(const int *)p;
+	int n1 = *(const int *)q;
+
+	if (text_size(n0) != text_size(n1))
+		return (text_size(n0) < text_size(n1) ? -1 : 1);
+	if (token_hash[n0] != token_hash[n1])
+		return (token_hash[n0] < token_hash[n1] ? -1 : 1);
+	return n0 - n1;
+}
+
+static int
+is_same_text(int n0, int n1) {
+	return text_size(n0) == text_size(n1)
+	&&	token_hash[n0] == token_hash[n1]
+	&&	memcmp(&Token_Array[Text[n0].tx_start],
+			&Token_Array[Text[n1].tx_start],
+			text_size(n0) * sizeof (Token)) == 0;
+}
+
+static void
+report_identical_texts(void) {
+	int n;
+
+	for (n = 0; n < Number_of_Texts; n++) {
+		if (!Is_Duplicate_Text(n)) continue;
+		fprintf(Output_File, "File %s: identical to %s\n",
+			Text[n].tx_fname, Text[representative[n]].tx_fname);
+	}
+	fprintf(Output_File, "\n");
+	fflush(Output_File);
+}
+
+void
+Find_Identical_Texts(void) {
+	int *order = (int *)Malloc(Number_of_Texts * sizeof (int));
+	int *last_member = (int *)Malloc(Number_of_Texts * sizeof (int));
+	int n_candidates = 0;
+	int n_duplicates = 0;
+	int n, i, j;
+
+	token_hash = (uint64_t *)Malloc(Number_of_Texts * sizeof (uint64_t));
+	representative = (int *)Malloc(Number_of_Texts * sizeof (int));
+	next_member = (int *)Malloc(Number_of_Texts * sizeof (int));
+	for (n = 0; n < Number_of_Texts; n++) {
+		representative[n] = n;
+		next_member[n] = -1;
+		last_member[n] = n;
+		if (!Text[n].tx_opened || text_size(n) < (size_t)Min_Run_Size)
+			continue;
+		token_hash[n] = hash_tokens(&Text[n]);
+		order[n_candidates++] = n;
+	}
+	qsort(order, n_candidates, sizeof (int), text_cmp);
+
+	for (i = 1; i < n_candidates; i++) {
+		int m = order[i];
+
+		/* look for its representative among the equal keys before it */
+		for (	j = i - 1;
+			j >= 0 && text_size(order[j]) == text_size(m)
+			&& token_hash[order[j]] == token_hash[m];
+			j--
+		) {
+			int r = representative[order[j]];
+
+			if (!is_same_text(r, m)) continue;
+			representative[m] = r;
+			next_member[last_member[r]] = m;
+			last_member[r] = m;
+			n_duplicates++;
+			break;
+		}
+	}
+	Free(last_member);
+	Free(order);
+	Free(token_hash); token_hash = 0;
+
+	if (n_duplicates == 0) {
+		Free_Identical_Texts();
+		return;
+	}
+	kept_runs = (struct kept_runs *)
+		Calloc(Number_of_Texts, sizeof (struct kept_runs));
+	hidden_limit = (size_t *)Malloc(Number_of_Texts * sizeof (size_t));
+	report_identical_texts();
+}
+
+int
+Is_Duplicate_Text(int n) {
+	return representative && representative[n] != n;
+}
+
+							/* INDEXING */
+void
+Hide_Duplicate_Texts(void) {
+	int n;
+
+	if (!representative) return;
+	for (n = 0; n < Number_of_Texts; n++) {
+		if (!Is_Duplicate_Text(n)) continue;
+		hidden_limit[n] = Text[n].tx_limit;
+		Text[n].tx_limit = Text[n].tx_start;
+	}
+}
+
+void
+Show_Duplicate_Texts(void) {
+	int n;
+
+	if (!representative) return;
+	for (n = 0; n < Number_of_Texts; n++) {
+		if (!Is_Duplicate_Text(n)) continue;
+		Text[n].tx_limit = hidden_limit[n];
+	}
+}
+
+							/* RUNS */
+static void
+keep_run(int n0, size_t offset0, int n1, size_t i1, size_t size) {
+	struct kept_runs *kr = &kept_runs[n0];
+
+	if (kr->kr_free == kr->kr_n_size) {
+		/* allocated array is full; increase its size */
+		kr->kr_n_size = (kr->kr_n_size ? 2 * kr->kr_n_size : 64);
+		kr->kr_list = (struct kept_run *)Realloc(kr->kr_list,
+			kr->kr_n_size * sizeof (struct kept_run));
+	}
+	struct kept_run *k = &kr->kr_list[kr->kr_free++];
+	k->kr_text1 = n1;
+	k->kr_offset0 = offset0;
+	k->kr_i1 = i1;
+	k->kr_size = size;
+}
+
+static void
+free_kept_runs(int n) {
+	struct kept_runs *kr = &kept_runs[n];
+
+	if (kr->kr_list) {
+		Free(kr->kr_list); kr->kr_list = 0;
+	}
+	kr->kr_free = 0;
+	kr->kr_n_size = 0;
+}
+
+static int
+is_run_between(int n0, int n1) {
+	/* the texts of a group are only reported as identical */
+	return n0 == n1 || representative[n0] != representative[n1];
+}
+
+void
+Add_Run_And_Copies(
+	struct text *txt0, size_t i0,
+	struct text *txt1, size_t i1,
+	size_t size
+) {
+	int n0 = (int)(txt0 - &Text[0]);
+	int n1 = (int)(txt1 - &Text[0]);
+	int m;
+
+	if (!representative) {
+		add_run(txt0, i0, txt1, i1, size);
+		return;
+	}
+
+	if (	/* a new text will want it */
+		representative[n0] == n0 && next_member[n0] >= 0
+	&&	next_member[n0] < Number_of_New_Texts
+	) {
+		keep_run(n0, i0 - txt0->tx_start, n1, i1, size);
+	}
+	if (is_run_between(n0, n1)) {
+		add_run(txt0, i0, txt1, i1, size);
+	}
+	if (representative[n1] != n1) return;
+	for (m = next_member[n1]; m >= 0; m = next_member[m]) {
+		if (!is_run_between(n0, m)) continue;
+		add_run(txt0, i0,
+			&Text[m], Text[m].tx_start + (i1 - txt1->tx_start), size);
+	}
+}
+
+void
+Add_Runs_Of_Duplicate(int n) {
+	int r = representative[n];
+	const struct kept_runs *kr = &kept_runs[r];
+	size_t i;
+
+	for (i = 0; i < kr->kr_free; i++) {
+		const struct kept_run *k = &kr->kr_list[i];
+
+		Add_Run_And_Copies(&Text[n], Text[n].tx_start + k->kr_offset0,
+			&Text[k->kr_text1], k->kr_i1, k->kr_size);
+	}
+	if (next_member[n] < 0 || next_member[n] >= Number_of_New_Texts) {
+		/* it was the last new text of the group */
+		free_kept_runs(r);
+	}
+}
+
+void
+Free_Identical_Texts(void) {
+	int n;
+
+	if (kept_runs) {
+		for (n = 0; n < Number_of_Texts; n++) {
+			free_kept_runs(n);
+		}
+		Free(kept_runs); kept_runs = 0;
+	}
+	if (hidden_limit) {
+		Free(hidden_limit); hidden_limit = 0;
+	}
+	if (representative) {
+		Free(representative); representative = 0;
+		Free(next_member); next_member = 0;
+	}
+}
@@ -0,0 +1,40 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Collapsing identical texts, under -Z.
+
+	Find_Identical_Texts(), called after Read_Input_Files(), groups
+	the texts with identical token streams and reports the groups. The
+	first text of a group is its representative; the others are
+	duplicates, and Is_Duplicate_Text(n) tells if Text[n] is one.
+
+	The duplicates are left out of the index: Hide_Duplicate_Texts()
+	makes them empty while it is made, and Show_Duplicate_Texts()
+	restores them. Nor are they compared; instead the comparison passes
+	each run to Add_Run_And_Copies(), which gives it to add_run(), with
+	a copy for each duplicate of the second text, and keeps it if the
+	first text is a representative. When the turn of a duplicate comes,
+	Add_Runs_Of_Duplicate(n) passes the runs kept for its representative
+	on as runs of Text[n]. Runs between different texts of one group are
+	dropped: the report of Find_Identical_Texts() stands for them.
+
+	Under -e the results are then those of comparing all texts. The
+	representative must be in the range of each text, which under -a
+	it is; without -e a segment found in a group is credited to all its
+	texts, where the comparison of all texts credits it to one of them.
+*/
+
+extern void Find_Identical_Texts(void);
+extern int Is_Duplicate_Text(int n);
+
+extern void Hide_Duplicate_Texts(void);
+extern void Show_Duplicate_Texts(void);
+
+extern void Add_Run_And_Copies(
+	struct text *txt0, size_t i0,
+	struct text *txt1, size_t i1,
+	size_t size
+);
+extern void Add_Runs_Of_Duplicate(int n);
+
+extern void Free_Identical_Texts(void);
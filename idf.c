@@ -10,44 +10,202 @@
 #include	"token.h"
 #include	"idf.h"
 
-Token
-idf_in_list(
+static int
+lower(int ch) {
+	return ('A' <= ch && ch <= 'Z' ? ch + (-'A' + 'a') : ch);
+}
+
+static int
+str_cmp(const char *s1, const char *s2, int folding) {
+	/* like strcmp(), with s1 in lower case if folding */
+	if (!folding) return strcmp(s1, s2);
+
+	while (lower(*s1 & 0377) == (*s2 & 0377)) {
+		if (*s1 == '\0') return 0;
+		s1++, s2++;
+	}
+	return (lower(*s1 & 0377) - (*s2 & 0377));
+}
+
+							/* INDEXED LISTS */
+/*	An indexed list has a perfect hash table: each keyword has a slot of
+	its own, so a lookup takes one hash and at most one compare. The hash
+	of a string longer than the longest keyword is not even completed.
+	The tables are made in the main thread, before the lexing starts, and
+	are only read afterwards.
+*/
+#define	IDF_MAX_TABLES	8
+#define	IDF_MAX_SLOTS	1024
+#define	IDF_MAX_SEEDS	10000
+
+struct idf_table {
+	const struct idf *it_list;
+	uint32_t it_seed;
+	uint32_t it_mask;		/* number of slots - 1 */
+	size_t it_max_len;		/* of the keywords */
+	unsigned char it_slot[IDF_MAX_SLOTS];	/* list index + 1, or 0 */
+};
+
+static struct idf_table idf_table[IDF_MAX_TABLES];
+static int n_idf_tables;
+
+static int
+slot_of(
+	const struct idf_table *it, const char *str, int folding, uint32_t *sp
+) {
+	/* sets *sp and returns 1, or returns 0 if str is too long */
+	uint32_t h = it->it_seed;
+	size_t len = 0;
+
+	while (*str) {
+		int ch = *str++ & 0377;
+
+		if (++len > it->it_max_len) return 0;
+		if (folding) ch = lower(ch);
+		h = (h ^ (uint32_t)ch) * 16777619u;	/* FNV-1a */
+	}
+	h ^= h >> 15;
+	*sp = h & it->it_mask;
+	return 1;
+}
+
+static int
+fill_idf_table(struct idf_table *it, size_t n_idfs) {
+	/* returns 1 if there was no collision with the present seed */
+	size_t i;
+
+	for (i = 0; i <= it->it_mask; i++) {
+		it->it_slot[i] = 0;
+	}
+	for (i = 0; i < n_idfs; i++) {
+		uint32_t s;
+
+		/* no keyword is longer than it_max_len; if one were, no
+		   seed would do, and in_list() would use binary search */
+		if (!slot_of(it, it->it_list[i].id_tag, 0, &s)) return 0;
+		if (it->it_slot[s]) return 0;
+		it->it_slot[s] = (unsigned char)(i + 1);
+	}
+	return 1;
+}
+
+void
+idf_index_list(const struct idf list[], size_t list_size) {
+	size_t n_idfs = list_size / sizeof (struct idf);
+	struct idf_table *it = &idf_table[n_idf_tables];
+	size_t i;
+
+	/* if there is no room, in_list() just uses binary search */
+	if (n_idf_tables == IDF_MAX_TABLES || n_idfs > 255) return;
+
+	it->it_list = list;
+	it->it_max_len = 0;
+	for (i = 0; i < n_idfs; i++) {
+		size_t len = strlen(list[i].id_tag);
+
+		if (len > it->it_max_len) it->it_max_len = len;
+	}
+
+	/* look for a seed without collisions, in ever larger tables */
+	for (	it->it_mask = 1;
+		it->it_mask + 1 <= IDF_MAX_SLOTS;
+		it->it_mask = 2 * it->it_mask + 1
+	) {
+		if (it->it_mask + 1 < 2 * n_idfs) continue;
+
+		for (it->it_seed = 1; it->it_seed <= IDF_MAX_SEEDS; it->it_seed++) {
+			if (fill_idf_table(it, n_idfs)) {
+				n_idf_tables++;
+				return;
+			}
+		}
+	}
+}
+
+static const struct idf_table *
+idf_table_of(const struct idf list[]) {
+	int i;
+
+	for (i = 0; i < n_idf_tables; i++) {
+		if (idf_table[i].it_list == list) return &idf_table[i];
+	}
+	return 0;
+}
+
+							/* LOOKING UP */
+static Token
+in_list(
 	const char *str,
 	const struct idf list[],
 	size_t list_size,
-	Token default_token
+	Token default_token,
+	int folding
 ) {
+	const struct idf_table *it = idf_table_of(list);
 	int first = 0;
 	int last = (int) (list_size / sizeof (struct idf)) - 1;
 
+	if (it) {
+		uint32_t s;
+		int i;
+
+		if (!slot_of(it, str, folding, &s)) return default_token;
+		i = it->it_slot[s];
+		return (i && str_cmp(str, list[i-1].id_tag, folding) == 0
+		?	list[i-1].id_tr
+		:	default_token
+		);
+	}
+
 	while (first < last) {
 		int middle = (first + last) / 2;
 
-		if (strcmp(str, list[middle].id_tag) > 0) {
+		if (str_cmp(str, list[middle].id_tag, folding) > 0) {
 			first = middle + 1;
 		}
 		else {
 			last = middle;
 		}
 	}
-	return (strcmp(str, list[first].id_tag) == 0
+	return (str_cmp(str, list[first].id_tag, folding) == 0
 	?	list[first].id_tr
 	:	default_token
 	);
 }
 
-#define	HASH(h,ch)	(((h) * 8209) + (ch)*613)
+Token
+idf_in_list(
+	const char *str,
+	const struct idf list[],
+	size_t list_size,
+	Token default_token
+) {
+	return in_list(str, list, list_size, default_token, 0);
+}
 
 Token
-idf_hashed(const char *str) {
+idf_in_list_lower_case(
+	const char *str,
+	const struct idf list[],
+	size_t list_size,
+	Token default_token
+) {
+	return in_list(str, list, list_size, default_token, 1);
+}
+
+#define	HASH(h,ch)	(((h) * 8209) + (ch)*613)
+
+static Token
+hashed(const char *str, size_t len, int folding) {
 	int32_t h = 0;
 
 	/* let's be careful about ranges; if done wrong it's hard to debug */
-	while (*str) {
+	while (len-- > 0) {
 		int ch = *str++ & 0377;
 
 		/* ignore spaces in spaced words */
 		if (ch == ' ') continue;
+		if (folding) ch = lower(ch);
 
 		/* -1 <= h <= 2^31-1 */
 		h = HASH(h, ch);
@@ -76,6 +234,102 @@ idf_hashed(const char *str) {
 	/* this avoids the regular tokens and End_Of_Line */
 }
 
+							/* THE CACHE */
+/*	Most occurrences of identifiers are of a small vocabulary, so the
+	tokens of the last identifiers hashed are kept in a direct-mapped
+	cache, one per thread, so the threads that lex need no lock. The
+	slot of an identifier derives from its length and three of its
+	characters only, which is much cheaper than hashing it; a hit still
+	compares the identifier in full, so the tokens are the same as
+	without the cache. Identifiers longer than IDF_CACHE_KEY_LEN are
+	not cached.
+*/
+#if	defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define	THREAD_LOCAL	_Thread_local
+#elif	defined(__GNUC__)
+#define	THREAD_LOCAL	__thread
+#endif
+
+#if	defined(THREAD_LOCAL) && !defined(lint)
+#define	IDF_CACHE
+#endif
+
+#ifdef	IDF_CACHE
+#define	IDF_CACHE_BITS		10
+#define	IDF_CACHE_SIZE		(1 << IDF_CACHE_BITS)
+#define	IDF_CACHE_KEY_LEN	30
+
+struct idf_cache_entry {
+	unsigned char ic_len;		/* 0 if the entry is empty */
+	unsigned char ic_folding;
+	char ic_key[IDF_CACHE_KEY_LEN];
+	Token ic_token;
+};
+
+struct idf_cache {
+	struct idf_cache_entry ic_entry[IDF_CACHE_SIZE];
+	size_t ic_hits;
+	size_t ic_misses;
+};
+
+static THREAD_LOCAL struct idf_cache idf_cache;
+
+static Token
+cached_hashed(const char *str, size_t len, int folding) {
+	if (len == 0 || len > IDF_CACHE_KEY_LEN) {
+		return hashed(str, len, folding);
+	}
+
+	uint32_t h = (uint32_t)len * 0x9E3779B1u
+		^ (uint32_t)(str[0] & 0377)
+		^ (uint32_t)(str[len-1] & 0377) << 8
+		^ (uint32_t)(str[len/2] & 0377) << 16;
+	uint32_t slot = (h * 0x85EBCA6Bu) >> (32 - IDF_CACHE_BITS);
+	struct idf_cache_entry *ic = &idf_cache.ic_entry[slot];
+
+	if (	ic->ic_len == len && ic->ic_folding == folding
+	&&	memcmp(ic->ic_key, str, len) == 0
+	) {
+		idf_cache.ic_hits++;
+		return ic->ic_token;
+	}
+	idf_cache.ic_misses++;
+	ic->ic_len = (unsigned char)len;
+	ic->ic_folding = (unsigned char)folding;
+	memcpy(ic->ic_key, str, len);
+	ic->ic_token = hashed(str, len, folding);
+	return ic->ic_token;
+}
+#else	/* IDF_CACHE */
+#define	cached_hashed(str, len, folding)	hashed(str, len, folding)
+#endif	/* IDF_CACHE */
+
+void
+idf_cache_counts(size_t *hits, size_t *misses) {
+#ifdef	IDF_CACHE
+	*hits += idf_cache.ic_hits;
+	*misses += idf_cache.ic_misses;
+	idf_cache.ic_hits = idf_cache.ic_misses = 0;
+#else	/* IDF_CACHE */
+	if (hits == 0 || misses == 0) return;
+#endif	/* IDF_CACHE */
+}
+
+Token
+idf_hashed(const char *str) {
+	return cached_hashed(str, strlen(str), 0);
+}
+
+Token
+idf_hashed_lower_case(const char *str) {
+	return cached_hashed(str, strlen(str), 1);
+}
+
+Token
+idf_hashed_lower_case_n(const char *str, size_t len) {
+	return cached_hashed(str, len, 1);
+}
+
 void
 lower_case(char *str) {
 	char *s;
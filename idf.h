@@ -13,9 +13,21 @@
 		looks up a keyword in a list of keywords l, represented as an
 		array of struct idf, and returns its translation as a token;
 		default_token is returned if the keyword is not found.
+	void idf_index_list(const struct idf list[], size_t list_size);
+		gives the list a perfect hash table, after which idf_in_list()
+		finds a keyword in it with one hash and one compare; to be
+		called from Init_Language(), before any lexing.
 	Token idf_hashed(char *str);
 		returns a token unequal to No_Token or End_Of_Line, derived
 		from str through hashing
+	idf_in_list_lower_case() and idf_hashed_lower_case() do the same
+	as if str were in lower case, without changing str; the scanners
+	use them to keep the input buffer intact.
+	idf_hashed_lower_case_n(str, len) hashes the len characters at str,
+	which need not be followed by a null byte.
+	The hashing goes through a cache of recent identifiers, one per
+	thread; idf_cache_counts(&hits, &misses) adds the counts of the
+	cache of the calling thread to hits and misses, and clears them.
 */
 
 /* the struct for keywords etc. */
@@ -31,5 +43,15 @@ extern Token idf_in_list(
 	size_t list_size,
 	Token default_token
 );
+extern Token idf_in_list_lower_case(
+	const char *str,
+	const struct idf list[],
+	size_t list_size,
+	Token default_token
+);
+extern void idf_index_list(const struct idf list[], size_t list_size);
 extern Token idf_hashed(const char *str);
+extern Token idf_hashed_lower_case(const char *str);
+extern Token idf_hashed_lower_case_n(const char *str, size_t len);
+extern void idf_cache_counts(size_t *hits, size_t *misses);
 extern void lower_case(char *str);
@@ -0,0 +1,522 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	A results file consists of a header, a table of texts and one record
+	per run.
+
+	The header holds the identification line INCREMENTAL_MAGIC, the
+	language, the value of Min_Run_Size and of the threshold, and the
+	options that affect the tokens or the runs found; a results file
+	that does not agree with all of these is not used. The table holds,
+	for each text, its name, whether it was new, its number of tokens
+	and the FNV-1a hash of its token stream. A run record holds the
+	numbers of the two texts in the table, the offsets of the two chunks
+	in their texts and the size; a record with an impossible text number
+	ends the file. All numbers are written in the native byte order.
+
+	Which pairs are compared under -e depends only on the order of the
+	two texts and on whether they are new (see compare_new_text() in
+	compare.c), so a pair of unchanged texts was compared in the previous
+	run if and only if it is compared now, provided their order and their
+	newness are the same. Under -a the chains are circular, and the runs
+	of a text with itself may be found through the chains of the other
+	texts; these pairs are always compared again.
+
+	The new results file is written under a temporary name and renamed
+	by Finish_Incremental(), so an interrupted run leaves the old one.
+*/
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<stdint.h>
+#include	<string.h>
+
+#include	"sim.h"
+#include	"text.h"
+#include	"token.h"
+#include	"tokenarray.h"
+#include	"lang.h"
+#include	"options.h"
+#include	"Malloc.h"
+#include	"incremental.h"
+
+#define	INCREMENTAL_MAGIC	"SIM incremental results 1\n"
+
+/* the options that change the tokens or the runs that are found */
+#define	COMPARISON_OPTIONS	"aefFpsS"
+
+#define	END_OF_RUNS	UINT64_MAX
+
+const char *Incremental_Name;
+
+							/* FILE HANDLING */
+static void
+results_error(const char *fname, const char *what) {
+	char *msg = (char *)Malloc(strlen(fname) + strlen(what) + 100);
+
+	sprintf(msg, "results file `%s': %s", fname, what);
+	fatal(msg);
+	/*NOTREACHED*/
+}
+
+static void
+put_number(FILE *f, const char *fname, uint64_t v) {
+	if (fwrite(&v, sizeof v, 1, f) != 1) {
+		results_error(fname, "cannot write");
+	}
+}
+
+static uint64_t
+get_number(FILE *f, const char *fname) {
+	uint64_t v;
+
+	if (fread(&v, sizeof v, 1, f) != 1) {
+		results_error(fname, "truncated or unreadable");
+	}
+	return v;
+}
+
+static void
+put_string(FILE *f, const char *fname, const char *s) {
+	size_t len = strlen(s);
+
+	put_number(f, fname, (uint64_t)len);
+	if (len && fwrite(s, len, 1, f) != 1) {
+		results_error(fname, "cannot write");
+	}
+}
+
+static char *
+get_string(FILE *f, const char *fname) {
+	uint64_t len = get_number(f, fname);
+
+	if (len > 100000) {
+		results_error(fname, "corrupted");
+	}
+	char *s = (char *)Malloc((size_t)len + 1);
+	if (len && fread(s, (size_t)len, 1, f) != 1) {
+		results_error(fname, "truncated or unreadable");
+	}
+	s[len] = '\0';
+	return s;
+}
+
+static void
+put_settings(FILE *f, const char *fname) {
+	const char *op;
+
+	put_string(f, fname, Subject);
+	put_number(f, fname, (uint64_t)sizeof (Token));
+	put_number(f, fname, (uint64_t)Min_Run_Size);
+	put_number(f, fname, (uint64_t)Threshold_Percentage);
+	for (op = COMPARISON_OPTIONS; *op; op++) {
+		put_number(f, fname, is_set_option(*op) ? 1 : 0);
+	}
+}
+
+static int
+has_same_settings(FILE *f, const char *fname) {
+	char *subject = get_string(f, fname);
+	int same = (strcmp(subject, Subject) == 0);
+	const char *op;
+
+	Free(subject);
+	same &= (get_number(f, fname) == (uint64_t)sizeof (Token));
+	same &= (get_number(f, fname) == (uint64_t)Min_Run_Size);
+	same &= (get_number(f, fname) == (uint64_t)Threshold_Percentage);
+	for (op = COMPARISON_OPTIONS; *op; op++) {
+		same &= (get_number(f, fname) == (is_set_option(*op) ? 1 : 0));
+	}
+	return same;
+}
+
+							/* TEXTS */
+struct text_key {
+	uint64_t tk_size;		/* in tokens */
+	uint64_t tk_hash;		/* of the tokens */
+};
+
+static struct text_key *text_key;	/* of Text[], to be filled by Malloc() */
+static int *previous_number;		/* of Text[n], or -1 if changed */
+static char *was_new;			/* of the texts of the previous run */
+
+#define	FNV_OFFSET	UINT64_C(0xcbf29ce484222325)
+#define	FNV_PRIME	UINT64_C(0x100000001b3)
+
+static void
+make_text_key(const struct text *txt, struct text_key *tk) {
+	uint64_t h = FNV_OFFSET;
+	size_t i;
+
+	for (i = txt->tx_start; i < txt->tx_limit; i++) {
+		uint32_t v = (uint32_t)Token2int(Token_Array[i]);
+		int b;
+
+		for (b = 0; b < 4; b++) {
+			h = (h ^ (v & 0xff)) * FNV_PRIME;
+			v >>= 8;
+		}
+	}
+	tk->tk_size = (uint64_t)(txt->tx_limit - txt->tx_start);
+	tk->tk_hash = h;
+}
+
+static int
+is_new_text(int n) {
+	return n < Number_of_New_Texts;
+}
+
+static int *texts_by_name;		/* the numbers of Text[], sorted */
+
+static int
+name_cmp(const void *p, const void *q) {
+	int n0 = *(const int *)p;
+	int n1 = *(const int *)q;
+	int res = strcmp(Text[n0].tx_fname, Text[n1].tx_fname);
+
+	return (res ? res : n0 - n1);
+}
+
+static int
+unmatched_text_named(const char *name) {
+	/* the first text with this name that has not been matched yet */
+	int lo = 0, hi = Number_of_Texts;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (strcmp(Text[texts_by_name[mid]].tx_fname, name) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	for (	/* all texts with this name */
+		;
+		lo < Number_of_Texts
+	&&	strcmp(Text[texts_by_name[lo]].tx_fname, name) == 0;
+		lo++
+	) {
+		int n = texts_by_name[lo];
+		if (previous_number[n] < 0) return n;
+	}
+	return -1;
+}
+
+							/* CARRIED RUNS */
+struct stored_run {
+	int sr_n0, sr_n1;		/* numbers in Text[] */
+	size_t sr_seq;			/* order in the file */
+	struct carried_run sr_run;
+};
+
+struct carried_pair {
+	int cp_n0, cp_n1;
+	size_t cp_first;		/* in carried_runs[] */
+	size_t cp_n_runs;
+};
+
+static struct carried_run *carried_runs;	/* to be filled by Malloc() */
+static struct carried_pair *carried_pairs;	/* to be filled by Malloc() */
+static size_t n_carried_pairs;
+
+static int
+stored_run_cmp(const void *p, const void *q) {
+	const struct stored_run *sr0 = (const struct stored_run *)p;
+	const struct stored_run *sr1 = (const struct stored_run *)q;
+
+	if (sr0->sr_n0 != sr1->sr_n0) {
+		return (sr0->sr_n0 < sr1->sr_n0 ? -1 : 1);
+	}
+	if (sr0->sr_n1 != sr1->sr_n1) {
+		return (sr0->sr_n1 < sr1->sr_n1 ? -1 : 1);
+	}
+	return (sr0->sr_seq < sr1->sr_seq ? -1 : sr0->sr_seq > sr1->sr_seq);
+}
+
+static void
+group_carried_runs(struct stored_run *stored, size_t n_stored) {
+	size_t i;
+
+	qsort(stored, n_stored, sizeof (struct stored_run), stored_run_cmp);
+	carried_runs = (struct carried_run *)
+		Malloc((n_stored + 1) * sizeof (struct carried_run));
+	carried_pairs = (struct carried_pair *)
+		Malloc((n_stored + 1) * sizeof (struct carried_pair));
+	n_carried_pairs = 0;
+	for (i = 0; i < n_stored; i++) {
+		const struct stored_run *sr = &stored[i];
+		struct carried_pair *cp =
+			(n_carried_pairs ? &carried_pairs[n_carried_pairs-1] : 0);
+
+		if (	!cp
+		||	cp->cp_n0 != sr->sr_n0 || cp->cp_n1 != sr->sr_n1
+		) {
+			cp = &carried_pairs[n_carried_pairs++];
+			cp->cp_n0 = sr->sr_n0;
+			cp->cp_n1 = sr->sr_n1;
+			cp->cp_first = i;
+			cp->cp_n_runs = 0;
+		}
+		carried_runs[i] = sr->sr_run;
+		cp->cp_n_runs++;
+	}
+}
+
+static const struct carried_pair *
+carried_pair(int n, int m) {
+	size_t lo = 0, hi = n_carried_pairs;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		const struct carried_pair *cp = &carried_pairs[mid];
+
+		if (cp->cp_n0 < n || (cp->cp_n0 == n && cp->cp_n1 < m)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (	lo < n_carried_pairs
+	&&	carried_pairs[lo].cp_n0 == n && carried_pairs[lo].cp_n1 == m
+	) {
+		return &carried_pairs[lo];
+	}
+	return 0;
+}
+
+int
+Is_Carried_Over(int n, int m, const struct carried_run **runs, size_t *n_runs) {
+	if (!previous_number) return 0;
+
+	int pn = previous_number[n];
+	int pm = previous_number[m];
+
+	if (	/* one of them has changed */
+		pn < 0 || pm < 0
+	||	/* their order has changed */
+		(n < m) != (pn < pm) || (n == m) != (pn == pm)
+	||	/* one of them has moved between the new and the old texts */
+		is_new_text(n) != was_new[pn] || is_new_text(m) != was_new[pm]
+	||	/* it may depend on other texts */
+		(n == m && is_set_option('a'))
+	) {
+		return 0;
+	}
+
+	const struct carried_pair *cp = carried_pair(n, m);
+	*runs = (cp ? &carried_runs[cp->cp_first] : carried_runs);
+	*n_runs = (cp ? cp->cp_n_runs : 0);
+	return 1;
+}
+
+							/* READING */
+static size_t n_unchanged_texts;
+
+static void
+read_previous_results(FILE *f, const char *fname) {
+	int n_prev = (int)get_number(f, fname);
+	int *current_number = (int *)Malloc((n_prev + 1) * sizeof (int));
+	int p, n;
+
+	/* the texts */
+	was_new = (char *)Malloc(n_prev + 1);
+	for (p = 0; p < n_prev; p++) {
+		char *name = get_string(f, fname);
+		struct text_key tk;
+
+		was_new[p] = (char)get_number(f, fname);
+		tk.tk_size = get_number(f, fname);
+		tk.tk_hash = get_number(f, fname);
+
+		n = unmatched_text_named(name);
+		if (	n >= 0
+		&&	text_key[n].tk_size == tk.tk_size
+		&&	text_key[n].tk_hash == tk.tk_hash
+		) {
+			previous_number[n] = p;
+			n_unchanged_texts++;
+		} else {
+			n = -1;
+		}
+		current_number[p] = n;
+		Free(name);
+	}
+
+	/* the runs of pairs of unchanged texts */
+	struct stored_run *stored = 0;
+	size_t n_stored = 0;
+	size_t stored_size = 0;
+	size_t seq;
+
+	for (seq = 0; ; seq++) {
+		uint64_t p0 = get_number(f, fname);
+		if (p0 == END_OF_RUNS) break;
+		uint64_t i0 = get_number(f, fname);
+		uint64_t p1 = get_number(f, fname);
+		uint64_t i1 = get_number(f, fname);
+		uint64_t size = get_number(f, fname);
+
+		if (p0 >= (uint64_t)n_prev || p1 >= (uint64_t)n_prev) {
+			results_error(fname, "text number out of range");
+		}
+		int n0 = current_number[p0];
+		int n1 = current_number[p1];
+		if (n0 < 0 || n1 < 0) continue;
+
+		if (	i0 + size > text_key[n0].tk_size
+		||	i1 + size > text_key[n1].tk_size
+		) {
+			results_error(fname, "run out of range");
+		}
+		if (n_stored == stored_size) {
+			stored_size = (stored_size ? 2 * stored_size : 1024);
+			stored = (struct stored_run *)Realloc(stored,
+				stored_size * sizeof (struct stored_run));
+		}
+		struct stored_run *sr = &stored[n_stored++];
+		sr->sr_n0 = n0;
+		sr->sr_n1 = n1;
+		sr->sr_seq = seq;
+		sr->sr_run.cr_i0 = (size_t)i0;
+		sr->sr_run.cr_i1 = (size_t)i1;
+		sr->sr_run.cr_size = (size_t)size;
+	}
+
+	group_carried_runs(stored, n_stored);
+	if (stored) Free(stored);
+	Free(current_number);
+}
+
+static int
+open_previous_results(const char *fname) {
+	/* returns 1 if there are previous results made like these */
+	char magic[sizeof INCREMENTAL_MAGIC];
+	FILE *f = fopen(fname, "rb");
+
+	if (!f) return 0;		/* the first run */
+
+	magic[sizeof INCREMENTAL_MAGIC - 1] = '\0';
+	if (	fread(magic, sizeof INCREMENTAL_MAGIC - 1, 1, f) != 1
+	||	strcmp(magic, INCREMENTAL_MAGIC) != 0
+	) {
+		results_error(fname, "not a SIM results file");
+	}
+	if (!has_same_settings(f, fname)) {
+		fprintf(stderr, ">>>> Results file %s %s <<<<\n", fname,
+			"was made with other options; all files are compared");
+		fclose(f);
+		return 0;
+	}
+
+	read_previous_results(f, fname);
+	fclose(f);
+	return 1;
+}
+
+							/* WRITING */
+static FILE *results_file;
+static char *tmp_name;
+
+static void
+open_new_results(const char *fname) {
+	int n;
+
+	tmp_name = (char *)Malloc(strlen(fname) + 10);
+	sprintf(tmp_name, "%s.tmp", fname);
+	results_file = fopen(tmp_name, "wb");
+	if (!results_file) {
+		results_error(tmp_name, "cannot open for writing");
+	}
+	if (	fwrite(INCREMENTAL_MAGIC, strlen(INCREMENTAL_MAGIC), 1,
+			results_file)
+		!= 1
+	) {
+		results_error(tmp_name, "cannot write");
+	}
+	put_settings(results_file, tmp_name);
+
+	put_number(results_file, tmp_name, (uint64_t)Number_of_Texts);
+	for (n = 0; n < Number_of_Texts; n++) {
+		put_string(results_file, tmp_name, Text[n].tx_fname);
+		put_number(results_file, tmp_name, is_new_text(n) ? 1 : 0);
+		put_number(results_file, tmp_name, text_key[n].tk_size);
+		put_number(results_file, tmp_name, text_key[n].tk_hash);
+	}
+}
+
+void
+Record_Incremental_Run(
+	const struct text *txt0, size_t i0,
+	const struct text *txt1, size_t i1,
+	size_t size
+) {
+	put_number(results_file, tmp_name, (uint64_t)(txt0 - Text));
+	put_number(results_file, tmp_name, (uint64_t)(i0 - txt0->tx_start));
+	put_number(results_file, tmp_name, (uint64_t)(txt1 - Text));
+	put_number(results_file, tmp_name, (uint64_t)(i1 - txt1->tx_start));
+	put_number(results_file, tmp_name, (uint64_t)size);
+}
+
+							/* MAIN ENTRIES */
+void
+Start_Incremental(void) {
+	const char *fname = Incremental_Name;
+	int n;
+
+	text_key = (struct text_key *)
+		Malloc((Number_of_Texts + 1) * sizeof (struct text_key));
+	previous_number = (int *)Malloc((Number_of_Texts + 1) * sizeof (int));
+	texts_by_name = (int *)Malloc((Number_of_Texts + 1) * sizeof (int));
+	for (n = 0; n < Number_of_Texts; n++) {
+		make_text_key(&Text[n], &text_key[n]);
+		previous_number[n] = -1;
+		texts_by_name[n] = n;
+	}
+	qsort(texts_by_name, Number_of_Texts, sizeof (int), name_cmp);
+
+	n_unchanged_texts = 0;
+	if (!open_previous_results(fname)) {
+		/* everything is compared */
+		Free(previous_number); previous_number = 0;
+	}
+	Free(texts_by_name); texts_by_name = 0;
+
+	if (is_set_option('D')) {
+		fprintf(stderr, "Incremental: %s of %d texts unchanged\n",
+			size_t2string(n_unchanged_texts), Number_of_Texts);
+	}
+
+	open_new_results(fname);
+}
+
+void
+Finish_Incremental(void) {
+	const char *fname = Incremental_Name;
+
+	put_number(results_file, tmp_name, END_OF_RUNS);
+	if (fclose(results_file) != 0) {
+		results_error(tmp_name, "cannot write");
+	}
+	results_file = 0;
+	remove(fname);			/* rename() may not replace it */
+	if (rename(tmp_name, fname) != 0) {
+		results_error(fname, "cannot replace");
+	}
+	Free(tmp_name); tmp_name = 0;
+
+	Free(text_key); text_key = 0;
+	if (previous_number) {
+		Free(previous_number); previous_number = 0;
+	}
+	if (was_new) {
+		Free(was_new); was_new = 0;
+	}
+	if (carried_runs) {
+		Free(carried_runs); carried_runs = 0;
+	}
+	if (carried_pairs) {
+		Free(carried_pairs); carried_pairs = 0;
+	}
+	n_carried_pairs = 0;
+}
@@ -0,0 +1,40 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Incremental comparison, for -U F (Incremental_Name), under -e.
+
+	Under -e the runs of a pair of texts depend on these two texts only,
+	so they need not be found again as long as neither has changed.
+	Under -U F the runs found are kept in the results file F, with the
+	name, the number of tokens and a hash of the token stream of each
+	text. Start_Incremental(), called after Pass 1, reads the F of the
+	previous run, if it was made with the same options, and finds the
+	texts whose token streams are still the same.
+	Is_Carried_Over(n, m, &runs, &n_runs) then tells if the pair of
+	Text[n] and Text[m] was compared in that run as it would be now, and
+	both texts are unchanged; if so, it sets runs and n_runs to the runs
+	of the pair from F, in the order in which they were found, with their
+	positions as offsets in the texts, and the pair is not compared again.
+
+	Each run passed on by add_run() goes to Record_Incremental_Run(),
+	and Finish_Incremental() replaces F by the new results.
+*/
+
+extern const char *Incremental_Name;
+
+struct carried_run {
+	size_t cr_i0;			/* offset in Text[n] */
+	size_t cr_i1;			/* offset in Text[m] */
+	size_t cr_size;
+};
+
+extern void Start_Incremental(void);
+extern int Is_Carried_Over(
+	int n, int m, const struct carried_run **runs, size_t *n_runs
+);
+extern void Record_Incremental_Run(
+	const struct text *txt0, size_t i0,
+	const struct text *txt1, size_t i1,
+	size_t size
+);
+extern void Finish_Incremental(void);
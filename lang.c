@@ -16,32 +16,64 @@
 #include	"lang.h"
 
 
-FILE *yyin;
+int
+yylex_init_extra(struct lex_state *ls, void **scanner) {
+	*scanner = ls;
+	return 0;
+}
+
+void
+yyset_in(FILE *f, void *scanner) {
+	(void)f;
+	(void)scanner;
+}
 
 int
-yylex(void) {
+yylex(void *scanner) {
 #ifdef	lint
 	(void)May_Be_Start_Of_Run(0);
 	(void)Best_Run_Size(0, 0);
+	Prepare_Best_Run_Size();
 	(void)idf_in_list(0, 0, 0, 0);
 	(void)idf_hashed(0);
 	(void)lower_case(0);
 #endif
+	(void)scanner;
+	return 0;
+}
+
+char *
+yyget_text(void *scanner) {
+	(void)scanner;
+	return "";
+}
+
+int
+yylex_destroy(void *scanner) {
+	(void)scanner;
 	return 0;
 }
 
+struct yy_buffer_state *
+yy_scan_buffer(char *base, size_t size, void *scanner) {
+	if (base == 0 || size == 0 || scanner == 0) return 0;
+	return (struct yy_buffer_state *)scanner;
+}
+
 void
-yystart(void) {
+yy_delete_buffer(struct yy_buffer_state *b, void *scanner) {
+	(void)b;
+	(void)scanner;
+}
+
+void
+yystart(void *scanner) {
 #ifdef	lint
 	Init_Language_Properties(0, 0, 0, 0);
 #endif
+	(void)scanner;
 }
 
-Token lex_token;
-size_t lex_nl_cnt;
-size_t lex_tk_cnt;
-size_t lex_non_ASCII_cnt;
-
 const char *Subject;
 
 void
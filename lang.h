@@ -18,16 +18,49 @@
 	*lang.c .
 */
 
-/* defined by lex(1) or flex(1) */
-extern FILE *yyin;
-extern int yylex(void);
-extern void yystart(void);
+/*	The state of a scanner as seen by the program: the token produced and
+	the counts.  Each scanner has its own, passed to it as its "extra"
+	data, so several files can be scanned at the same time, on different
+	threads.
+*/
+struct lex_state {
+	Token ls_token;			/* token produced, or End_Of_Line */
+	size_t ls_nl_cnt;		/* line count */
+	size_t ls_tk_cnt;		/* token position */
+	size_t ls_non_ASCII_cnt;	/* # of non-ASCII chars found */
+	int ls_lang_state[2];		/* for the state variables of the
+					   *lang.l proper */
+};
+
+/* defined by flex(1), which produces a reentrant scanner */
+extern int yylex_init_extra(struct lex_state *ls, void **scanner);
+extern void yyset_in(FILE *f, void *scanner);
+extern int yylex(void *scanner);
+extern char *yyget_text(void *scanner);
+extern int yylex_destroy(void *scanner);
+struct yy_buffer_state;
+extern struct yy_buffer_state *yy_scan_buffer(
+	char *base, size_t size, void *scanner
+);
+extern void yy_delete_buffer(struct yy_buffer_state *b, void *scanner);
 
 /* defined by the pertinent *lang.l */
-extern Token lex_token;			/* token produced, or End_Of_Line */
-extern size_t lex_nl_cnt;		/* line count */
-extern size_t lex_tk_cnt;		/* token position */
-extern size_t lex_non_ASCII_cnt;	/* # of non-ASCII chars found */
+extern void yystart(void *scanner);
+
+/*	A binary with several front ends (see multilang.c) sets these two in
+	Init_Language(): Language_Of_File() yields the number of the front end
+	for a file, and the stream module passes it to Select_Language()
+	before the file is scanned.  Both are 0 in a binary with one front end.
+*/
+extern int (*Language_Of_File)(const char *fname);
+extern void (*Select_Language)(void *scanner, int language);
+
+/* the state of the scanner of the main thread, in the traditional names */
+extern struct lex_state Lex_State;
+#define	lex_token		(Lex_State.ls_token)
+#define	lex_nl_cnt		(Lex_State.ls_nl_cnt)
+#define	lex_tk_cnt		(Lex_State.ls_tk_cnt)
+#define	lex_non_ASCII_cnt	(Lex_State.ls_non_ASCII_cnt)
 
 extern const char *Subject;
 extern void Init_Language(void);
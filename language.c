@@ -35,3 +35,8 @@ Best_Run_Size(const Token *str, size_t size) {
 	return 0;
 }
 
+void
+Prepare_Best_Run_Size(void) {
+	abort();
+}
+
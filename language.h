@@ -24,3 +24,8 @@ extern const char *Subject;
 extern void Init_Language(void);
 extern int May_Be_Start_Of_Run(Token ch);
 extern size_t Best_Run_Size(const Token *str, size_t size);
+/*	Prepare_Best_Run_Size() is called by the main thread before the
+	search for runs, once the texts are in Token_Array[], so the language
+	can derive data from them for Best_Run_Size().
+*/
+extern void Prepare_Best_Run_Size(void);
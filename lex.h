@@ -5,8 +5,13 @@
 
 /* Macros for use in the *lang.l files */
 /* All returns in *lang.l files go through these macros which set
-   lex_token, lex_tk_cnt, and lex_nl_cnt.
+   ls_token, ls_tk_cnt, and ls_nl_cnt in the state of the scanner.
 */
-#define	return_tk(tk)	{lex_tk_cnt++; lex_token = (tk); return 1;}
-#define	return_ch(ch)	{lex_tk_cnt++; lex_token = int2Token((int)(ch)); return 1;}
-#define	return_eol()	{lex_nl_cnt++; lex_token = End_Of_Line; return 1;}
+#define	return_tk(tk)	{yyextra->ls_tk_cnt++; yyextra->ls_token = (tk); return 1;}
+#define	return_ch(ch)	{yyextra->ls_tk_cnt++; \
+			 yyextra->ls_token = int2Token((int)(ch)); return 1;}
+#define	return_eol()	{yyextra->ls_nl_cnt++; \
+			 yyextra->ls_token = End_Of_Line; return 1;}
+
+/* The non-ASCII characters are counted through this one */
+#define	count_non_ASCII()	(yyextra->ls_non_ASCII_cnt++)
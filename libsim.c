@@ -0,0 +1,334 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	The library interface of libsim.h.
+
+	The library is linked with the sim modules instead of sim.c, and
+	supplies the entries of sim.h. A context keeps its texts as names
+	and buffers of its own; Sim_Compare() makes the buffers members in
+	memory (see Add_Memory_Member() in archive.h), passes the names to
+	Read_Input_Files() as sim's main() passes its arguments, and copies
+	the runs into the context after Pass 2, instead of printing them.
+
+	fatal() does not stop the program while a Sim_Compare() is in
+	progress, but returns from it, through a longjmp(), with the message
+	in the context. The memory of the sim modules that is in use at
+	that moment may not all be given back.
+*/
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<setjmp.h>
+#include	<pthread.h>
+
+#include	"system.par"
+#include	"settings.par"
+#include	"sim.h"
+#include	"options.h"
+#include	"token.h"
+#include	"tokenarray.h"
+#include	"text.h"
+#include	"lang.h"
+#include	"runs.h"
+#include	"hash.h"
+#include	"compare.h"
+#include	"pass1.h"
+#include	"pass2.h"
+#include	"archive.h"
+#include	"Malloc.h"
+#include	"libsim.h"
+
+#define	MAX_ERROR_LENGTH	200
+
+struct sim_context {
+	/* the texts, as the arguments of sim */
+	const char **sc_names;		/* to be filled by Malloc() */
+	char **sc_bufs;			/* 0 for a separator */
+	size_t *sc_sizes;
+	int sc_n_texts;
+	int sc_texts_size;
+
+	/* the options */
+	char sc_options[sizeof LIBSIM_OPTIONS];
+	int sc_min_run_size;
+
+	/* the results */
+	struct sim_match *sc_matches;	/* to be filled by Malloc() */
+	size_t sc_n_matches;
+	size_t sc_matches_size;
+	size_t sc_next_match;
+	char sc_error[MAX_ERROR_LENGTH];
+};
+
+/* the Sim_Compare() in progress, protected by library_lock */
+static pthread_mutex_t library_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_context *current_context;
+static jmp_buf *fatal_return;
+static FILE *null_file;
+
+							/* ENTRIES OF SIM.H */
+const char *Version = "libsim";
+int Min_Run_Size = DEFAULT_MIN_RUN_SIZE;
+int Page_Width = DEFAULT_PAGE_WIDTH;
+int Threshold_Percentage = 1;
+FILE *Output_File;
+FILE *Debug_File;
+const char *Token_Name = "token";
+
+int
+is_new_old_separator(const char *s) {
+	return strcmp(s, "/") == 0 || strcmp(s, "|") == 0;
+}
+
+const char *
+size_t2string(size_t s) {
+	static char buff[30];
+
+	sprintf(buff, "%lu", (unsigned long)s);
+	return buff;
+}
+
+void
+fatal(const char *msg) {
+	if (!fatal_return) {
+		fprintf(stderr, "libsim: %s\n", msg);
+		exit(1);
+	}
+	strncpy(current_context->sc_error, msg, MAX_ERROR_LENGTH - 1);
+	current_context->sc_error[MAX_ERROR_LENGTH - 1] = '\0';
+	longjmp(*fatal_return, 1);
+}
+
+							/* CONTEXTS */
+struct sim_context *
+Sim_New_Context(void) {
+	struct sim_context *sc = new(struct sim_context);
+
+	sc->sc_names = 0;
+	sc->sc_bufs = 0;
+	sc->sc_sizes = 0;
+	sc->sc_n_texts = 0;
+	sc->sc_texts_size = 0;
+	sc->sc_options[0] = '\0';
+	sc->sc_min_run_size = DEFAULT_MIN_RUN_SIZE;
+	sc->sc_matches = 0;
+	sc->sc_n_matches = 0;
+	sc->sc_matches_size = 0;
+	sc->sc_next_match = 0;
+	sc->sc_error[0] = '\0';
+	return sc;
+}
+
+int
+Sim_Set_Options(struct sim_context *sc, const char *options) {
+	size_t n = 0;
+	const char *p;
+
+	sc->sc_options[0] = '\0';
+	for (p = options; *p; p++) {
+		if (!strchr(LIBSIM_OPTIONS, *p)) {
+			sprintf(sc->sc_error, "option -%c not available", *p);
+			return -1;
+		}
+		if (!strchr(sc->sc_options, *p)) {
+			sc->sc_options[n++] = *p;
+			sc->sc_options[n] = '\0';
+		}
+	}
+	return 0;
+}
+
+int
+Sim_Set_Min_Run_Size(struct sim_context *sc, int size) {
+	if (size <= 0) {
+		strcpy(sc->sc_error, "bad run size");
+		return -1;
+	}
+	sc->sc_min_run_size = size;
+	return 0;
+}
+
+static void
+add_arg(struct sim_context *sc, const char *name, char *buf, size_t size) {
+	if (sc->sc_n_texts == sc->sc_texts_size) {
+		/* allocated arrays are full; increase their size */
+		sc->sc_texts_size =
+			(sc->sc_texts_size ? 2 * sc->sc_texts_size : 16);
+		sc->sc_names = (const char **)Realloc(sc->sc_names,
+			sc->sc_texts_size * sizeof (const char *));
+		sc->sc_bufs = (char **)Realloc(sc->sc_bufs,
+			sc->sc_texts_size * sizeof (char *));
+		sc->sc_sizes = (size_t *)Realloc(sc->sc_sizes,
+			sc->sc_texts_size * sizeof (size_t));
+	}
+	char *copy = (char *)Malloc(strlen(name) + 1);
+
+	sc->sc_names[sc->sc_n_texts] = strcpy(copy, name);
+	sc->sc_bufs[sc->sc_n_texts] = buf;
+	sc->sc_sizes[sc->sc_n_texts] = size;
+	sc->sc_n_texts++;
+}
+
+void
+Sim_Add_Text(
+	struct sim_context *sc, const char *name, const char *buf, size_t size
+) {
+	/* the scanner wants two null bytes after the contents */
+	char *contents = (char *)Malloc(size + 2);
+
+	memcpy(contents, buf, size);
+	contents[size] = contents[size + 1] = '\0';
+	add_arg(sc, name, contents, size);
+}
+
+void
+Sim_Add_Separator(struct sim_context *sc) {
+	add_arg(sc, "/", 0, 0);
+}
+
+const char *
+Sim_Error(const struct sim_context *sc) {
+	return sc->sc_error;
+}
+
+static void
+free_matches(struct sim_context *sc) {
+	if (sc->sc_matches) {
+		Free(sc->sc_matches); sc->sc_matches = 0;
+	}
+	sc->sc_n_matches = 0;
+	sc->sc_matches_size = 0;
+	sc->sc_next_match = 0;
+}
+
+void
+Sim_Free_Context(struct sim_context *sc) {
+	int n;
+
+	for (n = 0; n < sc->sc_n_texts; n++) {
+		Free((char *)sc->sc_names[n]);
+		if (sc->sc_bufs[n]) {
+			Free(sc->sc_bufs[n]);
+		}
+	}
+	if (sc->sc_names) {
+		Free(sc->sc_names);
+		Free(sc->sc_bufs);
+		Free(sc->sc_sizes);
+	}
+	free_matches(sc);
+	Free(sc);
+}
+
+							/* RESULTS */
+static void
+add_match(struct sim_context *sc, const struct run *run) {
+	const struct chunk *cnk0 = &run->rn_chunk0;
+	const struct chunk *cnk1 = &run->rn_chunk1;
+
+	if (sc->sc_n_matches == sc->sc_matches_size) {
+		/* allocated array is full; increase its size */
+		sc->sc_matches_size =
+			(sc->sc_matches_size ? 2 * sc->sc_matches_size : 64);
+		sc->sc_matches = (struct sim_match *)Realloc(sc->sc_matches,
+			sc->sc_matches_size * sizeof (struct sim_match));
+	}
+	struct sim_match *sm = &sc->sc_matches[sc->sc_n_matches++];
+
+	sm->sm_name0 = cnk0->ch_text->tx_fname;
+	sm->sm_first_line0 = cnk0->ch_first.ps_nl_cnt;
+	sm->sm_last_line0 = cnk0->ch_last.ps_nl_cnt;
+	sm->sm_name1 = cnk1->ch_text->tx_fname;
+	sm->sm_first_line1 = cnk1->ch_first.ps_nl_cnt;
+	sm->sm_last_line1 = cnk1->ch_last.ps_nl_cnt;
+	sm->sm_size = run->rn_size;
+}
+
+const struct sim_match *
+Sim_Next_Match(struct sim_context *sc) {
+	if (sc->sc_next_match == sc->sc_n_matches) return 0;
+	return &sc->sc_matches[sc->sc_next_match++];
+}
+
+							/* COMPARING */
+static void
+set_options(const struct sim_context *sc) {
+	/* as main() in sim.c does */
+	const char *p;
+
+	clear_options();
+	Threshold_Percentage = 1;
+	Init_Language();
+	for (p = sc->sc_options; *p; p++) {
+		set_option(*p);
+	}
+	set_option('T');		/* no reports of the input files */
+	allow_at_most_one_option_out_of("aS");
+	allow_at_most_one_option_out_of("sS");
+	Min_Run_Size = sc->sc_min_run_size;
+	Select_Window_Hash();
+}
+
+static void
+compare_texts(struct sim_context *sc) {
+	const struct run *run;
+	int n;
+
+	if (!null_file) {
+		null_file = fopen(NULLFILE, "w");
+		if (!null_file) fatal("cannot open the null file");
+	}
+	Output_File = Debug_File = null_file;
+	set_options(sc);
+
+	for (n = 0; n < sc->sc_n_texts; n++) {
+		if (!sc->sc_bufs[n]) continue;
+		Add_Memory_Member(sc->sc_names[n],
+			sc->sc_bufs[n], sc->sc_sizes[n]);
+	}
+	Read_Input_Files(sc->sc_n_texts, sc->sc_names);
+	Compare_Files();
+	Retrieve_Runs();
+
+	for (	run = (is_set_option('u') ? unsorted_runs() : sorted_runs());
+		run;
+		run = run->rn_next
+	) {
+		add_match(sc, run);
+	}
+}
+
+static void
+clean_up(void) {
+	discard_runs();
+	Free_Text();
+	Free_Token_Array();
+	Free_Archives();
+}
+
+int
+Sim_Compare(struct sim_context *sc) {
+	jmp_buf env;
+	int ok;
+
+	pthread_mutex_lock(&library_lock);
+	free_matches(sc);
+	sc->sc_error[0] = '\0';
+	current_context = sc;
+	fatal_return = &env;
+	if (setjmp(env) == 0) {
+		if (sc->sc_n_texts > 0) {
+			compare_texts(sc);
+		}
+		ok = 1;
+	}
+	else {
+		ok = 0;
+	}
+	fatal_return = 0;
+	current_context = 0;
+	clean_up();
+	pthread_mutex_unlock(&library_lock);
+	return (ok ? 0 : -1);
+}
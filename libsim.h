@@ -0,0 +1,59 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	The similarity tester as a library, libsim.a, for programs that
+	compare texts they hold in memory, without running sim and parsing
+	its output. It is made with one front end, like the sim_* programs;
+	see the Makefile.
+
+	All work is done through a context, which holds the texts, the
+	options and the results of one comparison:
+
+	    struct sim_context *sc = Sim_New_Context();
+	    Sim_Set_Options(sc, "e");		option letters, as for sim
+	    Sim_Set_Min_Run_Size(sc, 12);	like -r 12
+	    Sim_Add_Text(sc, "a.c", buf, size);	copies buf
+	    Sim_Add_Separator(sc);		like / among the arguments
+	    Sim_Compare(sc);			reads, indexes and compares
+	    while ((sm = Sim_Next_Match(sc))) ...
+	    Sim_Free_Context(sc);
+
+	The option letters accepted are those of LIBSIM_OPTIONS below; the
+	others concern the output or the files and have no meaning here.
+	Sim_Compare() yields 0 on success; otherwise Sim_Error() yields the
+	message that sim would have printed. The matches are the runs, in
+	the order of sim's output, with the names as given to
+	Sim_Add_Text() and the line numbers counted from 1; they stay
+	valid until the next Sim_Compare() or Sim_Free_Context().
+
+	Any number of contexts may exist, and be used from different
+	threads. The comparison itself still uses the global data of the
+	sim modules, though, so the Sim_Compare() calls of different
+	contexts are done one at a time, under a lock of the library.
+*/
+
+#define	LIBSIM_OPTIONS	"aefFsSu"
+
+struct sim_context;
+
+struct sim_match {
+	const char *sm_name0;		/* the text containing the run */
+	size_t sm_first_line0;
+	size_t sm_last_line0;
+	const char *sm_name1;		/* the text it was found in */
+	size_t sm_first_line1;
+	size_t sm_last_line1;
+	size_t sm_size;			/* in tokens */
+};
+
+extern struct sim_context *Sim_New_Context(void);
+extern int Sim_Set_Options(struct sim_context *sc, const char *options);
+extern int Sim_Set_Min_Run_Size(struct sim_context *sc, int size);
+extern void Sim_Add_Text(
+	struct sim_context *sc, const char *name, const char *buf, size_t size
+);
+extern void Sim_Add_Separator(struct sim_context *sc);
+extern int Sim_Compare(struct sim_context *sc);
+extern const char *Sim_Error(const struct sim_context *sc);
+extern const struct sim_match *Sim_Next_Match(struct sim_context *sc);
+extern void Sim_Free_Context(struct sim_context *sc);
@@ -0,0 +1,329 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+#include	<stdio.h>
+#include	<string.h>
+
+#include	"sim.h"
+#include	"Malloc.h"
+#include	"parallel.h"
+#include	"mapped.h"
+
+const char *Scratch_Directory;
+int Huge_Pages;
+
+#ifndef	MSDOS
+
+#include	<stdlib.h>
+#include	<unistd.h>
+#include	<sys/types.h>
+#include	<sys/mman.h>
+#ifdef	__linux__
+#include	<sys/syscall.h>
+#endif
+
+/* the few arrays that are mapped at any one time */
+#define	MAX_MAPPINGS	16
+
+struct mapping {
+	char *mp_addr;			/* 0 if the entry is free */
+	size_t mp_size;
+	int mp_fd;			/* -1 for anonymous memory */
+};
+static struct mapping mappings[MAX_MAPPINGS];
+
+static struct mapping *
+free_mapping(void) {
+	int m;
+
+	for (m = 0; m < MAX_MAPPINGS; m++) {
+		if (!mappings[m].mp_addr) return &mappings[m];
+	}
+	fatal("internal error, too many mapped arrays");
+	/*NOTREACHED*/
+	return 0;
+}
+
+static struct mapping *
+mapping_of(const void *p) {
+	int m;
+
+	if (!p) return 0;
+	for (m = 0; m < MAX_MAPPINGS; m++) {
+		if (mappings[m].mp_addr == (const char *)p) return &mappings[m];
+	}
+	return 0;
+}
+
+static char *
+map_file(int fd, size_t size) {
+	/* maps the first size bytes of fd; returns 0 on failure */
+	if (ftruncate(fd, (off_t)size) != 0) return 0;
+
+	void *addr = mmap(0, (size ? size : 1), PROT_READ|PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	return (addr == MAP_FAILED ? 0 : (char *)addr);
+}
+
+							/* HUGE PAGES */
+/*	Under -l (Huge_Pages) the arrays are anonymous memory of a whole
+	number of huge pages, aligned on a huge page. Explicit huge pages
+	(MAP_HUGETLB) are used if the system has them in reserve; otherwise
+	the memory is marked for transparent huge pages (MADV_HUGEPAGE).
+	Under -j, on a machine with several NUMA nodes, the pages of the
+	arrays are interleaved over the nodes, so the random accesses of
+	all the threads are spread over all memory controllers, rather than
+	all going to the node of the thread that touched the pages first.
+*/
+#define	HUGE_PAGE_SIZE	((size_t)2 << 20)
+
+static size_t
+huge_size(size_t size) {
+	/* size rounded up to a whole number of huge pages, at least one */
+	size_t hs = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+	return (hs ? hs : HUGE_PAGE_SIZE);
+}
+
+#if	defined(__linux__) && defined(SYS_mbind)
+
+#define	MPOL_INTERLEAVE_	3	/* from <numaif.h>, which we do not need */
+#define	MAX_NODES		1024
+
+static unsigned long node_mask[MAX_NODES / (8 * sizeof (unsigned long))];
+static int n_nodes = -1;		/* -1 if not known yet */
+
+static void
+read_node_mask(void) {
+	/* from a list like 0-3,6 in /sys/devices/system/node/online */
+	FILE *f = fopen("/sys/devices/system/node/online", "r");
+	int lo, hi;
+
+	n_nodes = 0;
+	if (!f) return;
+	while (fscanf(f, "%d", &lo) == 1) {
+		int ch = getc(f);
+
+		hi = lo;
+		if (ch == '-') {
+			if (fscanf(f, "%d", &hi) != 1) break;
+			ch = getc(f);
+		}
+		for (; lo <= hi && lo < MAX_NODES; lo++) {
+			node_mask[lo / (8 * sizeof (unsigned long))] |=
+				1UL << (lo % (8 * sizeof (unsigned long)));
+			n_nodes++;
+		}
+		if (ch != ',') break;
+	}
+	fclose(f);
+}
+
+static void
+interleave(char *addr, size_t size) {
+	if (Number_of_Threads <= 1) return;
+	if (n_nodes < 0) {
+		read_node_mask();
+	}
+	if (n_nodes <= 1) return;
+	/* a failure only costs speed */
+	(void)syscall(SYS_mbind, addr, size, MPOL_INTERLEAVE_,
+		node_mask, (unsigned long)MAX_NODES + 1, 0);
+}
+
+#else	/* no mbind() */
+
+static void
+interleave(char *addr, size_t size) {
+	if (addr == addr || size == size) return;
+}
+
+#endif	/* no mbind() */
+
+static char *
+map_huge(size_t size) {
+	/* maps size bytes, a whole number of huge pages; 0 on failure */
+	void *addr;
+
+#ifdef	MAP_HUGETLB
+	addr = mmap(0, size, PROT_READ|PROT_WRITE,
+		MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+	if (addr != MAP_FAILED) {
+		interleave((char *)addr, size);
+		return (char *)addr;
+	}
+#endif	/* MAP_HUGETLB */
+
+	/* map one huge page more, and trim it to alignment */
+	addr = mmap(0, size + HUGE_PAGE_SIZE, PROT_READ|PROT_WRITE,
+		MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) return 0;
+
+	char *start = (char *)addr;
+	size_t head = (HUGE_PAGE_SIZE - ((size_t)start & (HUGE_PAGE_SIZE - 1)))
+		& (HUGE_PAGE_SIZE - 1);
+	if (head) {
+		munmap(start, head);
+	}
+	munmap(start + head + size, HUGE_PAGE_SIZE - head);
+	start += head;
+
+#ifdef	MADV_HUGEPAGE
+	(void)madvise(start, size, MADV_HUGEPAGE);
+#endif	/* MADV_HUGEPAGE */
+	interleave(start, size);
+	return start;
+}
+
+static void *
+try_huge_calloc(size_t size) {
+	/* anonymous memory is all zeroes */
+	size_t hs = huge_size(size);
+	struct mapping *mp = free_mapping();
+	char *addr = map_huge(hs);
+
+	if (!addr) return 0;
+	mp->mp_addr = addr;
+	mp->mp_size = hs;
+	mp->mp_fd = -1;
+	return addr;
+}
+
+static void *
+try_huge_realloc(struct mapping *mp, size_t s) {
+	size_t hs = huge_size(s);
+
+	if (hs == mp->mp_size) return mp->mp_addr;
+
+	char *addr = map_huge(hs);
+	if (!addr) return 0;
+	memcpy(addr, mp->mp_addr, (hs < mp->mp_size ? hs : mp->mp_size));
+	munmap(mp->mp_addr, mp->mp_size);
+	mp->mp_addr = addr;
+	mp->mp_size = hs;
+	return addr;
+}
+
+							/* MAPPED ARRAYS */
+void *
+TryMap_Calloc(size_t n, size_t s) {
+	size_t size = n * s;
+	if (n && size / n != s) return 0;
+
+	if (!Scratch_Directory) {
+		return (Huge_Pages ? try_huge_calloc(size) : TryCalloc(n, s));
+	}
+
+	struct mapping *mp = free_mapping();
+
+	/* create an anonymous file in the scratch directory */
+	char *fname = (char *)Malloc(strlen(Scratch_Directory) + 20);
+	sprintf(fname, "%s/simXXXXXX", Scratch_Directory);
+	int fd = mkstemp(fname);
+	if (fd < 0) {
+		char *msg = (char *)Malloc(strlen(Scratch_Directory) + 100);
+
+		sprintf(msg, "cannot create files in scratch directory `%s'",
+			Scratch_Directory);
+		fatal(msg);
+		/*NOTREACHED*/
+	}
+	unlink(fname);
+	Free(fname);
+
+	/* the file is new, so the array is all zeroes */
+	char *addr = map_file(fd, size);
+	if (!addr) {
+		close(fd);
+		return 0;
+	}
+	mp->mp_addr = addr;
+	mp->mp_size = size;
+	mp->mp_fd = fd;
+	return addr;
+}
+
+void *
+Map_Calloc(size_t n, size_t s) {
+	void *p = TryMap_Calloc(n, s);
+
+	if (!p) fatal("out of memory: cannot map array");
+	return p;
+}
+
+void *
+TryMap_Realloc(void *p, size_t s) {
+	struct mapping *mp = mapping_of(p);
+
+	if (!mp) {
+		if (!p && (Scratch_Directory || Huge_Pages)) {
+			return TryMap_Calloc(1, s);
+		}
+		return TryRealloc(p, s);
+	}
+	if (mp->mp_fd < 0) return try_huge_realloc(mp, s);
+
+	/* the contents are in the file, so we map it anew */
+	char *addr = map_file(mp->mp_fd, s);
+	if (!addr) return 0;
+	munmap(mp->mp_addr, (mp->mp_size ? mp->mp_size : 1));
+	mp->mp_addr = addr;
+	mp->mp_size = s;
+	return addr;
+}
+
+void
+Map_Free(void *p) {
+	struct mapping *mp = mapping_of(p);
+
+	if (!mp) {
+		Free(p);
+		return;
+	}
+	munmap(mp->mp_addr, (mp->mp_size ? mp->mp_size : 1));
+	if (mp->mp_fd >= 0) {
+		close(mp->mp_fd);
+	}
+	mp->mp_addr = 0;
+}
+
+void
+Map_Advise(void *p, int advice) {
+	struct mapping *mp = mapping_of(p);
+
+	/* anonymous memory has no file to read ahead in */
+	if (!mp || !mp->mp_size || mp->mp_fd < 0) return;
+	posix_madvise(mp->mp_addr, mp->mp_size,
+		(advice == Map_Sequential ?
+			POSIX_MADV_SEQUENTIAL : POSIX_MADV_RANDOM)
+	);
+}
+
+#else	/* MSDOS */
+
+void *
+TryMap_Calloc(size_t n, size_t s) {
+	return TryCalloc(n, s);
+}
+
+void *
+Map_Calloc(size_t n, size_t s) {
+	return Calloc(n, s);
+}
+
+void *
+TryMap_Realloc(void *p, size_t s) {
+	return TryRealloc(p, s);
+}
+
+void
+Map_Free(void *p) {
+	Free(p);
+}
+
+void
+Map_Advise(void *p, int advice) {
+	if (p == p || advice == advice) return;
+}
+
+#endif	/* MSDOS */
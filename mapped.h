@@ -0,0 +1,46 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Large arrays in memory-mapped files.
+
+	When Scratch_Directory is set (-m option), the arrays allocated by
+	this module live in memory-mapped files in that directory, so the
+	operating system can page them out to the file rather than to swap;
+	this allows inputs larger than the physical memory. The files are
+	removed as soon as they are created, so they disappear when the
+	program ends.
+
+	    void *Map_Calloc(size_t n, size_t s)
+	    void *TryMap_Calloc(size_t n, size_t s)
+	    void *TryMap_Realloc(void *p, size_t s)
+	    void Map_Free(void *p)
+
+	act like Calloc(), TryCalloc(), TryRealloc() and Free() from
+	Malloc.h, and are these when neither Scratch_Directory nor
+	Huge_Pages is set.
+
+	When Huge_Pages is set (-l option), and Scratch_Directory is not,
+	the arrays are made of huge pages, which saves most of the TLB
+	misses of the random accesses to the large arrays; under -j their
+	pages are interleaved over the NUMA nodes of the machine.
+
+	    void Map_Advise(void *p, int advice)
+
+	tells the operating system how the array p is going to be accessed,
+	Map_Sequential or Map_Random; it has no effect on arrays that are
+	not mapped.
+
+	Mapping is not available under MSDOS.
+*/
+
+extern const char *Scratch_Directory;
+extern int Huge_Pages;
+
+extern void *Map_Calloc(size_t n, size_t s);
+extern void *TryMap_Calloc(size_t n, size_t s);
+extern void *TryMap_Realloc(void *p, size_t s);
+extern void Map_Free(void *p);
+
+#define	Map_Sequential	1
+#define	Map_Random	2
+extern void Map_Advise(void *p, int advice);
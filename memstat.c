@@ -0,0 +1,85 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+#include	<stdio.h>
+
+#ifndef	MSDOS
+#include	<sys/time.h>
+#include	<sys/resource.h>
+#endif	/* MSDOS */
+
+#include	"any_int.h"
+#include	"memstat.h"
+
+static const char *category_name[MEM_N_CATEGORIES] = {
+	"token array",
+	"forward references",
+	"latest index",
+	"runs",
+	"matches",
+	"balance index"
+};
+
+static size_t held[MEM_N_CATEGORIES];
+static size_t max_held[MEM_N_CATEGORIES];	/* in the present phase */
+
+void
+Count_Memory(int category, size_t size) {
+	held[category] += size;
+	if (held[category] > max_held[category]) {
+		max_held[category] = held[category];
+	}
+}
+
+void
+Uncount_Memory(int category, size_t size) {
+	held[category] -= size;
+}
+
+size_t
+Memory_Held(void) {
+	size_t total = 0;
+	int cat;
+
+	for (cat = 0; cat < MEM_N_CATEGORIES; cat++) {
+		total += held[cat];
+	}
+	return total;
+}
+
+long
+Peak_Resident_kB(void) {
+	/* -1 if not known */
+#ifndef	MSDOS
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) == 0) {
+		return ru.ru_maxrss;		/* in kB */
+	}
+#endif	/* MSDOS */
+	return -1;
+}
+
+void
+Report_Memory_Phase(FILE *f, const char *phase) {
+	long rss = Peak_Resident_kB();
+	const char *sep = " ";
+	int cat;
+
+	fprintf(f, "Memory after %s:", phase);
+	for (cat = 0; cat < MEM_N_CATEGORIES; cat++) {
+		if (max_held[cat] == 0) continue;
+		fprintf(f, "%s%s = %s", sep, category_name[cat],
+			any_uint2string(held[cat], 0));
+		fprintf(f, " (max. %s)", any_uint2string(max_held[cat], 0));
+		sep = ", ";
+		/* the next phase starts with what is held now */
+		max_held[cat] = held[cat];
+	}
+	if (rss >= 0) {
+		fprintf(f, "%speak resident = %s kB", (*sep == ',' ? "; " : " "),
+			any_uint2string((size_t)rss, 0));
+	}
+	fprintf(f, "\n");
+	fflush(f);
+}
@@ -0,0 +1,35 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Memory statistics per category, for -M.
+
+	The large data structures count the memory they hold, by
+	Count_Memory(category, size) and Uncount_Memory(category, size); this
+	costs an addition per block, so it is always on. Most of them are
+	allocated through mapped.h or arena.h rather than directly through
+	Malloc(), which is why the counting is done by their owners.
+	Report_Memory_Phase(f, phase) prints, for each category, the memory
+	held at the end of the phase and the maximum during it, and the peak
+	resident set size of the process so far, where available; the
+	maxima then start afresh for the next phase.
+
+	The counting is done by the main thread only. Memory_Held() yields
+	the total held at the moment, and Peak_Resident_kB() the peak
+	resident set size, or -1 where it is not known; the progress reports
+	(see progress.h) call them from their own thread, so there they are
+	approximate.
+*/
+
+#define	MEM_TOKEN_ARRAY		0
+#define	MEM_FORWARD_REFERENCES	1
+#define	MEM_LATEST_INDEX	2
+#define	MEM_RUNS		3
+#define	MEM_MATCHES		4
+#define	MEM_BALANCE_INDEX	5
+#define	MEM_N_CATEGORIES	6
+
+extern void Count_Memory(int category, size_t size);
+extern void Uncount_Memory(int category, size_t size);
+extern void Report_Memory_Phase(FILE *f, const char *phase);
+extern size_t Memory_Held(void);
+extern long Peak_Resident_kB(void);
@@ -0,0 +1,390 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Microbenchmarks of the hot kernels, for make microbench:
+
+	    microbench hash|lcs|sort|idf|all [N]
+
+	hash	Make_Forward_References() over N random tokens in 100 texts;
+	lcs	Compare_Files() over texts that are mutated copies of one
+		text, so each window has a chain of a known length, for
+		several lengths; the time includes the forward references;
+	sort	the run list sort of runs.c, over N runs with random keys,
+		both with the split-sort-merge of sortlist.bdy and with the
+		radix sort of radixlist.bdy, and Sort_Pos_Refs() of the
+		position arrays of Pass 2, over N positions;
+	idf	idf_hashed() and idf_in_list(), the latter both with and
+		without its index, over N identifiers.
+
+	Each kernel is timed in CPU time, as the best of a few repetitions,
+	and reported in nanoseconds per token or per item. N is 1000000 by
+	default. The input is made by a fixed random generator, so the
+	numbers can be compared between versions.
+
+	The program is linked with the sim modules and the text front end
+	textscan.c, instead of sim.c; it supplies the entries of sim.h.
+*/
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<time.h>
+
+#include	"sim.h"
+#include	"options.h"
+#include	"token.h"
+#include	"tokenarray.h"
+#include	"text.h"
+#include	"lang.h"
+#include	"hash.h"
+#include	"compare.h"
+#include	"runs.h"
+#include	"idf.h"
+#include	"Malloc.h"
+
+#define	REPETITIONS	5
+
+							/* ENTRIES OF SIM.H */
+const char *Version = "microbench";
+int Min_Run_Size = 24;
+int Page_Width = 80;
+int Threshold_Percentage = 1;
+FILE *Output_File;
+FILE *Debug_File;
+const char *Token_Name = "token";
+
+int
+is_new_old_separator(const char *s) {
+	return strcmp(s, "/") == 0 || strcmp(s, "|") == 0;
+}
+
+const char *
+size_t2string(size_t s) {
+	static char buff[30];
+
+	sprintf(buff, "%lu", (unsigned long)s);
+	return buff;
+}
+
+void
+fatal(const char *msg) {
+	fprintf(stderr, "microbench: %s\n", msg);
+	exit(1);
+}
+
+							/* SERVICE ROUTINES */
+static unsigned long long rng_state = 0x9E3779B97F4A7C15ULL;
+
+static unsigned long
+next_random(void) {
+	/* xorshift64*, the same on any machine */
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (unsigned long)((rng_state * 2685821657736338717ULL) >> 33);
+}
+
+static Token
+random_token(void) {
+	/* from a vocabulary of 1000 words, as sim_text would make them */
+	return int2Token(N_REGULAR_TOKENS + next_random() % 1000);
+}
+
+static double
+cpu_seconds(void) {
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static void
+report(const char *kernel, double seconds, size_t n, const char *unit) {
+	fprintf(stdout, "%-28s %10lu %ss %10.2f ns/%s\n",
+		kernel, (unsigned long)n, unit,
+		seconds * 1e9 / (double)(n ? n : 1), unit);
+	fflush(stdout);
+}
+
+static void
+make_texts(int n_texts, size_t n_tokens, const Token *base, int mutation) {
+	/*	Fills Token_Array[] with n_texts texts of n_tokens tokens; if
+		base is not 0, each text is a copy of it in which each token
+		is replaced by a random one with a chance of 1 in mutation.
+	*/
+	int n;
+
+	Init_Token_Array();
+	Init_Text(n_texts);
+	Number_of_New_Texts = n_texts;
+	for (n = 0; n < n_texts; n++) {
+		struct text *txt = &Text[n];
+		size_t i;
+
+		memset(txt, 0, sizeof *txt);
+		txt->tx_fname = "microbench";
+		txt->tx_opened = 1;
+		txt->tx_start = Token_Array_Length();
+		Reserve_Token_Array(n_tokens);
+		for (i = 0; i < n_tokens; i++) {
+			Store_Token(
+				base && next_random() % mutation != 0 ?
+					base[i] : random_token()
+			);
+		}
+		txt->tx_limit = Token_Array_Length();
+	}
+}
+
+							/* THE KERNELS */
+static void
+bench_hash(size_t n) {
+	double best = 0.0;
+	int r;
+
+	make_texts(100, n / 100, 0, 0);
+	for (r = 0; r < REPETITIONS; r++) {
+		double start = cpu_seconds();
+
+		Make_Forward_References();
+		double t = cpu_seconds() - start;
+		Free_Forward_References();
+		if (r == 0 || t < best) best = t;
+	}
+	report("Make_Forward_References", best, n, "token");
+}
+
+static void
+bench_lcs(size_t n) {
+	static const int chain_length[] = {1, 4, 16, 64};
+	int c;
+
+	for (c = 0; c < (int)(sizeof chain_length / sizeof chain_length[0]);
+	     c++
+	) {
+		int n_texts = chain_length[c] + 1;
+		size_t text_size = n / n_texts;
+		Token *base = (Token *)Malloc(text_size * sizeof (Token));
+		double best = 0.0;
+		size_t i;
+		int r;
+
+		for (i = 0; i < text_size; i++) {
+			base[i] = random_token();
+		}
+		/* runs of about 50 tokens, broken by the mutations */
+		make_texts(n_texts, text_size, base, 50);
+		Free(base);
+
+		for (r = 0; r < REPETITIONS; r++) {
+			double start = cpu_seconds();
+
+			Compare_Files();
+			double t = cpu_seconds() - start;
+			discard_runs();
+			if (r == 0 || t < best) best = t;
+		}
+
+		char kernel[50];
+		sprintf(kernel, "Compare_Files, chains of %d",
+			chain_length[c]);
+		report(kernel, best, text_size * n_texts, "token");
+	}
+}
+
+/* begin instantiate, as in runs.c */
+static void merge_run_list(struct run **listhook);
+#define	SORT_STRUCT		run
+#define	SORT_NAME		merge_run_list
+#define	SORT_BEFORE(r0,r1)	((r0)->rn_size > (r1)->rn_size)
+#define	SORT_NEXT		rn_next
+#include	"sortlist.bdy"
+#undef	SORT_NAME
+
+static void radix_run_list(struct run **listhook);
+#define	SORT_NAME		radix_run_list
+#define	SORT_KEY(r)		((r)->rn_size)
+#define	SORT_DESCENDING
+#include	"radixlist.bdy"
+#undef	SORT_STRUCT
+#undef	SORT_NAME
+#undef	SORT_BEFORE
+#undef	SORT_KEY
+#undef	SORT_DESCENDING
+#undef	SORT_NEXT
+/* end instantiate */
+
+typedef void run_sorter(struct run **);
+
+static void
+bench_sort_runs(size_t n, const char *name, run_sorter *sort_runs) {
+	struct run *runs = (struct run *)Malloc(n * sizeof (struct run));
+	double best = 0.0;
+	char kernel[50];
+	size_t i;
+	int r;
+
+	rng_state = 0x9E3779B97F4A7C15ULL;	/* the same lists each time */
+	for (r = 0; r < REPETITIONS; r++) {
+		struct run *run_list = 0;
+
+		/* the list is linked in a random order of memory */
+		for (i = 0; i < n; i++) {
+			size_t j = next_random() % (i + 1);
+
+			runs[i] = runs[j];
+			runs[j].rn_size = 24 + next_random() % 1000;
+		}
+		for (i = 0; i < n; i++) {
+			runs[i].rn_next = run_list, run_list = &runs[i];
+		}
+
+		double start = cpu_seconds();
+		(*sort_runs)(&run_list);
+		double t = cpu_seconds() - start;
+		if (r == 0 || t < best) best = t;
+	}
+	sprintf(kernel, "run list, %s", name);
+	report(kernel, best, n, "item");
+	Free(runs);
+}
+
+static void
+bench_sort_positions(size_t n) {
+	struct position *pos =
+		(struct position *)Malloc(n * sizeof (struct position));
+	struct pos_ref *pr = (struct pos_ref *)Malloc(n * sizeof (struct pos_ref));
+	double best = 0.0;
+	size_t i;
+	int r;
+
+	rng_state = 0x9E3779B97F4A7C15ULL;	/* the same arrays each time */
+	for (r = 0; r < REPETITIONS; r++) {
+		/* the array points in a random order of memory */
+		for (i = 0; i < n; i++) {
+			size_t j = next_random() % (i + 1);
+
+			pr[i] = pr[j];
+			pos[i].ps_tk_cnt = next_random();
+			pr[j].pr_pos = &pos[i];
+		}
+		for (i = 0; i < n; i++) {
+			pr[i].pr_tk_cnt = pr[i].pr_pos->ps_tk_cnt;
+		}
+
+		double start = cpu_seconds();
+		Sort_Pos_Refs(pr, n);
+		double t = cpu_seconds() - start;
+		if (r == 0 || t < best) best = t;
+	}
+	report("position array, radix", best, n, "item");
+	Free(pos);
+	Free(pr);
+}
+
+static void
+bench_sort(size_t n) {
+	bench_sort_runs(n, "sortlist.bdy", merge_run_list);
+	bench_sort_runs(n, "radixlist.bdy", radix_run_list);
+	bench_sort_positions(n);
+}
+
+static const struct idf keyword[] = {
+	{"auto", NORM('a')}, {"break", NORM('b')}, {"case", NORM('c')},
+	{"char", NORM('C')}, {"const", CTRL('C')}, {"continue", META('c')},
+	{"default", NORM('d')}, {"do", NORM('D')}, {"double", CTRL('D')},
+	{"else", NORM('e')}, {"enum", NORM('E')}, {"extern", CTRL('E')},
+	{"float", NORM('f')}, {"for", NORM('F')}, {"goto", NORM('g')},
+	{"if", NORM('i')}, {"int", NORM('I')}, {"long", NORM('l')},
+	{"register", No_Token}, {"return", NORM('r')}, {"short", NORM('s')},
+	{"signed", No_Token}, {"sizeof", CTRL('S')}, {"static", META('s')},
+	{"struct", NORM('S')}, {"switch", META('S')}, {"typedef", NORM('t')},
+	{"union", NORM('u')}, {"unsigned", NORM('U')}, {"void", No_Token},
+	{"volatile", No_Token}, {"while", NORM('w')}
+};
+
+static double
+time_in_list(const char **words, size_t n) {
+	double best = 0.0;
+	int r;
+
+	for (r = 0; r < REPETITIONS; r++) {
+		double start = cpu_seconds();
+		size_t i;
+		unsigned long sum = 0;
+
+		for (i = 0; i < n; i++) {
+			sum += Token2int(idf_in_list(words[i], keyword,
+				sizeof keyword, IDF));
+		}
+		double t = cpu_seconds() - start;
+		if (sum == 0) fprintf(stdout, "(no words)\n");
+		if (r == 0 || t < best) best = t;
+	}
+	return best;
+}
+
+static void
+bench_idf(size_t n) {
+	/* identifiers with a skewed distribution; one in four a keyword */
+	char (*vocabulary)[12] = (char (*)[12])Malloc(1000 * 12);
+	const char **words = (const char **)Malloc(n * sizeof (const char *));
+	double best = 0.0;
+	size_t i;
+	int r;
+
+	for (i = 0; i < 1000; i++) {
+		sprintf(vocabulary[i], "id_%lu", next_random() % 100000);
+	}
+	for (i = 0; i < n; i++) {
+		size_t w = next_random() % 1000;
+
+		words[i] = (next_random() % 4 == 0
+		?	keyword[next_random() %
+				(sizeof keyword / sizeof keyword[0])].id_tag
+		:	vocabulary[next_random() % (w + 1)]
+		);
+	}
+
+	for (r = 0; r < REPETITIONS; r++) {
+		double start = cpu_seconds();
+		unsigned long sum = 0;
+
+		for (i = 0; i < n; i++) {
+			sum += Token2int(idf_hashed(words[i]));
+		}
+		double t = cpu_seconds() - start;
+		if (sum == 0) fprintf(stdout, "(no words)\n");
+		if (r == 0 || t < best) best = t;
+	}
+	report("idf_hashed", best, n, "item");
+
+	report("idf_in_list, binary search",
+		time_in_list(words, n), n, "item");
+	idf_index_list(keyword, sizeof keyword);
+	report("idf_in_list, indexed", time_in_list(words, n), n, "item");
+
+	Free(words);
+	Free(vocabulary);
+}
+
+							/* MAIN */
+int
+main(int argc, const char *argv[]) {
+	const char *kernel = (argc > 1 ? argv[1] : "all");
+	size_t n = (argc > 2 ? (size_t)atol(argv[2]) : 1000000);
+	int all = strcmp(kernel, "all") == 0;
+
+	if (argc > 3 || n < 1000) {
+		fprintf(stderr,
+			"usage: microbench hash|lcs|sort|idf|all [N]\n");
+		return 1;
+	}
+	Output_File = stdout;
+	Debug_File = stderr;
+	set_option('n');
+	Init_Language();
+
+	if (all || strcmp(kernel, "hash") == 0) bench_hash(n);
+	if (all || strcmp(kernel, "lcs") == 0) bench_lcs(n);
+	if (all || strcmp(kernel, "sort") == 0) bench_sort(n);
+	if (all || strcmp(kernel, "idf") == 0) bench_idf(n);
+	return 0;
+}
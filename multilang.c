@@ -0,0 +1,301 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	The front end of sim_mix, which links the front ends of several
+	languages and selects one per file, by the extension of the file name;
+	a file with an unknown extension goes to the first one.
+
+	Each front end is the output of flex with the option -P<prefix>,
+	compiled together with a copy of properties.c with its entries renamed
+	to <prefix><entry> (see MIX_RENAME in the Makefile); this module
+	supplies the entries of lang.h and language.h once more, and passes
+	the calls on to the front end of the file or token concerned.
+
+	The tokens of the front ends are moved into disjoint token spaces, so
+	a window in one language never matches a window in another one.  The
+	regular tokens of front end l become l*N_REGULAR_TOKENS + tk, and the
+	hashed tokens go to the remaining range, interleaved.  The front end
+	of a token is thus known from the token itself, which is what
+	May_Be_Start_Of_Run() and Best_Run_Size() need; they get the tokens
+	of the front end back.  The hashed tokens get less room each, but
+	they only serve to tell identifiers apart under -F and in sim_text.
+*/
+
+#include	<stdio.h>
+#include	<string.h>
+
+#include	"sim.h"
+#include	"token.h"
+#include	"Malloc.h"
+#include	"lang.h"
+#include	"language.h"
+
+							/* THE FRONT ENDS */
+struct front_end {
+	const char *fe_extensions;	/* separated by spaces */
+	void (*fe_init_language)(void);
+	int (*fe_may_be_start_of_run)(Token ch);
+	size_t (*fe_best_run_size)(const Token *str, size_t size);
+	int (*fe_lex_init_extra)(struct lex_state *ls, void **scanner);
+	void (*fe_set_in)(FILE *f, void *scanner);
+	int (*fe_lex)(void *scanner);
+	char *(*fe_get_text)(void *scanner);
+	int (*fe_lex_destroy)(void *scanner);
+	struct yy_buffer_state *(*fe_scan_buffer)(
+		char *base, size_t size, void *scanner
+	);
+	void (*fe_delete_buffer)(struct yy_buffer_state *b, void *scanner);
+	void (*fe_start)(void *scanner);
+};
+
+#define	DECLARE_FRONT_END(P)						\
+	extern void P##Init_Language(void);				\
+	extern int P##May_Be_Start_Of_Run(Token ch);			\
+	extern size_t P##Best_Run_Size(const Token *str, size_t size);	\
+	extern int P##lex_init_extra(struct lex_state *ls, void **sc);	\
+	extern void P##set_in(FILE *f, void *scanner);			\
+	extern int P##lex(void *scanner);				\
+	extern char *P##get_text(void *scanner);			\
+	extern int P##lex_destroy(void *scanner);			\
+	extern struct yy_buffer_state *P##_scan_buffer(			\
+		char *base, size_t size, void *scanner			\
+	);								\
+	extern void P##_delete_buffer(struct yy_buffer_state *b, void *sc); \
+	extern void P##start(void *scanner)
+
+#define	FRONT_END(P, extensions)					\
+	{	extensions,						\
+		P##Init_Language, P##May_Be_Start_Of_Run, P##Best_Run_Size, \
+		P##lex_init_extra, P##set_in, P##lex, P##get_text,	\
+		P##lex_destroy, P##_scan_buffer, P##_delete_buffer,	\
+		P##start						\
+	}
+
+/* To add a language, add it here and to SIM_MIX_LANG_OBJ in the Makefile */
+DECLARE_FRONT_END(c_);
+DECLARE_FRONT_END(cpp_);
+DECLARE_FRONT_END(java_);
+
+static const struct front_end front_end[] = {
+	FRONT_END(c_, ".c .h"),
+	FRONT_END(cpp_, ".cpp .cc .cxx .c++ .C .hpp .hh .hxx .h++"),
+	FRONT_END(java_, ".java")
+};
+#define	N_FRONT_ENDS	((int)(sizeof front_end / sizeof front_end[0]))
+
+const char *Subject = "C, C++ and Java programs";
+
+static int
+has_extension(const char *extensions, const char *ext, size_t len) {
+	const char *e = extensions;
+
+	while (*e) {
+		size_t e_len = strcspn(e, " ");
+
+		if (e_len == len && strncmp(e, ext, len) == 0) return 1;
+		e += e_len;
+		while (*e == ' ') e++;
+	}
+	return 0;
+}
+
+static int
+language_of_file(const char *fname) {
+	const char *dot = strrchr(fname, '.');
+	int l;
+
+	if (!dot || strchr(dot, '/')) return 0;
+	for (l = 0; l < N_FRONT_ENDS; l++) {
+		if (has_extension(front_end[l].fe_extensions, dot, strlen(dot)))
+			return l;
+	}
+	return 0;
+}
+
+							/* THE TOKEN SPACES */
+#define	HASHED_BASE	((unsigned long)N_FRONT_ENDS * N_REGULAR_TOKENS)
+
+static unsigned long
+hashed_room(void) {
+	/* the number of hashed tokens of each front end */
+	return ((unsigned long)Token2int(End_Of_Line) - HASHED_BASE)
+		/ N_FRONT_ENDS;
+}
+
+static Token
+global_token(int l, Token tk) {
+	unsigned long t = (unsigned long)Token2int(tk);
+
+	if (Token_EQ(tk, No_Token) || Token_EQ(tk, End_Of_Line)) return tk;
+	if (is_regular_token(tk)) {
+		return int2Token((unsigned long)l * N_REGULAR_TOKENS + t);
+	}
+	return int2Token(HASHED_BASE + (unsigned long)l +
+		N_FRONT_ENDS * ((t - N_REGULAR_TOKENS) % hashed_room()));
+}
+
+static int
+language_of_token(Token tk) {
+	unsigned long t = (unsigned long)Token2int(tk);
+
+	return (int)(t < HASHED_BASE ?
+		t / N_REGULAR_TOKENS : (t - HASHED_BASE) % N_FRONT_ENDS);
+}
+
+static Token
+local_token(Token tk) {
+	/* the hashed tokens all map to the first one; only the regular
+	   tokens have properties
+	*/
+	unsigned long t = (unsigned long)Token2int(tk);
+
+	return int2Token(t < HASHED_BASE ?
+		t % N_REGULAR_TOKENS : N_REGULAR_TOKENS);
+}
+
+							/* THE SCANNER */
+struct mixed_scanner {
+	struct lex_state *ms_extra;
+	int ms_language;
+	void *ms_scanner[N_FRONT_ENDS];	/* made when first needed */
+};
+
+static void *
+current_scanner(struct mixed_scanner *ms) {
+	int l = ms->ms_language;
+
+	if (!ms->ms_scanner[l]) {
+		if (front_end[l].fe_lex_init_extra(
+			ms->ms_extra, &ms->ms_scanner[l]) != 0
+		) {
+			fatal("out of memory: cannot create scanner");
+		}
+	}
+	return ms->ms_scanner[l];
+}
+
+static void
+select_language(void *scanner, int language) {
+	((struct mixed_scanner *)scanner)->ms_language = language;
+}
+
+int
+yylex_init_extra(struct lex_state *ls, void **scanner) {
+	struct mixed_scanner *ms =
+		(struct mixed_scanner *)TryMalloc(sizeof *ms);
+	int l;
+
+	if (!ms) return 1;
+	ms->ms_extra = ls;
+	ms->ms_language = 0;
+	for (l = 0; l < N_FRONT_ENDS; l++) {
+		ms->ms_scanner[l] = 0;
+	}
+	*scanner = ms;
+	return 0;
+}
+
+void
+yyset_in(FILE *f, void *scanner) {
+	struct mixed_scanner *ms = (struct mixed_scanner *)scanner;
+
+	front_end[ms->ms_language].fe_set_in(f, current_scanner(ms));
+}
+
+struct yy_buffer_state *
+yy_scan_buffer(char *base, size_t size, void *scanner) {
+	struct mixed_scanner *ms = (struct mixed_scanner *)scanner;
+
+	return front_end[ms->ms_language].fe_scan_buffer(
+		base, size, current_scanner(ms)
+	);
+}
+
+void
+yy_delete_buffer(struct yy_buffer_state *b, void *scanner) {
+	struct mixed_scanner *ms = (struct mixed_scanner *)scanner;
+
+	front_end[ms->ms_language].fe_delete_buffer(b, current_scanner(ms));
+}
+
+void
+yystart(void *scanner) {
+	struct mixed_scanner *ms = (struct mixed_scanner *)scanner;
+
+	front_end[ms->ms_language].fe_start(current_scanner(ms));
+}
+
+int
+yylex(void *scanner) {
+	struct mixed_scanner *ms = (struct mixed_scanner *)scanner;
+	int l = ms->ms_language;
+
+	if (!front_end[l].fe_lex(current_scanner(ms))) return 0;
+	ms->ms_extra->ls_token = global_token(l, ms->ms_extra->ls_token);
+	return 1;
+}
+
+char *
+yyget_text(void *scanner) {
+	struct mixed_scanner *ms = (struct mixed_scanner *)scanner;
+
+	return front_end[ms->ms_language].fe_get_text(current_scanner(ms));
+}
+
+int
+yylex_destroy(void *scanner) {
+	struct mixed_scanner *ms = (struct mixed_scanner *)scanner;
+	int l;
+
+	for (l = 0; l < N_FRONT_ENDS; l++) {
+		if (ms->ms_scanner[l]) {
+			(void)front_end[l].fe_lex_destroy(ms->ms_scanner[l]);
+		}
+	}
+	Free(ms);
+	return 0;
+}
+
+							/* THE LANGUAGE */
+void
+Init_Language(void) {
+	int l;
+
+	for (l = 0; l < N_FRONT_ENDS; l++) {
+		front_end[l].fe_init_language();
+	}
+	Language_Of_File = language_of_file;
+	Select_Language = select_language;
+}
+
+int
+May_Be_Start_Of_Run(Token ch) {
+	return front_end[language_of_token(ch)].fe_may_be_start_of_run(
+		local_token(ch)
+	);
+}
+
+size_t
+Best_Run_Size(const Token *str, size_t size) {
+	/* a run lies in one text, so all its tokens are of one front end */
+	if (size == 0) return 0;
+
+	Token *local = (Token *)Malloc(size * sizeof (Token));
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		local[i] = local_token(str[i]);
+	}
+	size_t best = front_end[language_of_token(str[0])].fe_best_run_size(
+		local, size
+	);
+	Free(local);
+	return best;
+}
+
+void
+Prepare_Best_Run_Size(void) {
+	/* the balance index of properties.c works for one front end only,
+	   so the front ends search the runs themselves
+	*/
+}
@@ -4,9 +4,12 @@
 */
 
 #include	<stdio.h>
+#include	<string.h>
+#include	<errno.h>
 
 #include	"sim.h"
 #include	"ForEachFile.h"
+#include	"parallel.h"
 #include	"Malloc.h"
 #include	"newargs.h"
 
@@ -117,6 +120,68 @@ get_new_std_input_args(int *argcp, const char **argvp[]) {
 	*argcp = argc, *argvp = argv;
 }
 
+							/* FILTERING */
+const char *Include_Patterns;
+const char *Exclude_Patterns;
+int Max_File_Size;			/* in kilobytes, 0 for no limit */
+
+static int
+glob_match(const char *s, const char *p, const char *p_end) {
+	/* does s match the pattern p .. p_end, with * and ? as usual */
+	while (p < p_end) {
+		if (*p == '*') {
+			p++;
+			for (;; s++) {
+				if (glob_match(s, p, p_end)) return 1;
+				if (!*s) return 0;
+			}
+		}
+		if (!*s) return 0;
+		if (*p != '?' && *p != *s) return 0;
+		p++, s++;
+	}
+	return *s == '\0';
+}
+
+static int
+matches_one_of(const char *fn, const char *patterns) {
+	/* patterns is a comma-separated list; only the last component of
+	   fn is matched
+	*/
+	const char *base = strrchr(fn, '/');
+	base = (base ? base + 1 : fn);
+
+	while (*patterns) {
+		const char *end = strchr(patterns, ',');
+		if (!end) {
+			end = patterns + strlen(patterns);
+		}
+		if (glob_match(base, patterns, end)) return 1;
+		patterns = (*end ? end + 1 : end);
+	}
+	return 0;
+}
+
+static int
+is_wanted_file(const char *fn, const struct stat *fs) {
+	if (	/* it is not a non-empty regular file */
+		!(S_ISREG(fs->st_mode) && fs->st_size > 0)
+	) return 0;
+	if (	Max_File_Size
+	&&	fs->st_size > (off_t)Max_File_Size * 1024
+	) return 0;
+	if (Include_Patterns && !matches_one_of(fn, Include_Patterns))
+		return 0;
+	if (Exclude_Patterns && matches_one_of(fn, Exclude_Patterns))
+		return 0;
+	return 1;
+}
+
+static int
+is_wanted_directory(const char *fn) {
+	return !(Exclude_Patterns && matches_one_of(fn, Exclude_Patterns));
+}
+
 static int
 register_file(const Fchar *fn, const char *msg, const struct stat *fs) {
 	if (msg) {
@@ -124,18 +189,202 @@ register_file(const Fchar *fn, const char *msg, const struct stat *fs) {
 		return 0;
 	}
 
-	if (	/* it is a non-empty regular file */
-		S_ISREG(fs->st_mode) && fs->st_size > 0
-	) {
+	if (is_dirstat(fs)) {
+		/* enter it or not */
+		return is_wanted_directory(Fname2str(fn));
+	}
+	if (is_wanted_file(Fname2str(fn), fs)) {
 		add_string_to_args(Fname2str(fn));
 	}
 	return 1;
 }
 
+							/* PARALLEL WALK */
+/*	Under -j, the directories are read by worker threads: a worker takes
+	a directory from the list of pending directories, reads its entries
+	into its walk_node, in the order of Readdir(), and adds the
+	subdirectories to be entered to the list. When all directories have
+	been read, the tree of walk_nodes is traversed depth-first, which
+	yields the files, and the error messages, exactly in the order in
+	which ForEachFile() would have reported them.
+*/
+struct walk_node {
+	char *wn_name;			/* to be filled by Malloc() */
+	int wn_errno;			/* set if the name could not be examined */
+	int wn_wanted;			/* Boolean, a file to be compared */
+	int wn_to_enter;		/* Boolean, a directory to be entered */
+	int wn_unreadable;		/* Boolean, it could not be opened */
+	struct walk_node *wn_entries;	/* to be filled by Malloc() */
+	size_t wn_n_entries;
+	struct walk_node *wn_next;	/* in the pending list */
+};
+
+static struct walk_node *pending;	/* protected by Lock() */
+static int n_busy;			/* protected by Lock() */
+
+static void
+examine_name(struct walk_node *wn, int top_level) {
+	struct stat fs;
+
+	wn->wn_errno = 0;
+	wn->wn_wanted = 0;
+	wn->wn_to_enter = 0;
+	wn->wn_unreadable = 0;
+	wn->wn_entries = 0;
+	wn->wn_n_entries = 0;
+	wn->wn_next = 0;
+	if (lstat(wn->wn_name, &fs) < 0) {
+		wn->wn_errno = errno;
+		return;
+	}
+	if (is_dirstat(&fs)) {
+		wn->wn_to_enter = top_level || is_wanted_directory(wn->wn_name);
+	} else {
+		wn->wn_wanted = is_wanted_file(wn->wn_name, &fs);
+	}
+}
+
+static void
+read_directory(struct walk_node *wn) {
+	Dir_t *dir = Opendir(wn->wn_name);
+	size_t size = 0;
+
+	if (dir == 0) {
+		wn->wn_unreadable = 1;
+		return;
+	}
+
+	Dirent_t *dent;
+	while ((dent = Readdir(dir)) != (Dirent_t *)0) {
+		const char *d_name = dent->d_name;
+		if (is_Admin_Dirname(d_name)) continue;
+
+		if (wn->wn_n_entries == size) {
+			/* allocated array is full; increase its size */
+			size = (size ? 2 * size : 16);
+			wn->wn_entries = (struct walk_node *)Realloc(
+				wn->wn_entries, size * sizeof (struct walk_node)
+			);
+		}
+		struct walk_node *entry = &wn->wn_entries[wn->wn_n_entries++];
+		entry->wn_name = (char *)
+			Malloc(strlen(wn->wn_name) + 1 + strlen(d_name) + 1);
+		sprintf(entry->wn_name, "%s/%s", wn->wn_name, d_name);
+		examine_name(entry, 0);
+	}
+	Closedir(dir);
+}
+
+static void
+walk_worker(int w, void *arg) {
+	(void)w;
+	(void)arg;
+	for (;;) {
+		Lock();
+		while (!pending && n_busy > 0) {
+			Wait_For_Change();
+		}
+		struct walk_node *wn = pending;
+		if (!wn) {
+			/* nothing pending and nobody who can add to it */
+			Unlock();
+			break;
+		}
+		pending = wn->wn_next;
+		n_busy++;
+		Unlock();
+
+		read_directory(wn);
+
+		Lock();
+		size_t i;
+		for (i = 0; i < wn->wn_n_entries; i++) {
+			struct walk_node *entry = &wn->wn_entries[i];
+
+			if (entry->wn_to_enter) {
+				entry->wn_next = pending;
+				pending = entry;
+			}
+		}
+		n_busy--;
+		Signal_Change();
+		Unlock();
+	}
+}
+
+static void
+register_walk_node(struct walk_node *wn) {
+	/* registers and frees the tree under wn */
+	size_t i;
+
+	if (wn->wn_errno) {
+		fprintf(stderr, "could not handle file %s: %s\n",
+			wn->wn_name, strerror(wn->wn_errno));
+	}
+	if (wn->wn_wanted) {
+		add_string_to_args(wn->wn_name);
+	}
+	if (wn->wn_unreadable) {
+		fprintf(stderr, "could not handle file %s: %s\n",
+			wn->wn_name, "directory not readable");
+	}
+	for (i = 0; i < wn->wn_n_entries; i++) {
+		register_walk_node(&wn->wn_entries[i]);
+	}
+	if (wn->wn_entries) {
+		Free(wn->wn_entries);
+	}
+	Free(wn->wn_name);
+}
+
+static void
+walk_in_parallel(int argc, const char *argv[]) {
+	struct walk_node *roots = (struct walk_node *)
+		Malloc((size_t)argc * sizeof (struct walk_node));
+	int i;
+
+	pending = 0;
+	n_busy = 0;
+	for (i = argc - 1; i >= 0; i--) {
+		struct walk_node *wn = &roots[i];
+		size_t len = strlen(argv[i]);
+
+		if (is_new_old_separator(argv[i])) continue;
+
+		wn->wn_name = (char *)Malloc(len + 1);
+		strcpy(wn->wn_name, argv[i]);
+		/* remove a trailing separator */
+		if (len > 1 && wn->wn_name[len-1] == '/') {
+			wn->wn_name[len-1] = '\0';
+		}
+		examine_name(wn, 1);
+		if (wn->wn_to_enter) {
+			wn->wn_next = pending;
+			pending = wn;
+		}
+	}
+
+	Run_Workers(Number_of_Threads, walk_worker, 0);
+
+	for (i = 0; i < argc; i++) {
+		if (is_new_old_separator(argv[i])) {
+			add_string_to_args(argv[i]);
+		} else {
+			register_walk_node(&roots[i]);
+		}
+	}
+	Free(roots);
+}
+
 static char *
 recursive_args(int argc, const char *argv[]) {
+	static const char *dot_argv[] = {".", 0};
+
 	if (argc == 0) {
-		ForEachFile(str2Fname("."), register_file);
+		argc = 1, argv = dot_argv;
+	}
+	if (Number_of_Threads > 1) {
+		walk_in_parallel(argc, argv);
 	}
 	else {
 		int i;
@@ -5,3 +5,16 @@
 
 extern void get_new_std_input_args(int *argcp, char const **argvp[]);
 extern void get_new_recursive_args(int *argcp, const char **argvp[]);
+
+/*	Under -R, only the non-empty regular files are taken that are not
+	larger than Max_File_Size kilobytes (if not 0), whose names match
+	one of the comma-separated patterns in Include_Patterns (if set) and
+	none of those in Exclude_Patterns (if set); directories matching
+	Exclude_Patterns are not entered. A pattern is matched against the
+	last component of the name, with * and ? as in the shell.
+	Under -j, the directories are read on several threads; the order of
+	the files is the same.
+*/
+extern const char *Include_Patterns;
+extern const char *Exclude_Patterns;
+extern int Max_File_Size;
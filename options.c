@@ -48,6 +48,15 @@ set_option(char ch) {
 	options[(int)ch]++;
 }
 
+void
+clear_options(void) {
+	int ch;
+
+	for (ch = 0; ch < 128; ch++) {
+		options[ch] = 0;
+	}
+}
+
 int
 is_set_option(int ch) {
 	return options[ch];
@@ -118,6 +127,7 @@ opt_value(
 	case Number:
 		*(int *)op->op_value = atoi(string);
 		break;
+	case Numbers:
 	case String:
 		*(const char **)op->op_value = string;
 		break;
@@ -161,6 +171,7 @@ bad_option_exit(
 			fprintf(stderr, "\t-%c%c\t%s\n",
 				op->op_char,
 				(	op->op_type == Number ? 'N' :
+					op->op_type == Numbers ? 'N' :
 					op->op_type == String ? 'F' :
 					' '
 				),
@@ -200,6 +211,10 @@ print_options(const char *progname, const struct option *optlist) {
 				fprintf(stdout, "%d",
 					*(int *)op->op_value);
 				break;
+			case Numbers:
+				fprintf(stdout, "%s",
+					*(const char **)op->op_value);
+				break;
 			case String:
 				fprintf(stdout, " %s",
 					*(const char **)op->op_value);
@@ -6,7 +6,7 @@
 /*	Setting and consulting command line options
 */
 
-enum Value_Type {None, Number, String};
+enum Value_Type {None, Number, Numbers, String};	/* Numbers: N,N,... */
 struct option {
 	char op_char;		/* char as in call */
 	char *op_text;		/* explanatory text */
@@ -15,6 +15,7 @@ struct option {
 };
 
 extern void set_option(char ch);
+extern void clear_options(void);	/* for libsim.c */
 extern int is_set_option(int ch);
 extern int do_options(
 	const char *progname, const struct option *optlist,
@@ -0,0 +1,105 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+#include	<pthread.h>
+#include	<unistd.h>
+
+#include	"sim.h"
+#include	"Malloc.h"
+#include	"parallel.h"
+
+int Number_of_Threads = 1;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t change = PTHREAD_COND_INITIALIZER;
+
+struct worker {
+	pthread_t wk_thread;
+	int wk_number;
+	void (*wk_proc)(int, void *);
+	void *wk_arg;
+};
+
+static struct worker *workers;		/* to be filled by Malloc() */
+static int n_workers;
+
+static void *
+run_worker(void *p) {
+	struct worker *wk = (struct worker *)p;
+
+	(*wk->wk_proc)(wk->wk_number, wk->wk_arg);
+	return 0;
+}
+
+void
+Start_Workers(int n, void (*proc)(int, void *), void *arg) {
+	int w;
+
+	if (workers) fatal("internal error, worker pool already active");
+	if (n < 1) n = 1;
+
+	n_workers = n;
+	workers = (struct worker *)Malloc(n * sizeof (struct worker));
+	for (w = 0; w < n; w++) {
+		struct worker *wk = &workers[w];
+
+		wk->wk_number = w;
+		wk->wk_proc = proc;
+		wk->wk_arg = arg;
+		if (n == 1) {
+			/* no point in creating a thread */
+			run_worker(wk);
+		}
+		else if (pthread_create(&wk->wk_thread, 0, run_worker, wk)) {
+			fatal("cannot create thread");
+		}
+	}
+}
+
+void
+Join_Workers(void) {
+	int w;
+
+	if (!workers) return;
+	if (n_workers > 1) {
+		for (w = 0; w < n_workers; w++) {
+			pthread_join(workers[w].wk_thread, 0);
+		}
+	}
+	Free(workers); workers = 0;
+	n_workers = 0;
+}
+
+void
+Run_Workers(int n, void (*proc)(int, void *), void *arg) {
+	Start_Workers(n, proc, arg);
+	Join_Workers();
+}
+
+void
+Lock(void) {
+	pthread_mutex_lock(&lock);
+}
+
+void
+Unlock(void) {
+	pthread_mutex_unlock(&lock);
+}
+
+void
+Wait_For_Change(void) {
+	pthread_cond_wait(&change, &lock);
+}
+
+void
+Signal_Change(void) {
+	pthread_cond_broadcast(&change);
+}
+
+int
+Number_of_Processors(void) {
+	/* the number of processors online, or 0 if it cannot be found */
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (n > 0 ? (int)n : 0);
+}
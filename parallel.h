@@ -0,0 +1,36 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Running work on several threads.
+
+	The module offers a pool of worker threads and one global lock plus
+	one condition for the coordination between the workers and the main
+	thread. The model is deliberately simple: a workload is started by
+	    Start_Workers(n, proc, arg)
+	which calls proc(w, arg) on n threads, with w = 0 .. n-1, and the
+	main thread waits for the completion of all of them by
+	    Join_Workers(),
+	optionally doing useful work in between. Only one pool can be active
+	at any time. Run_Workers() combines the two.
+
+	All shared data is protected by Lock() / Unlock(); a thread that has
+	to wait for another thread calls Wait_For_Change() while holding the
+	lock, and a thread that has changed shared data calls Signal_Change().
+
+	Number_of_Threads is set from the -j option; 1 means no threads are
+	created at all and proc(0, arg) is called directly.
+	Number_of_Processors() tells on how many processors they can run.
+*/
+
+extern int Number_of_Threads;
+
+extern void Start_Workers(int n, void (*proc)(int, void *), void *arg);
+extern void Join_Workers(void);
+extern void Run_Workers(int n, void (*proc)(int, void *), void *arg);
+
+extern void Lock(void);
+extern void Unlock(void);
+extern void Wait_For_Change(void);
+extern void Signal_Change(void);
+
+extern int Number_of_Processors(void);
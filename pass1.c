@@ -5,14 +5,26 @@
 
 #include	<stdio.h>
 #include	<string.h>
+#include	<stdint.h>
 
+#include	"settings.par"
 #include	"debug.par"
 #include	"sim.h"
+#include	"fname.h"
 #include	"text.h"
 #include	"token.h"
 #include	"tokenarray.h"
 #include	"lang.h"
+#include	"stream.h"
 #include	"options.h"
+#include	"parallel.h"
+#include	"stats.h"
+#include	"Malloc.h"
+#include	"textindex.h"
+#include	"tokencache.h"
+#include	"archive.h"
+#include	"hash.h"
+#include	"progress.h"
 #include	"pass1.h"
 
 #ifdef	DB_TEXT
@@ -32,8 +44,172 @@ do_separator(const struct text *txt, const char *fname) {
 	}
 }
 
+							/* TOKEN CACHE */
+static int
+read_from_cache(const struct cache_key *key, struct cached_text *ct) {
+	int hit = Read_Cached_Text(key, ct);
+
+	Lock();
+	if (hit) {
+		Token_Cache_Hits++;
+	} else {
+		Token_Cache_Misses++;
+	}
+	Unlock();
+	return hit;
+}
+
+static int
+text_from_cache(struct text *txt, const struct cache_key *key) {
+	/* under -C, try to get the text from the token cache */
+	struct cached_text ct;
+
+	if (!read_from_cache(key, &ct)) return 0;
+
+	Store_Tokens(ct.ct_tokens, ct.ct_n_tokens);
+	Free(ct.ct_tokens);
+	txt->tx_limit = Token_Array_Length();
+	txt->tx_EOL_terminated = ct.ct_EOL_terminated;
+	txt->tx_opened = 1;
+	txt->tx_nl_cnt = ct.ct_nl_cnt;
+	txt->tx_non_ASCII_cnt = ct.ct_non_ASCII_cnt;
+	txt->tx_lines = ct.ct_lines;
+	return 1;
+}
+
+static void
+text_to_cache(const struct text *txt, const struct cache_key *key) {
+	struct cached_text ct;
+
+	ct.ct_tokens = &Token_Array[txt->tx_start];
+	ct.ct_n_tokens = txt->tx_limit - txt->tx_start;
+	ct.ct_lines = txt->tx_lines;
+	ct.ct_EOL_terminated = txt->tx_EOL_terminated;
+	ct.ct_nl_cnt = txt->tx_nl_cnt;
+	ct.ct_non_ASCII_cnt = txt->tx_non_ASCII_cnt;
+	Write_Cached_Text(key, &ct);
+}
+
+							/* SHARED CONTENTS */
+/*	Texts whose contents are one and the same buffer in memory, like the
+	files of a git repository with equal blobs (see archive.h), yield
+	the same tokens; such a text is not lexed but copied from the first
+	text with that buffer. same_contents_as[n] is the number of that
+	text, or n itself.
+*/
+static int *same_contents_as;		/* to be filled by Malloc() */
+static int n_same_contents;
+
+static size_t
+buf_hash(const char *buf) {
+	uint64_t h = (uint64_t)(uintptr_t)buf * UINT64_C(0x9E3779B97F4A7C15);
+
+	return (size_t)(h >> 32);
+}
+
+static void
+find_shared_contents(int argc, const char *argv[]) {
+	size_t table_size = 16;
+	int n;
+
+	while (table_size < 2 * (size_t)argc) {
+		table_size *= 2;
+	}
+	int *table = (int *)Malloc(table_size * sizeof (int));
+	const char **bufs = (const char **)
+		Malloc((argc + 1) * sizeof (const char *));
+	size_t h;
+
+	for (h = 0; h < table_size; h++) {
+		table[h] = -1;
+	}
+	same_contents_as = (int *)Malloc((argc + 1) * sizeof (int));
+	n_same_contents = argc;
+	for (n = 0; n < argc; n++) {
+		const struct input *in = (is_new_old_separator(argv[n]) ? 0 :
+			Archive_Member(argv[n]));
+
+		same_contents_as[n] = n;
+		bufs[n] = (in ? in->in_buf : 0);
+		if (!bufs[n]) continue;
+
+		/* look the buffer up, by linear probing */
+		h = buf_hash(bufs[n]) & (table_size-1);
+		while (table[h] >= 0 && bufs[table[h]] != bufs[n]) {
+			h = (h + 1) & (table_size-1);
+		}
+		if (table[h] >= 0) {
+			same_contents_as[n] = table[h];
+		} else {
+			table[h] = n;
+		}
+	}
+	Free(bufs);
+	Free(table);
+}
+
+static int
+is_copy(int n) {
+	return n < n_same_contents && same_contents_as[n] != n;
+}
+
+static int
+copy_text(const char *fname, struct text *txt, const struct text *orig) {
+	size_t n_tokens = orig->tx_limit - orig->tx_start;
+
+	if (!orig->tx_opened) {
+		fprintf(Output_File, "File %s: >>>> cannot open <<<<\n", fname);
+	}
+
+	/* make room first, since that may move Token_Array[] */
+	Reserve_Token_Array(n_tokens);
+	Store_Tokens(&Token_Array[orig->tx_start], n_tokens);
+	txt->tx_limit = Token_Array_Length();
+	txt->tx_EOL_terminated = orig->tx_EOL_terminated;
+	txt->tx_opened = orig->tx_opened;
+	txt->tx_nl_cnt = orig->tx_nl_cnt;
+	txt->tx_non_ASCII_cnt = orig->tx_non_ASCII_cnt;
+	txt->tx_lines = (orig->tx_lines ? Copy_Line_List(orig->tx_lines) : 0);
+
+#ifdef	DB_TEXT
+	db_print_text(txt);
+#endif	/* DB_TEXT */
+
+	return txt->tx_opened;
+}
+
+							/* PREFETCHING */
+/*	When file n is about to be read, file n + PREFETCH_DISTANCE is
+	prefetched (see Prefetch_Input() in stream.h), and the first files
+	are prefetched at the start. So the operating system reads the files
+	ahead while the lexer works on the ones before, both in the serial
+	reading and under -j, where the workers take the files in order.
+*/
+static void
+prefetch_for(int argc, const char *argv[], int n) {
+	int first = (n == 0 ? 1 : n + PREFETCH_DISTANCE);
+	int last = n + PREFETCH_DISTANCE;
+	int i;
+
+	for (i = first; i <= last && i < argc; i++) {
+		if (is_new_old_separator(argv[i]) || is_copy(i)) continue;
+		Prefetch_Input(argv[i]);
+	}
+}
+
+							/* READING TEXTS */
 static int
 read_text(const char *fname, struct text *txt) {
+	struct cache_key key;
+	int cacheable = (Token_Cache_Name && Cache_Key_Of(fname, &key));
+
+	if (cacheable && text_from_cache(txt, &key)) {
+#ifdef	DB_TEXT
+		db_print_text(txt);
+#endif	/* DB_TEXT */
+		return 1;
+	}
+
 	int file_opened = 0;
 	if (Open_Text(txt)) {
 		file_opened = 1;
@@ -45,15 +221,29 @@ read_text(const char *fname, struct text *txt) {
 		*/
 	}
 
+	/* record the line ends, for Pass 2 */
+	txt->tx_lines = (struct line_list *)
+		Calloc(1, sizeof (struct line_list));
+
 	while (Next_Text_Token_Obtained()) {
 		if (!Token_EQ(lex_token, End_Of_Line)) {
 			Store_Token(lex_token);
 		}
+		else {
+			Add_Line_End(txt->tx_lines, lex_tk_cnt);
+		}
 	}
 	Close_Text();
 	txt->tx_limit = Token_Array_Length();
 	txt->tx_EOL_terminated =
 		Token_EQ(lex_token, End_Of_Line);
+	txt->tx_opened = file_opened;
+	txt->tx_nl_cnt = lex_nl_cnt;
+	txt->tx_non_ASCII_cnt = lex_non_ASCII_cnt;
+
+	if (cacheable && file_opened) {
+		text_to_cache(txt, &key);
+	}
 
 #ifdef	DB_TEXT
 	db_print_text(txt);
@@ -62,6 +252,153 @@ read_text(const char *fname, struct text *txt) {
 	return file_opened;
 }
 
+							/* PARALLEL LEXING */
+/*	Under -j, the files are lexed by worker threads, each with a scanner
+	of its own, into private token buffers; the main thread then appends
+	the buffers to Token_Array[] in argument order, as they become
+	available. So the texts end up exactly where the serial reading
+	would have put them. Under Hash_While_Reading the main thread then
+	hashes the windows of each text it has appended, so the reading,
+	the lexing and the hashing of successive files form a pipeline.
+*/
+
+struct lexed_text {
+	Token *lt_tokens;		/* to be filled by Malloc() */
+	size_t lt_free;
+	size_t lt_size;
+	int lt_opened;			/* Boolean */
+	int lt_EOL_terminated;		/* Boolean */
+	size_t lt_nl_cnt;
+	size_t lt_non_ASCII_cnt;
+	struct input *lt_input;		/* under -k */
+	struct line_list *lt_lines;
+	int lt_done;			/* Boolean, protected by Lock() */
+};
+
+static struct lexed_text *lexed_texts;	/* one for each argument */
+static const char **lexed_names;
+static int next_text_to_lex;		/* protected by Lock() */
+
+static void
+lex_text(struct stream *st, const char *fname, struct lexed_text *lt) {
+	const struct lex_state *ls = st->st_lex;
+	struct cache_key key;
+	int cacheable = (Token_Cache_Name && Cache_Key_Of(fname, &key));
+
+	if (cacheable) {
+		struct cached_text ct;
+
+		if (read_from_cache(&key, &ct)) {
+			lt->lt_tokens = ct.ct_tokens;
+			lt->lt_free = lt->lt_size = ct.ct_n_tokens;
+			lt->lt_opened = 1;
+			lt->lt_EOL_terminated = ct.ct_EOL_terminated;
+			lt->lt_nl_cnt = ct.ct_nl_cnt;
+			lt->lt_non_ASCII_cnt = ct.ct_non_ASCII_cnt;
+			lt->lt_lines = ct.ct_lines;
+			return;
+		}
+	}
+
+	if (is_set_option('k')) {
+		lt->lt_input = (struct input *)Malloc(sizeof (struct input));
+		(void)Map_Input(fname, lt->lt_input);
+		lt->lt_opened = Open_Stream_Input_Of(st, lt->lt_input, fname);
+	}
+	else {
+		lt->lt_opened = Open_Stream_Of(st, fname);
+	}
+	lt->lt_lines = (struct line_list *)
+		Calloc(1, sizeof (struct line_list));
+	while (Next_Stream_Token_Obtained_Of(st)) {
+		if (Token_EQ(ls->ls_token, End_Of_Line)) {
+			Add_Line_End(lt->lt_lines, ls->ls_tk_cnt);
+			continue;
+		}
+
+		if (lt->lt_free == lt->lt_size) {
+			/* allocated array is full; increase its size */
+			lt->lt_size = (lt->lt_size ? 2 * lt->lt_size : 1024);
+			lt->lt_tokens = (Token *)Realloc(
+				lt->lt_tokens, lt->lt_size * sizeof (Token)
+			);
+		}
+		lt->lt_tokens[lt->lt_free++] = ls->ls_token;
+	}
+	Close_Stream_Of(st);
+	lt->lt_EOL_terminated = Token_EQ(ls->ls_token, End_Of_Line);
+	lt->lt_nl_cnt = ls->ls_nl_cnt;
+	lt->lt_non_ASCII_cnt = ls->ls_non_ASCII_cnt;
+
+	if (cacheable && lt->lt_opened) {
+		struct cached_text ct;
+
+		ct.ct_tokens = lt->lt_tokens;
+		ct.ct_n_tokens = lt->lt_free;
+		ct.ct_lines = lt->lt_lines;
+		ct.ct_EOL_terminated = lt->lt_EOL_terminated;
+		ct.ct_nl_cnt = lt->lt_nl_cnt;
+		ct.ct_non_ASCII_cnt = lt->lt_non_ASCII_cnt;
+		Write_Cached_Text(&key, &ct);
+	}
+}
+
+static void
+lex_texts_worker(int w, void *arg) {
+	struct lex_state lex_state;
+	struct stream stream;
+
+	(void)w;
+	(void)arg;
+
+	Init_Stream_Of(&stream, &lex_state);
+	for (;;) {
+		Lock();
+		int n = next_text_to_lex++;
+		Unlock();
+		if (n >= Number_of_Texts) break;
+
+		prefetch_for(Number_of_Texts, lexed_names, n);
+		if (!is_new_old_separator(lexed_names[n]) && !is_copy(n)) {
+			lex_text(&stream, lexed_names[n], &lexed_texts[n]);
+		}
+
+		Lock();
+		lexed_texts[n].lt_done = 1;
+		Signal_Change();
+		Unlock();
+	}
+	Free_Stream_Of(&stream);
+	Add_Idf_Cache_Counts();
+}
+
+static int
+splice_text(const char *fname, struct text *txt, struct lexed_text *lt) {
+	/* the counterpart of read_text() for a text lexed by a worker */
+	if (!lt->lt_opened) {
+		fprintf(Output_File, "File %s: >>>> cannot open <<<<\n", fname);
+	}
+
+	Store_Tokens(lt->lt_tokens, lt->lt_free);
+	if (lt->lt_tokens) {
+		Free(lt->lt_tokens); lt->lt_tokens = 0;
+	}
+	txt->tx_limit = Token_Array_Length();
+	txt->tx_EOL_terminated = lt->lt_EOL_terminated;
+	txt->tx_opened = lt->lt_opened;
+	txt->tx_nl_cnt = lt->lt_nl_cnt;
+	txt->tx_non_ASCII_cnt = lt->lt_non_ASCII_cnt;
+	txt->tx_input = lt->lt_input;
+	txt->tx_lines = lt->lt_lines;
+
+#ifdef	DB_TEXT
+	db_print_text(txt);
+#endif	/* DB_TEXT */
+
+	return lt->lt_opened;
+}
+
+							/* READING FILES */
 static void
 fprint_count(FILE *f, size_t cnt, const char *unit) {
 	/*	Prints a grammatically correct string "%u %s[s]"
@@ -76,54 +413,172 @@ report_file(const char *fname, struct text *txt) {
 	fprint_count(Output_File, txt->tx_limit - txt->tx_start, Token_Name);
 	fprintf(Output_File, ", ");
 	fprint_count(Output_File,
-		lex_nl_cnt - 1 + (!txt->tx_EOL_terminated ? 1 : 0), "line"
+		txt->tx_nl_cnt - 1 + (!txt->tx_EOL_terminated ? 1 : 0), "line"
 	);
 	if (!txt->tx_EOL_terminated) {
 		fprintf(Output_File, " (not NL-terminated)");
 	}
-	if (lex_non_ASCII_cnt) {
+	if (txt->tx_non_ASCII_cnt) {
 		fprintf(Output_File, ", ");
 		fprint_count(Output_File,
-			lex_non_ASCII_cnt, "non-ASCII character"
+			txt->tx_non_ASCII_cnt, "non-ASCII character"
 		);
 	}
 	fprintf(Output_File, "\n");
 }
 
 static void
-read_file(const char *fname, struct text *txt) {
+read_file(const char *fname, struct text *txt, struct lexed_text *lt) {
 	txt->tx_fname = fname;
-	txt->tx_pos = 0;
+	txt->tx_input = 0;
+	txt->tx_lines = 0;
 	txt->tx_start = Token_Array_Length();
 	txt->tx_limit = Token_Array_Length();
+	txt->tx_EOL_terminated = 1;
+	txt->tx_opened = 0;
+	txt->tx_nl_cnt = 0;
+	txt->tx_non_ASCII_cnt = 0;
 
 	if (is_new_old_separator(fname)) {
 		do_separator(txt, fname);
 	}
 	else {	/* it is a real file */
-		int ok = read_text(fname, txt);
+		int n = (int)(txt - &Text[0]);
+		int ok = (
+			is_copy(n) ?
+				copy_text(fname, txt, &Text[same_contents_as[n]])
+			: lt ?	splice_text(fname, txt, lt)
+			:	read_text(fname, txt)
+		);
 		if (ok && !is_set_option('T')) {
 			report_file(fname, txt);
 		}
 	}
+	Progress_Done(1, txt->tx_limit - txt->tx_start);
 
 	fflush(Output_File);
 }
 
+static void
+read_text_index(const char *fname) {
+	/* get the old texts from the index file fname */
+	int n_old = Open_Text_Index(fname);
+	int n = Number_of_Texts;
+
+	/* make room for a separator and the old texts */
+	Extend_Text(Number_of_Texts + 1 + n_old);
+	Number_of_New_Texts = Number_of_Texts;
+	read_file("/", &Text[n++], 0);
+
+	for (; n < Number_of_Texts; n++) {
+		struct text *txt = &Text[n];
+
+		txt->tx_input = 0;
+		txt->tx_lines = 0;
+		txt->tx_start = Token_Array_Length();
+		Read_Indexed_Text(txt);
+		txt->tx_limit = Token_Array_Length();
+
+		if (!txt->tx_opened) {
+			fprintf(Output_File,
+				"File %s: >>>> cannot open <<<<\n", txt->tx_fname);
+		}
+		else if (!is_set_option('T')) {
+			report_file(txt->tx_fname, txt);
+		}
+	}
+	Close_Text_Index();
+	fflush(Output_File);
+}
+
+static size_t
+estimated_token_count(int argc, const char *argv[]) {
+	/* from the sizes of the files; rather too high than too low */
+	size_t n_bytes = 0;
+	int n;
+
+	for (n = 0; n < argc; n++) {
+		const struct input *in;
+		struct stat st;
+
+		if (is_new_old_separator(argv[n])) continue;
+		if ((in = Archive_Member(argv[n]))) {
+			n_bytes += in->in_size - 2;
+		}
+		else if (Stat(str2Fname(argv[n]), &st) == 0) {
+			n_bytes += (size_t)st.st_size;
+		}
+	}
+	return n_bytes / BYTES_PER_TOKEN_ESTIMATE;
+}
+
+int Hash_While_Reading;
+
 void
 Read_Input_Files(int argc, const char *argv[]) {
 	int n;
+	size_t estimated_length = estimated_token_count(argc, argv);
 
 	Init_Text(argc);
 	Init_Token_Array();
+	Reserve_Token_Array(estimated_length);
+	find_shared_contents(argc, argv);
+	Progress_Phase("reading", Number_of_Texts, estimated_length);
 
 	/* Initially assume all texts to be new */
 	Number_of_New_Texts = Number_of_Texts;
 
 	/* Read the files */
-	for (n = 0; n < Number_of_Texts; n++) {
-		/* do one argument/file name */
-		read_file(argv[n],&Text[n]);
+	if (Number_of_Threads <= 1 || Number_of_Texts <= 1) {
+		for (n = 0; n < Number_of_Texts; n++) {
+			/* do one argument/file name */
+			prefetch_for(Number_of_Texts, argv, n);
+			read_file(argv[n],&Text[n], 0);
+		}
+	}
+	else {
+		lexed_texts = (struct lexed_text *)
+			Calloc(Number_of_Texts, sizeof (struct lexed_text));
+		lexed_names = argv;
+		next_text_to_lex = 0;
+		if (Hash_While_Reading) {
+			Start_Window_Hashing(estimated_length);
+		}
+		Start_Workers(Number_of_Threads, lex_texts_worker, 0);
+
+		/* take the texts in argument order, as they become available */
+		for (n = 0; n < Number_of_Texts; n++) {
+			Lock();
+			while (!lexed_texts[n].lt_done) {
+				Wait_For_Change();
+			}
+			Unlock();
+			read_file(argv[n], &Text[n], &lexed_texts[n]);
+			Hash_Windows_Up_To(n + 1);
+		}
+
+		Join_Workers();
+		Free(lexed_texts); lexed_texts = 0;
+		lexed_names = 0;
+	}
+
+	Free(same_contents_as); same_contents_as = 0;
+	n_same_contents = 0;
+
+	if (Text_Index_Name) {
+		if (Number_of_Texts != Number_of_New_Texts) {
+			/* there are old texts; save them */
+			Write_Text_Index(Text_Index_Name);
+		} else {
+			/* get them from the index */
+			read_text_index(Text_Index_Name);
+		}
+	}
+	Trim_Token_Array();
+
+	if (is_set_option('c') || is_set_option('J')) {
+		/* the output is to be a matrix or JSON objects only */
+		return;
 	}
 
 	/* report total */
@@ -141,3 +596,9 @@ Read_Input_Files(int argc, const char *argv[]) {
 	fprintf(Output_File, "\n\n");
 	fflush(Output_File);
 }
+
+void
+Add_Input_File(const char *fname) {
+	Extend_Text(Number_of_Texts + 1);
+	read_file(fname, &Text[Number_of_Texts-1], 0);
+}
@@ -7,3 +7,15 @@
 	and the input file descriptions in struct text text[].
 */
 extern void Read_Input_Files(int argc, const char *argv[]);
+
+/*	If Hash_While_Reading is set, the forward references are going to be
+	made from the texts read, and under -j the hash values of the
+	windows of each text are computed as soon as it has been read (see
+	Start_Window_Hashing() in hash.h), while the next texts are lexed.
+*/
+extern int Hash_While_Reading;
+
+/*	Reads one more input file, as Text[Number_of_Texts], after the
+	others; used by -q.
+*/
+extern void Add_Input_File(const char *fname);
@@ -12,30 +12,22 @@
 #include	"token.h"
 #include	"text.h"
 #include	"lang.h"
+#include	"runs.h"
 #include	"pass2.h"
 
 #ifdef	DB_POS
 #include	"pass2_db.i"
 #endif
 
-/* begin instantiate */
-static void sort_pos_list(struct position **);
-#define	SORT_STRUCT		position
-#define	SORT_NAME		sort_pos_list
-#define	SORT_BEFORE(p1,p2)	((p1)->ps_tk_cnt < (p2)->ps_tk_cnt)
-#define	SORT_NEXT		ps_next
-#include	"sortlist.bdy"
-/* end instantiate sort_pos_list() */
-
 static void
-match_pos_list_of(struct text *txt) {
-	struct position *pos = txt->tx_pos;
+match_pos_list_of(const struct text *txt, struct pos_ref *pr, size_t n_pos) {
+	size_t i;
 
-	while (pos) {
-		/* we scan the pos list and the file in parallel */
+	for (i = 0; i < n_pos; i++) {
+		/* we scan the positions and the file in parallel */
 
 		/* find the corresponding line */
-		while (pos->ps_tk_cnt >= lex_tk_cnt) {
+		while (pr[i].pr_tk_cnt >= lex_tk_cnt) {
 			/* pos does not refer to this line, try the next */
 			/* >= because of TK_CNT_HORROR */
 
@@ -65,17 +57,57 @@ match_pos_list_of(struct text *txt) {
 		}
 
 		/* fill in the pos */
-		pos->ps_nl_cnt = lex_nl_cnt - 1;	/* TK_CNT_HORROR */
+		pr[i].pr_pos->ps_nl_cnt = lex_nl_cnt - 1;	/* TK_CNT_HORROR */
+	}
+}
+
+static void
+match_pos_list_by_lines(
+	const struct text *txt, struct pos_ref *pr, size_t n_pos
+) {
+	/* the same as match_pos_list_of(), from the line ends recorded by
+	   Pass 1 rather than from the file
+	*/
+	size_t offset = 0;
+	size_t tk_cnt = 0;		/* plays the role of lex_tk_cnt */
+	size_t nl_cnt = 1;		/* plays the role of lex_nl_cnt */
+	size_t i;
+
+	for (i = 0; i < n_pos; i++) {
+		/* find the corresponding line */
+		while (pr[i].pr_tk_cnt >= tk_cnt) {
+			/* >= because of TK_CNT_HORROR */
+			if (!Next_Line_End(txt->tx_lines, &offset, &tk_cnt)) {
+				/* no more line ends; the rest is on the last
+				   line
+				*/
+				break;
+			}
+			nl_cnt++;
+		}
 
-		/* and get the next pos */
-		pos = pos->ps_next;
+		/* fill in the pos */
+		pr[i].pr_pos->ps_nl_cnt = nl_cnt - 1;	/* TK_CNT_HORROR */
 	}
 }
 
 static void
 pass2_txt(struct text *txt) {
-	if (!txt->tx_pos)	/* no need to scan the file */
+	size_t n_pos;
+	struct pos_ref *pr = Positions_Of(txt, &n_pos);
+
+	if (!pr)		/* no need to scan the file */
+		return;
+
+	if (txt->tx_lines) {
+		/* no need to scan the file either */
+		Sort_Pos_Refs(pr, n_pos);
+		match_pos_list_by_lines(txt, pr, n_pos);
+#ifdef	DB_POS
+		db_print_pos_list("from the line ends", txt);
+#endif	/* DB_POS */
 		return;
+	}
 
 	/* Open_Text() initializes lex_nl_cnt and lex_tk_cnt */
 	if (!Open_Text(txt)) {
@@ -85,15 +117,15 @@ pass2_txt(struct text *txt) {
 		return;
 	}
 
-	/* Sort the positions so they can be matched to the file; the linked
-	   list of struct positions snakes through the struct positions in the
-	   struct chunks in the struct runs.
+	/* Sort the positions so they can be matched to the file; the array
+	   points into the struct positions in the struct chunks in the struct
+	   runs.
 	*/
 #ifdef	DB_POS
 	db_print_pos_list("before sorting", txt);
 #endif	/* DB_POS */
 
-	sort_pos_list(&txt->tx_pos);
+	Sort_Pos_Refs(pr, n_pos);
 
 #ifdef	DB_POS
 	db_print_pos_list("after sorting", txt);
@@ -103,7 +135,7 @@ pass2_txt(struct text *txt) {
 	fprintf(Debug_File, "\n**** DB_PRINT_SCAN of %s ****\n", txt->tx_fname);
 #endif	/* DB_POS */
 
-	match_pos_list_of(txt);
+	match_pos_list_of(txt, pr, n_pos);
 
 #ifdef	DB_POS
 	db_print_pos_list("after scanning", txt);
@@ -116,6 +148,9 @@ void
 Retrieve_Runs(void) {
 	int n;
 
+	/* under -K, the runs to be reported are known only now */
+	select_runs();
+
 	for (n = 0; n < Number_of_Texts; n++) {
 		pass2_txt(&Text[n]);
 	}
@@ -27,10 +27,10 @@ db_print_pos_list(const char *msg, const struct text *txt) {
 	fprintf(Debug_File, "\n**** DB_PRINT_POS_LIST of %s, %s ****\n",
 		txt->tx_fname, msg);
 
-	const struct position *pos = txt->tx_pos;
-	while (pos) {
-		db_print_pos(pos);
-		pos = pos->ps_next;
+	size_t n_pos, i;
+	const struct pos_ref *pr = Positions_Of(txt, &n_pos);
+	for (i = 0; i < n_pos; i++) {
+		db_print_pos(pr[i].pr_pos);
 	}
 	fprintf(Debug_File, "\n");
 }
@@ -4,6 +4,7 @@
 */
 
 #include	<stdio.h>
+#include	<stdint.h>
 #include	<string.h>
 
 #include	"system.par"
@@ -13,9 +14,13 @@
 #include	"fname.h"
 #include	"utf8.h"
 #include	"text.h"
+#include	"stream.h"
 #include	"token.h"
 #include	"runs.h"
 #include	"percentages.h"
+#include	"Malloc.h"
+#include	"archive.h"
+#include	"parallel.h"
 #include	"pass3.h"
 
 #ifdef	DB_RUN
@@ -46,17 +51,71 @@ typedef int pts;
 #define	is_leading_utf8_byte(bt)	((bt&0300) == 0300)
 #define	is_continuation_utf8_byte(bt)	((bt&0300) == 0200)
 
-							/* AUXILIARIES */
+							/* OUTPUT BUFFER */
+/*	The output of a run is built in a buffer, in which spaces are padded
+	in bulk, and written by fwrite() once it has grown large enough; the
+	widths of the file names are computed once for each text. The
+	column layout is the same as that of printing piecemeal.
+*/
 
-static pts
-print_string(const char *str) {
-	/* assumes str to be UTF-8-correct */
-	const char *s = str;
+#define	OUT_BUF_FLUSH	(64*1024)	/* write when it holds this much */
+
+struct out_buf {
+	char *ob_text;			/* to be filled by Malloc() */
+	size_t ob_free;
+	size_t ob_size;
+};
+
+static void
+make_room(struct out_buf *ob, size_t n) {
+	if (ob->ob_free + n > ob->ob_size) {
+		/* allocated array is full; increase its size */
+		size_t new_size = (ob->ob_size ? 2 * ob->ob_size : 4096);
+		while (ob->ob_free + n > new_size) {
+			new_size *= 2;
+		}
+		ob->ob_text = (char *)Realloc(ob->ob_text, new_size);
+		ob->ob_size = new_size;
+	}
+}
+
+static void
+add_bytes(struct out_buf *ob, const char *s, size_t n) {
+	make_room(ob, n);
+	memcpy(&ob->ob_text[ob->ob_free], s, n);
+	ob->ob_free += n;
+}
+
+static void
+add_fill(struct out_buf *ob, char ch, size_t n) {
+	make_room(ob, n);
+	memset(&ob->ob_text[ob->ob_free], ch, n);
+	ob->ob_free += n;
+}
 
-	fprintf(Output_File, "%s", str);
+static void
+write_out_buf(struct out_buf *ob) {
+	if (ob->ob_free) {
+		(void)fwrite(ob->ob_text, 1, ob->ob_free, Output_File);
+		ob->ob_free = 0;
+	}
+}
 
-	/* compute the printed length */
+static void
+free_out_buf(struct out_buf *ob) {
+	if (ob->ob_text) {
+		Free(ob->ob_text); ob->ob_text = 0;
+	}
+	ob->ob_free = ob->ob_size = 0;
+}
+
+							/* AUXILIARIES */
+
+static pts
+string_width(const char *s) {
+	/* assumes s to be UTF-8-correct */
 	pts len = 0;
+
 	while (*s) {
 		len += (is_ascii_byte(*s) ? ASCII_WIDTH : UTF8_WIDTH);
 		s++;
@@ -64,6 +123,12 @@ print_string(const char *str) {
 	return len;
 }
 
+static pts
+print_string(struct out_buf *ob, const char *str) {
+	add_bytes(ob, str, strlen(str));
+	return string_width(str);
+}
+
 static pts
 width_of_size_t(size_t u) {
 	pts res = ASCII_WIDTH;
@@ -75,59 +140,265 @@ width_of_size_t(size_t u) {
 }
 
 static pts
-print_size_t(size_t u) {
-	fprintf(Output_File, "%s", size_t2string(u));
-	return width_of_size_t(u);
+print_size_t(struct out_buf *ob, size_t u) {
+	/* size_t2string() is not safe for several threads */
+	char digits[3 * sizeof (size_t) + 1];
+	size_t n = sizeof digits;
+
+	do {
+		digits[--n] = (char)('0' + u % 10);
+		u /= 10;
+	} while (u > 0);
+	add_bytes(ob, &digits[n], sizeof digits - n);
+	return (pts)(sizeof digits - n) * ASCII_WIDTH;
 }
 
-							/* CHUNK PRINTING */
+static void
+print_spaces(struct out_buf *ob, pts n) {
+	if (n > 0) {
+		/* as many spaces as it takes to cover n */
+		add_fill(ob, ' ', (size_t)((n + ASCII_WIDTH - 1) / ASCII_WIDTH));
+	}
+}
 
-static pts
-print_header(const struct chunk *cnk) {
-	pts width = 0;
+static void
+print_char(struct out_buf *ob, char ch) {
+	make_room(ob, 1);
+	ob->ob_text[ob->ob_free++] = ch;
+}
 
-	width += print_string(cnk->ch_text->tx_fname);
-	width += print_string(": line ");
-	width += print_size_t(cnk->ch_first.ps_nl_cnt);
-	width += print_string("-");
-	width += print_size_t(cnk->ch_last.ps_nl_cnt);
-	return width;
+							/* LINE INDEX */
+/*	The first time a text is opened, the byte offsets of the starts of its
+	lines are collected; after that the first line of a chunk is found by
+	seeking to it rather than by reading up to it. So printing the runs
+	takes time linear in the size of the files plus that of the output,
+	rather than in the number of chunks times the size of the files.
+	When the runs are printed by several threads, the thread that finds
+	the index of a text missing makes it, and others needing it wait.
+
+	While the file is read for its index, its UTF-8 is checked as well,
+	so that of a file that is pure ASCII or correct UTF-8 the lines can
+	be printed without passing each byte through a utf8_box; see
+	print_checked_line() and next_char().
+*/
+
+#define	IS_ASCII	0
+#define	IS_UTF8		1
+#define	IS_BAD_UTF8	2
+
+struct line_index {
+	long *li_start;		/* li_start[k] is the offset of line k+1 */
+	size_t li_free;
+	size_t li_size;
+	long li_end;		/* the size of the file */
+	int li_utf8;		/* IS_ASCII, IS_UTF8 or IS_BAD_UTF8 */
+	int li_made;		/* Boolean, protected by Lock() */
+	int li_busy;		/* Boolean, being made; same */
+};
+
+static struct line_index *line_indexes;	/* one for each text */
+
+static void
+add_line_start(struct line_index *li, long offset) {
+	if (li->li_free == li->li_size) {
+		/* allocated array is full; increase its size */
+		li->li_size = (li->li_size ? 2 * li->li_size : 256);
+		li->li_start = (long *)Realloc(
+			li->li_start, li->li_size * sizeof (long)
+		);
+	}
+	li->li_start[li->li_free++] = offset;
+}
+
+/*	The check accepts what fill_ubox() would pass unchanged: no null
+	bytes, no overlong forms, no UTF-16 surrogate halves, and nothing
+	above U+10FFFF; the bytes following a leading byte must lie in the
+	range that excludes these, given in lo and hi. The ASCII stretches
+	are skipped 8 bytes at a time.
+*/
+#define	ONES		UINT64_C(0x0101010101010101)
+#define	HIGH_BITS	UINT64_C(0x8080808080808080)
+
+struct utf8_check {
+	int uc_utf8;		/* IS_ASCII, IS_UTF8 or IS_BAD_UTF8 */
+	int uc_need;		/* continuation bytes still to come */
+	int uc_lo, uc_hi;	/* the range of the next one */
+};
+
+static int
+is_ascii_word(const unsigned char *p) {
+	/* no top bits set, and no null bytes */
+	uint64_t w;
+
+	memcpy(&w, p, sizeof w);
+	return ((w | ((w - ONES) & ~w)) & HIGH_BITS) == 0;
 }
 
 static void
-print_spaces(pts n) {
-	while (n > 0) {
-		n -= print_string(" ");
+check_utf8(struct utf8_check *uc, const unsigned char *p, size_t n) {
+	size_t i = 0;
+
+	while (i < n && uc->uc_utf8 != IS_BAD_UTF8) {
+		if (uc->uc_need == 0) {
+			while (i + 8 <= n && is_ascii_word(&p[i])) {
+				i += 8;
+			}
+			if (i == n) break;
+
+			int byte = p[i++];
+			uc->uc_lo = 0200, uc->uc_hi = 0277;
+			if (byte == 0) {
+				uc->uc_utf8 = IS_BAD_UTF8;
+			} else
+			if (byte < 0200) {
+				/* ASCII */
+			} else
+			if (0302 <= byte && byte <= 0337) {
+				uc->uc_need = 1;
+			} else
+			if (0340 <= byte && byte <= 0357) {
+				uc->uc_need = 2;
+				if (byte == 0340) uc->uc_lo = 0240;
+				if (byte == 0355) uc->uc_hi = 0237;
+			} else
+			if (0360 <= byte && byte <= 0364) {
+				uc->uc_need = 3;
+				if (byte == 0360) uc->uc_lo = 0220;
+				if (byte == 0364) uc->uc_hi = 0217;
+			} else {
+				uc->uc_utf8 = IS_BAD_UTF8;
+			}
+			if (uc->uc_need) {
+				uc->uc_utf8 = IS_UTF8;
+			}
+		}
+		else {
+			int byte = p[i++];
+
+			if (byte < uc->uc_lo || byte > uc->uc_hi) {
+				uc->uc_utf8 = IS_BAD_UTF8;
+			}
+			uc->uc_need--;
+			uc->uc_lo = 0200, uc->uc_hi = 0277;
+		}
+	}
+}
+
+static void
+make_line_index(FILE *f, struct line_index *li) {
+	char buff[8192];
+	long offset = 0;
+	size_t n;
+	struct utf8_check uc = {IS_ASCII, 0, 0200, 0277};
+
+	add_line_start(li, 0);
+	while ((n = fread(buff, 1, sizeof buff, f)) > 0) {
+		const char *p = buff;
+		const char *nl;
+
+		while ((nl = memchr(p, '\n', (size_t)(&buff[n] - p)))) {
+			add_line_start(li, offset + (long)(nl - buff) + 1);
+			p = nl + 1;
+		}
+		check_utf8(&uc, (const unsigned char *)buff, n);
+		offset += (long)n;
 	}
+	li->li_end = offset;
+	li->li_utf8 = (uc.uc_need ? IS_BAD_UTF8 : uc.uc_utf8);
+}
+
+static const struct line_index *
+line_index_of(FILE *f, struct line_index *li) {
+	/* yields li, made from f if that has not been done yet */
+	Lock();
+	while (li->li_busy) {
+		Wait_For_Change();
+	}
+	if (li->li_made) {
+		Unlock();
+		return li;
+	}
+	li->li_busy = 1;
+	Unlock();
+
+	make_line_index(f, li);
+
+	Lock();
+	li->li_made = 1;
+	li->li_busy = 0;
+	Signal_Change();
+	Unlock();
+	return li;
 }
 
 static void
-print_char(char ch) {
-	fprintf(Output_File, "%c", ch);
+seek_line(FILE *f, const struct line_index *li, size_t nl_cnt) {
+	/* positions f at the start of line nl_cnt, or at the end of the
+	   file if it has fewer lines
+	*/
+	size_t k = (nl_cnt > 1 ? nl_cnt - 1 : 0);
+
+	(void)fseek(f, (k < li->li_free ? li->li_start[k] : li->li_end),
+		SEEK_SET);
+}
+
+static void
+free_line_indexes(void) {
+	int n;
+
+	if (!line_indexes) return;
+	for (n = 0; n < Number_of_Texts; n++) {
+		if (line_indexes[n].li_start) {
+			Free(line_indexes[n].li_start);
+		}
+	}
+	Free(line_indexes); line_indexes = 0;
+}
+
+							/* CHUNK PRINTING */
+
+static pts *name_widths;		/* one for each text */
+
+static pts
+print_header(struct out_buf *ob, const struct chunk *cnk) {
+	const struct text *txt = cnk->ch_text;
+	pts width = 0;
+
+	add_bytes(ob, txt->tx_fname, strlen(txt->tx_fname));
+	width += name_widths[txt - Text];
+	width += print_string(ob, ": line ");
+	width += print_size_t(ob, cnk->ch_first.ps_nl_cnt);
+	width += print_string(ob, "-");
+	width += print_size_t(ob, cnk->ch_last.ps_nl_cnt);
+	return width;
 }
 
 static void
-print_2_headers(
+print_2_headers(struct out_buf *ob,
     const struct chunk *cnk0, const struct chunk *cnk1,
     pts max_line_length, size_t size
 ) {
 	if (!is_set_option('d')) {
 		/* no assumptions about the lengths of the file names! */
-		pts width = print_header(cnk0);
-		print_spaces(max_line_length - width);
-		print_char('|');
-		width = print_header(cnk1);
+		pts width = print_header(ob, cnk0);
+		print_spaces(ob, max_line_length - width);
+		print_char(ob, '|');
+		width = print_header(ob, cnk1);
 		/* add width of the print to come */
 		width += ASCII_WIDTH + width_of_size_t(size) + ASCII_WIDTH;
-		print_spaces(max_line_length - width);
-		fprintf(Output_File, "[%s]\n", size_t2string(size));
+		print_spaces(ob, max_line_length - width);
+		print_char(ob, '[');
+		(void)print_size_t(ob, size);
+		(void)print_string(ob, "]\n");
 	}
 	else {
 		/* diff-like format */
-		(void)print_header(cnk0);
-		fprintf(Output_File, " [%s]\n", size_t2string(size));
-		(void)print_header(cnk1);
-		print_char('\n');
+		(void)print_header(ob, cnk0);
+		(void)print_string(ob, " [");
+		(void)print_size_t(ob, size);
+		(void)print_string(ob, "]\n");
+		(void)print_header(ob, cnk1);
+		print_char(ob, '\n');
 	}
 }
 
@@ -138,7 +409,25 @@ open_chunk(const struct chunk *cnk) {
 	*/
 
 	const char *fname = cnk->ch_text->tx_fname;
-	FILE *f = Fopen(str2Fname(fname), "r");
+	const struct input *in = cnk->ch_text->tx_input;
+	FILE *f = 0;
+
+	if (!in) {
+		/* it may be a member of an archive */
+		in = Archive_Member(fname);
+	}
+#ifndef	MSDOS
+	if (in && in->in_buf) {
+		/* the file is in memory already, under -k or -A */
+		f = fmemopen(in->in_buf, in->in_size - 2, "r");
+	}
+#endif	/* MSDOS */
+	if (!f) {
+		/* str2Fname() may yield a transient result */
+		Lock();
+		f = Fopen(str2Fname(fname), "r");
+		Unlock();
+	}
 	/* ^ Note that we use [Ff]open() here, which opens a character stream,
 	   rather than Open_Text(), which opens a token stream.
 	*/
@@ -148,20 +437,19 @@ open_chunk(const struct chunk *cnk) {
 		f = fopen(NULLFILE, "r");
 	}
 
-	/* skip ch_first.ps_nl_cnt newlines */
-	size_t nl_cnt = cnk->ch_first.ps_nl_cnt;
-	while (nl_cnt > 1) {
-		int ch = getc(f);
-		if (ch < 0) break;
-
-		if (ch == '\n') {
-			nl_cnt--;
-		}
-	}
+	/* skip to line ch_first.ps_nl_cnt */
+	seek_line(f, line_index_of(f, &line_indexes[cnk->ch_text - Text]),
+		cnk->ch_first.ps_nl_cnt);
 
 	return f;
 }
 
+static int
+utf8_of(const struct chunk *cnk) {
+	/* after open_chunk() */
+	return line_indexes[cnk->ch_text - Text].li_utf8;
+}
+
 static int
 fill_ubox(FILE *f, utf8_box *u) {
 	int len = 0;
@@ -175,11 +463,86 @@ fill_ubox(FILE *f, utf8_box *u) {
 	return len;
 }
 
+static int
+next_char(FILE *f, int utf8, utf8_box *u) {
+	/*	Reads the next UTF-8 character from f into u->text, and yields
+		its length, or 0 at the end, as fill_ubox() does; the box is
+		used only if the UTF-8 of f is not correct.
+	*/
+	if (utf8 == IS_BAD_UTF8) return fill_ubox(f, u);
+
+	int byte = getc(f);
+	if (byte < 0) return 0;
+
+	int len = (byte < 0200 ? 1 : byte < 0340 ? 2 : byte < 0360 ? 3 : 4);
+	int i;
+
+	u->text[0] = (char)byte;
+	for (i = 1; i < len; i++) {
+		u->text[i] = (char)getc(f);
+	}
+	u->text[len] = '\0';
+	return len;
+}
+
+static pts
+print_checked_line(struct out_buf *ob, FILE *f, pts max_line_length) {
+	/*	As print_line(), for a file with correct UTF-8: the bytes are
+		taken from f one by one, and the leading byte of a non-ASCII
+		character tells how many bytes follow.
+	*/
+	pts width = 0;
+	int at_beginning_of_line = 1, last_was_space = 0;
+	int ch;
+
+	while ((ch = getc(f)) >= 0 && ch != '\n') {
+		if (ch == '\t') ch = ' ';		/* reduce tab to space*/
+		if (ch < ' ') continue;			/* skip non-printables*/
+
+		/* condense spaces where appropriate */
+		if (!at_beginning_of_line && ch == ' ') {
+			if (last_was_space) continue;
+			last_was_space = 1;
+		} else {
+			at_beginning_of_line = 0;
+			last_was_space = 0;
+		}
+
+		if (ch < 0200) {
+			if (width + ASCII_WIDTH <= max_line_length) {
+				print_char(ob, (char)ch);
+				width += ASCII_WIDTH;
+			}
+			continue;
+		}
+
+		/* the leading byte tells how many bytes follow */
+		int len = (ch < 0340 ? 2 : ch < 0360 ? 3 : 4);
+		int fits = (width + len * UTF8_WIDTH <= max_line_length);
+		int i;
+
+		if (fits) {
+			print_char(ob, (char)ch);
+			width += len * UTF8_WIDTH;
+		}
+		for (i = 1; i < len; i++) {
+			ch = getc(f);
+			if (fits) print_char(ob, (char)ch);
+		}
+	}
+	return width;
+}
+
 static pts
-print_line(FILE *f, pts max_line_length) {
+print_line(struct out_buf *ob, FILE *f, int utf8, pts max_line_length) {
 	/* Reads one line from f and prints it in condensed form, up to a
 	   maximum length of max_line_length.
 	*/
+	if (utf8 != IS_BAD_UTF8) {
+		/* no need for a utf8_box */
+		return print_checked_line(ob, f, max_line_length);
+	}
+
 	pts width = 0;
 	int at_beginning_of_line = 1, last_was_space = 0;
 	utf8_box u; clear_utf8_box(&u);
@@ -204,7 +567,7 @@ print_line(FILE *f, pts max_line_length) {
 		/* UTF8 char ok, print it? */
 		pts ch_width = (len == 1 ? ASCII_WIDTH : len * UTF8_WIDTH);
 		if (width + ch_width <= max_line_length) {
-			fprintf(Output_File, "%s", u.text);
+			add_bytes(ob, u.text, (size_t)len);
 			width += ch_width;
 		}
 	}
@@ -212,21 +575,22 @@ print_line(FILE *f, pts max_line_length) {
 }
 
 static void
-print_1_line(FILE *f, const char *marker) {
+print_1_line(struct out_buf *ob, FILE *f, const char *marker) {
 	/* displays one line from f, preceded by the marker */
 	/* there is no length limitation, so we do not bother with UTF-8 */
 
-	fprintf(Output_File, "%s ", marker);
+	(void)print_string(ob, marker);
+	print_char(ob, ' ');
 
 	int ch;
 	while ((ch = getc(f)), ch > 0 && ch != '\n') {
-		print_char(ch);
+		print_char(ob, ch);
 	}
-	print_char('\n');
+	print_char(ob, '\n');
 }
 
 static void
-print_2_chunks(
+print_2_chunks(struct out_buf *ob,
     const struct chunk *cnk0, const struct chunk *cnk1,
     pts max_line_length
 ) {
@@ -243,26 +607,28 @@ print_2_chunks(
 		while (nl_cnt0 != 0 || nl_cnt1 != 0) {
 			pts width = 0;
 			if (nl_cnt0) {
-				width = print_line(f0, max_line_length);
+				width = print_line(ob, f0, utf8_of(cnk0),
+					max_line_length);
 				nl_cnt0--;
 			}
-			print_spaces(max_line_length - width);
-			print_char('|');
+			print_spaces(ob, max_line_length - width);
+			print_char(ob, '|');
 			if (nl_cnt1) {
-				(void)print_line(f1, max_line_length);
+				(void)print_line(ob, f1, utf8_of(cnk1),
+					max_line_length);
 				nl_cnt1--;
 			}
-			print_char('\n');
+			print_char(ob, '\n');
 		}
 	}
 	else {
 		/* display the chunks in a diff(1)-like format */
 		while (nl_cnt0--) {
-			print_1_line(f0, "<");
+			print_1_line(ob, f0, "<");
 		}
-		(void)print_string("---\n");
+		(void)print_string(ob, "---\n");
 		while (nl_cnt1--) {
-			print_1_line(f1, ">");
+			print_1_line(ob, f1, ">");
 		}
 	}
 
@@ -272,22 +638,245 @@ print_2_chunks(
 }
 
 static void
-print_run(const struct run *run) {
+print_run(struct out_buf *ob, const struct run *run) {
 	pts max_line_length = (Page_Width / 2 - 1) * ASCII_WIDTH;
 
 	const struct chunk *cnk0 = &run->rn_chunk0;
 	const struct chunk *cnk1 = &run->rn_chunk1;
 
-	print_2_headers(cnk0, cnk1, max_line_length, run->rn_size);
+	print_2_headers(ob, cnk0, cnk1, max_line_length, run->rn_size);
 
 	/* stop if that suffices */
 	if (is_set_option('n'))	return;
 
-	print_2_chunks(cnk0, cnk1, max_line_length);
+	print_2_chunks(ob, cnk0, cnk1, max_line_length);
+}
+
+							/* JSON OUTPUT */
+/*	Under -J each run is printed as one JSON object on a line of its
+	own (NDJSON), giving for both chunks the file name, the positions of
+	the first and the last token in the text, counted from 0, and the
+	first and the last line; under -n that is all, and the files are not
+	opened at all. Otherwise the lines of the chunks follow as strings,
+	from which invalid UTF-8 is left out, as in print_line().
+*/
+
+static void
+print_json_char(struct out_buf *ob, const char *str) {
+	/* prints the UTF-8 character in str, escaped as JSON requires */
+	unsigned char ch = (unsigned char)str[0];
+
+	if (ch == '"' || ch == '\\') {
+		print_char(ob, '\\');
+		print_char(ob, (char)ch);
+	} else
+	if (ch == '\n') {
+		(void)print_string(ob, "\\n");
+	} else
+	if (ch < ' ') {
+		char esc[8];
+
+		sprintf(esc, "\\u%04x", ch);
+		(void)print_string(ob, esc);
+	} else {
+		(void)print_string(ob, str);
+	}
+}
+
+static void
+print_json_string(struct out_buf *ob, const char *str) {
+	char ch[2];
+
+	ch[1] = '\0';
+	print_char(ob, '"');
+	while (*str) {
+		ch[0] = *str++;
+		print_json_char(ob, ch);
+	}
+	print_char(ob, '"');
+}
+
+static void
+print_json_number(struct out_buf *ob, const char *name, size_t u) {
+	/* prints ,"name":u */
+	(void)print_string(ob, ",\"");
+	(void)print_string(ob, name);
+	(void)print_string(ob, "\":");
+	(void)print_size_t(ob, u);
+}
+
+static void
+print_json_chunk(struct out_buf *ob, const struct chunk *cnk, int i) {
+	(void)print_string(ob, (i == 0 ? "\"file0\":" : ",\"file1\":"));
+	print_json_string(ob, cnk->ch_text->tx_fname);
+	print_json_number(ob, (i == 0 ? "first_token0" : "first_token1"),
+		cnk->ch_first.ps_tk_cnt);
+	print_json_number(ob, (i == 0 ? "last_token0" : "last_token1"),
+		cnk->ch_last.ps_tk_cnt);
+	print_json_number(ob, (i == 0 ? "first_line0" : "first_line1"),
+		cnk->ch_first.ps_nl_cnt);
+	print_json_number(ob, (i == 0 ? "last_line0" : "last_line1"),
+		cnk->ch_last.ps_nl_cnt);
+}
+
+static void
+print_json_chunk_text(struct out_buf *ob, const struct chunk *cnk, int i) {
+	FILE *f = open_chunk(cnk);
+	int utf8 = utf8_of(cnk);
+	size_t nl_cnt = cnk->ch_last.ps_nl_cnt - cnk->ch_first.ps_nl_cnt + 1;
+	utf8_box u; clear_utf8_box(&u);
+
+	(void)print_string(ob, (i == 0 ? ",\"text0\":\"" : ",\"text1\":\""));
+	while (next_char(f, utf8, &u)) {
+		if (u.text[0] == '\n') {
+			/* the end of the last line is not included */
+			if (--nl_cnt == 0) break;
+		}
+		print_json_char(ob, u.text);
+	}
+	print_char(ob, '"');
+	fclose(f);
+}
+
+static void
+print_json_run(struct out_buf *ob, const struct run *run) {
+	print_char(ob, '{');
+	print_json_chunk(ob, &run->rn_chunk0, 0);
+	print_json_chunk(ob, &run->rn_chunk1, 1);
+	print_json_number(ob, "size", run->rn_size);
+	if (!is_set_option('n')) {
+		print_json_chunk_text(ob, &run->rn_chunk0, 0);
+		print_json_chunk_text(ob, &run->rn_chunk1, 1);
+	}
+	print_char(ob, '}');
 }
 
 							/* PRINT RUNS */
 
+static void
+print_any_run(struct out_buf *ob, const struct run *run) {
+	if (is_set_option('J')) {
+		print_json_run(ob, run);
+	} else {
+		print_run(ob, run);
+	}
+	print_char(ob, '\n');
+}
+
+static void
+print_runs_serially(const struct run *run) {
+	struct out_buf ob = {0, 0, 0};
+
+	while (run) {
+#ifdef	DB_RUN
+		db_run(run);
+#endif	/* DB_RUN */
+		print_any_run(&ob, run);
+		if (ob.ob_free >= OUT_BUF_FLUSH) {
+			write_out_buf(&ob);
+		}
+		run = run->rn_next;
+	}
+	write_out_buf(&ob);
+	free_out_buf(&ob);
+}
+
+/*	Under -j, the runs are printed by the workers, each into a buffer of
+	its own, and the buffers are written by the main thread in the order
+	of the runs, so the output is the same as that of printing them one
+	by one. To keep the memory bounded, the workers keep at most
+	RENDER_WINDOW runs ahead of the writing; run k is printed in
+	slots[k % RENDER_WINDOW].
+*/
+
+#define	RENDER_WINDOW	(256)
+
+struct render_slot {
+	struct out_buf rs_buf;
+	int rs_done;			/* Boolean, protected by Lock() */
+};
+
+static const struct run **run_list;	/* to be filled by Malloc() */
+static size_t n_runs;
+static struct render_slot *slots;	/* to be filled by Calloc() */
+static size_t next_run_to_do;		/* protected by Lock() */
+static size_t n_runs_written;		/* same */
+
+static void
+print_runs_worker(int w, void *arg) {
+	(void)w;
+	(void)arg;
+	for (;;) {
+		Lock();
+		while (	next_run_to_do < n_runs
+		&&	next_run_to_do >= n_runs_written + RENDER_WINDOW
+		) {
+			/* the slot is still in use */
+			Wait_For_Change();
+		}
+		size_t k = next_run_to_do++;
+		Unlock();
+		if (k >= n_runs) break;
+
+		struct render_slot *rs = &slots[k % RENDER_WINDOW];
+		print_any_run(&rs->rs_buf, run_list[k]);
+
+		Lock();
+		rs->rs_done = 1;
+		Signal_Change();
+		Unlock();
+	}
+}
+
+static void
+print_runs_in_parallel(const struct run *run) {
+	const struct run *r;
+	size_t k;
+
+	n_runs = 0;
+	for (r = run; r; r = r->rn_next) {
+		n_runs++;
+	}
+	run_list = (const struct run **)
+		Malloc((n_runs + 1) * sizeof (const struct run *));
+	for (k = 0, r = run; r; k++, r = r->rn_next) {
+		run_list[k] = r;
+	}
+	slots = (struct render_slot *)
+		Calloc(RENDER_WINDOW, sizeof (struct render_slot));
+	next_run_to_do = 0;
+	n_runs_written = 0;
+	Start_Workers(Number_of_Threads, print_runs_worker, 0);
+
+	/* write the runs in order, as they become available */
+	for (k = 0; k < n_runs; k++) {
+		struct render_slot *rs = &slots[k % RENDER_WINDOW];
+
+		Lock();
+		while (!rs->rs_done) {
+			Wait_For_Change();
+		}
+		Unlock();
+#ifdef	DB_RUN
+		db_run(run_list[k]);
+#endif	/* DB_RUN */
+		write_out_buf(&rs->rs_buf);
+
+		Lock();
+		rs->rs_done = 0;
+		n_runs_written++;
+		Signal_Change();
+		Unlock();
+	}
+
+	Join_Workers();
+	for (k = 0; k < RENDER_WINDOW; k++) {
+		free_out_buf(&slots[k].rs_buf);
+	}
+	Free(slots); slots = 0;
+	Free(run_list); run_list = 0;
+}
+
 void
 Print_Runs(void) {
 #ifdef	DB_RUN
@@ -295,16 +884,24 @@ Print_Runs(void) {
 #endif	/* DB_RUN */
 	const struct run *run =
 		(is_set_option('u') ? unsorted_runs() : sorted_runs());
+	int n;
+
+	line_indexes = (struct line_index *)
+		Calloc(Number_of_Texts, sizeof (struct line_index));
+	/* the widths of the file names are needed by any thread */
+	name_widths = (pts *)Malloc((Number_of_Texts + 1) * sizeof (pts));
+	for (n = 0; n < Number_of_Texts; n++) {
+		name_widths[n] = string_width(Text[n].tx_fname);
+	}
 
-	while (run) {
-#ifdef	DB_RUN
-		db_run(run);
-#endif	/* DB_RUN */
-		print_run(run);
-		print_char('\n');
-		fflush(Output_File);
-		run = run->rn_next;
+	if (Number_of_Threads > 1 && run && run->rn_next) {
+		print_runs_in_parallel(run);
+	} else {
+		print_runs_serially(run);
 	}
+	fflush(Output_File);
 
+	Free(name_widths); name_widths = 0;
 	discard_runs();
+	free_line_indexes();
 }
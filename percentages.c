@@ -4,23 +4,37 @@
 */
 
 #include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<stdint.h>
 
 #include	"debug.par"
 #include	"sim.h"
 #include	"text.h"
 #include	"options.h"
 #include	"Malloc.h"
+#include	"memstat.h"
+#include	"arena.h"
+#include	"spill.h"
 #include	"percentages.h"
 
 struct match {
 	struct match *ma_next;
+	struct match *ma_hash_next;	/* in the chain in match_table[] */
+	int ma_text0;			/* index in Text[] of file 0 */
+	int ma_text1;			/* same, of file 1 */
 	const char *ma_fname0;
 	const char *ma_fname1;
 	size_t ma_size;			/* # tokens of file 0 found in file 1 */
 	size_t ma_size0;		/* # tokens in file 0 */
+	size_t ma_seq;			/* the order of creation */
 };
 
-static struct match *match_list = 0;	/* to be allocated by new() */
+static struct match *match_list = 0;	/* to be allocated in match_arena */
+static struct arena match_arena = ARENA_OF(struct match, MEM_MATCHES);
+static size_t n_live_matches;		/* in match_list */
+static size_t n_present_matches;	/* of the present text, in front */
+static size_t n_created_matches;
 
 #ifdef	DB_PERC
 static float match_percentage(const struct match *m);
@@ -32,6 +46,9 @@ do_add_to_percentages(
     int rec_level, const struct text *txt0, const struct text *txt1,
     size_t size);
 static void print_perc_info(const struct match *m);
+static void sort_match_list(struct match **listhook);
+static void print_match_list(void);
+static int spill_finished_matches(void);
 
 static float
 match_percentage(const struct match *m) {
@@ -53,15 +70,143 @@ add_to_percentages(
    will never return.
 */
 
+							/* MATCH TABLE */
+/*	To find the entry of a (txt0, txt1) combination without walking the
+	whole match list, the entries are also kept in a hash table on the
+	text indices, with chaining; if there is a table, all entries of the
+	list are in it. The table is only an accelerator: if there is no
+	memory for growing it, the administration carries on with longer
+	chains, and if there is no memory at all, without it, walking the
+	list.
+*/
+static struct match **match_table;	/* to be filled by TryCalloc() */
+static size_t match_table_size;		/* a power of 2, or 0 */
+static size_t n_matches;		/* in match_table[] */
+static int match_table_dropped;		/* Boolean, memory ran out */
+
+static size_t
+match_hash(int n0, int n1) {
+	uint64_t h = (((uint64_t)(unsigned int)n0 << 32) | (unsigned int)n1)
+		* UINT64_C(0x9E3779B97F4A7C15);
+
+	return (size_t)(h >> 32) & (match_table_size - 1);
+}
+
 static void
-print_and_remove_match_list(void) {
-	while (match_list) {
-		struct match *m = match_list;
-		match_list = m->ma_next;
+grow_match_table(void) {
+	size_t new_size = (match_table_size ? 2 * match_table_size : 1024);
+	struct match **new_table = (struct match **)
+		TryCalloc(new_size, sizeof (struct match *));
+	size_t i;
+
+	if (!new_table) return;		/* carry on with the old table */
+
+	struct match **old_table = match_table;
+	size_t old_size = match_table_size;
+
+	match_table = new_table;
+	match_table_size = new_size;
+	for (i = 0; i < old_size; i++) {
+		while (old_table[i]) {
+			struct match *m = old_table[i];
+			size_t h = match_hash(m->ma_text0, m->ma_text1);
+
+			old_table[i] = m->ma_hash_next;
+			m->ma_hash_next = match_table[h];
+			match_table[h] = m;
+		}
+	}
+	if (old_table) {
+		Free(old_table);
+	}
+	Uncount_Memory(MEM_MATCHES, old_size * sizeof (struct match *));
+	Count_Memory(MEM_MATCHES, new_size * sizeof (struct match *));
+}
+
+static void
+free_match_table(void) {
+	if (match_table) {
+		Free(match_table); match_table = 0;
+	}
+	Uncount_Memory(MEM_MATCHES, match_table_size * sizeof (struct match *));
+	match_table_size = 0;
+	n_matches = 0;
+}
+
+static void
+drop_match_table(void) {
+	/* give back its memory; the list is walked from now on */
+	free_match_table();
+	match_table_dropped = 1;
+}
+
+static void
+enter_match(struct match *m) {
+	if (match_table_dropped) return;
+	if (n_matches >= match_table_size) {
+		grow_match_table();
+		if (!match_table) {
+			/* not even room for a first table */
+			match_table_dropped = 1;
+			return;
+		}
+	}
+
+	size_t h = match_hash(m->ma_text0, m->ma_text1);
+	m->ma_hash_next = match_table[h];
+	match_table[h] = m;
+	n_matches++;
+}
 
-		print_perc_info(m);
-		Free(m);
+static void
+remove_match(struct match *m) {
+	/* from match_table[], if it is there */
+	if (!match_table) return;
+
+	struct match **m_hook =
+		&match_table[match_hash(m->ma_text0, m->ma_text1)];
+	while (*m_hook) {
+		if (*m_hook == m) {
+			*m_hook = m->ma_hash_next;
+			n_matches--;
+			return;
+		}
+		m_hook = &(*m_hook)->ma_hash_next;
+	}
+}
+
+static struct match *
+find_match(int n0, int n1) {
+	struct match *m = match_list;
+
+	/* most of the time it is the most recent one */
+	if (m && m->ma_text0 == n0 && m->ma_text1 == n1) return m;
+
+	if (match_table) {
+		m = match_table[match_hash(n0, n1)];
+		while (m) {
+			if (m->ma_text0 == n0 && m->ma_text1 == n1) return m;
+			m = m->ma_hash_next;
+		}
+		return 0;
+	}
+
+	/* there is no table; walk the list */
+	while (m) {
+		if (m->ma_text0 == n0 && m->ma_text1 == n1) return m;
+		m = m->ma_next;
 	}
+	return 0;
+}
+
+static void
+print_and_remove_match_list(void) {
+	/* prints the entries collected so far, in sorted order */
+	sort_match_list(&match_list);
+	print_match_list();
+	free_match_table();
+	/* the list is empty now, so a new table can be started */
+	match_table_dropped = 0;
 }
 
 static void
@@ -76,25 +221,39 @@ do_add_to_percentages(
 		size);
 #endif
 
+	int n0 = (int)(txt0 - &Text[0]);
+	int n1 = (int)(txt1 - &Text[0]);
+
+	if (is_set_option('c') && match_list && match_list->ma_text0 != n0) {
+		/*	The runs of a text come together, so the previous text
+			is finished; its row of the matrix can be printed.
+		*/
+		print_and_remove_match_list();
+	}
+
 	/* look up the (txt0, txt1) combination in the match list */
-	struct match *m = match_list;
-	while (m) {
-		if (	m->ma_fname0 == txt0->tx_fname
-		&&	m->ma_fname1 == txt1->tx_fname
-		) {
-			/* found it; now update it */
-			m->ma_size += size;
+	struct match *m = find_match(n0, n1);
+	if (m) {
+		/* found it; now update it */
+		m->ma_size += size;
 #ifdef	DB_PERC
-			fprintf(Debug_File, "match updated:\n");
-			db_print_match(m);
+		fprintf(Debug_File, "match updated:\n");
+		db_print_match(m);
 #endif
-			return;
-		}
-		m = m->ma_next;
+		return;
 	}
 
 	{	/* it's not there; create a new entry, but tread carefully */
-		m = try_new(struct match);
+		m = (struct match *)Try_Arena_New(&match_arena);
+		if (m == 0 && spill_finished_matches()) {
+			/* under -B, the spilled ones leave room */
+			m = (struct match *)Try_Arena_New(&match_arena);
+		}
+		if (m == 0 && match_table) {
+			/* first give back the memory of the match table */
+			drop_match_table();
+			m = (struct match *)Try_Arena_New(&match_arena);
+		}
 		if (m == 0) {
 			/* Normally this should not happen. Freeing the
 			   forward_reference[] and the last_index[] tables
@@ -104,7 +263,8 @@ do_add_to_percentages(
 			   quadratic, so for massive comparisons the runs may
 			   overtake the tables.
 			   We then free memory by flushing collected results,
-			   sacrificing the sorting.
+			   sorted among themselves, sacrificing the overall
+			   sorting.
 			*/
 			/* try to recover */
 			if (rec_level > 0) {
@@ -124,17 +284,33 @@ do_add_to_percentages(
 			return;
 		}
 
+		if (!match_list || match_list->ma_text0 != n0) {
+			/* the matches of a new text start */
+			n_present_matches = 0;
+		}
 		m->ma_next = match_list;
 		match_list = m;
+		n_live_matches++;
+		n_present_matches++;
 
+		m->ma_text0 = n0;
+		m->ma_text1 = n1;
 		m->ma_fname0 = txt0->tx_fname;
 		m->ma_fname1 = txt1->tx_fname;
 		m->ma_size = size;
 		m->ma_size0 = txt0->tx_limit - txt0->tx_start;
+		m->ma_seq = n_created_matches++;
+		enter_match(m);
 #ifdef	DB_PERC
 		fprintf(Debug_File, "match created:\n");
 		db_print_match(m);
 #endif	/* DB_PERC */
+		if (Exceeds_Memory_Limit(
+			n_live_matches * sizeof (struct match)
+			+ match_table_size * sizeof (struct match *))
+		) {
+			(void)spill_finished_matches();
+		}
 	}
 
 	if (is_set_option('u')) {
@@ -147,7 +323,9 @@ do_add_to_percentages(
 		*/
 		if (match_list->ma_next) {
 			print_perc_info(match_list->ma_next);
-			Free(match_list->ma_next);
+			remove_match(match_list->ma_next);
+			Arena_Free(&match_arena, match_list->ma_next);
+			n_live_matches--;
 			match_list->ma_next = 0;
 		}
 	}
@@ -160,38 +338,88 @@ do_add_to_percentages(
       etc.
    but this order cannot be specified by a single SORT_BEFORE().
    So we sort for percentage, and then reorder during printing.
+   Matches with equal percentages stay in the order in which they were
+   created, so their order does not depend on which other matches are
+   in the list (see SPILLING).
 */
 
+static uint32_t
+percentage_key(const struct match *m) {
+	/* non-negative floats are in the same order as their bit patterns */
+	float mp = match_percentage(m);
+	uint32_t key;
+
+	memcpy(&key, &mp, sizeof key);
+	return key;
+}
+
 /* begin instantiate */
 static void sort_match_list(struct match **listhook);
 #define	SORT_STRUCT		match
 #define	SORT_NAME		sort_match_list
-#define	SORT_BEFORE(p1,p2)	(match_percentage(p1) > match_percentage(p2))
+#define	SORT_KEY(p)		percentage_key(p)
+#define	SORT_DESCENDING
+#define	SORT_TIES_REVERSED
 #define	SORT_NEXT		ma_next
-#include	"sortlist.bdy"
+#include	"radixlist.bdy"
 /* end instantiate */
 
+static void
+print_csv_field(const char *s) {
+	/* quoted if need be, with " written as "" */
+	if (!s[strcspn(s, ",\"\r\n")]) {
+		fputs(s, Output_File);
+		return;
+	}
+	putc('"', Output_File);
+	while (*s) {
+		if (*s == '"') {
+			putc('"', Output_File);
+		}
+		putc(*s++, Output_File);
+	}
+	putc('"', Output_File);
+}
+
 static void
 print_perc_info(const struct match *m) {
 	int mp = (int)(match_percentage(m)*100.0 + 0.5 /* rounding */);
 
-	if (mp >= Threshold_Percentage) {
+	if (mp < Threshold_Percentage) return;
+
+	if (is_set_option('c')) {
+		/* text0,text1,tokens of text0 in text1,tokens of text0,
+		   name0,name1
+		*/
+		fprintf(Output_File, "%d,%d,%s,", m->ma_text0, m->ma_text1,
+			size_t2string(m->ma_size));
+		fprintf(Output_File, "%s,", size_t2string(m->ma_size0));
+		print_csv_field(m->ma_fname0);
+		putc(',', Output_File);
+		print_csv_field(m->ma_fname1);
+		putc('\n', Output_File);
+	}
+	else {
 		fprintf(Output_File,
 			"%s consists for %d %% of %s material\n",
 			m->ma_fname0, mp, m->ma_fname1
 		);
-		fflush(Output_File);
 	}
+	fflush(Output_File);
 }
 
 static void
-print_and_remove_perc_info_for_top_file(struct match **m_hook) {
+report_and_remove_top_file(
+	struct match **m_hook, void (*report)(const struct match *m)
+) {
+	/* report is print_perc_info, or spill_match under -B */
 	struct match *m = *m_hook;
 	const char *fname = m->ma_fname0;
 
-	print_perc_info(m);		/* always print main contributor */
+	(*report)(m);			/* always print main contributor */
 	*m_hook = m->ma_next;
-	Free(m);
+	Arena_Free(&match_arena, m);
+	n_live_matches--;
 
 	/* This is a horrible piece of code that should be rewritten.
 	   It works only because initially m_hook points to match_list,
@@ -207,11 +435,12 @@ print_and_remove_perc_info_for_top_file(struct match **m_hook) {
 			   suppressed by -P
 			*/
 			if (!is_set_option('P')) {
-				print_perc_info(m);
+				(*report)(m);
 			}
 			/* remove the struct */
 			*m_hook = m->ma_next;
-			Free(m);
+			Arena_Free(&match_arena, m);
+			n_live_matches--;
 		} else {
 			/* skip the struct */
 			m_hook = &m->ma_next;
@@ -227,12 +456,159 @@ print_match_list(void) {
 
 	/* destroys the match list while printing */
 	while (match_list) {
-		print_and_remove_perc_info_for_top_file(&match_list);
+		report_and_remove_top_file(&match_list, print_perc_info);
+	}
+}
+
+							/* SPILLING */
+/*	Under -B, when the matches held pass the memory limit, those of the
+	finished texts, which are all but the ones in front, are put in the
+	order in which print_match_list() would print them, and written out
+	as a batch of struct spilled_matches (see spill.h). Each carries the
+	percentage key and the creation number of the main contributor of its
+	file, so the merge of the batches can put the files in the order of
+	their main contributors in sort_match_list(); as the matches of a
+	text come together, the matches of a file are all in one batch, and
+	are in the same order there as without -B. So the output is that
+	without -B.
+*/
+struct spilled_match {
+	uint32_t sm_file_key;		/* of its main contributor */
+	size_t sm_file_seq;		/* same */
+	size_t sm_rank;			/* within its file */
+	int sm_text0;
+	int sm_text1;
+	size_t sm_size;
+	size_t sm_size0;
+};
+
+static int
+spilled_match_before(const void *p, const void *q) {
+	const struct spilled_match *sm0 = (const struct spilled_match *)p;
+	const struct spilled_match *sm1 = (const struct spilled_match *)q;
+
+	if (sm0->sm_file_key != sm1->sm_file_key) {
+		return sm0->sm_file_key > sm1->sm_file_key;
+	}
+	if (sm0->sm_file_seq != sm1->sm_file_seq) {
+		return sm0->sm_file_seq < sm1->sm_file_seq;
+	}
+	return sm0->sm_rank < sm1->sm_rank;
+}
+
+static int
+spilled_match_cmp(const void *p, const void *q) {
+	return (spilled_match_before(p, q) ? -1 : spilled_match_before(q, p));
+}
+
+static struct spill match_spill =
+	SPILL_OF(struct spilled_match, spilled_match_before);
+
+static struct spilled_match *spill_buffer;	/* to be filled by Malloc() */
+static size_t n_spill_buffer;
+
+static void
+spill_match(const struct match *m) {
+	struct spilled_match *sm = &spill_buffer[n_spill_buffer];
+
+	if (n_spill_buffer > 0 && sm[-1].sm_text0 == m->ma_text0) {
+		sm->sm_file_key = sm[-1].sm_file_key;
+		sm->sm_file_seq = sm[-1].sm_file_seq;
+		sm->sm_rank = sm[-1].sm_rank + 1;
+	} else {
+		/* the main contributor of its file comes first */
+		sm->sm_file_key = percentage_key(m);
+		sm->sm_file_seq = m->ma_seq;
+		sm->sm_rank = 0;
+	}
+	sm->sm_text0 = m->ma_text0;
+	sm->sm_text1 = m->ma_text1;
+	sm->sm_size = m->ma_size;
+	sm->sm_size0 = m->ma_size0;
+	n_spill_buffer++;
+}
+
+static void
+spill_match_list(struct match **m_hook, size_t n) {
+	/* spills and removes the n matches in *m_hook */
+	spill_buffer = (struct spilled_match *)
+		Malloc(n * sizeof (struct spilled_match));
+	n_spill_buffer = 0;
+
+	sort_match_list(m_hook);
+	while (*m_hook) {
+		report_and_remove_top_file(m_hook, spill_match);
+	}
+	qsort(spill_buffer, n_spill_buffer, sizeof (struct spilled_match),
+		spilled_match_cmp);
+	Spill_Batch(&match_spill, spill_buffer, n_spill_buffer);
+
+	Free(spill_buffer); spill_buffer = 0;
+}
+
+static int
+spill_finished_matches(void) {
+	/* yields 1 if matches have been spilled */
+	size_t n_finished = n_live_matches - n_present_matches;
+
+	if (	!Memory_Limit || n_finished == 0
+	||	is_set_option('u') || is_set_option('c')
+	) {
+		/* under -u and -c the matches are printed as they come */
+		return 0;
+	}
+
+	/* detach the finished matches, behind the present ones */
+	struct match **m_hook = &match_list;
+	size_t i;
+
+	for (i = 0; i < n_present_matches; i++) {
+		m_hook = &(*m_hook)->ma_next;
+	}
+	struct match *finished = *m_hook;
+	*m_hook = 0;
+	spill_match_list(&finished, n_finished);
+
+	/* and start a new match table, for the present matches */
+	struct match *m;
+	free_match_table();
+	for (m = match_list; m; m = m->ma_next) {
+		enter_match(m);
 	}
+	return 1;
+}
+
+static void
+print_spilled_matches(void) {
+	struct spilled_match sm;
+
+	Start_Merge(&match_spill);
+	while (Next_Merged(&match_spill, &sm)) {
+		struct match m;
+
+		m.ma_text0 = sm.sm_text0;
+		m.ma_text1 = sm.sm_text1;
+		m.ma_fname0 = Text[sm.sm_text0].tx_fname;
+		m.ma_fname1 = Text[sm.sm_text1].tx_fname;
+		m.ma_size = sm.sm_size;
+		m.ma_size0 = sm.sm_size0;
+		print_perc_info(&m);
+	}
+	Free_Spill(&match_spill);
 }
 
 void
 Print_Percentages(void) {
+	if (Spilled_Batches(&match_spill) > 0) {
+		/* the matches still held make the last batch */
+		spill_match_list(&match_list, n_live_matches);
+		print_spilled_matches();
+		free_match_table();
+		match_table_dropped = 0;
+		Free_Arena(&match_arena);
+		return;
+	}
+
 #ifdef	DB_PERC
 	db_print_match_list("before sort");
 #endif	/* DB_PERC */
@@ -241,4 +617,7 @@ Print_Percentages(void) {
 	db_print_match_list("after sort");
 #endif	/* DB_PERC */
 	print_match_list();
+	free_match_table();
+	match_table_dropped = 0;
+	Free_Arena(&match_arena);
 }
@@ -0,0 +1,269 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+#include	<stdio.h>
+#include	<string.h>
+#include	<time.h>
+#include	<errno.h>
+#include	<pthread.h>
+
+#include	"settings.par"
+#include	"sim.h"
+#include	"any_int.h"
+#include	"memstat.h"
+#include	"Malloc.h"
+#include	"progress.h"
+
+int Progress_Interval;
+const char *Metrics_Name;
+
+static int reporting;			/* Boolean, set before the thread */
+static int to_stderr;			/* Boolean, -V was given */
+static pthread_t reporter;
+static char *new_metrics_name;		/* Metrics_Name.new */
+
+/* the state of the work, protected by progress_lock */
+static pthread_mutex_t progress_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t progress_stop = PTHREAD_COND_INITIALIZER;
+static int stopping;			/* Boolean */
+static const char *phase_name = "starting";
+static time_t start_time;
+static time_t phase_start_time;
+static int phase_texts;
+static int texts_done;
+static size_t phase_tokens;
+static size_t tokens_done;
+static size_t runs_found;
+
+							/* COUNTING */
+void
+Progress_Phase(const char *phase, int n_texts, size_t n_tokens) {
+	if (!reporting) return;
+
+	pthread_mutex_lock(&progress_lock);
+	phase_name = phase;
+	phase_start_time = time(0);
+	phase_texts = n_texts;
+	texts_done = 0;
+	phase_tokens = n_tokens;
+	tokens_done = 0;
+	pthread_mutex_unlock(&progress_lock);
+}
+
+void
+Progress_Done(int n_texts, size_t n_tokens) {
+	if (!reporting) return;
+
+	pthread_mutex_lock(&progress_lock);
+	texts_done += n_texts;
+	tokens_done += n_tokens;
+	pthread_mutex_unlock(&progress_lock);
+}
+
+void
+Progress_Run(void) {
+	if (!reporting) return;
+
+	pthread_mutex_lock(&progress_lock);
+	runs_found++;
+	pthread_mutex_unlock(&progress_lock);
+}
+
+							/* REPORTING */
+struct progress {
+	const char *pg_phase;
+	int pg_texts;			/* 0 if not counted */
+	int pg_texts_done;
+	size_t pg_tokens;		/* 0 if not counted */
+	size_t pg_tokens_done;
+	size_t pg_runs;
+	long pg_elapsed;		/* in seconds */
+	long pg_eta;			/* in seconds, -1 if not known */
+	size_t pg_held;			/* in bytes */
+	long pg_resident;		/* in kB, -1 if not known */
+};
+
+static void
+take_snapshot(struct progress *pg) {
+	/* under progress_lock */
+	time_t now = time(0);
+	long phase_elapsed = (long)(now - phase_start_time);
+
+	pg->pg_phase = phase_name;
+	pg->pg_texts = phase_texts;
+	pg->pg_texts_done = texts_done;
+	pg->pg_tokens = phase_tokens;
+	pg->pg_tokens_done = tokens_done;
+	pg->pg_runs = runs_found;
+	pg->pg_elapsed = (long)(now - start_time);
+	pg->pg_eta = -1;
+	if (phase_tokens && tokens_done && phase_elapsed > 0) {
+		/* at the token rate of the phase so far */
+		pg->pg_eta = (tokens_done >= phase_tokens ? 0
+			: (long)((double)phase_elapsed
+				* (double)(phase_tokens - tokens_done)
+				/ (double)tokens_done + 0.5));
+	}
+	pg->pg_held = Memory_Held();
+	pg->pg_resident = Peak_Resident_kB();
+}
+
+static const char *
+duration(long s) {
+	/* as h:mm:ss */
+	static char buff[40];
+
+	sprintf(buff, "%ld:%02ld:%02ld", s / 3600, s / 60 % 60, s % 60);
+	return buff;
+}
+
+static void
+print_progress(FILE *f, const struct progress *pg) {
+	fprintf(f, "Progress: %s", pg->pg_phase);
+	if (pg->pg_texts) {
+		fprintf(f, ", %d of %d texts", pg->pg_texts_done, pg->pg_texts);
+	}
+	if (pg->pg_tokens) {
+		fprintf(f, ", %d %% of %s tokens",
+			(int)(100.0 * pg->pg_tokens_done / pg->pg_tokens),
+			any_uint2string(pg->pg_tokens, 0));
+	}
+	fprintf(f, ", %s runs", any_uint2string(pg->pg_runs, 0));
+	fprintf(f, ", %s bytes held", any_uint2string(pg->pg_held, 0));
+	if (pg->pg_resident >= 0) {
+		fprintf(f, ", %s kB peak resident",
+			any_uint2string((size_t)pg->pg_resident, 0));
+	}
+	fprintf(f, ", %s elapsed", duration(pg->pg_elapsed));
+	if (pg->pg_eta >= 0) {
+		fprintf(f, ", ETA %s", duration(pg->pg_eta));
+	}
+	fprintf(f, "\n");
+	fflush(f);
+}
+
+static void
+print_metric(FILE *f, const char *name, const char *help, double value) {
+	fprintf(f, "# HELP %s %s\n", name, help);
+	fprintf(f, "# TYPE %s gauge\n", name);
+	fprintf(f, "%s %.0f\n", name, value);
+}
+
+static void
+write_metrics(const struct progress *pg) {
+	/* through a new file, so readers never see half a file */
+	FILE *f = fopen(new_metrics_name, "w");
+
+	if (!f) return;			/* the next report may do better */
+	fprintf(f, "# HELP sim_phase The phase that is running.\n");
+	fprintf(f, "# TYPE sim_phase gauge\n");
+	fprintf(f, "sim_phase{phase=\"%s\"} 1\n", pg->pg_phase);
+	print_metric(f, "sim_phase_texts", "Texts to do in the phase.",
+		(double)pg->pg_texts);
+	print_metric(f, "sim_phase_texts_done", "Texts done in the phase.",
+		(double)pg->pg_texts_done);
+	print_metric(f, "sim_phase_tokens", "Tokens to do in the phase.",
+		(double)pg->pg_tokens);
+	print_metric(f, "sim_phase_tokens_done", "Tokens done in the phase.",
+		(double)pg->pg_tokens_done);
+	print_metric(f, "sim_runs_found", "Runs found so far.",
+		(double)pg->pg_runs);
+	print_metric(f, "sim_memory_held_bytes",
+		"Memory held by the large data structures.",
+		(double)pg->pg_held);
+	if (pg->pg_resident >= 0) {
+		print_metric(f, "sim_peak_resident_bytes",
+			"Peak resident set size.",
+			1024.0 * (double)pg->pg_resident);
+	}
+	print_metric(f, "sim_elapsed_seconds", "Time since the start.",
+		(double)pg->pg_elapsed);
+	if (pg->pg_eta >= 0) {
+		print_metric(f, "sim_phase_eta_seconds",
+			"Estimated time to the end of the phase.",
+			(double)pg->pg_eta);
+	}
+	if (fclose(f) == 0) {
+		rename(new_metrics_name, Metrics_Name);
+	}
+}
+
+static void
+report(const struct progress *pg) {
+	if (to_stderr) {
+		print_progress(stderr, pg);
+	}
+	if (Metrics_Name) {
+		write_metrics(pg);
+	}
+}
+
+static void *
+report_periodically(void *arg) {
+	pthread_mutex_lock(&progress_lock);
+	while (!stopping) {
+		struct timespec until;
+		struct progress pg;
+
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_sec += Progress_Interval;
+		while (	!stopping
+		&&	pthread_cond_timedwait(&progress_stop, &progress_lock,
+				&until) != ETIMEDOUT
+		) {
+			/* woken up early */
+		}
+		if (stopping) break;
+
+		take_snapshot(&pg);
+		pthread_mutex_unlock(&progress_lock);
+		report(&pg);
+		pthread_mutex_lock(&progress_lock);
+	}
+	pthread_mutex_unlock(&progress_lock);
+	return arg;
+}
+
+void
+Start_Progress(void) {
+	if (!Progress_Interval && !Metrics_Name) return;
+	to_stderr = (Progress_Interval != 0);
+	if (!Progress_Interval) {
+		Progress_Interval = DEFAULT_PROGRESS_INTERVAL;
+	}
+	if (Metrics_Name) {
+		new_metrics_name = (char *)Malloc(strlen(Metrics_Name) + 5);
+		sprintf(new_metrics_name, "%s.new", Metrics_Name);
+	}
+
+	start_time = phase_start_time = time(0);
+	stopping = 0;
+	reporting = 1;
+	if (pthread_create(&reporter, 0, report_periodically, 0)) {
+		fatal("cannot create thread");
+	}
+}
+
+void
+Stop_Progress(void) {
+	struct progress pg;
+
+	if (!reporting) return;
+
+	pthread_mutex_lock(&progress_lock);
+	stopping = 1;
+	pthread_cond_signal(&progress_stop);
+	pthread_mutex_unlock(&progress_lock);
+	pthread_join(reporter, 0);
+
+	Progress_Phase("done", 0, 0);
+	pthread_mutex_lock(&progress_lock);
+	take_snapshot(&pg);
+	pthread_mutex_unlock(&progress_lock);
+	report(&pg);
+
+	reporting = 0;
+	if (new_metrics_name) {
+		Free(new_metrics_name); new_metrics_name = 0;
+	}
+}
@@ -0,0 +1,31 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Progress reports, for -V N and -E F.
+
+	Start_Progress() starts a thread that wakes up every
+	Progress_Interval seconds and reports the phase that is running,
+	the texts and tokens done in it out of those it has, the runs found,
+	the memory held (see memstat.h), the time spent, and, if the phase
+	has a known number of tokens, the time still needed at the rate so
+	far. Under -V the report is a line on standard error; under -E it
+	replaces the file Metrics_Name, in the text format of Prometheus.
+	Stop_Progress() gives a last report, for the phase "done", and
+	stops the thread.
+
+	Progress_Phase(phase, n_texts, n_tokens) starts a phase, with
+	n_texts texts and n_tokens tokens to do, or 0 if they are not
+	counted; Progress_Done(n_texts, n_tokens) adds the work done in it,
+	and Progress_Run() counts a run found. They may be called by any
+	thread, and cost next to nothing when no reports are made.
+*/
+
+extern int Progress_Interval;		/* in seconds */
+extern const char *Metrics_Name;
+
+extern void Start_Progress(void);
+extern void Stop_Progress(void);
+
+extern void Progress_Phase(const char *phase, int n_texts, size_t n_tokens);
+extern void Progress_Done(int n_texts, size_t n_tokens);
+extern void Progress_Run(void);
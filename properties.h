@@ -9,7 +9,10 @@
 	        accepts language properties and stores them; see below;
 	    int May_Be_Start_Of_Run() and
 	    size_t Best_Run_Size()
-	        allow proposed runs the be judged and/or modified.
+	        allow proposed runs the be judged and/or modified;
+	    void Prepare_Best_Run_Size()
+	        indexes the parentheses in Token_Array[] under -f, so
+	        Best_Run_Size() need not scan the runs for them.
 
 	Two sets of properties are maintained:
 	1.  sets of Tokens that cannot be the beginning or end of a run;
@@ -37,3 +40,4 @@ extern void Init_Language_Properties(
 ); /* note the order of the arguments: Non_Finals ~ Openers, etc. */
 extern int May_Be_Start_Of_Run(Token tk);
 extern size_t Best_Run_Size(const Token *str, size_t size);
+extern void Prepare_Best_Run_Size(void);
@@ -0,0 +1,101 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+#include	<stdio.h>
+
+#include	"sim.h"
+#include	"text.h"
+#include	"token.h"
+#include	"tokenarray.h"
+#include	"options.h"
+#include	"compare.h"
+#include	"pass1.h"
+#include	"pass2.h"
+#include	"pass3.h"
+#include	"percentages.h"
+#include	"textindex.h"
+#include	"Malloc.h"
+#include	"query.h"
+
+#define	END_OF_ANSWER	"."
+
+static char *
+read_line(FILE *f) {
+	/* the next line of f, without the newline, or 0 at end of file */
+	size_t size = 256;
+	size_t len = 0;
+	char *line = (char *)Malloc(size);
+	int ch;
+
+	while ((ch = getc(f)) != EOF && ch != '\n') {
+		if (len + 1 == size) {
+			/* allocated array is full; increase its size */
+			size *= 2;
+			line = (char *)Realloc(line, size);
+		}
+		line[len++] = (char)ch;
+	}
+	if (ch == EOF && len == 0) {
+		Free(line);
+		return 0;
+	}
+	line[len] = '\0';
+	return line;
+}
+
+static void
+end_of_answer(void) {
+	fprintf(Output_File, "%s\n", END_OF_ANSWER);
+	fflush(Output_File);
+}
+
+static void
+answer_query(const char *fname) {
+	Add_Input_File(fname);
+	struct text *txt = &Text[Number_of_Texts-1];
+
+	Compare_To_Old_Files(Number_of_Texts-1);
+	if (is_set_option('p')) {
+		Print_Percentages();
+	} else {
+		Retrieve_Runs();
+		Print_Runs();
+	}
+
+	Truncate_Token_Array(txt->tx_start);
+	Remove_Last_Text();
+}
+
+void
+Serve_Queries(int argc, const char *argv[]) {
+	/* the arguments are all old files */
+	const char **old_argv =
+		(const char **)Malloc((argc + 2) * sizeof (const char *));
+	int i;
+
+	old_argv[0] = "/";
+	for (i = 0; i < argc; i++) {
+		old_argv[i+1] = argv[i];
+	}
+	old_argv[argc+1] = 0;
+	if (argc == 0 && Text_Index_Name) {
+		/* take them from the index */
+		Read_Input_Files(0, old_argv + 1);
+	} else {
+		Read_Input_Files(argc + 1, old_argv);
+	}
+	Prepare_Old_Files();
+	end_of_answer();
+
+	char *line;
+	while ((line = read_line(stdin))) {
+		if (*line && !is_new_old_separator(line)) {
+			answer_query(line);
+			end_of_answer();
+		}
+		Free(line);
+	}
+
+	Release_Old_Files();
+	Free(old_argv);
+}
@@ -0,0 +1,17 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Serving queries against a resident set of old files (-q option).
+
+	Serve_Queries(argc, argv) reads the files in argv as old files, or
+	takes them from the text index under -I when there are none, and
+	prepares them for comparison once. Then it reads file names from
+	standard input, one per line, and compares each of these files with
+	the old files only, as -S would with that file as the only new file,
+	printing the runs or the percentages as usual. The output of the
+	initial reading and that of each file are followed by a line
+	consisting of a single full stop, and flushed, so another program
+	can talk to sim through a pair of pipes.
+*/
+
+extern void Serve_Queries(int argc, const char *argv[]);
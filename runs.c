@@ -3,24 +3,59 @@
 	$Id: runs.c,v 1.19 2017-11-27 20:15:54 dick Exp $
 */
 
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<stdint.h>
+#include	<string.h>
+
 #include	"sim.h"
 #include	"text.h"
+#include	"options.h"
 #include	"runs.h"
 #include	"Malloc.h"
+#include	"memstat.h"
+#include	"arena.h"
+#include	"spill.h"
 #include	"debug.par"
 
 static struct run *runs;
+static struct arena run_arena = ARENA_OF(struct run, MEM_RUNS);
+static size_t n_runs_held;		/* in runs */
+static int runs_in_order;		/* Boolean, from the spill file */
+static void spill_runs(void);
 static void set_chunk(
-    struct chunk *cnk, struct text *txt, size_t start, size_t size);
+    struct chunk *cnk, const struct text *txt, size_t start, size_t size);
 static void set_pos(
-    struct position *pos, int type, struct text *txt, size_t start);
+    struct position *pos, int type, const struct text *txt, size_t start);
+static void free_positions(void);
+static void enter_run(
+    struct text *txt0, size_t i0, struct text *txt1, size_t i1,
+    size_t size);
+static void add_to_top_runs(
+    struct text *txt0, size_t i0, struct text *txt1, size_t i1,
+    size_t size);
 
 void
 add_to_runs(
     struct text *txt0, size_t i0, struct text *txt1, size_t i1,
     size_t size
 ) {
-	struct run *r = new(struct run);
+	if (Max_Runs) {
+		add_to_top_runs(txt0, i0, txt1, i1, size);
+	} else {
+		enter_run(txt0, i0, txt1, i1, size);
+		if (Exceeds_Memory_Limit(n_runs_held * sizeof (struct run))) {
+			spill_runs();
+		}
+	}
+}
+
+static void
+enter_run(
+    struct text *txt0, size_t i0, struct text *txt1, size_t i1,
+    size_t size
+) {
+	struct run *r = (struct run *)Arena_New(&run_arena);
 	/* This should always succeed, since releasing the forward_reference[]
 	   and the last_index[] tables will have freed large amounts of memory,
 	   and  massive comparisons as in percentage.c are not reasonable and
@@ -40,10 +75,11 @@ add_to_runs(
 #endif
 	r->rn_next = runs;
 	runs = r;
+	n_runs_held++;
 }
 
 static void
-set_chunk(struct chunk *cnk, struct text *txt,
+set_chunk(struct chunk *cnk, const struct text *txt,
 	  size_t start, size_t size
 ) {
 	/*	Fill the chunk *cnk with info about the piece of text
@@ -54,24 +90,314 @@ set_chunk(struct chunk *cnk, struct text *txt,
 	set_pos(&cnk->ch_last, 1, txt, start + size - 1);
 }
 
+static void add_pos_ref(const struct text *txt, struct position *pos);
+
 static void
-set_pos(struct position *pos, int type, struct text *txt, size_t start) {
+set_pos(struct position *pos, int type, const struct text *txt, size_t start) {
 	/* Fill a single struct position */
-	pos->ps_next = txt->tx_pos;
-	txt->tx_pos = pos;
-
 	pos->ps_type = type;
 	pos->ps_tk_cnt = start;
-	pos->ps_nl_cnt = (size_t) -1;		/* uninitialized */
+	pos->ps_nl_cnt = (Index) -1;		/* uninitialized */
+
+	add_pos_ref(txt, pos);
 }
 
+							/* POSITIONS */
+/*	The positions of the chunks in a text are not linked through the
+	runs but kept in an array per text, of struct pos_refs, each holding
+	a copy of the token count of the position and a pointer back to it.
+	Pass 2 sorts the array in place and goes through it in step with
+	the text, and only touches a run to fill in the line number. The
+	arrays are part of the runs, and go with discard_runs().
+*/
+struct position_array {
+	struct pos_ref *pa_refs;	/* to be filled by Malloc() */
+	size_t pa_n;
+	size_t pa_size;
+};
+
+static struct position_array *positions;	/* one per text */
+static int n_position_arrays;
+static size_t counted_position_memory;		/* for memstat.h */
+
+static void
+add_pos_ref(const struct text *txt, struct position *pos) {
+	int n = (int)(txt - Text);
+
+	if (n >= n_position_arrays) {
+		/* there are more texts now, under -q */
+		positions = (struct position_array *)Realloc(positions,
+			Number_of_Texts * sizeof (struct position_array));
+		memset(&positions[n_position_arrays], 0,
+			(Number_of_Texts - n_position_arrays)
+				* sizeof (struct position_array));
+		n_position_arrays = Number_of_Texts;
+	}
+
+	struct position_array *pa = &positions[n];
+	if (pa->pa_n == pa->pa_size) {
+		size_t new_size = (pa->pa_size ? 2 * pa->pa_size : 16);
+
+		pa->pa_refs = (struct pos_ref *)Realloc(pa->pa_refs,
+			new_size * sizeof (struct pos_ref));
+		Count_Memory(MEM_RUNS,
+			(new_size - pa->pa_size) * sizeof (struct pos_ref));
+		counted_position_memory +=
+			(new_size - pa->pa_size) * sizeof (struct pos_ref);
+		pa->pa_size = new_size;
+	}
+	struct pos_ref *pr = &pa->pa_refs[pa->pa_n++];
+	pr->pr_tk_cnt = pos->ps_tk_cnt;
+	pr->pr_pos = pos;
+}
+
+struct pos_ref *
+Positions_Of(const struct text *txt, size_t *n_pos) {
+	int n = (int)(txt - Text);
+
+	if (n >= n_position_arrays || positions[n].pa_n == 0) {
+		*n_pos = 0;
+		return 0;
+	}
+	*n_pos = positions[n].pa_n;
+	return positions[n].pa_refs;
+}
+
+/* the arrays up to this length are sorted by insertion, without Malloc() */
+#define	SMALL_POS_ARRAY		32
+
+void
+Sort_Pos_Refs(struct pos_ref *pr, size_t n_pos) {
+	/*	Sorts pr[0..n_pos-1] on pr_tk_cnt, with an LSD radix sort, one
+		byte per pass, skipping the bytes that are the same in all
+		keys, as in radixlist.bdy.
+	*/
+	size_t i;
+
+	if (n_pos <= SMALL_POS_ARRAY) {
+		for (i = 1; i < n_pos; i++) {
+			struct pos_ref p = pr[i];
+			size_t j = i;
+
+			while (j > 0 && pr[j-1].pr_tk_cnt > p.pr_tk_cnt) {
+				pr[j] = pr[j-1];
+				j--;
+			}
+			pr[j] = p;
+		}
+		return;
+	}
+
+	struct pos_ref *buff =
+		(struct pos_ref *)Malloc(n_pos * sizeof (struct pos_ref));
+	struct pos_ref *from = pr, *to = buff;
+	size_t (*count)[256] = (size_t (*)[256])
+		Calloc(sizeof (size_t), sizeof count[0]);
+	int b;
+
+	/* the counts of all bytes in one scan */
+	for (i = 0; i < n_pos; i++) {
+		size_t key = pr[i].pr_tk_cnt;
+
+		for (b = 0; b < (int)sizeof (size_t); b++) {
+			count[b][(key >> (8*b)) & 0xFF]++;
+		}
+	}
+
+	for (b = 0; b < (int)sizeof (size_t); b++) {
+		size_t *cnt = count[b];
+		size_t pos = 0;
+		int d;
+
+		/* a byte that is the same in all keys does not need a pass */
+		if (cnt[(from[0].pr_tk_cnt >> (8*b)) & 0xFF] == n_pos) continue;
+
+		for (d = 0; d < 256; d++) {
+			size_t c = cnt[d];
+
+			cnt[d] = pos;
+			pos += c;
+		}
+		for (i = 0; i < n_pos; i++) {
+			int digit = (int)((from[i].pr_tk_cnt >> (8*b)) & 0xFF);
+
+			to[cnt[digit]++] = from[i];
+		}
+
+		struct pos_ref *tmp = from;
+		from = to, to = tmp;
+	}
+	if (from != pr) {
+		memcpy(pr, from, n_pos * sizeof (struct pos_ref));
+	}
+	Free(count);
+	Free(buff);
+}
+
+static void
+free_positions(void) {
+	int n;
+
+	for (n = 0; n < n_position_arrays; n++) {
+		if (positions[n].pa_refs) {
+			Free(positions[n].pa_refs);
+		}
+	}
+	if (positions) {
+		Free(positions); positions = 0;
+	}
+	n_position_arrays = 0;
+	Uncount_Memory(MEM_RUNS, counted_position_memory);
+	counted_position_memory = 0;
+}
+
+							/* TOP RUNS */
+/*	Under -K, only the Max_Runs largest runs are kept. The candidates
+	are held in a heap of at most Max_Runs entries with the smallest run
+	at the top, so a new run either replaces the top or is dropped
+	right away; of runs of equal size the earlier ones are kept. The
+	candidates are not yet runs: they become struct runs, with their
+	positions in the texts, only in select_runs(), so Pass 2 and
+	Pass 3 see the kept runs only, in the order in which they were found.
+*/
+int Max_Runs;
+
+struct top_run {
+	struct text *tr_txt0;
+	size_t tr_i0;
+	struct text *tr_txt1;
+	size_t tr_i1;
+	size_t tr_size;
+	size_t tr_seq;			/* order of arrival */
+};
+
+static struct top_run *top_runs;	/* to be filled by Malloc() */
+static size_t n_top_runs;
+static size_t top_runs_size;
+static size_t top_run_seq;
+
+static int
+is_worse(const struct top_run *t0, const struct top_run *t1) {
+	/* t0 would be dropped before t1 */
+	if (t0->tr_size != t1->tr_size) return t0->tr_size < t1->tr_size;
+	return t0->tr_seq > t1->tr_seq;
+}
+
+static void
+sift_down(size_t i) {
+	for (;;) {
+		size_t worst = i;
+		size_t child = 2*i + 1;
+
+		if (	child < n_top_runs
+		&&	is_worse(&top_runs[child], &top_runs[worst])
+		) {
+			worst = child;
+		}
+		if (	child + 1 < n_top_runs
+		&&	is_worse(&top_runs[child+1], &top_runs[worst])
+		) {
+			worst = child + 1;
+		}
+		if (worst == i) return;
+
+		struct top_run tmp = top_runs[i];
+		top_runs[i] = top_runs[worst];
+		top_runs[worst] = tmp;
+		i = worst;
+	}
+}
+
+static void
+sift_up(size_t i) {
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+
+		if (!is_worse(&top_runs[i], &top_runs[parent])) return;
+
+		struct top_run tmp = top_runs[i];
+		top_runs[i] = top_runs[parent];
+		top_runs[parent] = tmp;
+		i = parent;
+	}
+}
+
+static void
+add_to_top_runs(
+    struct text *txt0, size_t i0, struct text *txt1, size_t i1,
+    size_t size
+) {
+	struct top_run tr;
+
+	tr.tr_txt0 = txt0, tr.tr_i0 = i0;
+	tr.tr_txt1 = txt1, tr.tr_i1 = i1;
+	tr.tr_size = size;
+	tr.tr_seq = top_run_seq++;
+
+	if (n_top_runs == (size_t)Max_Runs) {
+		/* the heap is full; replace the top or drop the run */
+		if (!is_worse(&top_runs[0], &tr)) return;
+		top_runs[0] = tr;
+		sift_down(0);
+		return;
+	}
+
+	if (n_top_runs == top_runs_size) {
+		/* allocated array is full; increase its size */
+		top_runs_size = (top_runs_size ? 2 * top_runs_size : 256);
+		if (top_runs_size > (size_t)Max_Runs) {
+			top_runs_size = (size_t)Max_Runs;
+		}
+		Uncount_Memory(MEM_RUNS, n_top_runs * sizeof (struct top_run));
+		top_runs = (struct top_run *)Realloc(
+			top_runs, top_runs_size * sizeof (struct top_run)
+		);
+		Count_Memory(MEM_RUNS, top_runs_size * sizeof (struct top_run));
+	}
+	top_runs[n_top_runs] = tr;
+	sift_up(n_top_runs);
+	n_top_runs++;
+}
+
+static int
+top_run_seq_cmp(const void *p, const void *q) {
+	const struct top_run *t0 = (const struct top_run *)p;
+	const struct top_run *t1 = (const struct top_run *)q;
+
+	return (t0->tr_seq < t1->tr_seq ? -1 : t0->tr_seq > t1->tr_seq);
+}
+
+void
+select_runs(void) {
+	size_t i;
+
+	if (!Max_Runs) return;
+
+	/* enter the kept runs in the order in which they were found */
+	qsort(top_runs, n_top_runs, sizeof (struct top_run), top_run_seq_cmp);
+	for (i = 0; i < n_top_runs; i++) {
+		const struct top_run *tr = &top_runs[i];
+
+		enter_run(tr->tr_txt0, tr->tr_i0,
+			  tr->tr_txt1, tr->tr_i1, tr->tr_size);
+	}
+	if (top_runs) {
+		Free(top_runs); top_runs = 0;
+		Uncount_Memory(MEM_RUNS, top_runs_size * sizeof (struct top_run));
+	}
+	n_top_runs = top_runs_size = 0;
+	top_run_seq = 0;
+}
+
+							/* SORTING */
 /* begin instantiate */
 static void sort_run_list(struct run **listhook);
 #define	SORT_STRUCT		run
 #define	SORT_NAME		sort_run_list
-#define	SORT_BEFORE(r0,r1)	((r0)->rn_size > (r1)->rn_size)
+#define	SORT_KEY(r)		((r)->rn_size)
+#define	SORT_DESCENDING
 #define	SORT_NEXT		rn_next
-#include	"sortlist.bdy"
+#include	"radixlist.bdy"
 /* end instantiate */
 
 static void
@@ -97,15 +423,137 @@ unsorted_runs(void) {
 struct run *
 sorted_runs(void) {
 	reverse_runs(&runs);
-	sort_run_list(&runs);
+	/* runs from the spill file are in order already */
+	if (!runs_in_order) sort_run_list(&runs);
 	return runs;
 }
 
 void
 discard_runs(void) {
-	while (runs) {
-		struct run *r = runs;
-		runs = r->rn_next;
-		Free(r);
+	/* all runs at once */
+	runs = 0;
+	n_runs_held = 0;
+	runs_in_order = 0;
+	Free_Arena(&run_arena);
+	free_positions();
+}
+
+							/* SPILLING */
+/*	Under -B, when the runs held pass the memory limit, they are written
+	out as a batch of struct spilled_runs, in the order of sorted_runs(),
+	or of unsorted_runs() under -u, and their memory is given back.
+	Of two runs of equal size, sorted_runs() puts first the one whose
+	number of arrival, read from the lowest bit up, first has a 1 where
+	the other has a 0 (see radixlist.spc); that is, the one with the
+	larger bit-reversed number. This does not depend on the number of
+	runs, so the merge of the batches yields the order of sorted_runs()
+	over all runs, and the output is the same as without -B.
+*/
+struct spilled_run {
+	uint64_t sr_size_key;		/* the size, or 0 under -u */
+	uint64_t sr_order_key;		/* among runs of equal size */
+	int sr_text0, sr_text1;
+	size_t sr_i0, sr_i1;
+	size_t sr_size;
+};
+
+static int
+spilled_run_before(const void *p, const void *q) {
+	const struct spilled_run *sr0 = (const struct spilled_run *)p;
+	const struct spilled_run *sr1 = (const struct spilled_run *)q;
+
+	if (sr0->sr_size_key != sr1->sr_size_key) {
+		return sr0->sr_size_key > sr1->sr_size_key;
+	}
+	return sr0->sr_order_key > sr1->sr_order_key;
+}
+
+static int
+spilled_run_cmp(const void *p, const void *q) {
+	return (spilled_run_before(p, q) ? -1 : spilled_run_before(q, p));
+}
+
+static struct spill run_spill =
+	SPILL_OF(struct spilled_run, spilled_run_before);
+static size_t n_runs_spilled;
+
+static uint64_t
+bit_reversed(uint64_t v) {
+	uint64_t res = 0;
+	int i;
+
+	for (i = 0; i < 64; i++) {
+		res = (res << 1) | (v & 1);
+		v >>= 1;
+	}
+	return res;
+}
+
+static void
+spill_runs(void) {
+	struct spilled_run *batch = (struct spilled_run *)
+		Malloc(n_runs_held * sizeof (struct spilled_run));
+	const struct run *r;
+	size_t i = n_runs_held;
+
+	/* the run list is in reverse order of arrival */
+	for (r = runs; r; r = r->rn_next) {
+		const struct text *txt0 = r->rn_chunk0.ch_text;
+		const struct text *txt1 = r->rn_chunk1.ch_text;
+		struct spilled_run *sr = &batch[--i];
+		uint64_t seq = (uint64_t)(n_runs_spilled + i);
+
+		if (is_set_option('u')) {
+			sr->sr_size_key = 0;
+			sr->sr_order_key = ~seq;
+		} else {
+			sr->sr_size_key = r->rn_size;
+			sr->sr_order_key = bit_reversed(seq);
+		}
+		sr->sr_text0 = (int)(txt0 - Text);
+		sr->sr_i0 = txt0->tx_start + r->rn_chunk0.ch_first.ps_tk_cnt;
+		sr->sr_text1 = (int)(txt1 - Text);
+		sr->sr_i1 = txt1->tx_start + r->rn_chunk1.ch_first.ps_tk_cnt;
+		sr->sr_size = r->rn_size;
+	}
+	qsort(batch, n_runs_held, sizeof (struct spilled_run), spilled_run_cmp);
+	Spill_Batch(&run_spill, batch, n_runs_held);
+	n_runs_spilled += n_runs_held;
+	Free(batch);
+
+	/* their positions go with them */
+	discard_runs();
+}
+
+int
+Runs_Spilled(void) {
+	return Spilled_Batches(&run_spill) > 0;
+}
+
+int
+Next_Spilled_Runs(void) {
+	static int merging;
+	struct spilled_run sr;
+
+	if (!merging) {
+		/* the runs still held make the last batch */
+		if (runs) spill_runs();
+		Start_Merge(&run_spill);
+		merging = 1;
+	}
+	while (	(	n_runs_held == 0
+		||	!Exceeds_Memory_Limit((n_runs_held + 1) * sizeof (struct run))
+		)
+	&&	Next_Merged(&run_spill, &sr)
+	) {
+		enter_run(&Text[sr.sr_text0], sr.sr_i0,
+			  &Text[sr.sr_text1], sr.sr_i1, sr.sr_size);
+	}
+	if (n_runs_held == 0) {
+		Free_Spill(&run_spill);
+		merging = 0;
+		return 0;
 	}
+	runs_in_order = 1;
+	return 1;
 }
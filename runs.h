@@ -29,6 +29,37 @@ struct run {				/* a 'run' of coincident tokens */
 extern void add_to_runs(
     struct text *txt0, size_t i0, struct text *txt1, size_t i1,
     size_t size);
+/*	Under -K, add_to_runs() keeps only the Max_Runs largest runs, and
+	select_runs() must be called before Pass 2 to make them into runs
+	with their positions; otherwise it does nothing.
+*/
+extern int Max_Runs;
+extern void select_runs(void);
+
 extern struct run *sorted_runs(void);
 extern struct run *unsorted_runs(void);
 extern void discard_runs(void);
+
+/*	The positions of the chunks in each text, for Pass 2, are kept in
+	an array of struct pos_refs for that text, in the order in which the
+	runs were entered; Positions_Of(txt, &n_pos) yields that of txt, and
+	sets n_pos to its length. The array may be reordered in place;
+	Sort_Pos_Refs(pr, n_pos) sorts it on the token counts. Positions
+	with equal token counts get the same line number, so their order
+	does not matter.
+*/
+struct pos_ref {
+	size_t pr_tk_cnt;		/* the same as pr_pos->ps_tk_cnt */
+	struct position *pr_pos;	/* in a chunk of a run */
+};
+
+extern struct pos_ref *Positions_Of(const struct text *txt, size_t *n_pos);
+extern void Sort_Pos_Refs(struct pos_ref *pr, size_t n_pos);
+
+/*	Under -B, the runs are spilled to a file when they pass the memory
+	limit (see spill.h). If Runs_Spilled(), each Next_Spilled_Runs()
+	makes the next of them, as many as fit in the limit, in the order of
+	the output, for Pass 2 and Pass 3; it returns 0 when they are done.
+*/
+extern int Runs_Spilled(void);
+extern int Next_Spilled_Runs(void);
@@ -0,0 +1,319 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	A partial results file consists of a header and one record per run.
+
+	The header holds the identification line PARTIAL_MAGIC, the shard
+	and the number of shards, the number of texts and tokens, the value
+	of Min_Run_Size and of the threshold, and the options that affect
+	the runs found; a merge checks all of these against its own. A run
+	record holds the numbers of the two texts, the positions of the two
+	chunks in Token_Array[] and the size; a record with an impossible
+	text number ends the file.
+
+	Each shard writes its runs in the order of its new texts, so the
+	merge is a k-way merge on the number of the first text of the runs.
+	All numbers are written in the native byte order, as in the index
+	file (see textindex.c); the shards are meant to run on machines of
+	one kind.
+*/
+
+#include	<stdio.h>
+#include	<stdint.h>
+#include	<string.h>
+
+#include	"sim.h"
+#include	"text.h"
+#include	"token.h"
+#include	"tokenarray.h"
+#include	"options.h"
+#include	"add_run.h"
+#include	"Malloc.h"
+#include	"shard.h"
+
+#define	PARTIAL_MAGIC	"SIM partial results 1\n"
+
+/* the options that change the runs that are found */
+#define	COMPARISON_OPTIONS	"aefFpsSx"
+
+#define	END_OF_RUNS	UINT64_MAX
+
+							/* SHARDS */
+const char *Shard_Spec;
+
+static int shard_index;			/* 0 .. n_shards-1 */
+static int n_shards = 1;
+
+void
+Select_Shard(void) {
+	int i, n;
+	char rest;
+
+	if (!Shard_Spec) return;
+	if (	sscanf(Shard_Spec, "%d/%d%c", &i, &n, &rest) != 2
+	||	n <= 0 || i <= 0 || i > n
+	) {
+		fatal("bad shard; use i/n, with 1 <= i <= n");
+	}
+	shard_index = i - 1;
+	n_shards = n;
+}
+
+int
+Is_In_Shard(int n) {
+	return n % n_shards == shard_index;
+}
+
+							/* FILE HANDLING */
+static void
+partial_error(const char *fname, const char *what) {
+	char *msg = (char *)Malloc(strlen(fname) + strlen(what) + 100);
+
+	sprintf(msg, "partial results file `%s': %s", fname, what);
+	fatal(msg);
+	/*NOTREACHED*/
+}
+
+static void
+put_number(FILE *f, const char *fname, uint64_t v) {
+	if (fwrite(&v, sizeof v, 1, f) != 1) {
+		partial_error(fname, "cannot write");
+	}
+}
+
+static uint64_t
+get_number(FILE *f, const char *fname) {
+	uint64_t v;
+
+	if (fread(&v, sizeof v, 1, f) != 1) {
+		partial_error(fname, "truncated or unreadable");
+	}
+	return v;
+}
+
+static void
+put_settings(FILE *f, const char *fname) {
+	/* the settings a merge must agree with, after the shard numbers */
+	const char *op;
+
+	put_number(f, fname, (uint64_t)Number_of_Texts);
+	put_number(f, fname, (uint64_t)Token_Array_Length());
+	put_number(f, fname, (uint64_t)Min_Run_Size);
+	put_number(f, fname, (uint64_t)Threshold_Percentage);
+	for (op = COMPARISON_OPTIONS; *op; op++) {
+		put_number(f, fname, is_set_option(*op) ? 1 : 0);
+	}
+}
+
+static void
+check_settings(FILE *f, const char *fname) {
+	const char *op;
+
+	if (	get_number(f, fname) != (uint64_t)Number_of_Texts
+	||	get_number(f, fname) != (uint64_t)Token_Array_Length()
+	) {
+		partial_error(fname, "made with different files");
+	}
+	if (get_number(f, fname) != (uint64_t)Min_Run_Size) {
+		partial_error(fname, "made with a different run size");
+	}
+	if (get_number(f, fname) != (uint64_t)Threshold_Percentage) {
+		partial_error(fname, "made with a different threshold");
+	}
+	for (op = COMPARISON_OPTIONS; *op; op++) {
+		if (get_number(f, fname) != (is_set_option(*op) ? 1 : 0)) {
+			char what[100];
+
+			sprintf(what, "made with a different setting of -%c",
+				*op);
+			partial_error(fname, what);
+		}
+	}
+}
+
+							/* WRITING */
+const char *Partial_Results_Name;
+
+static FILE *partial_file;
+
+void
+Open_Partial_Results(void) {
+	const char *fname = Partial_Results_Name;
+
+	partial_file = fopen(fname, "wb");
+	if (!partial_file) {
+		partial_error(fname, "cannot open for writing");
+	}
+	if (	fwrite(PARTIAL_MAGIC, strlen(PARTIAL_MAGIC), 1, partial_file)
+		!= 1
+	) {
+		partial_error(fname, "cannot write");
+	}
+	put_number(partial_file, fname, (uint64_t)shard_index);
+	put_number(partial_file, fname, (uint64_t)n_shards);
+	put_settings(partial_file, fname);
+}
+
+void
+Write_Partial_Run(
+	const struct text *txt0, size_t i0,
+	const struct text *txt1, size_t i1,
+	size_t size
+) {
+	const char *fname = Partial_Results_Name;
+
+	put_number(partial_file, fname, (uint64_t)(txt0 - Text));
+	put_number(partial_file, fname, (uint64_t)i0);
+	put_number(partial_file, fname, (uint64_t)(txt1 - Text));
+	put_number(partial_file, fname, (uint64_t)i1);
+	put_number(partial_file, fname, (uint64_t)size);
+}
+
+void
+Close_Partial_Results(void) {
+	const char *fname = Partial_Results_Name;
+
+	put_number(partial_file, fname, END_OF_RUNS);
+	if (fclose(partial_file) != 0) {
+		partial_error(fname, "cannot write");
+	}
+	partial_file = 0;
+}
+
+							/* MERGING */
+const char *Merge_Names;
+
+struct shard_file {
+	const char *sf_fname;
+	FILE *sf_file;
+	uint64_t sf_txt0;		/* of the next run, or END_OF_RUNS */
+};
+
+static size_t
+checked_position(const struct shard_file *sf) {
+	uint64_t i = get_number(sf->sf_file, sf->sf_fname);
+
+	if (i >= Token_Array_Length()) {
+		partial_error(sf->sf_fname, "position out of range");
+	}
+	return (size_t)i;
+}
+
+static struct text *
+checked_text(const struct shard_file *sf, uint64_t n) {
+	if (n >= (uint64_t)Number_of_Texts) {
+		partial_error(sf->sf_fname, "text number out of range");
+	}
+	return &Text[n];
+}
+
+static void
+read_next_txt0(struct shard_file *sf) {
+	sf->sf_txt0 = get_number(sf->sf_file, sf->sf_fname);
+	if (sf->sf_txt0 != END_OF_RUNS) {
+		(void)checked_text(sf, sf->sf_txt0);
+	}
+}
+
+static void
+open_shard_file(struct shard_file *sf, int n_files, char *seen) {
+	char magic[sizeof PARTIAL_MAGIC];
+	const char *fname = sf->sf_fname;
+
+	sf->sf_file = fopen(fname, "rb");
+	if (!sf->sf_file) {
+		partial_error(fname, "cannot open");
+	}
+	magic[sizeof PARTIAL_MAGIC - 1] = '\0';
+	if (	fread(magic, sizeof PARTIAL_MAGIC - 1, 1, sf->sf_file) != 1
+	||	strcmp(magic, PARTIAL_MAGIC) != 0
+	) {
+		partial_error(fname, "not a SIM partial results file");
+	}
+
+	uint64_t i = get_number(sf->sf_file, fname);
+	uint64_t n = get_number(sf->sf_file, fname);
+	if (n != (uint64_t)n_files) {
+		partial_error(fname, "one of a different number of shards");
+	}
+	if (i >= n || seen[i]) {
+		partial_error(fname, "a shard that is already given");
+	}
+	seen[i] = 1;
+	check_settings(sf->sf_file, fname);
+	read_next_txt0(sf);
+}
+
+static int
+count_names(const char *names) {
+	int n = 1;
+
+	while ((names = strchr(names, ','))) {
+		names++, n++;
+	}
+	return n;
+}
+
+void
+Merge_Partial_Results(void) {
+	int n_files = count_names(Merge_Names);
+	struct shard_file *sf = (struct shard_file *)
+		Malloc(n_files * sizeof (struct shard_file));
+	char *seen = (char *)Calloc(n_files, 1);
+	char *names = (char *)Malloc(strlen(Merge_Names) + 1);
+	char *name = strcpy(names, Merge_Names);
+	int k;
+
+	/* split the names in place */
+	for (k = 0; k < n_files; k++) {
+		char *end = strchr(name, ',');
+
+		if (end) *end = '\0';
+		sf[k].sf_fname = name;
+		open_shard_file(&sf[k], n_files, seen);
+		name = (end ? end + 1 : 0);
+	}
+
+	for (;;) {
+		/* the shard with the lowest next text goes first */
+		struct shard_file *first = 0;
+
+		for (k = 0; k < n_files; k++) {
+			if (	sf[k].sf_txt0 != END_OF_RUNS
+			&&	(!first || sf[k].sf_txt0 < first->sf_txt0)
+			) {
+				first = &sf[k];
+			}
+		}
+		if (!first) break;
+
+		/* pass on its runs with that text */
+		uint64_t n0 = first->sf_txt0;
+		while (first->sf_txt0 == n0) {
+			struct text *txt0 = checked_text(first, n0);
+			size_t i0 = checked_position(first);
+			struct text *txt1 = checked_text(first,
+				get_number(first->sf_file, first->sf_fname));
+			size_t i1 = checked_position(first);
+			size_t size = (size_t)
+				get_number(first->sf_file, first->sf_fname);
+
+			if (	i0 + size > txt0->tx_limit
+			||	i1 + size > txt1->tx_limit
+			) {
+				partial_error(first->sf_fname,
+					"run out of range");
+			}
+
+			add_run(txt0, i0, txt1, i1, size);
+			read_next_txt0(first);
+		}
+	}
+
+	for (k = 0; k < n_files; k++) {
+		fclose(sf[k].sf_file);
+	}
+	Free(names);
+	Free(seen);
+	Free(sf);
+}
@@ -0,0 +1,39 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Splitting the comparison into shards, and merging their results.
+
+	Under -L i/n (Shard_Spec) only the new texts whose number is i - 1
+	modulo n are compared; Select_Shard() checks the specification,
+	and Is_In_Shard(n) tells if new text n is to be compared. The n
+	shards together compare each new text exactly once, so they can be
+	run on different machines, each with the same files and options.
+
+	Under -W F (Partial_Results_Name) the runs found are not reported
+	but written to the partial results file F: Open_Partial_Results()
+	is called before the comparison, add_run() passes each run to
+	Write_Partial_Run(), and Close_Partial_Results() ends the file.
+
+	Under -Y F,... (Merge_Names) the comparison is not done; instead
+	Merge_Partial_Results() reads the partial results files of all n
+	shards, which must have been made with the same files and options,
+	and passes their runs to add_run() in the order of the new texts.
+	This is the order in which a single run would find them, so the
+	output is the same.
+*/
+
+extern const char *Shard_Spec;
+extern void Select_Shard(void);
+extern int Is_In_Shard(int n);
+
+extern const char *Partial_Results_Name;
+extern void Open_Partial_Results(void);
+extern void Write_Partial_Run(
+	const struct text *txt0, size_t i0,
+	const struct text *txt1, size_t i1,
+	size_t size
+);
+extern void Close_Partial_Results(void);
+
+extern const char *Merge_Names;
+extern void Merge_Partial_Results(void);
@@ -6,6 +6,8 @@
 #include	<stdio.h>
 #include	<stdlib.h>
 #include	<string.h>
+#include	<stdint.h>
+#include	<limits.h>
 
 #include	"system.par"
 #include	"settings.par"
@@ -24,6 +26,20 @@
 #include	"percentages.h"
 #include	"stream.h"
 #include	"lang.h"
+#include	"parallel.h"
+#include	"textindex.h"
+#include	"tokencache.h"
+#include	"query.h"
+#include	"archive.h"
+#include	"mapped.h"
+#include	"memstat.h"
+#include	"stats.h"
+#include	"balance.h"
+#include	"shard.h"
+#include	"spill.h"
+#include	"incremental.h"
+#include	"progress.h"
+#include	"identical.h"
 
 #include	"Malloc.h"
 #include	"any_int.h"
@@ -43,24 +59,38 @@ const char *Token_Name = "token";
 
 static const char *progname;		/* for error reporting */
 static const char *output_name;		/* for redirecting the output */
+static const char *run_sizes_arg;	/* N or N,N,... */
+static char default_run_size[16];	/* for run_sizes_arg */
+
+/* the run sizes under -r N,N,..., increasing */
+static int *run_sizes;			/* to be filled by Malloc() */
+static int n_run_sizes;
 
 static const struct option optlist[] = {
-	{'r', "set minimum run size to N", Number, &Min_Run_Size},
+	{'r', "set minimum run size to N, or to each of N,N,... in turn",
+		Numbers, &run_sizes_arg},
 
 	{' ', "output runs as text (default)", None, 0},
 	{'d', "output in a diff-like format", None, 0},
+	{'J', "output the runs as JSON, one object per line", None, 0},
 	{'n', "suppress the text of the runs", None, 0},
+	{'K', "report only the N largest runs", Number, &Max_Runs},
 	{'T', "suppress reporting the input files", None, 0},
 	{'p', "output similarity in percentages", None, 0},
 	{'P', "main contributing file to percentages only", None, 0},
+	{'c', "percentages as sparse matrix in CSV, as they come", None, 0},
 	{'t', "threshold level of percentages", Number, &Threshold_Percentage},
+	{'x', "skip files that cannot reach the threshold", None, 0},
 
 	{'e', "compare each file to each file separately", None, 0},
+	{'Z', "under -a, compare only one of each set of identical files",
+		None, 0},
 
 	{' ', "compare a file to files after it only (default)", None, 0},
 	{'a', "compare to all files", None, 0},
 	{'S', "compare to old files only", None, 0},
 	{'s', "do not compare a file to itself", None, 0},
+	{'q', "compare files named on standard input to the files", None, 0},
 
 	{' ', "sorted output, most significant first (default)", None, 0},
 	{'u', "unbuffered, unsorted output", None, 0},
@@ -69,12 +99,47 @@ static const struct option optlist[] = {
 	{'f', "function-like forms only", None, 0},
 	{'F', "keep function identifiers in tact", None, 0},
 	{'R', "recurse into subdirectories", None, 0},
+	{'g', "under -R, take only files matching the patterns P", String,
+		&Include_Patterns},
+	{'G', "under -R, skip files and directories matching P", String,
+		&Exclude_Patterns},
+	{'z', "under -R, skip files larger than N kilobytes", Number,
+		&Max_File_Size},
 	{'i', "read arguments (file names) from standard input", None, 0},
+	{'A', "read the members of tar archives as files", None, 0},
+	{'b', "read the arguments rev:path from git repository F", String,
+		&Git_Repository_Name},
 	{'o', "write output to file F", String, &output_name},
 	{'w', "set page width to N", Number, &Page_Width},
 	{'O', "show command line options at start-up", None, 0},
 	{'M', "show memory usage info at close-down", None, 0},
+	{'D', "show the time per phase and search statistics", None, 0},
+	{'V', "report the progress every N seconds", Number,
+		&Progress_Interval},
+	{'E', "write progress metrics to file F, for Prometheus", String,
+		&Metrics_Name},
 	{'v', "show version number and compilation date", None, 0},
+	{'j', "use N threads", Number, &Number_of_Threads},
+	{'X', "use a suffix array to find the runs", None, 0},
+	{'H', "hash the windows with F: xor (default), poly or buz", String,
+		&Window_Hash_Name},
+	{'I', "keep the old files in index file F", String, &Text_Index_Name},
+	{'m', "keep the large arrays in files in directory F", String,
+		&Scratch_Directory},
+	{'l', "keep the large arrays in huge pages", None, 0},
+	{'B', "keep at most N megabytes of runs or matches, spill the rest",
+		Number, &Memory_Limit},
+	{'k', "keep the input files in memory", None, 0},
+	{'C', "keep the token streams in cache directory F", String,
+		&Token_Cache_Name},
+	{'L', "compare only shard i of n of the new files, as i/n", String,
+		&Shard_Spec},
+	{'W', "write the runs to partial results file F", String,
+		&Partial_Results_Name},
+	{'Y', "merge the runs from the partial results files F,...", String,
+		&Merge_Names},
+	{'U', "under -e, compare only changed files, keeping results in F",
+		String, &Incremental_Name},
 	{'-', "lexical scan output only", None, 0},
 	{0, 0, 0, 0}
 };
@@ -98,6 +163,131 @@ fatal(const char *msg) {
 	exit(1);
 }
 
+static FILE *
+open_output(const char *fname) {
+	FILE *f = fopen(fname, "w");
+
+	if (f == 0) {
+		char *msg = (char *)Malloc(strlen(fname) + 100);
+
+		sprintf(msg, "cannot open output file `%s'", fname);
+		fatal(msg);
+		/*NOTREACHED*/
+	}
+	return f;
+}
+
+static void
+get_run_sizes(void) {
+	/* from run_sizes_arg, in increasing order, without duplicates */
+	const char *p;
+	int n_sizes = 1;
+
+	for (p = run_sizes_arg; *p; p++) {
+		if (*p == ',') n_sizes++;
+	}
+	run_sizes = (int *)Malloc(n_sizes * sizeof (int));
+	n_run_sizes = 0;
+
+	p = run_sizes_arg;
+	for (;;) {
+		char *end;
+		long size = strtol(p, &end, 10);
+		int i;
+		int j;
+
+		if (end == p || (*end && *end != ',') || size <= 0
+		||  size > INT_MAX)
+			fatal("bad run size");
+		for (i = 0; i < n_run_sizes && run_sizes[i] < size; i++) {
+			/* find its place */
+		}
+		if (i == n_run_sizes || run_sizes[i] != size) {
+			for (j = n_run_sizes; j > i; j--) {
+				run_sizes[j] = run_sizes[j-1];
+			}
+			run_sizes[i] = (int)size;
+			n_run_sizes++;
+		}
+		if (!*end) break;
+		p = end + 1;
+	}
+	Min_Run_Size = run_sizes[0];
+}
+
+static void
+report_phase(const char *phase) {
+	if (is_set_option('D')) {
+		Time_Phase(stderr, phase);
+	}
+	if (is_set_option('M')) {
+		Report_Memory_Phase(stderr, phase);
+	}
+}
+
+							/* RESULTS */
+static void
+print_results(void) {
+	if (is_set_option('p')) {
+		Progress_Phase("percentages", 0, 0);
+		Print_Percentages();
+		report_phase("percentages");
+	}
+	else
+	if (Runs_Spilled()) {
+		/* the runs come back from the spill file in batches */
+		Progress_Phase("passes 2 and 3", 0, 0);
+		while (Next_Spilled_Runs()) {
+			Retrieve_Runs();
+			Print_Runs();
+		}
+		report_phase("passes 2 and 3");
+	} else {
+		Progress_Phase("pass 2", 0, 0);
+		Retrieve_Runs();
+		report_phase("pass 2");
+		Progress_Phase("pass 3", 0, 0);
+		Print_Runs();
+		report_phase("pass 3");
+	}
+}
+
+static void
+sweep_run_sizes(void) {
+	/*	The results for each run size follow under a heading, or under
+		-o F go to the file F.N.
+	*/
+	FILE *main_output = Output_File;
+	int i;
+
+	Start_Sweep();
+	for (i = 0; i < n_run_sizes; i++) {
+		Min_Run_Size = run_sizes[i];
+		if (output_name) {
+			char *fname = (char *)Malloc(strlen(output_name) + 30);
+
+			sprintf(fname, "%s.%d", output_name, Min_Run_Size);
+			Output_File = open_output(fname);
+			Free(fname);
+		}
+		else {
+			/* the percentages do not end in an empty line */
+			fprintf(Output_File, "%sMinimum run size %d:\n\n",
+				(i > 0 && is_set_option('p') ? "\n" : ""),
+				Min_Run_Size);
+		}
+		Compare_Files();
+		report_phase("comparison");
+		print_results();
+		if (output_name) {
+			fclose(Output_File);
+		}
+	}
+	End_Sweep();
+	Output_File = main_output;
+	Min_Run_Size = run_sizes[0];
+}
+
 							/* PROGRAM */
 
 #ifdef	ARG_TEST
@@ -150,6 +340,32 @@ main(int argc, const char *argv[]) {
 	allow_at_most_one_option_out_of("dnp");	/* alternative output formats */
 	allow_at_most_one_option_out_of("aS");	/* alternative ranges */
 	allow_at_most_one_option_out_of("sS");	/* self is outside old files */
+	allow_at_most_one_option_out_of("aq");	/* queries go to old files */
+	allow_at_most_one_option_out_of("iq");	/* both read standard input */
+	allow_at_most_one_option_out_of("qx");	/* sketches need all files */
+	allow_at_most_one_option_out_of("qX");	/* suffix array is not kept */
+	allow_at_most_one_option_out_of("Kp");	/* percentages have no runs */
+	allow_at_most_one_option_out_of("dJ");	/* alternative run formats */
+	allow_at_most_one_option_out_of("Jp");	/* percentages have no runs */
+	allow_at_most_one_option_out_of("LY");	/* merges are of all shards */
+	allow_at_most_one_option_out_of("WY");	/* alternative run sources */
+	allow_at_most_one_option_out_of("qW");	/* queries are not sharded */
+	allow_at_most_one_option_out_of("qY");
+	allow_at_most_one_option_out_of("BK");	/* the top runs are few */
+	allow_at_most_one_option_out_of("Bq");	/* queries are answered apart */
+	allow_at_most_one_option_out_of("Uq");	/* -U keeps all pairs */
+	allow_at_most_one_option_out_of("UW");	/* alternative run sinks */
+	allow_at_most_one_option_out_of("UY");	/* merges do not compare */
+	allow_at_most_one_option_out_of("Ux");	/* sketches need all files */
+	allow_at_most_one_option_out_of("lm");	/* alternative array memory */
+	allow_at_most_one_option_out_of("cZ");	/* the report spoils the matrix */
+	allow_at_most_one_option_out_of("JZ");
+	allow_at_most_one_option_out_of("qZ");	/* queries add texts later */
+	allow_at_most_one_option_out_of("uZ");	/* copies interleave the pairs */
+	allow_at_most_one_option_out_of("LZ");	/* groups cross shards */
+	allow_at_most_one_option_out_of("UZ");	/* copies are not carried over */
+	allow_at_most_one_option_out_of("WZ");
+	allow_at_most_one_option_out_of("YZ");
 
 	if (is_set_option('t')) {
 		/* threshold means percentages */
@@ -160,6 +376,38 @@ main(int argc, const char *argv[]) {
 		if (!is_set_option('p'))
 		    fatal("option -P requires -p");
 	}
+	if (is_set_option('x')) {
+		if (!is_set_option('p'))
+		    fatal("option -x requires -p");
+	}
+	if (is_set_option('c')) {
+		if (!is_set_option('p'))
+		    fatal("option -c requires -p");
+	}
+	if (is_set_option('Z')) {
+		/* the representatives must be in the range of every text */
+		if (!is_set_option('a'))
+		    fatal("option -Z requires -a");
+	}
+	if (is_set_option('U')) {
+		if (!is_set_option('e'))
+		    fatal("option -U requires -e");
+	}
+	if (run_sizes_arg && strchr(run_sizes_arg, ',')) {
+		/* the other runs need one run size */
+		if (	is_set_option('q') || is_set_option('U')
+		||	is_set_option('W') || is_set_option('Y')
+		)
+		    fatal("option -r N,N,... cannot be combined with"
+			  " -q, -U, -W or -Y");
+		/* a heading would spoil a matrix or JSON objects */
+		if ((is_set_option('c') || is_set_option('J')) && !output_name)
+		    fatal("option -r N,N,... with -c or -J requires -o");
+	}
+	if (is_set_option('g') || is_set_option('G') || is_set_option('z')) {
+		if (!is_set_option('R'))
+		    fatal("options -g, -G and -z require -R");
+	}
 
 	/* Treat the simple options */
 	if (is_set_option('v')) {
@@ -170,12 +418,37 @@ main(int argc, const char *argv[]) {
 	if (is_set_option('p')) {
 		set_option('s');
 	}
+	Huge_Pages = is_set_option('l');
+	if (is_set_option('c') || is_set_option('J')) {
+		/* the matrix rows or the JSON objects only */
+		set_option('T');
+	}
 
 	/* Check the value options */
+	if (run_sizes_arg) {
+		get_run_sizes();
+	}
+	else {
+		/* -r is always shown under -O */
+		sprintf(default_run_size, "%d", Min_Run_Size);
+		run_sizes_arg = default_run_size;
+	}
 	if (Min_Run_Size <= 0)
 		fatal("bad run size");
 	if (Page_Width <= 0)
 		fatal("bad page width");
+	if (Number_of_Threads <= 0)
+		fatal("bad number of threads");
+	if (Max_File_Size < 0)
+		fatal("bad file size");
+	if (is_set_option('K') && Max_Runs <= 0)
+		fatal("bad number of runs");
+	if (is_set_option('B') && Memory_Limit <= 0)
+		fatal("bad memory limit");
+	if (is_set_option('V') && Progress_Interval <= 0)
+		fatal("bad progress interval");
+	Select_Window_Hash();
+	Select_Shard();
 
 	if (is_set_option('p')) {
 		if ((Threshold_Percentage > 100) || (Threshold_Percentage <= 0))
@@ -183,15 +456,7 @@ main(int argc, const char *argv[]) {
 	}
 
 	if (output_name) {
-		Output_File = fopen(output_name, "w");
-		if (Output_File == 0) {
-			char *msg = (char *)Malloc(strlen(output_name) + 100);
-
-			sprintf(msg, "cannot open output file `%s'",
-				output_name);
-			fatal(msg);
-			/*NOTREACHED*/
-		}
+		Output_File = open_output(output_name);
 	}
 
 	/* Treat the input-determining options */
@@ -204,6 +469,12 @@ main(int argc, const char *argv[]) {
 	if (is_set_option('R')) {
 		get_new_recursive_args(&argc, &argv);
 	}
+	if (is_set_option('b')) {
+		Get_Git_Args(&argc, &argv);
+	}
+	if (is_set_option('A')) {
+		Get_Archive_Args(&argc, &argv);
+	}
 	/* (argc, argv) now represents new_file* [ / old_file*] */
 
 	/* Optionally show command line options */
@@ -212,6 +483,11 @@ main(int argc, const char *argv[]) {
 	}
 
 	/* Here the real work starts */
+	Start_Timing();
+	if (is_set_option('D')) {
+		Start_Paging_Counts();
+	}
+	Start_Progress();
 
 	if (is_set_option('-')) {
 		/* Just the lexical scan */
@@ -223,20 +499,80 @@ main(int argc, const char *argv[]) {
 			argv++;
 		}
 	}
+	else
+	if (is_set_option('q')) {
+		/* The works, once for each file named on standard input */
+		Serve_Queries(argc, argv);
+	}
 	else {	/* The works */
+		/* the forward references are needed for the comparison, and
+		   on one processor the hashing cannot overlap the lexing
+		*/
+		Hash_While_Reading = (!Merge_Names && !is_set_option('X')
+			&& Number_of_Processors() != 1);
 		Read_Input_Files(argc, argv);	/* turns files into texts */
-		Compare_Files();		/* turns texts into runs */
-		if (is_set_option('p')) {
-			Print_Percentages();
-		} else {
-			Retrieve_Runs();
-			Print_Runs();
+		report_phase("pass 1");
+		if (is_set_option('Z')) {
+			Find_Identical_Texts();
+		}
+		if (Merge_Names) {
+			/* the runs of the shards */
+			Progress_Phase("merge", 0, 0);
+			Merge_Partial_Results();
+			report_phase("merge");
+		}
+		else
+		if (n_run_sizes > 1) {
+			/* the texts are indexed once, for the smallest size */
+			sweep_run_sizes();
+		}
+		else {
+			if (Partial_Results_Name) Open_Partial_Results();
+			if (Incremental_Name) Start_Incremental();
+			Compare_Files();	/* turns texts into runs */
+			if (Incremental_Name) Finish_Incremental();
+			if (Partial_Results_Name) Close_Partial_Results();
+			report_phase("comparison");
+		}
+		if (Partial_Results_Name) {
+			/* the runs are reported by the merge */
+		}
+		else
+		if (n_run_sizes <= 1) {
+			print_results();
 		}
 	}
+	Stop_Progress();
 
+	Free_Identical_Texts();
 	Free_Text();
+	Free_Text_Index();
+	Free_Balance_Index();
 	Free_Token_Array();
+	Free_Archives();
+	if (run_sizes) {
+		Free(run_sizes); run_sizes = 0;
+	}
+	if (is_set_option('D')) {
+		/* the main thread may have lexed as well */
+		Add_Idf_Cache_Counts();
+		Report_Idf_Cache_Counts(stderr);
+		Report_Search_Counts(stderr);
+		Report_Paging_Counts(stderr);
+	}
 	if (is_set_option('M')) {
+		if (Token_Cache_Name) {
+			fprintf(stderr, "Token cache: %s hits, %s misses\n",
+				size_t2string(Token_Cache_Hits),
+				size_t2string(Token_Cache_Misses)
+			);
+		}
+		if (Git_Repository_Name) {
+			fprintf(stderr, "Git repository: %s files, %s blobs\n",
+				size_t2string(Git_Files_Read),
+				size_t2string(Git_Blobs_Read)
+			);
+		}
 		ReportMemoryStatus(stderr);
 	}
 
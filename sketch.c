@@ -0,0 +1,290 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	The fingerprints are 64-bit hashes of the windows of Min_Run_Size
+	tokens, of all positions. Every token of Text[n] that is in a run
+	with Text[m] lies in a window of Text[n] that occurs in Text[m] too,
+	and equal windows have equal fingerprints. So the number of tokens
+	of Text[n] covered by the windows whose fingerprints occur in
+	Text[m] is at least the number of tokens of Text[n] found in
+	Text[m]; fingerprints that are equal by accident only raise it.
+	Text[n] may reach the threshold if this bound does, for the best
+	Text[m], with a margin of one percent for the rounding. To keep the
+	cost linear, the windows whose fingerprint occurs in more than
+	SKETCH_MAX_SHARED texts (boilerplate) are counted as shared with all
+	texts, which can only raise the bound. So no text is skipped that
+	has a percentage at or above the threshold.
+*/
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<stdint.h>
+#include	<string.h>
+
+#include	"settings.par"
+#include	"sim.h"
+#include	"text.h"
+#include	"token.h"
+#include	"tokenarray.h"
+#include	"Malloc.h"
+#include	"sketch.h"
+
+struct fp_entry {
+	uint64_t fe_hash;
+	size_t fe_window;		/* the number of the window */
+	int fe_text;
+};
+
+static struct fp_entry *entries;	/* to be filled by Malloc() */
+static size_t n_entries;
+
+static uint64_t *window_fp;		/* of one text, to be filled by Realloc() */
+static size_t window_fp_size;
+
+static char *may_reach;			/* Boolean, one for each text */
+
+							/* FINGERPRINTING */
+#define	SKETCH_BASE	UINT64_C(0x100000001B3)
+
+static size_t
+n_windows_of(int n) {
+	const struct text *txt = &Text[n];
+	size_t length = txt->tx_limit - txt->tx_start;
+
+	return (length < (size_t)Min_Run_Size ? 0
+		: length - (size_t)Min_Run_Size + 1);
+}
+
+static size_t
+fingerprint_text(int n) {
+	/*	Puts the fingerprint of the window at Text[n].tx_start + k in
+		window_fp[k]; yields the number of windows.
+	*/
+	const struct text *txt = &Text[n];
+	size_t size = (size_t)Min_Run_Size;
+	size_t length = txt->tx_limit - txt->tx_start;
+	size_t n_windows = n_windows_of(n);
+	uint64_t base_power = 1;		/* BASE^Min_Run_Size */
+	uint64_t fp = 0;
+	size_t k;
+
+	if (n_windows == 0) return 0;
+	if (n_windows > window_fp_size) {
+		/* allocated array is too small; increase its size */
+		window_fp_size = n_windows;
+		window_fp = (uint64_t *)Realloc(
+			window_fp, window_fp_size * sizeof (uint64_t)
+		);
+	}
+
+	for (k = 0; k < size; k++) {
+		base_power *= SKETCH_BASE;
+	}
+	for (k = 0; k < length; k++) {
+		size_t j = txt->tx_start + k;
+
+		fp = fp * SKETCH_BASE + (uint64_t)Token2int(Token_Array[j]);
+		if (k >= size) {
+			/* remove the oldest token */
+			fp -= base_power * (uint64_t)Token2int(Token_Array[j - size]);
+		}
+		if (k + 1 >= size) {
+			window_fp[k + 1 - size] = fp;
+		}
+	}
+	return n_windows;
+}
+
+static struct fp_entry *
+sort_entries(struct fp_entry *entry, struct fp_entry *buff) {
+	/*	Sorts entry[0..n_entries-1] stably on fe_hash, one byte per
+		pass, using buff[]; yields the one of them that holds the
+		result.
+	*/
+	int b;
+
+	for (b = 0; b < (int)sizeof (uint64_t); b++) {
+		size_t count[256];
+		size_t pos = 0;
+		size_t e;
+		int d;
+
+		memset(count, 0, sizeof count);
+		for (e = 0; e < n_entries; e++) {
+			count[(entry[e].fe_hash >> (8*b)) & 0xFF]++;
+		}
+		/* a byte that is the same in all keys does not need a pass */
+		if (count[(entry[0].fe_hash >> (8*b)) & 0xFF] == n_entries)
+			continue;
+
+		for (d = 0; d < 256; d++) {
+			size_t c = count[d];
+
+			count[d] = pos;
+			pos += c;
+		}
+		for (e = 0; e < n_entries; e++) {
+			int digit = (int)((entry[e].fe_hash >> (8*b)) & 0xFF);
+
+			buff[count[digit]++] = entry[e];
+		}
+
+		struct fp_entry *tmp = entry;
+		entry = buff, buff = tmp;
+	}
+	return entry;
+}
+
+static void
+cover_window(size_t k, size_t *covered, size_t *cover_end) {
+	/* adds the tokens of window k not yet covered */
+	size_t end = k + (size_t)Min_Run_Size;
+
+	*covered += end - (*cover_end > k ? *cover_end : k);
+	*cover_end = end;
+}
+
+							/* COMPARING */
+void
+Make_Sketches(void) {
+	int n;
+	size_t e;
+	size_t k;
+
+	/* the windows are numbered through the texts */
+	size_t *first_window =
+		(size_t *)Malloc((Number_of_Texts + 1) * sizeof (size_t));
+	first_window[0] = 0;
+	for (n = 0; n < Number_of_Texts; n++) {
+		first_window[n+1] = first_window[n] + n_windows_of(n);
+	}
+
+	/* the fingerprints of all windows, sorted, in text order on ties */
+	size_t n_windows = first_window[Number_of_Texts];
+	struct fp_entry *buff = (struct fp_entry *)
+		Malloc(2 * (n_windows+1) * sizeof (struct fp_entry));
+	entries = buff + n_windows + 1;
+	n_entries = 0;
+	for (n = 0; n < Number_of_Texts; n++) {
+		size_t n_w = fingerprint_text(n);
+
+		for (k = 0; k < n_w; k++) {
+			struct fp_entry *fe = &entries[n_entries++];
+
+			fe->fe_hash = window_fp[k];
+			fe->fe_window = first_window[n] + k;
+			fe->fe_text = n;
+		}
+	}
+	if (n_entries > 0) {
+		entries = sort_entries(entries, buff);
+	}
+
+	/* remove the duplicates within each text, and note the group of
+	   equal fingerprints, by its first entry, of each window of a new
+	   text
+	*/
+	size_t n_new_windows = first_window[Number_of_New_Texts];
+	size_t *group_of_window =
+		(size_t *)Malloc((n_new_windows+1) * sizeof (size_t));
+	{	size_t n_kept = 0;
+		size_t group = 0;
+
+		for (e = 0; e < n_entries; e++) {
+			const struct fp_entry *fe = &entries[e];
+
+			if (	n_kept == 0
+			||	fe->fe_hash != entries[n_kept-1].fe_hash
+			) {
+				group = n_kept;
+				entries[n_kept++] = *fe;
+			}
+			else
+			if (fe->fe_text != entries[n_kept-1].fe_text) {
+				entries[n_kept++] = *fe;
+			}
+			if (fe->fe_window < n_new_windows) {
+				group_of_window[fe->fe_window] = group;
+			}
+		}
+		n_entries = n_kept;
+	}
+
+	/* group_end[g] is the end of the group that starts at entry g */
+	size_t *group_end = (size_t *)Malloc((n_entries+1) * sizeof (size_t));
+	for (e = n_entries; e > 0; e--) {
+		group_end[e-1] = (
+			e < n_entries
+		&&	entries[e].fe_hash == entries[e-1].fe_hash ?
+			group_end[e] : e);
+	}
+
+	/* bound the best share for each new text */
+	size_t *covered = (size_t *)Calloc(Number_of_Texts, sizeof (size_t));
+	size_t *cover_end = (size_t *)Calloc(Number_of_Texts, sizeof (size_t));
+	int *touched = (int *)Malloc((Number_of_Texts + 1) * sizeof (int));
+	may_reach = (char *)Calloc(Number_of_Texts + 1, sizeof (char));
+	for (n = 0; n < Number_of_New_Texts; n++) {
+		size_t n_w = n_windows_of(n);
+		size_t common = 0;		/* by boilerplate */
+		size_t common_end = 0;
+		size_t best = 0;
+		int n_touched = 0;
+
+		for (k = 0; k < n_w; k++) {
+			size_t g = group_of_window[first_window[n] + k];
+			size_t g_end = group_end[g];
+
+			if (g_end - g > SKETCH_MAX_SHARED) {
+				cover_window(k, &common, &common_end);
+				continue;
+			}
+			for (e = g; e < g_end; e++) {
+				int m = entries[e].fe_text;
+
+				if (m == n) continue;
+				if (covered[m] == 0) {
+					touched[n_touched++] = m;
+				}
+				cover_window(k, &covered[m], &cover_end[m]);
+			}
+		}
+		while (n_touched > 0) {
+			int m = touched[--n_touched];
+
+			if (covered[m] > best) best = covered[m];
+			covered[m] = cover_end[m] = 0;
+		}
+
+		/* compare (best+common)/size to the threshold, less 1 % */
+		size_t size = Text[n].tx_limit - Text[n].tx_start;
+		may_reach[n] =
+			n_w > 0
+		&&	(best + common) * 100 + size
+				>= (size_t)Threshold_Percentage * size;
+	}
+
+	Free(touched);
+	Free(cover_end);
+	Free(covered);
+	Free(group_end);
+	Free(group_of_window);
+	Free(buff); entries = 0;
+	Free(first_window);
+	if (window_fp) {
+		Free(window_fp); window_fp = 0;
+	}
+	window_fp_size = 0;
+}
+
+int
+May_Reach_Threshold(int n) {
+	return may_reach[n];
+}
+
+void
+Free_Sketches(void) {
+	if (may_reach) {
+		Free(may_reach); may_reach = 0;
+	}
+}
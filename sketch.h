@@ -0,0 +1,17 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	A quick upper bound on the percentages, used to skip the comparison
+	of new texts that cannot reach the threshold (-x option, with -p).
+
+	Make_Sketches() computes the fingerprints of all windows of
+	Min_Run_Size tokens and finds the texts that share them; after that,
+	May_Reach_Threshold(n) tells whether the bound on the share of some
+	other text in Text[n] is high enough for Text[n] to be compared.
+	The texts skipped would have had all their percentages below the
+	threshold, so the output is that without -x.
+*/
+
+extern void Make_Sketches(void);
+extern int May_Reach_Threshold(int n);
+extern void Free_Sketches(void);
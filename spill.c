@@ -0,0 +1,179 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	All batches of a struct spill go into one temporary file, made by
+	tmpfile(), so it is removed when the program ends, however it ends.
+	During the merge each batch is read through a buffer of its own of
+	SPILL_BUFFER records, and the batches are kept in a heap with the
+	batch with the first head record at the top.
+*/
+
+#include	<stdio.h>
+#include	<string.h>
+
+#include	"sim.h"
+#include	"Malloc.h"
+#include	"spill.h"
+
+#define	SPILL_BUFFER	256		/* in records */
+
+							/* THE LIMIT */
+int Memory_Limit;			/* in megabytes; 0 is no limit */
+
+int
+Exceeds_Memory_Limit(size_t size) {
+	return Memory_Limit > 0 && size > (size_t)Memory_Limit << 20;
+}
+
+							/* SPILLING */
+struct spill_batch {
+	long sb_offset;			/* of the next record in the file */
+	size_t sb_left;			/* # records still in the file */
+	char *sb_buffer;		/* to be filled by Malloc() */
+	size_t sb_n;			/* # records in the buffer */
+	size_t sb_next;			/* the head record in the buffer */
+};
+
+void
+Spill_Batch(struct spill *sp, const void *records, size_t n) {
+	if (n == 0) return;
+
+	if (!sp->sp_file) {
+		sp->sp_file = tmpfile();
+		if (!sp->sp_file) fatal("cannot create a spill file");
+	}
+	if (sp->sp_n_batches == sp->sp_batches_size) {
+		sp->sp_batches_size =
+			(sp->sp_batches_size ? 2 * sp->sp_batches_size : 16);
+		sp->sp_batches = (struct spill_batch *)Realloc(sp->sp_batches,
+			sp->sp_batches_size * sizeof (struct spill_batch));
+	}
+
+	struct spill_batch *sb = &sp->sp_batches[sp->sp_n_batches++];
+	if (fseek(sp->sp_file, 0L, SEEK_END) != 0) {
+		fatal("cannot write the spill file");
+	}
+	sb->sb_offset = ftell(sp->sp_file);
+	sb->sb_left = n;
+	sb->sb_buffer = 0;
+	sb->sb_n = sb->sb_next = 0;
+	if (fwrite(records, sp->sp_record_size, n, sp->sp_file) != n) {
+		fatal("cannot write the spill file; disk full?");
+	}
+}
+
+size_t
+Spilled_Batches(const struct spill *sp) {
+	return sp->sp_n_batches;
+}
+
+							/* MERGING */
+static char *
+head(const struct spill *sp, size_t b) {
+	const struct spill_batch *sb = &sp->sp_batches[b];
+
+	return sb->sb_buffer + sb->sb_next * sp->sp_record_size;
+}
+
+static int
+refill(struct spill *sp, struct spill_batch *sb) {
+	/* reads the next records of sb into its buffer, if there are any */
+	size_t n = (sb->sb_left < SPILL_BUFFER ? sb->sb_left : SPILL_BUFFER);
+
+	if (n == 0) return 0;
+	if (	fseek(sp->sp_file, sb->sb_offset, SEEK_SET) != 0
+	||	fread(sb->sb_buffer, sp->sp_record_size, n, sp->sp_file) != n
+	) {
+		fatal("cannot read the spill file");
+	}
+	sb->sb_offset += (long)(n * sp->sp_record_size);
+	sb->sb_left -= n;
+	sb->sb_n = n;
+	sb->sb_next = 0;
+	return 1;
+}
+
+static int
+heap_before(const struct spill *sp, size_t i, size_t j) {
+	return (*sp->sp_before)(head(sp, sp->sp_heap[i]),
+				head(sp, sp->sp_heap[j]));
+}
+
+static void
+sift_down(struct spill *sp, size_t i) {
+	for (;;) {
+		size_t first = i;
+		size_t child = 2*i + 1;
+
+		if (child < sp->sp_heap_size && heap_before(sp, child, first)) {
+			first = child;
+		}
+		if (	child + 1 < sp->sp_heap_size
+		&&	heap_before(sp, child + 1, first)
+		) {
+			first = child + 1;
+		}
+		if (first == i) return;
+
+		size_t tmp = sp->sp_heap[i];
+		sp->sp_heap[i] = sp->sp_heap[first];
+		sp->sp_heap[first] = tmp;
+		i = first;
+	}
+}
+
+void
+Start_Merge(struct spill *sp) {
+	size_t b;
+
+	sp->sp_heap = (size_t *)Malloc((sp->sp_n_batches + 1) * sizeof (size_t));
+	sp->sp_heap_size = 0;
+	for (b = 0; b < sp->sp_n_batches; b++) {
+		struct spill_batch *sb = &sp->sp_batches[b];
+
+		sb->sb_buffer = (char *)Malloc(SPILL_BUFFER * sp->sp_record_size);
+		(void)refill(sp, sb);
+		sp->sp_heap[sp->sp_heap_size++] = b;
+	}
+	b = sp->sp_heap_size / 2;
+	while (b-- > 0) {
+		sift_down(sp, b);
+	}
+}
+
+int
+Next_Merged(struct spill *sp, void *record) {
+	if (sp->sp_heap_size == 0) return 0;
+
+	size_t b = sp->sp_heap[0];
+	struct spill_batch *sb = &sp->sp_batches[b];
+
+	memcpy(record, head(sp, b), sp->sp_record_size);
+	if (++sb->sb_next == sb->sb_n && !refill(sp, sb)) {
+		/* this batch is done */
+		sp->sp_heap[0] = sp->sp_heap[--sp->sp_heap_size];
+	}
+	sift_down(sp, 0);
+	return 1;
+}
+
+void
+Free_Spill(struct spill *sp) {
+	size_t b;
+
+	for (b = 0; b < sp->sp_n_batches; b++) {
+		if (sp->sp_batches[b].sb_buffer) {
+			Free(sp->sp_batches[b].sb_buffer);
+		}
+	}
+	if (sp->sp_batches) {
+		Free(sp->sp_batches); sp->sp_batches = 0;
+	}
+	if (sp->sp_heap) {
+		Free(sp->sp_heap); sp->sp_heap = 0;
+	}
+	if (sp->sp_file) {
+		fclose(sp->sp_file); sp->sp_file = 0;
+	}
+	sp->sp_n_batches = sp->sp_batches_size = sp->sp_heap_size = 0;
+}
@@ -0,0 +1,44 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Spilling sorted batches of records to a temporary file, and merging
+	them back, for -B N (Memory_Limit, in megabytes).
+
+	Under -B the runs (runs.c) and the percentage matches
+	(percentages.c) are kept in memory only up to the limit; when
+	Exceeds_Memory_Limit(size) says that the size in bytes of what its
+	owner holds is over it, the owner puts these records in order and
+	writes them out as one batch with Spill_Batch(), and reuses their
+	memory. At output time Start_Merge() starts a k-way merge of all
+	batches, and Next_Merged() yields the records one by one, in order,
+	until it returns 0; Free_Spill() removes the file.
+
+	A struct spill holds the batches of records of one size, whose
+	order is given by a routine before(r0, r1) that yields non-zero if
+	r0 comes before r1; the order must be total, and the records of a
+	batch must be in it. It is initialized statically with
+	SPILL_OF(T, before), for records of type T.
+*/
+
+extern int Memory_Limit;
+
+extern int Exceeds_Memory_Limit(size_t size);
+
+struct spill {
+	size_t sp_record_size;
+	int (*sp_before)(const void *r0, const void *r1);
+	FILE *sp_file;			/* the batches, one after another */
+	struct spill_batch *sp_batches;	/* to be filled by Malloc() */
+	size_t sp_n_batches;
+	size_t sp_batches_size;
+	size_t *sp_heap;		/* batches in the merge, by head */
+	size_t sp_heap_size;
+};
+
+#define	SPILL_OF(T,before)	{sizeof (T), (before), 0, 0, 0, 0, 0, 0}
+
+extern void Spill_Batch(struct spill *sp, const void *records, size_t n);
+extern size_t Spilled_Batches(const struct spill *sp);
+extern void Start_Merge(struct spill *sp);
+extern int Next_Merged(struct spill *sp, void *record);
+extern void Free_Spill(struct spill *sp);
@@ -0,0 +1,193 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+#include	<stdio.h>
+#include	<time.h>
+
+#ifndef	MSDOS
+#include	<string.h>
+#include	<unistd.h>
+#include	<sys/time.h>
+#include	<sys/resource.h>
+#ifdef	__linux__
+#include	<sys/syscall.h>
+#include	<linux/perf_event.h>
+#endif	/* __linux__ */
+#endif	/* MSDOS */
+
+#include	"any_int.h"
+#include	"token.h"
+#include	"idf.h"
+#include	"parallel.h"
+#include	"stats.h"
+
+							/* TIMING */
+static double last_wall;
+static clock_t last_cpu;
+
+static double
+wall_clock(void) {
+	/* in seconds */
+#ifndef	MSDOS
+	struct timeval tv;
+
+	if (gettimeofday(&tv, 0) == 0) {
+		return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+	}
+#endif	/* MSDOS */
+	return (double)time(0);
+}
+
+void
+Start_Timing(void) {
+	last_wall = wall_clock();
+	last_cpu = clock();
+}
+
+void
+Time_Phase(FILE *f, const char *phase) {
+	double wall = wall_clock();
+	clock_t cpu = clock();
+
+	fprintf(f, "Time for %s: %.3f s wall, %.3f s CPU\n", phase,
+		wall - last_wall, (double)(cpu - last_cpu) / CLOCKS_PER_SEC);
+	fflush(f);
+	last_wall = wall;
+	last_cpu = cpu;
+}
+
+							/* SEARCH COUNTS */
+static struct search_counts total;	/* protected by Lock() */
+
+void
+Add_Search_Counts(const struct search_counts *sc) {
+	Lock();
+	total.sc_n_searches += sc->sc_n_searches;
+	total.sc_n_hops += sc->sc_n_hops;
+	total.sc_n_no_room += sc->sc_n_no_room;
+	total.sc_n_rejected += sc->sc_n_rejected;
+	total.sc_n_extended += sc->sc_n_extended;
+	if (sc->sc_longest_chain > total.sc_longest_chain) {
+		total.sc_longest_chain = sc->sc_longest_chain;
+	}
+	Unlock();
+}
+
+void
+Report_Search_Counts(FILE *f) {
+	fprintf(f, "Search: %s chain hops in %s searches",
+		any_uint2string(total.sc_n_hops, 0),
+		any_uint2string(total.sc_n_searches, 0));
+	fprintf(f, " (average chain length %.2f, longest chain %s)\n",
+		(total.sc_n_searches ?
+			(double)total.sc_n_hops / total.sc_n_searches : 0.0),
+		any_uint2string(total.sc_longest_chain, 0));
+	fprintf(f, "Candidates: %s without room,",
+		any_uint2string(total.sc_n_no_room, 0));
+	fprintf(f, " %s rejected by the backward check,",
+		any_uint2string(total.sc_n_rejected, 0));
+	fprintf(f, " %s extended\n", any_uint2string(total.sc_n_extended, 0));
+	fflush(f);
+}
+
+							/* IDENTIFIER CACHE */
+static size_t idf_cache_hits;		/* protected by Lock() */
+static size_t idf_cache_misses;
+
+void
+Add_Idf_Cache_Counts(void) {
+	Lock();
+	idf_cache_counts(&idf_cache_hits, &idf_cache_misses);
+	Unlock();
+}
+
+void
+Report_Idf_Cache_Counts(FILE *f) {
+	size_t n_hashed = idf_cache_hits + idf_cache_misses;
+
+	fprintf(f, "Identifier cache: %s hits in %s hashed identifiers",
+		any_uint2string(idf_cache_hits, 0),
+		any_uint2string(n_hashed, 0));
+	fprintf(f, " (%.1f%%)\n",
+		(n_hashed ? 100.0 * idf_cache_hits / n_hashed : 0.0));
+	fflush(f);
+}
+
+							/* PAGING */
+#ifndef	MSDOS
+
+static long start_minor_faults;
+static long start_major_faults;
+static int tlb_counter = -1;		/* file descriptor, -1 if none */
+
+void
+Start_Paging_Counts(void) {
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) == 0) {
+		start_minor_faults = ru.ru_minflt;
+		start_major_faults = ru.ru_majflt;
+	}
+#if	defined(__linux__) && defined(SYS_perf_event_open)
+	/* the data TLB misses of the loads, in user mode */
+	struct perf_event_attr pe;
+
+	memset(&pe, 0, sizeof pe);
+	pe.type = PERF_TYPE_HW_CACHE;
+	pe.size = sizeof pe;
+	pe.config = PERF_COUNT_HW_CACHE_DTLB
+		| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	pe.exclude_kernel = 1;
+	pe.exclude_hv = 1;
+	pe.inherit = 1;			/* the threads started later too */
+	tlb_counter = (int)syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+#endif	/* __linux__ */
+}
+
+void
+Report_Paging_Counts(FILE *f) {
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) == 0) {
+		fprintf(f, "Paging: %s minor and %s major page faults",
+			any_uint2string(
+				(size_t)(ru.ru_minflt - start_minor_faults), 0),
+			any_uint2string(
+				(size_t)(ru.ru_majflt - start_major_faults), 0));
+	}
+	else {
+		fprintf(f, "Paging: page faults not available");
+	}
+
+	unsigned long long n_tlb_misses;
+
+	if (	tlb_counter >= 0
+	&&	read(tlb_counter, &n_tlb_misses, sizeof n_tlb_misses)
+			== sizeof n_tlb_misses
+	) {
+		fprintf(f, ", %s data TLB misses\n",
+			any_uint2string((size_t)n_tlb_misses, 0));
+	}
+	else {
+		fprintf(f, ", TLB misses not available\n");
+	}
+	if (tlb_counter >= 0) {
+		close(tlb_counter); tlb_counter = -1;
+	}
+	fflush(f);
+}
+
+#else	/* MSDOS */
+
+void
+Start_Paging_Counts(void) {
+}
+
+void
+Report_Paging_Counts(FILE *f) {
+	fprintf(f, "Paging: not available\n");
+	fflush(f);
+}
+
+#endif	/* MSDOS */
@@ -0,0 +1,45 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Timing and search statistics, for -D.
+
+	Start_Timing() starts the clock; after that, each call of
+	Time_Phase(f, phase) prints the wall-clock time and the CPU time
+	spent since the previous call, for the phase just ended. The CPU
+	time is that of the whole process, so under -j it is the sum over
+	the threads.
+
+	The search for runs counts its work in a struct search_counts of
+	its own, one per thread, and adds it to the totals through
+	Add_Search_Counts(), which takes the lock; Report_Search_Counts(f)
+	prints the totals.
+
+	Each thread that lexes calls Add_Idf_Cache_Counts() when it is done,
+	which adds the counts of its identifier cache (see idf.h) to the
+	totals; Report_Idf_Cache_Counts(f) prints them.
+
+	Start_Paging_Counts() starts counting the page faults and, where the
+	system allows it, the data TLB misses of the process, including the
+	threads it starts later; Report_Paging_Counts(f) prints them.
+*/
+
+struct search_counts {
+	size_t sc_n_searches;		/* calls of lcs() */
+	size_t sc_n_hops;		/* candidates visited on the chains */
+	size_t sc_n_no_room;		/* no room for a better run */
+	size_t sc_n_rejected;		/* rejected by the backward check */
+	size_t sc_n_extended;		/* extended forwards */
+	size_t sc_longest_chain;	/* most hops in one search */
+};
+
+extern void Start_Timing(void);
+extern void Time_Phase(FILE *f, const char *phase);
+
+extern void Add_Search_Counts(const struct search_counts *sc);
+extern void Report_Search_Counts(FILE *f);
+
+extern void Add_Idf_Cache_Counts(void);
+extern void Report_Idf_Cache_Counts(FILE *f);
+
+extern void Start_Paging_Counts(void);
+extern void Report_Paging_Counts(FILE *f);
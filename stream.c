@@ -6,13 +6,20 @@
 #include	<stdio.h>
 #include	<sys/types.h>
 #include	<sys/stat.h>
+#ifndef	MSDOS
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/mman.h>
+#endif
 
 #include	"system.par"
 #include	"sim.h"
 #include	"token.h"
 #include	"lang.h"
 #include	"fname.h"
+#include	"Malloc.h"
 #include	"stream.h"
+#include	"archive.h"
 
 static FILE *
 fopen_regular_file(const char *fname) {
@@ -23,36 +30,234 @@ fopen_regular_file(const char *fname) {
 	return Fopen(str2Fname(fname), "r");
 }
 
+							/* INPUT IN MEMORY */
+/*	A file in memory is followed by two null bytes, as required by
+	yy_scan_buffer(). When the file size leaves room for them in its
+	last page, the file is mapped privately, so the scanner can write in
+	the buffer without changing the file; the bytes beyond the end of the
+	file in the last page are zero. Otherwise the file is read into
+	allocated memory.
+*/
+
+static int
+read_input(const char *fname, struct input *in, size_t size) {
+	FILE *f = Fopen(str2Fname(fname), "r");
+	if (!f) return 0;
+
+	in->in_buf = (char *)Malloc(size + 2);
+	size_t n = fread(in->in_buf, 1, size, f);
+	fclose(f);
+	if (n != size) {
+		Free(in->in_buf); in->in_buf = 0;
+		return 0;
+	}
+	in->in_buf[size] = in->in_buf[size+1] = '\0';
+	in->in_size = size + 2;
+	in->in_mapped = 0;
+	return 1;
+}
+
 int
-Open_Stream(const char *fname) {
-	lex_nl_cnt = 1;
-	lex_tk_cnt = 0;		/* but is raised before the token is delivered,
+Map_Input(const char *fname, struct input *in) {
+	struct stat buf;
+
+	in->in_buf = 0;
+	in->in_size = 0;
+	in->in_mapped = 0;
+	in->in_shared = 0;
+
+	struct input *member = Archive_Member(fname);
+	if (member) {
+		/* it is in memory already */
+		*in = *member;
+		return 1;
+	}
+
+	if (Stat(str2Fname(fname), &buf) != 0) return 0;
+	if ((buf.st_mode & S_IFMT) != S_IFREG) return 0;
+	size_t size = (size_t)buf.st_size;
+
+#ifndef	MSDOS
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	size_t in_last_page = size % page_size;
+
+	if (in_last_page != 0 && in_last_page <= page_size - 2) {
+		int fd = open(fname, O_RDONLY);
+		if (fd < 0) return 0;
+
+		void *addr = mmap(0, size + 2, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (addr != MAP_FAILED) {
+			in->in_buf = (char *)addr;
+			in->in_size = size + 2;
+			in->in_mapped = 1;
+			return 1;
+		}
+	}
+#endif	/* MSDOS */
+
+	return read_input(fname, in, size);
+}
+
+void
+Unmap_Input(struct input *in) {
+	if (!in->in_buf) return;
+	if (in->in_shared) {
+		/* the archive will free it */
+		in->in_buf = 0;
+		return;
+	}
+#ifndef	MSDOS
+	if (in->in_mapped) {
+		munmap(in->in_buf, in->in_size);
+		in->in_buf = 0;
+		return;
+	}
+#endif	/* MSDOS */
+	Free(in->in_buf); in->in_buf = 0;
+}
+
+void
+Prefetch_Input(const char *fname) {
+	if (Archive_Member(fname)) return;	/* it is in memory already */
+#if	!defined(MSDOS) && defined(POSIX_FADV_WILLNEED)
+	int fd = open(fname, O_RDONLY);
+	if (fd < 0) return;
+
+	/* the reading goes on after the close */
+	(void)posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	close(fd);
+#endif	/* MSDOS */
+}
+
+struct lex_state Lex_State;
+static struct stream main_stream;
+
+int (*Language_Of_File)(const char *fname);
+void (*Select_Language)(void *scanner, int language);
+
+static void
+select_language(struct stream *st, const char *fname) {
+	if (Language_Of_File) {
+		Select_Language(st->st_scanner, Language_Of_File(fname));
+	}
+}
+
+void
+Init_Stream_Of(struct stream *st, struct lex_state *ls) {
+	st->st_lex = ls;
+	st->st_file = 0;
+	st->st_buffer = 0;
+	if (yylex_init_extra(ls, &st->st_scanner) != 0) {
+		fatal("out of memory: cannot create scanner");
+	}
+}
+
+int
+Open_Stream_Of(struct stream *st, const char *fname) {
+	struct lex_state *ls = st->st_lex;
+	struct input *member = Archive_Member(fname);
+
+	if (member) {
+		return Open_Stream_Input_Of(st, member, fname);
+	}
+
+	ls->ls_nl_cnt = 1;
+	ls->ls_tk_cnt = 0;	/* but is raised before the token is delivered,
 				   so effectively *_tk_cnt starts at 1:
 				   TK_CNT_HORROR
 				*/
-	lex_non_ASCII_cnt = 0;
+	ls->ls_non_ASCII_cnt = 0;
 
 	/* start the lex machine */
-	yyin = fopen_regular_file(fname);
-	int ok = (yyin != 0);
+	st->st_file = fopen_regular_file(fname);
+	int ok = (st->st_file != 0);
 	if (!ok) {
 		/* fake a stream, to simplify the rest of the program */
-		yyin = fopen(NULLFILE, "r");
+		st->st_file = fopen(NULLFILE, "r");
 	}
-	yystart();
+	select_language(st, fname);
+	yyset_in(st->st_file, st->st_scanner);
+	yystart(st->st_scanner);
 	return ok;
 }
 
+int
+Open_Stream_Input_Of(struct stream *st, struct input *in, const char *fname) {
+	static char no_input[2];	/* the two null bytes only */
+	struct lex_state *ls = st->st_lex;
+
+	ls->ls_nl_cnt = 1;
+	ls->ls_tk_cnt = 0;	/* TK_CNT_HORROR, see above */
+	ls->ls_non_ASCII_cnt = 0;
+
+	/* start the lex machine on the buffer */
+	select_language(st, fname);
+	int ok = (in->in_buf != 0);
+	st->st_buffer = (ok ?
+		yy_scan_buffer(in->in_buf, in->in_size, st->st_scanner) :
+		yy_scan_buffer(no_input, sizeof no_input, st->st_scanner)
+	);
+	if (!st->st_buffer) {
+		fatal("internal error, input buffer not accepted by scanner");
+	}
+	yystart(st->st_scanner);
+	return ok;
+}
+
+int
+Next_Stream_Token_Obtained_Of(struct stream *st) {
+	return yylex(st->st_scanner);
+}
+
+void
+Close_Stream_Of(struct stream *st) {
+	if (st->st_buffer) {
+		yy_delete_buffer(st->st_buffer, st->st_scanner);
+		st->st_buffer = 0;
+	}
+	if (st->st_file) {
+		fclose(st->st_file);
+		st->st_file = 0;
+	}
+}
+
+void
+Free_Stream_Of(struct stream *st) {
+	Close_Stream_Of(st);
+	yylex_destroy(st->st_scanner);
+	st->st_scanner = 0;
+}
+
+int
+Open_Stream(const char *fname) {
+	if (!main_stream.st_scanner) {
+		Init_Stream_Of(&main_stream, &Lex_State);
+	}
+	return Open_Stream_Of(&main_stream, fname);
+}
+
+int
+Open_Stream_Input(struct input *in, const char *fname) {
+	if (!main_stream.st_scanner) {
+		Init_Stream_Of(&main_stream, &Lex_State);
+	}
+	return Open_Stream_Input_Of(&main_stream, in, fname);
+}
+
 int
 Next_Stream_Token_Obtained(void) {
-	return yylex();
+	return Next_Stream_Token_Obtained_Of(&main_stream);
 }
 
 void
 Close_Stream(void) {
-	if (yyin) {
-		fclose(yyin);
-		yyin = 0;
+	/* the scanner goes too, with the input it may hold; the next
+	   Open_Stream() makes a new one
+	*/
+	if (main_stream.st_scanner) {
+		Free_Stream_Of(&main_stream);
 	}
 }
 
@@ -61,6 +266,7 @@ Print_Stream(const char *fname) {
 	fprintf(Output_File, "File %s:", fname);
 	if (!Open_Stream(fname)) {
 		fprintf(Output_File, " cannot open\n");
+		Close_Stream();
 		return;
 	}
 
@@ -77,8 +283,8 @@ Print_Stream(const char *fname) {
 			);
 		}
 		else {
-			extern char *yytext;
-			fprintf(Output_File, " %s -> ", yytext);
+			fprintf(Output_File, " %s -> ",
+				yyget_text(main_stream.st_scanner));
 			fprint_token(Output_File, lex_token);
 			fprintf(Output_File, "\n");
 		}
@@ -14,3 +14,52 @@ extern int Open_Stream(const char *);
 extern int Next_Stream_Token_Obtained(void);	/* like yylex() */
 extern void Close_Stream(void);
 extern void Print_Stream(const char *fname);
+
+/*	Under -k, the files are kept in memory, as a struct input; they are
+	then read from the file system only once. Map_Input() fills in a
+	struct input, preferably by mapping the file, and returns 0 if the
+	file cannot be opened; Unmap_Input() gives the memory back.
+	Open_Stream_Input() is the counterpart of Open_Stream() for a file in
+	memory; the name of the file selects the front end in a binary with
+	several of them (see Language_Of_File in lang.h).  When the scanning
+	is complete the buffer holds the original contents again. For a
+	member of an archive (see archive.h), both Open_Stream() and
+	Map_Input() use the contents in the archive.
+*/
+struct input {
+	char *in_buf;		/* the contents, then two null bytes */
+	size_t in_size;		/* including the two null bytes */
+	int in_mapped;		/* Boolean */
+	int in_shared;		/* Boolean, the buffer belongs to an archive */
+};
+
+extern int Map_Input(const char *fname, struct input *in);
+extern void Unmap_Input(struct input *in);
+extern int Open_Stream_Input(struct input *in, const char *fname);
+
+/*	Prefetch_Input(fname) asks the operating system to start reading
+	the file fname into memory, so it may be there by the time it is
+	opened; it does nothing for a member of an archive, or where this
+	is not supported.
+*/
+extern void Prefetch_Input(const char *fname);
+
+/*	The routines above use the scanner of the main thread, whose state is
+	in Lex_State.  A thread that scans files on its own uses a stream of
+	its own, with its own struct lex_state:
+*/
+struct stream {
+	struct lex_state *st_lex;	/* the token and the counts */
+	void *st_scanner;		/* the reentrant scanner */
+	FILE *st_file;
+	struct yy_buffer_state *st_buffer;	/* under -k */
+};
+
+extern void Init_Stream_Of(struct stream *st, struct lex_state *ls);
+extern int Open_Stream_Of(struct stream *st, const char *fname);
+extern int Open_Stream_Input_Of(
+	struct stream *st, struct input *in, const char *fname
+);
+extern int Next_Stream_Token_Obtained_Of(struct stream *st);
+extern void Close_Stream_Of(struct stream *st);
+extern void Free_Stream_Of(struct stream *st);
@@ -0,0 +1,274 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	The suffix array is constructed by prefix doubling: in round k the
+	suffixes are sorted on their first 2^k tokens, using as keys the
+	classes of round k-1 of the suffix and of the suffix 2^(k-1) tokens
+	further on; both sorts are counting sorts, so each round is linear.
+	A suffix that has fewer tokens left in its text than the round needs
+	gets key 0 for the missing part, so it sorts before its extensions,
+	as end-of-text should.  Suffixes that are equal up to the ends of
+	their texts keep the order of their positions; this makes the order
+	total, which the LCP construction (Kasai's algorithm) relies upon.
+*/
+
+#include	<stdio.h>
+
+#include	"debug.par"
+#include	"sim.h"
+#include	"text.h"
+#include	"token.h"
+#include	"tokenarray.h"
+#include	"Malloc.h"
+#include	"suffix.h"
+
+/* the number of keys of a counting sort in round 0 */
+#ifdef	WIDE_TOKENS
+#define	ROUND0_KEYS	((size_t)1 << 16)
+#else
+#define	ROUND0_KEYS	((size_t)N_TOKENS)
+#endif
+
+static size_t *suffix_array;		/* to be filled by Malloc() */
+static size_t *suffix_rank;		/* to be filled by Malloc() */
+static size_t *suffix_lcp;		/* to be filled by Malloc() */
+static size_t n_suffixes;
+
+static void
+counting_sort(
+	const size_t *key,		/* the key of each position */
+	size_t n_keys,			/* keys are 0 .. n_keys-1 */
+	const size_t *in,		/* positions in[1] .. in[n_suffixes] */
+	size_t *out,			/* the same, sorted stably on key */
+	size_t *count			/* scratch, at least n_keys+1 entries */
+) {
+	size_t r;
+	size_t k;
+
+	for (k = 0; k <= n_keys; k++) {
+		count[k] = 0;
+	}
+	for (r = 1; r <= n_suffixes; r++) {
+		count[key[in[r]] + 1]++;
+	}
+	/* count[k] becomes the number of entries with a key < k */
+	for (k = 1; k <= n_keys; k++) {
+		count[k] += count[k-1];
+	}
+	for (r = 1; r <= n_suffixes; r++) {
+		out[++count[key[in[r]]]] = in[r];
+	}
+}
+
+static size_t
+set_classes(const size_t *key1, const size_t *key2, size_t *cls) {
+	/*	Gives the suffixes classes 1, 2, ... in the order of
+		suffix_array[], with equal classes for equal key pairs; returns
+		the number of classes.
+	*/
+	size_t n_classes = 0;
+	size_t r;
+
+	for (r = 1; r <= n_suffixes; r++) {
+		size_t p = suffix_array[r];
+
+		if (	r == 1
+		||	key1[p] != key1[suffix_array[r-1]]
+		||	key2[p] != key2[suffix_array[r-1]]
+		) {
+			n_classes++;
+		}
+		cls[p] = n_classes;
+	}
+	return n_classes;
+}
+
+static size_t
+text_limit_of(size_t i) {
+	return Text_Containing(i)->tx_limit;
+}
+
+static void
+make_lcp(void) {
+	/* Kasai's algorithm, restricted to the texts */
+	int n;
+
+	for (n = 0; n < Number_of_Texts; n++) {
+		const struct text *txt = &Text[n];
+		size_t h = 0;
+		size_t p;
+
+		for (p = txt->tx_start; p < txt->tx_limit; p++) {
+			size_t r = suffix_rank[p];
+
+			if (r == 1) {
+				suffix_lcp[r] = 0;
+				h = 0;
+				continue;
+			}
+
+			size_t q = suffix_array[r-1];
+			size_t q_limit = text_limit_of(q);
+			while (	p + h < txt->tx_limit && q + h < q_limit
+			&&	Token_EQ(Token_Array[p+h], Token_Array[q+h])
+			) {
+				h++;
+			}
+			suffix_lcp[r] = h;
+			if (h > 0) h--;
+		}
+	}
+}
+
+void
+Make_Suffix_Array(void) {
+	size_t length = Token_Array_Length();
+	size_t longest_text = 0;
+	size_t n_classes;
+	size_t step;
+	size_t r;
+	int n;
+
+	/* collect the positions, in increasing order */
+	size_t *positions = (size_t *)Malloc(sizeof (size_t) * length);
+	n_suffixes = 0;
+	for (n = 0; n < Number_of_Texts; n++) {
+		const struct text *txt = &Text[n];
+		size_t p;
+
+		for (p = txt->tx_start; p < txt->tx_limit; p++) {
+			positions[++n_suffixes] = p;
+		}
+		if (txt->tx_limit - txt->tx_start > longest_text) {
+			longest_text = txt->tx_limit - txt->tx_start;
+		}
+	}
+
+	suffix_array = (size_t *)Malloc(sizeof (size_t) * length);
+	size_t *sorted_on_key2 = (size_t *)Malloc(sizeof (size_t) * length);
+	size_t *cls = (size_t *)Malloc(sizeof (size_t) * length);
+	size_t *key2 = (size_t *)Malloc(sizeof (size_t) * length);
+	size_t *new_cls = (size_t *)Malloc(sizeof (size_t) * length);
+	size_t *count = (size_t *)Malloc(sizeof (size_t) *
+		((length > ROUND0_KEYS ? length : ROUND0_KEYS) + 1));
+
+	/* round 0: sort on the first token */
+#ifdef	WIDE_TOKENS
+	/* in two counting sorts, on the lower half and on the upper half */
+	{	size_t i;
+
+		for (i = 0; i < length; i++) {
+			cls[i] = (size_t)Token2int(Token_Array[i]) & 0xFFFF;
+		}
+		counting_sort(cls, ROUND0_KEYS, positions, sorted_on_key2, count);
+		for (i = 0; i < length; i++) {
+			cls[i] = (size_t)Token2int(Token_Array[i]) >> 16;
+		}
+		counting_sort(cls, ROUND0_KEYS, sorted_on_key2, suffix_array,
+			count);
+	}
+#endif
+	{	size_t i;
+
+		for (i = 0; i < length; i++) {
+			cls[i] = (size_t)Token2int(Token_Array[i]);
+			key2[i] = 0;
+		}
+	}
+#ifndef	WIDE_TOKENS
+	counting_sort(cls, ROUND0_KEYS, positions, suffix_array, count);
+#endif
+	n_classes = set_classes(cls, key2, new_cls);
+	{	size_t *tmp = cls; cls = new_cls; new_cls = tmp;}
+
+	/* the next rounds, until all suffixes differ or are complete */
+	for (	step = 1;
+		n_classes < n_suffixes && step < longest_text;
+		step *= 2
+	) {
+		for (n = 0; n < Number_of_Texts; n++) {
+			const struct text *txt = &Text[n];
+			size_t p;
+
+			for (p = txt->tx_start; p < txt->tx_limit; p++) {
+				key2[p] = (p + step < txt->tx_limit ?
+					cls[p + step] : 0);
+			}
+		}
+		/* on key2 starting from position order, then on cls */
+		counting_sort(key2, n_classes+1, positions,
+			sorted_on_key2, count);
+		counting_sort(cls, n_classes+1, sorted_on_key2,
+			suffix_array, count);
+		n_classes = set_classes(cls, key2, new_cls);
+		{	size_t *tmp = cls; cls = new_cls; new_cls = tmp;}
+	}
+	Free(count);
+	Free(new_cls);
+	Free(sorted_on_key2);
+	Free(positions);
+
+	/* the classes have served; turn cls[] into the ranks */
+	suffix_rank = cls;
+	for (r = 1; r <= n_suffixes; r++) {
+		suffix_rank[suffix_array[r]] = r;
+	}
+	suffix_lcp = key2;
+	make_lcp();
+
+#ifdef	DB_SUFFIX
+	for (r = 2; r <= n_suffixes; r++) {
+		size_t h = suffix_lcp[r];
+		size_t p = suffix_array[r-1];
+		size_t q = suffix_array[r];
+		size_t p_limit = text_limit_of(p);
+		size_t q_limit = text_limit_of(q);
+
+		int p_ends = (p + h == p_limit);
+		int q_ends = (q + h == q_limit);
+
+		if (	/* the common prefix is not quite common */
+			h > 0 && !Token_EQ(Token_Array[p+h-1], Token_Array[q+h-1])
+		||	/* or can be extended */
+			!p_ends && !q_ends
+		&&	Token_EQ(Token_Array[p+h], Token_Array[q+h])
+		||	/* or the order is wrong */
+			(	p_ends ? (q_ends && p > q)
+			:	q_ends ? 1
+			:	Token2int(Token_Array[p+h]) >
+					Token2int(Token_Array[q+h])
+			)
+		) {
+			fatal("internal error, bad suffix array");
+		}
+	}
+#endif	/* DB_SUFFIX */
+}
+
+void
+Free_Suffix_Array(void) {
+	Free(suffix_array); suffix_array = 0;
+	Free(suffix_rank); suffix_rank = 0;
+	Free(suffix_lcp); suffix_lcp = 0;
+	n_suffixes = 0;
+}
+
+size_t
+Suffix_Rank(size_t i) {
+	return suffix_rank[i];
+}
+
+size_t
+Suffix_At(size_t r) {
+	return suffix_array[r];
+}
+
+size_t
+Suffix_LCP(size_t r) {
+	return suffix_lcp[r];
+}
+
+size_t
+Suffix_Array_Limit(void) {
+	return n_suffixes + 1;
+}
@@ -0,0 +1,27 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Creating and consulting a suffix array over Token_Array[], used as an
+	alternative to the forward references (-X option).
+
+	The suffixes are those starting at the positions 1 .. N-1 of
+	Token_Array[], where N = Token_Array_Length(); each suffix ends at the
+	end of the text in which it starts, so common prefixes never extend
+
+
+	Suffix_Rank(i)		the index in the suffix array of the suffix
+				starting at position i
+	Suffix_At(r)		the position of the suffix with index r
+	Suffix_LCP(r)		the length of the longest common prefix of
+				the suffixes with index r-1 and r; 0 for r = 1
+	Suffix_Array_Limit()	the first index not in the suffix array;
+				the valid indexes are 1 .. Suffix_Array_Limit()-1
+*/
+
+extern void Make_Suffix_Array(void);
+extern void Free_Suffix_Array(void);
+
+extern size_t Suffix_Rank(size_t i);
+extern size_t Suffix_At(size_t r);
+extern size_t Suffix_LCP(size_t r);
+extern size_t Suffix_Array_Limit(void);
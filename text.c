@@ -3,7 +3,11 @@
 	$Id: text.c,v 1.27 2017-12-09 17:18:03 dick Exp $
 */
 
+#include	<stdio.h>
+#include	<string.h>
+
 #include	"stream.h"
+#include	"options.h"
 #include	"Malloc.h"
 #include	"text.h"
 
@@ -25,8 +29,25 @@ Init_Text(int nfiles) {
 		Malloc((size_t)(Number_of_Texts*sizeof (struct text)));
 }
 
+void
+Extend_Text(int nfiles) {
+	/* make room for nfiles text descriptors, keeping the present ones */
+	Number_of_Texts = nfiles;
+	Text = (struct text *)
+		Realloc(Text, (size_t)(Number_of_Texts*sizeof (struct text)));
+}
+
 int
 Open_Text(struct text *txt) {
+	if (is_set_option('k')) {
+		/* read the file only the first time */
+		if (!txt->tx_input) {
+			txt->tx_input = (struct input *)
+				Malloc(sizeof (struct input));
+			(void)Map_Input(txt->tx_fname, txt->tx_input);
+		}
+		return Open_Stream_Input(txt->tx_input, txt->tx_fname);
+	}
 	return Open_Stream(txt->tx_fname);
 }
 
@@ -45,10 +66,145 @@ Close_Text(void) {
 	Close_Stream();
 }
 
+static void
+free_text(struct text *txt) {
+	if (txt->tx_input) {
+		Unmap_Input(txt->tx_input);
+		Free(txt->tx_input); txt->tx_input = 0;
+	}
+	if (txt->tx_lines) {
+		Free_Line_List(txt->tx_lines); txt->tx_lines = 0;
+	}
+}
+
+void
+Remove_Last_Text(void) {
+	free_text(&Text[--Number_of_Texts]);
+}
+
 void
 Free_Text(void) {
-	if (Text) {
-		Free(Text); Text = 0;
+	int n;
+
+	if (!Text) return;
+	for (n = 0; n < Number_of_Texts; n++) {
+		free_text(&Text[n]);
+	}
+	Free(Text); Text = 0;
+}
+
+/*							LINE LISTS */
+static void
+add_line_byte(struct line_list *ll, unsigned char b) {
+	if (ll->ll_free == ll->ll_size) {
+		/* allocated array is full; increase its size */
+		ll->ll_size = (ll->ll_size ? 2 * ll->ll_size : 256);
+		ll->ll_bytes = (unsigned char *)Realloc(
+			ll->ll_bytes, ll->ll_size * sizeof (unsigned char)
+		);
+	}
+	ll->ll_bytes[ll->ll_free++] = b;
+}
+
+void
+Add_Line_End(struct line_list *ll, size_t tk_cnt) {
+	size_t n_tokens = tk_cnt - ll->ll_tk_cnt;
+
+	while (n_tokens >= 255) {
+		add_line_byte(ll, 255);
+		n_tokens -= 255;
+	}
+	add_line_byte(ll, (unsigned char)n_tokens);
+	ll->ll_tk_cnt = tk_cnt;
+}
+
+int
+Next_Line_End(const struct line_list *ll, size_t *offset, size_t *tk_cnt) {
+	if (*offset >= ll->ll_free) return 0;
+
+	while (ll->ll_bytes[*offset] == 255) {
+		*tk_cnt += 255;
+		(*offset)++;
+	}
+	*tk_cnt += ll->ll_bytes[*offset];
+	(*offset)++;
+	return 1;
+}
+
+struct line_list *
+Copy_Line_List(const struct line_list *ll) {
+	struct line_list *copy = (struct line_list *)
+		Calloc(1, sizeof (struct line_list));
+
+	if (ll->ll_free) {
+		copy->ll_bytes = (unsigned char *)Malloc(ll->ll_free);
+		memcpy(copy->ll_bytes, ll->ll_bytes, ll->ll_free);
+	}
+	copy->ll_free = copy->ll_size = ll->ll_free;
+	copy->ll_tk_cnt = ll->ll_tk_cnt;
+	return copy;
+}
+
+void
+Free_Line_List(struct line_list *ll) {
+	if (ll->ll_bytes) {
+		Free(ll->ll_bytes); ll->ll_bytes = 0;
+	}
+	Free(ll);
+}
+
+/*							TEXT MAP */
+/*	The token positions are divided into blocks of 2^TEXT_MAP_SHIFT
+	positions; text_map[b] is the index of the first text that does not
+	end before block b. The text of a position is then found by stepping
+	forward from there, over the few texts that end inside the block.
+	Positions beyond the last block, in texts added after the map was
+	made, are found by stepping forward from the last block.
+*/
+#define	TEXT_MAP_SHIFT	8
+
+static int *text_map;			/* to be filled by Malloc() */
+static size_t n_text_map_blocks;
+
+void
+Make_Text_Map(void) {
+	if (Number_of_Texts == 0) return;
+
+	size_t length = Text[Number_of_Texts-1].tx_limit;
+	size_t n_blocks = (length >> TEXT_MAP_SHIFT) + 1;
+	size_t b;
+	int n = 0;
+
+	text_map = (int *)Malloc(n_blocks * sizeof (int));
+	n_text_map_blocks = n_blocks;
+	for (b = 0; b < n_blocks; b++) {
+		size_t first = b << TEXT_MAP_SHIFT;
+
+		while (n < Number_of_Texts-1 && Text[n].tx_limit <= first) {
+			n++;
+		}
+		text_map[b] = n;
+	}
+}
+
+struct text *
+Text_Containing(size_t i) {
+	size_t b = i >> TEXT_MAP_SHIFT;
+
+	if (b >= n_text_map_blocks) {
+		b = n_text_map_blocks - 1;
+	}
+	struct text *txt = &Text[text_map[b]];
+
+	while (txt->tx_limit <= i && txt < &Text[Number_of_Texts-1]) {
+		txt++;
 	}
+	return txt;
 }
 
+void
+Free_Text_Map(void) {
+	if (text_map) {
+		Free(text_map); text_map = 0;
+	}
+}
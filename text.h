@@ -18,19 +18,52 @@ struct text {
 	size_t tx_limit;	/* index of first position in Token_Array[]
 				   not belonging to the text */
 	int tx_EOL_terminated;	/* Boolean */
-	struct position *tx_pos;/* list of positions in this file that are
-				   part of a chunk; sorted and updated by
-				   Pass 2
-				*/
+	int tx_opened;		/* Boolean, the file could be opened */
+	size_t tx_nl_cnt;	/* number of newlines seen by the lexer */
+	size_t tx_non_ASCII_cnt;/* same, for non-ASCII characters */
+	struct input *tx_input;	/* the file in memory, under -k */
+	struct line_list *tx_lines;
+				/* the line ends, recorded by Pass 1 */
+};
+
+/*	The line ends of a text, recorded while it is read by Pass 1, so
+	Pass 2 can find the line numbers of the positions without scanning
+	the file again. For each line the number of tokens on it is stored,
+	in one byte if less than 255; otherwise as bytes 255, each
+	standing for 255 tokens, followed by the rest.
+*/
+struct line_list {
+	unsigned char *ll_bytes;	/* to be filled by Malloc() */
+	size_t ll_free;
+	size_t ll_size;
+	size_t ll_tk_cnt;	/* number of tokens up to the last line end */
 };
 
+/*	The large tables of positions in Token_Array[], the forward references
+	and the hash table in hash.c, and the struct positions of the runs,
+	hold them as an Index. Normally this is a size_t; compiled with
+	INDEX_BITS=32 (see the Makefile), it is a uint32_t, which halves the
+	memory of these tables and doubles the chain entries per cache line,
+	and the input is then limited to MAX_INDEX tokens. The top bit is
+	kept free, for the marks of hash.c.
+*/
+#include	<stdint.h>
+
+#if	defined(INDEX_BITS) && INDEX_BITS == 32
+typedef uint32_t Index;
+#else
+typedef size_t Index;
+#endif
+#define	MAX_INDEX	((Index)-1 >> 1)
+
 struct position {
-	/* position of first and last token of a chunk */
-	struct position *ps_next;
+	/* position of first and last token of a chunk; the positions in a
+	   text are found through Positions_Of() (see runs.h)
+	*/
 	int ps_type;		/* first = 0, last = 1, for debugging */
-	size_t ps_tk_cnt;	/* in tokens; set by add_run()
+	Index ps_tk_cnt;	/* in tokens; set by add_run()
 				   in Read_Input_Files() */
-	size_t ps_nl_cnt;	/* same, in line numbers;set by Retrieve_Runs(),
+	Index ps_nl_cnt;	/* same, in line numbers;set by Retrieve_Runs(),
 				   used by Print_Runs(), to report line numbers
 				*/
 };
@@ -43,7 +76,32 @@ extern int Number_of_Texts;		/* number of text files;
 extern int Number_of_New_Texts;		/* number of *new* text files */
 
 extern void Init_Text(int nfiles);
+extern void Extend_Text(int nfiles);
+
+/*	Finding the text a token position belongs to: after Make_Text_Map(),
+	Text_Containing(i) yields the text with tx_start <= i < tx_limit,
+	for any position i inside a text, in about constant time; this
+	includes texts added after Make_Text_Map(), if they are few.
+*/
+extern void Make_Text_Map(void);
+extern struct text *Text_Containing(size_t i);
+extern void Free_Text_Map(void);
+/*	Add_Line_End(ll, tk_cnt) records a line end, after tk_cnt tokens
+	from the start of the text. Next_Line_End(ll, &offset, &tk_cnt)
+	steps offset (starting at 0) to the next line end, setting tk_cnt to
+	the number of tokens before it, and returns 0 at the end of the list.
+	Copy_Line_List(ll) yields a new line list equal to ll.
+*/
+extern void Add_Line_End(struct line_list *ll, size_t tk_cnt);
+extern int Next_Line_End(
+	const struct line_list *ll, size_t *offset, size_t *tk_cnt
+);
+extern struct line_list *Copy_Line_List(const struct line_list *ll);
+extern void Free_Line_List(struct line_list *ll);
+
 extern int Open_Text(struct text *txt);
 extern int Next_Text_Token_Obtained(void);
 extern void Close_Text(void);
+/* Remove_Last_Text() frees Text[Number_of_Texts-1] and removes it */
+extern void Remove_Last_Text(void);
 extern void Free_Text(void);
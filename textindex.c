@@ -0,0 +1,296 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	The index file consists of a header and one record per text.
+
+	The header holds the identification line INDEX_MAGIC, the size of a
+	Token, the values of Min_Run_Size and Window_Hash_Name at the time
+	of writing, the lexically relevant options and the Subject of the
+	language.
+	A record holds the file name, the counts and flags of the text, its
+	tokens, and the hash values of its windows of Min_Run_Size tokens.
+
+	All numbers are written in the native byte order; an index is not
+	meant to be moved between machines.
+*/
+
+#include	<stdio.h>
+#include	<stdint.h>
+#include	<string.h>
+
+#include	"sim.h"
+#include	"text.h"
+#include	"token.h"
+#include	"tokenarray.h"
+#include	"lang.h"
+#include	"options.h"
+#include	"hash.h"
+#include	"Malloc.h"
+#include	"textindex.h"
+
+#define	INDEX_MAGIC	"SIM text index 2\n"
+
+/* the options that change the tokens that are produced */
+#define	LEXICAL_OPTIONS	"fF"
+
+const char *Text_Index_Name;
+
+static FILE *index_file;
+static const char *index_name;
+static int index_min_run_size;		/* as found in the index */
+static const char *index_window_hash;
+
+/* the window hash values of the texts read from the index */
+static uint32_t *known_hash;		/* to be filled by Malloc() */
+static size_t known_start;
+static size_t known_size;
+static size_t known_room;
+
+/* the file names of the texts read from the index */
+struct name_block {
+	struct name_block *nb_next;
+	char nb_name[1];		/* extended by Malloc() */
+};
+static struct name_block *names;
+
+static void
+index_error(const char *fname, const char *what) {
+	char *msg = (char *)Malloc(strlen(fname) + strlen(what) + 100);
+
+	sprintf(msg, "index file `%s': %s", fname, what);
+	fatal(msg);
+	/*NOTREACHED*/
+}
+
+static size_t
+n_windows(size_t size) {
+	return (size >= (size_t)Min_Run_Size ? size - (Min_Run_Size - 1) : 0);
+}
+
+							/* WRITING */
+static void
+put_block(const void *p, size_t size) {
+	if (size && fwrite(p, size, 1, index_file) != 1) {
+		index_error(index_name, "cannot write");
+	}
+}
+
+static void
+put_number(uint64_t v) {
+	put_block(&v, sizeof v);
+}
+
+static void
+put_string(const char *s) {
+	size_t len = strlen(s);
+
+	put_number(len);
+	put_block(s, len);
+}
+
+static void
+put_lexical_options(void) {
+	const char *op;
+
+	for (op = LEXICAL_OPTIONS; *op; op++) {
+		put_number(is_set_option(*op) ? 1 : 0);
+	}
+}
+
+static void
+put_text(const struct text *txt) {
+	size_t size = txt->tx_limit - txt->tx_start;
+
+	put_string(txt->tx_fname);
+	put_number(txt->tx_opened);
+	put_number(txt->tx_EOL_terminated);
+	put_number(txt->tx_nl_cnt);
+	put_number(txt->tx_non_ASCII_cnt);
+	put_number(size);
+	put_block(&Token_Array[txt->tx_start], size * sizeof (Token));
+
+	size_t n_hashes = n_windows(size);
+	if (n_hashes) {
+		uint32_t *raw_hash =
+			(uint32_t *)Malloc(n_hashes * sizeof (uint32_t));
+
+		Get_Window_Hashes(txt, raw_hash);
+		put_block(raw_hash, n_hashes * sizeof (uint32_t));
+		Free(raw_hash);
+	}
+}
+
+void
+Write_Text_Index(const char *fname) {
+	int n;
+
+	index_name = fname;
+	index_file = fopen(fname, "wb");
+	if (!index_file) {
+		index_error(fname, "cannot open for writing");
+	}
+
+	put_block(INDEX_MAGIC, strlen(INDEX_MAGIC));
+	put_number(sizeof (Token));
+	put_number(Min_Run_Size);
+	put_string(Window_Hash_Name);
+	put_lexical_options();
+	put_string(Subject);
+
+	/* the old texts are those after the separator */
+	put_number(Number_of_Texts - Number_of_New_Texts - 1);
+	for (n = Number_of_New_Texts + 1; n < Number_of_Texts; n++) {
+		put_text(&Text[n]);
+	}
+
+	if (fclose(index_file) != 0) {
+		index_error(fname, "cannot write");
+	}
+	index_file = 0;
+}
+
+							/* READING */
+static void
+get_block(void *p, size_t size) {
+	if (size && fread(p, size, 1, index_file) != 1) {
+		index_error(index_name, "truncated or unreadable");
+	}
+}
+
+static uint64_t
+get_number(void) {
+	uint64_t v;
+
+	get_block(&v, sizeof v);
+	return v;
+}
+
+static char *
+get_string(void) {
+	size_t len = (size_t)get_number();
+	struct name_block *nb = (struct name_block *)
+		Malloc(sizeof (struct name_block) + len);
+
+	get_block(nb->nb_name, len);
+	nb->nb_name[len] = '\0';
+	nb->nb_next = names;
+	names = nb;
+	return nb->nb_name;
+}
+
+static void
+check_header(void) {
+	char magic[sizeof INDEX_MAGIC];
+	const char *op;
+
+	magic[sizeof INDEX_MAGIC - 1] = '\0';
+	if (	fread(magic, sizeof INDEX_MAGIC - 1, 1, index_file) != 1
+	||	strcmp(magic, INDEX_MAGIC) != 0
+	) {
+		index_error(index_name, "not a SIM text index");
+	}
+	if (get_number() != sizeof (Token)) {
+		index_error(index_name, "made with a different token size");
+	}
+	index_min_run_size = (int)get_number();
+	index_window_hash = get_string();
+	for (op = LEXICAL_OPTIONS; *op; op++) {
+		if (get_number() != (is_set_option(*op) ? 1 : 0)) {
+			char what[100];
+
+			sprintf(what, "made with a different setting of -%c",
+				*op);
+			index_error(index_name, what);
+		}
+	}
+
+	const char *subject = get_string();
+	if (strcmp(subject, Subject) != 0) {
+		index_error(index_name, "made for a different language");
+	}
+}
+
+int
+Open_Text_Index(const char *fname) {
+	index_name = fname;
+	index_file = fopen(fname, "rb");
+	if (!index_file) {
+		index_error(fname, "cannot open");
+	}
+	check_header();
+
+	known_start = Token_Array_Length();
+	known_size = 0;
+	return (int)get_number();
+}
+
+void
+Read_Indexed_Text(struct text *txt) {
+	size_t first = Token_Array_Length();
+
+	txt->tx_fname = get_string();
+	txt->tx_opened = (int)get_number();
+	txt->tx_EOL_terminated = (int)get_number();
+	txt->tx_nl_cnt = (size_t)get_number();
+	txt->tx_non_ASCII_cnt = (size_t)get_number();
+
+	size_t size = (size_t)get_number();
+	size_t done = 0;
+	Reserve_Token_Array(size);
+	while (done < size) {
+		Token buffer[4096];
+		size_t chunk = size - done;
+
+		if (chunk > sizeof buffer / sizeof buffer[0]) {
+			chunk = sizeof buffer / sizeof buffer[0];
+		}
+		get_block(buffer, chunk * sizeof (Token));
+		Store_Tokens(buffer, chunk);
+		done += chunk;
+	}
+
+	/* the window hashes go to known_hash[], in the positions of the text */
+	size_t n_hashes =
+		(size < (size_t)index_min_run_size ? 0
+		:	size - (index_min_run_size - 1));
+	known_size = first + size - known_start;
+	if (known_size > known_room) {
+		/* allocated array is too small; increase its size */
+		while (known_room < known_size) {
+			known_room = (known_room ? 2 * known_room : 16384);
+		}
+		known_hash = (uint32_t *)
+			Realloc(known_hash, known_room * sizeof (uint32_t));
+	}
+	get_block(&known_hash[first - known_start],
+		n_hashes * sizeof (uint32_t));
+}
+
+void
+Close_Text_Index(void) {
+	fclose(index_file);
+	index_file = 0;
+
+	if (	index_min_run_size == Min_Run_Size
+	&&	strcmp(index_window_hash, Window_Hash_Name) == 0
+	&&	known_hash
+	) {
+		/* the hash values apply */
+		Set_Known_Window_Hashes(known_start, known_start + known_size,
+			known_hash);
+	}
+}
+
+void
+Free_Text_Index(void) {
+	Set_Known_Window_Hashes(0, 0, 0);
+	if (known_hash) {
+		Free(known_hash); known_hash = 0;
+		known_room = 0;
+	}
+	while (names) {
+		struct name_block *nb = names;
+		names = nb->nb_next;
+		Free(nb);
+	}
+}
@@ -0,0 +1,31 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Saving and restoring the old texts in an index file (-I option).
+
+	When the old texts have been read from their files,
+	Write_Text_Index(fname) writes their token streams, file names, text
+	boundaries, line counts and window hash values to the file fname.
+	A later run can then get the old texts from the index rather than from
+	the files: Open_Text_Index(fname) checks the index and returns the
+	number of texts in it, each call of Read_Indexed_Text(txt) appends
+	the tokens of the next one to Token_Array[] and fills in txt, except
+	for tx_start and tx_limit, and Close_Text_Index() ends the reading.
+
+	An index is bound to the language and to the options that affect the
+	tokens; it can be used with any value of Min_Run_Size, but the window
+	hash values are only used if Min_Run_Size is the same as when the
+	index was written. The old files themselves are still needed for
+	printing runs.
+
+	Text_Index_Name is set from the -I option.
+*/
+
+extern const char *Text_Index_Name;
+
+extern void Write_Text_Index(const char *fname);
+
+extern int Open_Text_Index(const char *fname);
+extern void Read_Indexed_Text(struct text *txt);
+extern void Close_Text_Index(void);
+extern void Free_Text_Index(void);
@@ -0,0 +1,315 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Text front end for the similarity tester, with a hand-written scanner
+	instead of the one flex(1) generates from textlang.l; it yields the
+	same tokens, token texts and line counts, so sim_text_fast can stand
+	in for sim_text.  It supplies the entries of lang.h.
+
+	The tokens of textlang.l are, in flex terms:
+	    WordElem	[a-zA-Z0-9\200-\377]
+	    TightWord	{WordElem}+
+	    SpacedWord	({WordElem}" ")+{WordElem}, followed by a non-WordElem
+	and each newline yields an End_Of_Line; all other bytes are skipped.
+	A SpacedWord only exists where a WordElem is followed by a space, and
+	then it is the longest match, since flex counts the trailing context.
+	The bytes of UTF-8 sequences are all WordElems, as in textlang.l.
+
+	The scanner works on the whole input in memory: a buffer from
+	yy_scan_buffer(), or the contents of the file from yyset_in().  The
+	runs of WordElems and of skipped bytes are found 16 bytes at a time
+	where SSE2 is available, and the token is hashed directly from the
+	input, without copying it; yyget_text() makes the copy only when it
+	is asked for.
+*/
+
+#include	<stdio.h>
+#include	<string.h>
+
+/* the vector intrinsics come before Malloc.h, which bans malloc() */
+#undef	VECTOR_SSE2
+#if	!defined(lint) && !defined(lint_test) && defined(__GNUC__)
+#if	defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define	VECTOR_SSE2
+#include	<emmintrin.h>
+#endif
+#endif
+
+#include	"sim.h"
+#include	"options.h"
+#include	"token.h"
+#include	"idf.h"
+#include	"Malloc.h"
+#include	"lex.h"
+#include	"lang.h"
+
+static void get_classes(void);
+
+/* Language-dependent code */
+
+const char *Subject = "text";
+
+void
+Init_Language(void) {
+	if (is_set_option('f') || is_set_option('F'))
+		fatal("options -f or -F not applicable in sim_text");
+	Token_Name = "word";
+	Threshold_Percentage = 20;
+	get_classes();
+}
+
+							/* THE SCANNER STATE */
+struct scanner {
+	struct lex_state *sc_extra;
+	const char *sc_text;		/* the input */
+	size_t sc_size;			/* its size, without the null bytes */
+	size_t sc_pos;			/* the next byte to be scanned */
+	char *sc_file_text;		/* the input, when read from a file */
+	size_t sc_tk_start;		/* the bytes of the last token */
+	size_t sc_tk_size;
+	char *sc_yytext;		/* its copy, made by yyget_text() */
+	size_t sc_yytext_size;
+};
+
+static void
+forget_file_text(struct scanner *sc) {
+	if (sc->sc_file_text) {
+		Free(sc->sc_file_text); sc->sc_file_text = 0;
+	}
+}
+
+static void
+set_text(struct scanner *sc, const char *text, size_t size) {
+	sc->sc_text = text;
+	sc->sc_size = size;
+	sc->sc_pos = 0;
+	sc->sc_tk_start = 0;
+	sc->sc_tk_size = 0;
+}
+
+int
+yylex_init_extra(struct lex_state *ls, void **scanner) {
+	struct scanner *sc = (struct scanner *)TryMalloc(sizeof *sc);
+	if (!sc) return 1;
+
+	sc->sc_extra = ls;
+	sc->sc_file_text = 0;
+	sc->sc_yytext = 0;
+	sc->sc_yytext_size = 0;
+	set_text(sc, "", 0);
+	*scanner = sc;
+	return 0;
+}
+
+void
+yyset_in(FILE *f, void *scanner) {
+	struct scanner *sc = (struct scanner *)scanner;
+	size_t size = 0;
+	size_t allocated = 16384;
+	size_t n;
+
+	forget_file_text(sc);
+	sc->sc_file_text = (char *)Malloc(allocated);
+	while ((n = fread(&sc->sc_file_text[size], 1, allocated - size, f))
+	       > 0
+	) {
+		size += n;
+		if (size == allocated) {
+			allocated *= 2;
+			sc->sc_file_text =
+				(char *)Realloc(sc->sc_file_text, allocated);
+		}
+	}
+	set_text(sc, sc->sc_file_text, size);
+}
+
+struct yy_buffer_state *
+yy_scan_buffer(char *base, size_t size, void *scanner) {
+	/* like flex, requires the two null bytes at the end */
+	struct scanner *sc = (struct scanner *)scanner;
+
+	if (size < 2 || base[size-2] != '\0' || base[size-1] != '\0') return 0;
+	forget_file_text(sc);
+	set_text(sc, base, size - 2);
+	return (struct yy_buffer_state *)sc;
+}
+
+void
+yy_delete_buffer(struct yy_buffer_state *b, void *scanner) {
+	struct scanner *sc = (struct scanner *)scanner;
+
+	if (b == 0) return;
+	set_text(sc, "", 0);
+}
+
+void
+yystart(void *scanner) {
+	/* there are no start conditions */
+	if (scanner == 0) return;
+}
+
+char *
+yyget_text(void *scanner) {
+	struct scanner *sc = (struct scanner *)scanner;
+
+	if (sc->sc_tk_size + 1 > sc->sc_yytext_size) {
+		sc->sc_yytext_size = 2 * (sc->sc_tk_size + 1);
+		sc->sc_yytext =
+			(char *)Realloc(sc->sc_yytext, sc->sc_yytext_size);
+	}
+	memcpy(sc->sc_yytext, &sc->sc_text[sc->sc_tk_start], sc->sc_tk_size);
+	sc->sc_yytext[sc->sc_tk_size] = '\0';
+	return sc->sc_yytext;
+}
+
+int
+yylex_destroy(void *scanner) {
+	struct scanner *sc = (struct scanner *)scanner;
+
+	forget_file_text(sc);
+	if (sc->sc_yytext) {
+		Free(sc->sc_yytext);
+	}
+	Free(sc);
+	return 0;
+}
+
+							/* CLASSIFICATION */
+/*	is_word_elem[ch] is 1 for the WordElems, stops_skip[ch] also for the
+	newline; Init_Language() fills them in, before any scanning.
+*/
+static char is_word_elem[256];
+static char stops_skip[256];
+
+static void
+get_classes(void) {
+	int ch;
+
+	for (ch = 0; ch < 256; ch++) {
+		is_word_elem[ch] =
+			('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z')
+		||	('0' <= ch && ch <= '9') || ch >= 0200;
+		stops_skip[ch] = is_word_elem[ch] || ch == '\n';
+	}
+}
+
+#define	is_word_elem_at(t, i)	(is_word_elem[(t)[i] & 0377])
+
+#ifdef	VECTOR_SSE2
+#define	SSE2_BYTES	16
+
+static unsigned int
+sse2_word_elem_mask(__m128i x) {
+	/* one bit per byte: is it a WordElem? */
+	__m128i lc = _mm_or_si128(x, _mm_set1_epi8(0x20));
+	__m128i digit = _mm_and_si128(
+		_mm_cmpgt_epi8(x, _mm_set1_epi8('0' - 1)),
+		_mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), x)
+	);
+	__m128i letter = _mm_and_si128(
+		_mm_cmpgt_epi8(lc, _mm_set1_epi8('a' - 1)),
+		_mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lc)
+	);
+	/* the bytes from 0200 on are negative and have their top bits set */
+	return (unsigned int)_mm_movemask_epi8(
+		_mm_or_si128(x, _mm_or_si128(digit, letter))
+	);
+}
+#endif	/* VECTOR_SSE2 */
+
+static size_t
+end_of_word(const char *text, size_t i, size_t size) {
+	/* the position of the first non-WordElem at or after i */
+#ifdef	VECTOR_SSE2
+	while (i + SSE2_BYTES <= size) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&text[i]);
+		unsigned int m = ~sse2_word_elem_mask(x) & 0xFFFFu;
+		if (m) return i + __builtin_ctz(m);
+		i += SSE2_BYTES;
+	}
+#endif	/* VECTOR_SSE2 */
+	while (i < size && is_word_elem_at(text, i)) {
+		i++;
+	}
+	return i;
+}
+
+static size_t
+end_of_skip(const char *text, size_t i, size_t size) {
+	/* the position of the first WordElem or newline at or after i */
+#ifdef	VECTOR_SSE2
+	while (i + SSE2_BYTES <= size) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&text[i]);
+		unsigned int m = sse2_word_elem_mask(x) |
+			(unsigned int)_mm_movemask_epi8(
+				_mm_cmpeq_epi8(x, _mm_set1_epi8('\n'))
+			);
+		if (m) return i + __builtin_ctz(m);
+		i += SSE2_BYTES;
+	}
+#endif	/* VECTOR_SSE2 */
+	while (i < size && !stops_skip[text[i] & 0377]) {
+		i++;
+	}
+	return i;
+}
+
+static size_t
+end_of_spaced_word(const char *text, size_t i, size_t size) {
+	/*	A WordElem at i is followed by a space; returns the end of the
+		SpacedWord that starts at i, or 0 if there is none.
+	*/
+	size_t last = i;		/* the last WordElem in the chain */
+	size_t n_elems = 1;
+
+	while (	last + 2 < size && text[last+1] == ' '
+	&&	is_word_elem_at(text, last + 2)
+	) {
+		last += 2;
+		n_elems++;
+	}
+	if (last + 1 == size || is_word_elem_at(text, last + 1)) {
+		/*	no non-WordElem follows the last one, but a space
+			follows the one before it
+		*/
+		last -= 2;
+		n_elems--;
+	}
+	return (n_elems >= 2 ? last + 1 : 0);
+}
+
+							/* THE SCANNER */
+int
+yylex(void *scanner) {
+	struct scanner *sc = (struct scanner *)scanner;
+	struct lex_state *yyextra = sc->sc_extra;
+	const char *text = sc->sc_text;
+	size_t size = sc->sc_size;
+	size_t i = end_of_skip(text, sc->sc_pos, size);
+
+	sc->sc_tk_start = i;
+	if (i == size) {
+		sc->sc_pos = i;
+		sc->sc_tk_size = 0;
+		return 0;
+	}
+	if (text[i] == '\n') {
+		sc->sc_pos = i + 1;
+		sc->sc_tk_size = 1;
+		return_eol();
+	}
+
+	/* a TightWord or a SpacedWord starts at i */
+	size_t end = 0;
+
+	if (i + 1 < size && text[i+1] == ' ') {
+		end = end_of_spaced_word(text, i, size);
+	}
+	if (end == 0) {
+		end = end_of_word(text, i + 1, size);
+	}
+	sc->sc_pos = end;
+	sc->sc_tk_size = end - i;
+	/* ignore case */
+	return_tk(idf_hashed_lower_case_n(&text[i], end - i));
+}
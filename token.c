@@ -36,7 +36,8 @@ check_and_print(
 #define	is_NORM_token(tk)	(Token_in_range(tk, 0x0121, 0x017E))
 #define	is_MTCT_token(tk)	(Token_in_range(tk, 0x0181, 0x019E))
 #define	is_META_token(tk)	(Token_in_range(tk, 0x01A1, 0x01FE))
-#define	is_hashed_token(tk)	(Token_in_range(tk, 0x0200, 0xFFFE))
+#define	is_hashed_token(tk)	\
+	(Token_in_range(tk, N_REGULAR_TOKENS, Token2int(End_Of_Line) - 1))
 
 void
 fprint_token(FILE *ofile, const Token tk) {
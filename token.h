@@ -31,6 +31,12 @@
 	3. the conversion routines
 		Token2int(c)
 		int2Token(i)
+
+	Normally a Token is 16 bits wide, so the hashed tokens fall in only
+	some 65000 classes and the hash chains of large inputs get long.
+	Compiled with TOKEN_BITS=32 (see the Makefile), the Token type
+	is 32 bits wide and idf_hashed() spreads over 2^31 values; the token
+	array then takes twice the memory.
 */
 
 #include	<stdio.h>
@@ -39,6 +45,10 @@
 #ifndef	_TOKEN_H
 #define	_TOKEN_H
 
+#if	defined(TOKEN_BITS) && TOKEN_BITS == 32
+#define	WIDE_TOKENS
+#endif
+
 #ifdef	lint_test
 /* For security we want to distinguish tokens from integers. Lint is not
    good at this, so for checking we use a pointer to a weird data type.
@@ -46,12 +56,19 @@
 struct for_lint_only {int i;};
 typedef struct for_lint_only *Token;
 extern int Token_EQ(const Token t1, const Token t2);
+#elif	defined(WIDE_TOKENS)
+typedef uint32_t Token;
+#define	Token_EQ(t1,t2)	(Token2int(t1) == Token2int(t2))
 #else	/* if normal */
 typedef uint16_t Token;
 #define	Token_EQ(t1,t2)	(Token2int(t1) == Token2int(t2))
 #endif	/* lint_test/normal */
 
+#ifdef	WIDE_TOKENS
+#define	N_TOKENS		(1u<<31)	/* Token2int() remains an int */
+#else
 #define	N_TOKENS		(1<<16)
+#endif
 #define	N_REGULAR_TOKENS	(1<<9)
 
 /* Macros for the composition of tokens */		/* range (gaps unused)*/
@@ -63,8 +80,13 @@ typedef uint16_t Token;
 #define	STR		int2Token(0x180)		/* 0x0180 */
 #define	MTCT(ch)	int2Token(0x180|((ch)&0x01F))	/* 0x0181-0x019E */
 #define	META(ch)	int2Token(0x180|((ch)&0x07F))	/* 0x01A1-0x01FE */
+#ifdef	WIDE_TOKENS
+/* tokens from idf_hashed() */				/* 0x0200-0x7FFFFFFE */
+#define	End_Of_Line	int2Token(0x7FFFFFFF)		/* 0x7FFFFFFF */
+#else
 /* tokens from idf_hashed() */				/* 0x0200-0xFFFE */
 #define	End_Of_Line	int2Token(0xFFFF)		/* 0xFFFF */
+#endif
 
 /* Conversion routines */
 #define	Token2int(c)	((int)(c))
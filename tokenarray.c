@@ -5,11 +5,15 @@
 
 #include	<stdio.h>
 #include	<stdlib.h>
+#include	<string.h>
 
 #include	"sim.h"
 #include	"Malloc.h"
+#include	"mapped.h"
+#include	"memstat.h"
 #include	"token.h"
 #include	"lang.h"
+#include	"text.h"
 #include	"tokenarray.h"
 
 #define	Initial_Token_Array_Size	16384
@@ -17,13 +21,60 @@
 Token *Token_Array;			/* to be filled by Malloc() */
 static size_t tk_size;			/* size of Token_Array[] */
 static size_t tk_free;			/* next free position in Token_Array[]*/
+int Token_Array_Resets;
 
 void
 Init_Token_Array(void) {
-	if (Token_Array) Free(Token_Array);
+	if (Token_Array) {
+		Map_Free(Token_Array);
+		Uncount_Memory(MEM_TOKEN_ARRAY, tk_size * sizeof (Token));
+	}
 	tk_size = Initial_Token_Array_Size;
-	Token_Array = (Token *)Malloc(sizeof (Token) * tk_size);
+	Token_Array = (Token *)Map_Calloc(tk_size, sizeof (Token));
+	Count_Memory(MEM_TOKEN_ARRAY, tk_size * sizeof (Token));
 	tk_free = 1;		/* don't use position 0 */
+	Token_Array_Resets++;
+}
+
+static void
+check_index_room(size_t n) {
+	/* the positions must fit in an Index (see text.h) */
+	if (tk_free + n > MAX_INDEX)
+		fatal("too much text for the index type; see INDEX_BITS");
+}
+
+static void
+resize_token_array(size_t new_size) {
+	Token *new_array =
+		(Token *)TryMap_Realloc(
+			(char *)Token_Array, sizeof (Token) * new_size
+		);
+
+	if (!new_array) {
+		/* we failed */
+		fatal("out of memory: too much text");
+	}
+	Uncount_Memory(MEM_TOKEN_ARRAY, tk_size * sizeof (Token));
+	Token_Array = new_array, tk_size = new_size;
+	Count_Memory(MEM_TOKEN_ARRAY, tk_size * sizeof (Token));
+}
+
+void
+Reserve_Token_Array(size_t n) {
+	if (tk_free + n < tk_free)
+		fatal("out of address space");
+	if (tk_free + n > MAX_INDEX) {
+		/* reserve no more than can be used; storing checks it */
+		n = (tk_free < MAX_INDEX ? MAX_INDEX - tk_free : 0);
+	}
+	if (tk_free + n <= tk_size) return;
+
+	/* allocated array is too small; increase its size */
+	size_t new_size = tk_size + tk_size/2;
+	if (new_size < tk_free + n) {
+		new_size = tk_free + n;
+	}
+	resize_token_array(new_size);
 }
 
 void
@@ -33,27 +84,40 @@ Store_Token(Token tk) {
 		size_t new_size = tk_size + tk_size/2;
 		if (new_size < tk_free)
 			fatal("out of address space");
-
-		Token *new_array =
-			(Token *)TryRealloc(
-				(char *)Token_Array, sizeof (Token) * new_size
-			);
-
-		if (!new_array) {
-			/* we failed */
-			fatal("out of memory: too much text");
+		check_index_room(1);
+		if (new_size > MAX_INDEX) {
+			new_size = MAX_INDEX;
 		}
-		Token_Array = new_array, tk_size = new_size;
+
+		resize_token_array(new_size);
 	}
 
 	/* now we are sure there is room enough */
 	Token_Array[tk_free++] = tk;
 }
 
+void
+Store_Tokens(const Token *tk, size_t n) {
+	check_index_room(n);
+	Reserve_Token_Array(n);
+	memcpy(&Token_Array[tk_free], tk, n * sizeof (Token));
+	tk_free += n;
+}
+
+void
+Trim_Token_Array(void) {
+	/* give back the room reserved but not used */
+	if (tk_free < tk_size) {
+		resize_token_array(tk_free);
+	}
+}
+
 void
 Free_Token_Array(void) {
 	if (Token_Array) {
-		Free(Token_Array); Token_Array = 0;
+		Map_Free(Token_Array); Token_Array = 0;
+		Uncount_Memory(MEM_TOKEN_ARRAY, tk_size * sizeof (Token));
+		tk_size = 0;
 	}
 }
 
@@ -61,3 +125,12 @@ size_t
 Token_Array_Length(void) {
 	return tk_free;
 }
+
+void
+Truncate_Token_Array(size_t length) {
+	/* forget the tokens from position length on */
+	if (length < tk_free) {
+		tk_free = length;
+		Token_Array_Resets++;
+	}
+}
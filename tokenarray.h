@@ -6,8 +6,22 @@
 /* Interface for the token storage */
 extern void Init_Token_Array(void);
 extern void Store_Token(Token tk);
+extern void Store_Tokens(const Token *tk, size_t n);	/* n at a time */
+/*	Reserve_Token_Array(n) makes room for n more tokens in one step, so
+	storing them does not reallocate Token_Array[] piecemeal;
+	Trim_Token_Array() gives back the room that remained unused.
+*/
+extern void Reserve_Token_Array(size_t n);
+extern void Trim_Token_Array(void);
 extern void Free_Token_Array(void);
 extern size_t Token_Array_Length(void);	/* also first free token position */
+extern void Truncate_Token_Array(size_t length);
+/*	Token_Array_Resets counts the calls of Init_Token_Array() and
+	Truncate_Token_Array(), after which stored tokens may be replaced;
+	data derived from Token_Array[] can use it to see that they must be
+	made anew.
+*/
+extern int Token_Array_Resets;
 
 extern Token *Token_Array;
 
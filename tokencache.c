@@ -0,0 +1,270 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	A cache entry is a file whose name is the key in hexadecimal. It
+	consists of a header, which repeats everything that went into the
+	key, so a collision of hash values is noticed, and the contents:
+	the flags and counts of the text, its tokens and its line list.
+
+	A new entry is written under a temporary name and then renamed, so
+	a concurrent run never sees half an entry. All numbers are written
+	in the native byte order.
+*/
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<stdint.h>
+#include	<string.h>
+#ifndef	MSDOS
+#include	<unistd.h>
+#endif
+
+#include	"sim.h"
+#include	"token.h"
+#include	"text.h"
+#include	"lang.h"
+#include	"options.h"
+#include	"fname.h"
+#include	"Malloc.h"
+#include	"tokencache.h"
+
+#define	CACHE_MAGIC	"SIM token cache 1\n"
+
+/* the options that change the tokens that are produced */
+#define	LEXICAL_OPTIONS	"fF"
+
+const char *Token_Cache_Name;
+size_t Token_Cache_Hits;
+size_t Token_Cache_Misses;
+
+							/* KEYS */
+#define	FNV_OFFSET	UINT64_C(0xcbf29ce484222325)
+#define	FNV_PRIME	UINT64_C(0x100000001b3)
+
+static uint64_t
+fnv_block(uint64_t h, const void *p, size_t size) {
+	const unsigned char *b = (const unsigned char *)p;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		h = (h ^ b[i]) * FNV_PRIME;
+	}
+	return h;
+}
+
+int
+Cache_Key_Of(const char *fname, struct cache_key *key) {
+	FILE *f = Fopen(str2Fname(fname), "rb");
+	if (!f) return 0;
+
+	/* the language and the lexical options */
+	uint64_t h = fnv_block(FNV_OFFSET, Subject, strlen(Subject) + 1);
+	const char *op;
+	for (op = LEXICAL_OPTIONS; *op; op++) {
+		char setting = (is_set_option(*op) ? '1' : '0');
+
+		h = fnv_block(h, &setting, 1);
+	}
+
+	/* the front end, if there are several */
+	if (Language_Of_File) {
+		int language = Language_Of_File(fname);
+
+		h = fnv_block(h, &language, sizeof language);
+	}
+
+	/* the contents */
+	char buff[8192];
+	uint64_t size = 0;
+	size_t n;
+	while ((n = fread(buff, 1, sizeof buff, f)) > 0) {
+		h = fnv_block(h, buff, n);
+		size += n;
+	}
+	int ok = !ferror(f);
+	fclose(f);
+
+	key->ck_hash = h;
+	key->ck_size = size;
+	return ok;
+}
+
+static char *
+entry_name(const struct cache_key *key, const char *suffix) {
+	char *name = (char *)
+		Malloc(strlen(Token_Cache_Name) + strlen(suffix) + 20);
+
+	sprintf(name, "%s/%08lx%08lx%s", Token_Cache_Name,
+		(unsigned long)(key->ck_hash >> 32),
+		(unsigned long)(key->ck_hash & 0xffffffff),
+		suffix
+	);
+	return name;
+}
+
+							/* WRITING */
+static int
+put_block(FILE *f, const void *p, size_t size) {
+	return (size == 0 || fwrite(p, size, 1, f) == 1);
+}
+
+static int
+put_number(FILE *f, uint64_t v) {
+	return put_block(f, &v, sizeof v);
+}
+
+static int
+put_header(FILE *f, const struct cache_key *key) {
+	const char *op;
+	int ok = 1;
+
+	ok &= put_block(f, CACHE_MAGIC, strlen(CACHE_MAGIC));
+	ok &= put_number(f, sizeof (Token));
+	for (op = LEXICAL_OPTIONS; *op; op++) {
+		ok &= put_number(f, is_set_option(*op) ? 1 : 0);
+	}
+	ok &= put_number(f, strlen(Subject));
+	ok &= put_block(f, Subject, strlen(Subject));
+	ok &= put_number(f, key->ck_hash);
+	ok &= put_number(f, key->ck_size);
+	return ok;
+}
+
+static FILE *
+create_entry(const struct cache_key *key, char **tmp_name) {
+#ifndef	MSDOS
+	*tmp_name = entry_name(key, ".XXXXXX");
+	int fd = mkstemp(*tmp_name);
+	FILE *f = (fd < 0 ? 0 : fdopen(fd, "wb"));
+#else
+	*tmp_name = entry_name(key, ".tmp");
+	FILE *f = fopen(*tmp_name, "wb");
+#endif
+
+	if (!f) {
+		char *msg = (char *)Malloc(strlen(Token_Cache_Name) + 100);
+
+		sprintf(msg, "cannot create files in token cache directory `%s'",
+			Token_Cache_Name);
+		fatal(msg);
+		/*NOTREACHED*/
+	}
+	return f;
+}
+
+void
+Write_Cached_Text(const struct cache_key *key, const struct cached_text *ct) {
+	char *tmp_name;
+	FILE *f = create_entry(key, &tmp_name);
+	const struct line_list *ll = ct->ct_lines;
+	int ok = 1;
+
+	ok &= put_header(f, key);
+	ok &= put_number(f, ct->ct_EOL_terminated);
+	ok &= put_number(f, ct->ct_nl_cnt);
+	ok &= put_number(f, ct->ct_non_ASCII_cnt);
+	ok &= put_number(f, ct->ct_n_tokens);
+	ok &= put_block(f, ct->ct_tokens, ct->ct_n_tokens * sizeof (Token));
+	ok &= put_number(f, ll->ll_tk_cnt);
+	ok &= put_number(f, ll->ll_free);
+	ok &= put_block(f, ll->ll_bytes, ll->ll_free);
+	ok &= (fclose(f) == 0);
+
+	/* a failed entry is not fatal; there is just no entry */
+	char *name = entry_name(key, "");
+	if (!ok || rename(tmp_name, name) != 0) {
+		remove(tmp_name);
+	}
+	Free(name);
+	Free(tmp_name);
+}
+
+							/* READING */
+static int
+get_block(FILE *f, void *p, size_t size) {
+	return (size == 0 || fread(p, size, 1, f) == 1);
+}
+
+static int
+get_number(FILE *f, uint64_t *v) {
+	return get_block(f, v, sizeof *v);
+}
+
+static int
+check_header(FILE *f, const struct cache_key *key) {
+	char magic[sizeof CACHE_MAGIC];
+	const char *op;
+	uint64_t v;
+
+	magic[sizeof CACHE_MAGIC - 1] = '\0';
+	if (!get_block(f, magic, sizeof CACHE_MAGIC - 1)) return 0;
+	if (strcmp(magic, CACHE_MAGIC) != 0) return 0;
+	if (!get_number(f, &v) || v != sizeof (Token)) return 0;
+	for (op = LEXICAL_OPTIONS; *op; op++) {
+		if (!get_number(f, &v) || v != (is_set_option(*op) ? 1 : 0))
+			return 0;
+	}
+	if (!get_number(f, &v) || v != strlen(Subject)) return 0;
+
+	char *subject = (char *)Malloc((size_t)v + 1);
+	int ok = get_block(f, subject, (size_t)v);
+	subject[v] = '\0';
+	ok = ok && strcmp(subject, Subject) == 0;
+	Free(subject);
+	if (!ok) return 0;
+
+	if (!get_number(f, &v) || v != key->ck_hash) return 0;
+	if (!get_number(f, &v) || v != key->ck_size) return 0;
+	return 1;
+}
+
+static int
+get_contents(FILE *f, struct cached_text *ct) {
+	uint64_t EOL_terminated, nl_cnt, non_ASCII_cnt, n_tokens;
+	uint64_t tk_cnt, n_bytes;
+
+	if (	!get_number(f, &EOL_terminated)
+	||	!get_number(f, &nl_cnt)
+	||	!get_number(f, &non_ASCII_cnt)
+	||	!get_number(f, &n_tokens)
+	) return 0;
+	ct->ct_EOL_terminated = (int)EOL_terminated;
+	ct->ct_nl_cnt = (size_t)nl_cnt;
+	ct->ct_non_ASCII_cnt = (size_t)non_ASCII_cnt;
+	ct->ct_n_tokens = (size_t)n_tokens;
+
+	ct->ct_tokens = (Token *)Malloc((ct->ct_n_tokens + 1) * sizeof (Token));
+	if (!get_block(f, ct->ct_tokens, ct->ct_n_tokens * sizeof (Token)))
+		return 0;
+
+	if (!get_number(f, &tk_cnt) || !get_number(f, &n_bytes)) return 0;
+	struct line_list *ll = ct->ct_lines;
+	ll->ll_tk_cnt = (size_t)tk_cnt;
+	ll->ll_size = (size_t)n_bytes + 1;
+	ll->ll_bytes = (unsigned char *)Malloc(ll->ll_size);
+	ll->ll_free = (size_t)n_bytes;
+	return get_block(f, ll->ll_bytes, ll->ll_free);
+}
+
+int
+Read_Cached_Text(const struct cache_key *key, struct cached_text *ct) {
+	char *name = entry_name(key, "");
+	FILE *f = fopen(name, "rb");
+	Free(name);
+	if (!f) return 0;
+
+	ct->ct_tokens = 0;
+	ct->ct_lines = (struct line_list *)
+		Calloc(1, sizeof (struct line_list));
+	int ok = check_header(f, key) && get_contents(f, ct);
+	fclose(f);
+
+	if (!ok) {
+		/* a damaged or foreign entry; treat it as absent */
+		if (ct->ct_tokens) {
+			Free(ct->ct_tokens); ct->ct_tokens = 0;
+		}
+		Free_Line_List(ct->ct_lines); ct->ct_lines = 0;
+	}
+	return ok;
+}
@@ -0,0 +1,44 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	A cache of token streams on disk (-C option).
+
+	The token stream of a file, with its line ends and counts, is kept
+	in a file in the directory Token_Cache_Name, named after a hash of
+	the contents of the file, the language and the options that affect
+	the tokens. A later run that meets a file with the same contents
+	takes the tokens from the cache rather than scanning the file.
+
+	Cache_Key_Of(fname, &key) computes the key of the file fname and
+	returns 0 if the file cannot be read; Read_Cached_Text(&key, ct)
+	fills ct from the cache, with the tokens in allocated memory, and
+	returns 0 if the cache has no proper entry for the key;
+	Write_Cached_Text(&key, ct) makes the entry. The routines can be
+	called from several threads at once.
+*/
+
+extern const char *Token_Cache_Name;
+extern size_t Token_Cache_Hits;
+extern size_t Token_Cache_Misses;
+
+struct cached_text {
+	Token *ct_tokens;
+	size_t ct_n_tokens;
+	struct line_list *ct_lines;
+	int ct_EOL_terminated;
+	size_t ct_nl_cnt;
+	size_t ct_non_ASCII_cnt;
+};
+
+struct cache_key {
+	uint64_t ck_hash;	/* of the contents, language and options */
+	uint64_t ck_size;	/* of the file */
+};
+
+extern int Cache_Key_Of(const char *fname, struct cache_key *key);
+extern int Read_Cached_Text(
+	const struct cache_key *key, struct cached_text *ct
+);
+extern void Write_Cached_Text(
+	const struct cache_key *key, const struct cached_text *ct
+);
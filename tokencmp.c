@@ -0,0 +1,228 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+#include	<stdio.h>
+#include	<stdint.h>
+
+#include	"token.h"
+#include	"tokencmp.h"
+
+/* The vector versions rely on a Token being a uint16_t, or a uint32_t
+   under WIDE_TOKENS
+*/
+#undef	VECTOR_X86
+#undef	VECTOR_NEON
+#if	!defined(lint) && !defined(lint_test) && defined(__GNUC__)
+#if	defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define	VECTOR_X86
+#include	<immintrin.h>
+#elif	defined(__ARM_NEON) && defined(__ORDER_LITTLE_ENDIAN__)
+#define	VECTOR_NEON
+#include	<arm_neon.h>
+#endif
+#endif
+
+#ifdef	WIDE_TOKENS
+#define	TOKEN_BYTES	4
+#define	SSE2_CMPEQ	_mm_cmpeq_epi32
+#define	AVX2_CMPEQ	_mm256_cmpeq_epi32
+#else
+#define	TOKEN_BYTES	2
+#define	SSE2_CMPEQ	_mm_cmpeq_epi16
+#define	AVX2_CMPEQ	_mm256_cmpeq_epi16
+#endif
+
+							/* SCALAR */
+static size_t
+scalar_prefix_size(const Token *p, const Token *q, size_t n, size_t max) {
+	while (n < max && Token_EQ(p[n], q[n])) {
+		n++;
+	}
+	return n;
+}
+
+static size_t
+scalar_suffix_size(const Token *p, const Token *q, size_t n, size_t max) {
+	/* n tokens at the end have already been found equal */
+	while (n < max && Token_EQ(p[max-1-n], q[max-1-n])) {
+		n++;
+	}
+	return n;
+}
+
+#ifdef	VECTOR_X86
+							/* SSE2 */
+/* In the masks, each token is represented by TOKEN_BYTES bits */
+#define	SSE2_TOKENS	(16 / TOKEN_BYTES)
+#define	SSE2_ALL_EQUAL	0xFFFFu
+
+static unsigned int
+sse2_eq_mask(const Token *p, const Token *q) {
+	__m128i a = _mm_loadu_si128((const __m128i *)p);
+	__m128i b = _mm_loadu_si128((const __m128i *)q);
+	return (unsigned int)_mm_movemask_epi8(SSE2_CMPEQ(a, b));
+}
+
+static size_t
+sse2_prefix_size(const Token *p, const Token *q, size_t max) {
+	size_t n = 0;
+
+	while (n + SSE2_TOKENS <= max) {
+		unsigned int m = sse2_eq_mask(&p[n], &q[n]);
+		if (m != SSE2_ALL_EQUAL) {
+			return n + __builtin_ctz(~m) / TOKEN_BYTES;
+		}
+		n += SSE2_TOKENS;
+	}
+	return scalar_prefix_size(p, q, n, max);
+}
+
+static size_t
+sse2_suffix_size(const Token *p, const Token *q, size_t max) {
+	size_t n = 0;
+
+	while (n + SSE2_TOKENS <= max) {
+		size_t b = max - n - SSE2_TOKENS;
+		unsigned int m = sse2_eq_mask(&p[b], &q[b]);
+		if (m != SSE2_ALL_EQUAL) {
+			unsigned int x = ~m & SSE2_ALL_EQUAL;
+			int last_bad = (31 - __builtin_clz(x)) / TOKEN_BYTES;
+			return n + (SSE2_TOKENS - 1 - last_bad);
+		}
+		n += SSE2_TOKENS;
+	}
+	return scalar_suffix_size(p, q, n, max);
+}
+
+							/* AVX2 */
+#define	AVX2_TOKENS	(32 / TOKEN_BYTES)
+#define	AVX2_ALL_EQUAL	0xFFFFFFFFu
+
+__attribute__((target("avx2")))
+static unsigned int
+avx2_eq_mask(const Token *p, const Token *q) {
+	__m256i a = _mm256_loadu_si256((const __m256i *)p);
+	__m256i b = _mm256_loadu_si256((const __m256i *)q);
+	return (unsigned int)_mm256_movemask_epi8(AVX2_CMPEQ(a, b));
+}
+
+__attribute__((target("avx2")))
+static size_t
+avx2_prefix_size(const Token *p, const Token *q, size_t max) {
+	size_t n = 0;
+
+	while (n + AVX2_TOKENS <= max) {
+		unsigned int m = avx2_eq_mask(&p[n], &q[n]);
+		if (m != AVX2_ALL_EQUAL) {
+			return n + __builtin_ctz(~m) / TOKEN_BYTES;
+		}
+		n += AVX2_TOKENS;
+	}
+	return scalar_prefix_size(p, q, n, max);
+}
+
+__attribute__((target("avx2")))
+static size_t
+avx2_suffix_size(const Token *p, const Token *q, size_t max) {
+	size_t n = 0;
+
+	while (n + AVX2_TOKENS <= max) {
+		size_t b = max - n - AVX2_TOKENS;
+		unsigned int m = avx2_eq_mask(&p[b], &q[b]);
+		if (m != AVX2_ALL_EQUAL) {
+			int last_bad = (31 - __builtin_clz(~m)) / TOKEN_BYTES;
+			return n + (AVX2_TOKENS - 1 - last_bad);
+		}
+		n += AVX2_TOKENS;
+	}
+	return scalar_suffix_size(p, q, n, max);
+}
+
+static int
+has_avx2(void) {
+	/* the answer does not change, so a race is harmless */
+	static int answer = -1;
+
+	if (answer < 0) {
+		__builtin_cpu_init();
+		answer = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+	return answer;
+}
+#endif	/* VECTOR_X86 */
+
+#ifdef	VECTOR_NEON
+							/* NEON */
+/* In the masks, each token is represented by NEON_BITS bits */
+#ifdef	WIDE_TOKENS
+#define	NEON_TOKENS	4
+#define	NEON_BITS	16
+
+static uint64_t
+neon_neq_mask(const Token *p, const Token *q) {
+	uint32x4_t eq = vceqq_u32(vld1q_u32(p), vld1q_u32(q));
+	return ~vget_lane_u64(vreinterpret_u64_u16(vmovn_u32(eq)), 0);
+}
+#else
+#define	NEON_TOKENS	8
+#define	NEON_BITS	8
+
+static uint64_t
+neon_neq_mask(const Token *p, const Token *q) {
+	uint16x8_t eq = vceqq_u16(vld1q_u16(p), vld1q_u16(q));
+	return ~vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(eq)), 0);
+}
+#endif
+
+static size_t
+neon_prefix_size(const Token *p, const Token *q, size_t max) {
+	size_t n = 0;
+
+	while (n + NEON_TOKENS <= max) {
+		uint64_t x = neon_neq_mask(&p[n], &q[n]);
+		if (x) {
+			return n + __builtin_ctzll(x) / NEON_BITS;
+		}
+		n += NEON_TOKENS;
+	}
+	return scalar_prefix_size(p, q, n, max);
+}
+
+static size_t
+neon_suffix_size(const Token *p, const Token *q, size_t max) {
+	size_t n = 0;
+
+	while (n + NEON_TOKENS <= max) {
+		size_t b = max - n - NEON_TOKENS;
+		uint64_t x = neon_neq_mask(&p[b], &q[b]);
+		if (x) {
+			return n + __builtin_clzll(x) / NEON_BITS;
+		}
+		n += NEON_TOKENS;
+	}
+	return scalar_suffix_size(p, q, n, max);
+}
+#endif	/* VECTOR_NEON */
+
+							/* THE ENTRIES */
+size_t
+Common_Prefix_Size(const Token *p, const Token *q, size_t max) {
+#if	defined(VECTOR_X86)
+	return (has_avx2() ? avx2_prefix_size : sse2_prefix_size)(p, q, max);
+#elif	defined(VECTOR_NEON)
+	return neon_prefix_size(p, q, max);
+#else
+	return scalar_prefix_size(p, q, 0, max);
+#endif
+}
+
+size_t
+Common_Suffix_Size(const Token *p, const Token *q, size_t max) {
+#if	defined(VECTOR_X86)
+	return (has_avx2() ? avx2_suffix_size : sse2_suffix_size)(p, q, max);
+#elif	defined(VECTOR_NEON)
+	return neon_suffix_size(p, q, max);
+#else
+	return scalar_suffix_size(p, q, 0, max);
+#endif
+}
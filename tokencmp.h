@@ -0,0 +1,21 @@
+/*	This file is part of the software similarity tester SIM.
+*/
+
+/*	Fast comparison of token sequences.
+
+	size_t Common_Prefix_Size(const Token *p, const Token *q, size_t max)
+		returns the largest n <= max such that p[0..n-1] and
+		q[0..n-1] are equal, token by token;
+	size_t Common_Suffix_Size(const Token *p, const Token *q, size_t max)
+		returns the largest n <= max such that p[max-n..max-1] and
+		q[max-n..max-1] are equal, token by token; the comparison
+		proceeds from the end.
+
+	The sequences may overlap. Where available, the comparisons are done
+	with vector instructions (SSE2 or AVX2 on x86, NEON on ARM), selected
+	at run time; otherwise, and when compiled for lint, they are done
+	token by token.
+*/
+
+extern size_t Common_Prefix_Size(const Token *p, const Token *q, size_t max);
+extern size_t Common_Suffix_Size(const Token *p, const Token *q, size_t max);